@@ -210,6 +210,7 @@
 #include "gromacs/analysisdata/arraydata.h"
 #include "gromacs/analysisdata/dataframe.h"
 #include "gromacs/analysisdata/modules/average.h"
+#include "gromacs/analysisdata/modules/binarydata.h"
 #include "gromacs/analysisdata/modules/displacement.h"
 #include "gromacs/analysisdata/modules/histogram.h"
 #include "gromacs/analysisdata/modules/lifetime.h"
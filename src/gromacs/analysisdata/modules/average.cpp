@@ -50,6 +50,7 @@
 
 #include "gromacs/analysisdata/dataframe.h"
 #include "gromacs/analysisdata/datastorage.h"
+#include "gromacs/analysisdata/paralleloptions.h"
 
 #include "frameaverager.h"
 
@@ -63,10 +64,26 @@ namespace gmx
 class AnalysisDataAverageModule::Impl
 {
     public:
+        //! Container type for averaging helper objects for each data set.
+        typedef std::vector<AnalysisDataFrameAverager> AveragerList;
+
         Impl() : bDataSets_(false) {}
 
-        //! Averaging helper objects for each input data set.
-        std::vector<AnalysisDataFrameAverager>  averagers_;
+        //! Returns the averaging helper objects to use for a given frame.
+        AveragerList &frameAveragers(int frameIndex)
+        {
+            return averagers_[frameIndex % averagers_.size()];
+        }
+
+        /*! \brief
+         * Averaging helper objects for each input data set.
+         *
+         * There is one set of averagers for each frame that can be
+         * constructed concurrently (a frame with index \c i accumulates into
+         * `averagers_[i % N]`).  The sets are combined into the first one when
+         * the data is finished.
+         */
+        std::vector<AveragerList>               averagers_;
         //! Whether to average all columns in a data set into a single value.
         bool                                    bDataSets_;
 };
@@ -91,28 +108,45 @@ int AnalysisDataAverageModule::flags() const
            | efAllowMultipleDataSets;
 }
 
-void
-AnalysisDataAverageModule::dataStarted(AbstractAnalysisData *data)
+bool
+AnalysisDataAverageModule::parallelDataStarted(
+        AbstractAnalysisData              *data,
+        const AnalysisDataParallelOptions &options)
 {
+    impl_->averagers_.resize(options.parallelizationFactor());
+    for (size_t f = 0; f < impl_->averagers_.size(); ++f)
+    {
+        Impl::AveragerList &averagers = impl_->averagers_[f];
+        if (impl_->bDataSets_)
+        {
+            averagers.resize(1);
+            averagers[0].setColumnCount(data->dataSetCount());
+        }
+        else
+        {
+            averagers.resize(data->dataSetCount());
+            for (int i = 0; i < data->dataSetCount(); ++i)
+            {
+                averagers[i].setColumnCount(data->columnCount(i));
+            }
+        }
+    }
     if (impl_->bDataSets_)
     {
         setColumnCount(1);
         setRowCount(data->dataSetCount());
-        impl_->averagers_.resize(1);
-        impl_->averagers_[0].setColumnCount(data->dataSetCount());
     }
     else
     {
         setColumnCount(data->dataSetCount());
-        impl_->averagers_.resize(data->dataSetCount());
         int rowCount = 0;
         for (int i = 0; i < data->dataSetCount(); ++i)
         {
-            impl_->averagers_[i].setColumnCount(data->columnCount(i));
             rowCount = std::max(rowCount, data->columnCount(i));
         }
         setRowCount(rowCount);
     }
+    return true;
 }
 
 void
@@ -123,6 +157,7 @@ AnalysisDataAverageModule::frameStarted(const AnalysisDataFrameHeader & /*header
 void
 AnalysisDataAverageModule::pointsAdded(const AnalysisDataPointSetRef &points)
 {
+    Impl::AveragerList &averagers = impl_->frameAveragers(points.frameIndex());
     if (impl_->bDataSets_)
     {
         const int dataSet = points.dataSetIndex();
@@ -130,13 +165,13 @@ AnalysisDataAverageModule::pointsAdded(const AnalysisDataPointSetRef &points)
         {
             if (points.present(i))
             {
-                impl_->averagers_[0].addValue(dataSet, points.y(i));
+                averagers[0].addValue(dataSet, points.y(i));
             }
         }
     }
     else
     {
-        impl_->averagers_[points.dataSetIndex()].addPoints(points);
+        averagers[points.dataSetIndex()].addPoints(points);
     }
 }
 
@@ -145,18 +180,34 @@ AnalysisDataAverageModule::frameFinished(const AnalysisDataFrameHeader & /*heade
 {
 }
 
+void
+AnalysisDataAverageModule::frameFinishedSerial(int /*frameIndex*/)
+{
+}
+
 void
 AnalysisDataAverageModule::dataFinished()
 {
+    // Combine the partial averages from concurrently constructed frames.
+    Impl::AveragerList &averagers = impl_->averagers_[0];
+    for (size_t f = 1; f < impl_->averagers_.size(); ++f)
+    {
+        for (size_t i = 0; i < averagers.size(); ++i)
+        {
+            averagers[i].combine(impl_->averagers_[f][i]);
+        }
+    }
+    impl_->averagers_.resize(1);
+
     allocateValues();
     for (int i = 0; i < columnCount(); ++i)
     {
-        impl_->averagers_[i].finish();
+        averagers[i].finish();
         int j = 0;
-        for (; j < impl_->averagers_[i].columnCount(); ++j)
+        for (; j < averagers[i].columnCount(); ++j)
         {
-            value(j, i).setValue(impl_->averagers_[i].average(j),
-                                 std::sqrt(impl_->averagers_[i].variance(j)));
+            value(j, i).setValue(averagers[i].average(j),
+                                 std::sqrt(averagers[i].variance(j)));
         }
         for (; j < rowCount(); ++j)
         {
@@ -196,7 +247,7 @@ int AnalysisDataAverageModule::sampleCount(int dataSet, int column) const
                    "Column should be zero with setAverageDataSets(true)");
         std::swap(dataSet, column);
     }
-    return impl_->averagers_[dataSet].sampleCount(column);
+    return impl_->averagers_[0][dataSet].sampleCount(column);
 }
 
 
@@ -76,11 +76,15 @@ namespace gmx
  * The output data becomes available only after the input data has been
  * finished.
  *
+ * The module supports parallel input data: frames that are constructed
+ * concurrently are accumulated into separate partial averages, which are
+ * combined when the input data is finished.
+ *
  * \inpublicapi
  * \ingroup module_analysisdata
  */
 class AnalysisDataAverageModule : public AbstractAnalysisArrayData,
-                                  public AnalysisDataModuleSerial
+                                  public AnalysisDataModuleParallel
 {
     public:
         AnalysisDataAverageModule();
@@ -105,10 +109,13 @@ class AnalysisDataAverageModule : public AbstractAnalysisArrayData,
 
         virtual int flags() const;
 
-        virtual void dataStarted(AbstractAnalysisData *data);
+        virtual bool parallelDataStarted(
+            AbstractAnalysisData              *data,
+            const AnalysisDataParallelOptions &options);
         virtual void frameStarted(const AnalysisDataFrameHeader &header);
         virtual void pointsAdded(const AnalysisDataPointSetRef &points);
         virtual void frameFinished(const AnalysisDataFrameHeader &header);
+        virtual void frameFinishedSerial(int frameIndex);
         virtual void dataFinished();
 
         /*! \brief
@@ -0,0 +1,763 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Implements classes in binarydata.h.
+ *
+ * \ingroup module_analysisdata
+ */
+#include "gmxpre.h"
+
+#include "binarydata.h"
+
+#include "config.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <boost/shared_ptr.hpp>
+
+#include "gromacs/analysisdata/abstractdata.h"
+#include "gromacs/analysisdata/dataframe.h"
+#include "gromacs/utility/basedefinitions.h"
+#include "gromacs/utility/exceptions.h"
+#include "gromacs/utility/futil.h"
+#include "gromacs/utility/gmxassert.h"
+#include "gromacs/utility/stringutil.h"
+
+namespace gmx
+{
+
+namespace
+{
+
+//! Magic string at the start of a binary analysis data file.
+const char         c_binaryDataMagic[8]   = "GMXADAT";
+//! Marker used to detect byte order mismatches.
+const gmx_int32_t  c_byteOrderMarker      = 0x01020304;
+//! Version of the binary analysis data file format.
+const gmx_int32_t  c_binaryDataVersion    = 1;
+/*! \brief
+ * Alignment (in bytes) of the start of each chunk in the file.
+ *
+ * Together with the two 32-bit integers at the start of each chunk, this
+ * keeps the x values and the columns aligned in a memory-mapped file.
+ */
+const size_t       c_dataAlignment        = 8;
+//! Default memory budget for buffering a chunk in the writer (in bytes).
+const size_t       c_defaultChunkSize     = 64*1024*1024;
+
+//! Smart pointer type for closing a file handle.
+typedef boost::shared_ptr<FILE> FileGuard;
+
+/*! \brief
+ * Opens a file and throws on errors.
+ *
+ * \param[in] filename  Name of the file to open.
+ * \param[in] mode      Mode to pass to fopen().
+ * \returns   Smart pointer that closes the file when it goes out of scope.
+ */
+FileGuard openFile(const std::string &filename, const char *mode)
+{
+    FILE *fp = std::fopen(filename.c_str(), mode);
+    if (fp == NULL)
+    {
+        GMX_THROW_WITH_ERRNO(
+                FileIOError(formatString("Could not open file '%s'", filename.c_str())),
+                "fopen", errno);
+    }
+    return FileGuard(fp, &std::fclose);
+}
+
+//! Writes \p count items from \p data into \p fp, throwing on errors.
+template <typename T>
+void writeItems(FILE *fp, const T *data, size_t count)
+{
+    if (count > 0 && std::fwrite(data, sizeof(T), count, fp) != count)
+    {
+        GMX_THROW_WITH_ERRNO(FileIOError("Error writing binary analysis data"),
+                             "fwrite", errno);
+    }
+}
+
+//! Writes a single item into \p fp, throwing on errors.
+template <typename T>
+void writeItem(FILE *fp, const T &value)
+{
+    writeItems(fp, &value, 1);
+}
+
+//! Writes a length-prefixed string into \p fp, throwing on errors.
+void writeString(FILE *fp, const std::string &value)
+{
+    writeItem(fp, static_cast<gmx_int32_t>(value.length()));
+    writeItems(fp, value.data(), value.length());
+}
+
+//! Writes zeros into \p fp up to the next multiple of #c_dataAlignment.
+void writePadding(FILE *fp)
+{
+    const gmx_off_t position = gmx_ftell(fp);
+    if (position < 0)
+    {
+        GMX_THROW_WITH_ERRNO(FileIOError("Error writing binary analysis data"),
+                             "ftell", errno);
+    }
+    const char zeros[c_dataAlignment] = { 0 };
+    writeItems(fp, zeros, (c_dataAlignment - position % c_dataAlignment)
+               % c_dataAlignment);
+}
+
+}   // namespace
+
+/********************************************************************
+ * AnalysisDataBinaryWriterModule::Impl
+ */
+
+/*! \internal \brief
+ * Private implementation class for AnalysisDataBinaryWriterModule.
+ *
+ * \ingroup module_analysisdata
+ */
+class AnalysisDataBinaryWriterModule::Impl
+{
+    public:
+        Impl()
+            : chunkSize_(c_defaultChunkSize), chunkFrameCount_(0),
+              totalColumnCount_(0), currentFrame_(0)
+        {
+        }
+
+        //! Returns the index of a value in \a values_.
+        size_t valueIndex(size_t column, size_t frame) const
+        {
+            return column * chunkFrameCount_ + frame;
+        }
+        //! Writes the file header.
+        void writeHeader();
+        //! Writes the buffered frames as a chunk and clears the buffer.
+        void writeChunk();
+
+        //! Name of the output file.
+        std::string               filename_;
+        //! Output file, or NULL if no output is being written.
+        FileGuard                 fp_;
+        //! Title to write into the header.
+        std::string               title_;
+        //! X axis label to write into the header.
+        std::string               xlabel_;
+        //! Legend strings to write into the header.
+        std::vector<std::string>  legend_;
+        //! Memory budget for the buffered chunk (in bytes).
+        size_t                    chunkSize_;
+        //! Maximum number of frames in a chunk, computed from \a chunkSize_.
+        size_t                    chunkFrameCount_;
+        //! Number of columns in each data set.
+        std::vector<int>          columnCounts_;
+        //! Index of the first column of each data set in \a values_.
+        std::vector<size_t>       columnOffsets_;
+        //! Total number of columns in all data sets.
+        size_t                    totalColumnCount_;
+        //! Index of the current frame within the chunk.
+        size_t                    currentFrame_;
+        //! X values for the frames in the current chunk.
+        std::vector<double>       x_;
+        /*! \brief
+         * Values for the frames in the current chunk.
+         *
+         * The values for column \c i are stored starting at
+         * `i * chunkFrameCount_`.
+         */
+        std::vector<float>        values_;
+};
+
+void AnalysisDataBinaryWriterModule::Impl::writeHeader()
+{
+    FILE *fp = fp_.get();
+    writeItems(fp, c_binaryDataMagic, sizeof(c_binaryDataMagic));
+    writeItem(fp, c_byteOrderMarker);
+    writeItem(fp, c_binaryDataVersion);
+    writeString(fp, title_);
+    writeString(fp, xlabel_);
+    writeItem(fp, static_cast<gmx_int32_t>(legend_.size()));
+    for (size_t i = 0; i < legend_.size(); ++i)
+    {
+        writeString(fp, legend_[i]);
+    }
+    writeItem(fp, static_cast<gmx_int32_t>(columnCounts_.size()));
+    for (size_t i = 0; i < columnCounts_.size(); ++i)
+    {
+        writeItem(fp, static_cast<gmx_int32_t>(columnCounts_[i]));
+    }
+    writePadding(fp);
+}
+
+void AnalysisDataBinaryWriterModule::Impl::writeChunk()
+{
+    const size_t frameCount = x_.size();
+    if (frameCount == 0)
+    {
+        return;
+    }
+    FILE *fp = fp_.get();
+    writeItem(fp, static_cast<gmx_int32_t>(frameCount));
+    // Reserved; keeps the x values aligned.
+    writeItem(fp, static_cast<gmx_int32_t>(0));
+    writeItems(fp, &x_[0], frameCount);
+    for (size_t i = 0; i < totalColumnCount_; ++i)
+    {
+        writeItems(fp, &values_[valueIndex(i, 0)], frameCount);
+    }
+    writePadding(fp);
+    x_.clear();
+}
+
+/********************************************************************
+ * AnalysisDataBinaryWriterModule
+ */
+
+AnalysisDataBinaryWriterModule::AnalysisDataBinaryWriterModule()
+    : impl_(new Impl())
+{
+}
+
+AnalysisDataBinaryWriterModule::~AnalysisDataBinaryWriterModule()
+{
+}
+
+void AnalysisDataBinaryWriterModule::setFileName(const std::string &filename)
+{
+    impl_->filename_ = filename;
+}
+
+void AnalysisDataBinaryWriterModule::setChunkSize(size_t bytes)
+{
+    GMX_RELEASE_ASSERT(bytes > 0, "Invalid chunk size");
+    impl_->chunkSize_ = bytes;
+}
+
+void AnalysisDataBinaryWriterModule::setTitle(const std::string &title)
+{
+    impl_->title_ = title;
+}
+
+void AnalysisDataBinaryWriterModule::setXLabel(const std::string &label)
+{
+    impl_->xlabel_ = label;
+}
+
+void AnalysisDataBinaryWriterModule::appendLegend(const std::string &setname)
+{
+    impl_->legend_.push_back(setname);
+}
+
+int AnalysisDataBinaryWriterModule::flags() const
+{
+    return efAllowMulticolumn | efAllowMissing | efAllowMultipleDataSets;
+}
+
+void AnalysisDataBinaryWriterModule::dataStarted(AbstractAnalysisData *data)
+{
+    if (impl_->filename_.empty())
+    {
+        return;
+    }
+    impl_->columnCounts_.resize(data->dataSetCount());
+    impl_->columnOffsets_.resize(data->dataSetCount());
+    impl_->totalColumnCount_ = 0;
+    for (int i = 0; i < data->dataSetCount(); ++i)
+    {
+        impl_->columnCounts_[i]   = data->columnCount(i);
+        impl_->columnOffsets_[i]  = impl_->totalColumnCount_;
+        impl_->totalColumnCount_ += data->columnCount(i);
+    }
+    // At least one frame is always buffered, even if it does not fit into
+    // the budget, and the frame count in a chunk must fit into 32 bits.
+    const size_t frameSize = sizeof(double)
+        + impl_->totalColumnCount_ * sizeof(float);
+    impl_->chunkFrameCount_
+        = std::min(std::max(impl_->chunkSize_ / frameSize, static_cast<size_t>(1)),
+                   static_cast<size_t>(std::numeric_limits<gmx_int32_t>::max()));
+    impl_->x_.reserve(impl_->chunkFrameCount_);
+    impl_->values_.resize(impl_->totalColumnCount_ * impl_->chunkFrameCount_);
+    impl_->fp_ = openFile(impl_->filename_, "wb");
+    impl_->writeHeader();
+}
+
+void AnalysisDataBinaryWriterModule::frameStarted(const AnalysisDataFrameHeader &header)
+{
+    if (!impl_->fp_)
+    {
+        return;
+    }
+    impl_->currentFrame_ = impl_->x_.size();
+    impl_->x_.push_back(header.x());
+    // Columns that are not set during the frame are stored as missing.
+    const float missing = std::numeric_limits<float>::quiet_NaN();
+    for (size_t i = 0; i < impl_->totalColumnCount_; ++i)
+    {
+        impl_->values_[impl_->valueIndex(i, impl_->currentFrame_)] = missing;
+    }
+}
+
+void AnalysisDataBinaryWriterModule::pointsAdded(const AnalysisDataPointSetRef &points)
+{
+    if (!impl_->fp_)
+    {
+        return;
+    }
+    const size_t firstColumn = impl_->columnOffsets_[points.dataSetIndex()]
+        + points.firstColumn();
+    const float  missing     = std::numeric_limits<float>::quiet_NaN();
+    for (int i = 0; i < points.columnCount(); ++i)
+    {
+        const size_t index = impl_->valueIndex(firstColumn + i,
+                                               impl_->currentFrame_);
+        impl_->values_[index] = points.present(i) ? points.y(i) : missing;
+    }
+}
+
+void AnalysisDataBinaryWriterModule::frameFinished(const AnalysisDataFrameHeader & /*header*/)
+{
+    if (!impl_->fp_)
+    {
+        return;
+    }
+    if (impl_->x_.size() == impl_->chunkFrameCount_)
+    {
+        impl_->writeChunk();
+    }
+}
+
+void AnalysisDataBinaryWriterModule::dataFinished()
+{
+    if (!impl_->fp_)
+    {
+        return;
+    }
+    impl_->writeChunk();
+    impl_->fp_.reset();
+    std::vector<float>().swap(impl_->values_);
+}
+
+/********************************************************************
+ * AnalysisDataBinaryReader::Impl
+ */
+
+/*! \internal \brief
+ * Private implementation class for AnalysisDataBinaryReader.
+ *
+ * The file is memory-mapped where supported, and otherwise read into a
+ * single buffer.  Only the header and the x values are parsed when the file
+ * is opened; the column values are accessed directly in the mapping.
+ *
+ * \ingroup module_analysisdata
+ */
+class AnalysisDataBinaryReader::Impl
+{
+    public:
+        //! Location of a chunk in the file.
+        struct ChunkInfo
+        {
+            //! Index of the first frame in the chunk.
+            int                 firstFrame;
+            //! Number of frames in the chunk.
+            int                 frameCount;
+            //! Offset of the column values of the chunk in the file.
+            size_t              valueOffset;
+        };
+
+        Impl() : data_(NULL), size_(0), mappedSize_(0), position_(0) {}
+        ~Impl();
+
+        //! Maps (or reads) the file into memory, throwing on errors.
+        void mapFile(const std::string &filename);
+        //! Reads the file header, throwing on errors.
+        void readHeader();
+        /*! \brief
+         * Reads the x values and locates the columns for the next chunk.
+         *
+         * \returns false if the end of file was reached.
+         */
+        bool readChunk();
+
+        //! Copies \p count items from the current position, throwing at end of file.
+        template <typename T>
+        void readItems(T *data, size_t count)
+        {
+            if (count > (size_ - position_) / sizeof(T))
+            {
+                GMX_THROW(InvalidInputError("Binary analysis data file is truncated"));
+            }
+            if (count > 0)
+            {
+                std::memcpy(data, data_ + position_, count * sizeof(T));
+                position_ += count * sizeof(T);
+            }
+        }
+        //! Reads a single item, throwing at end of file.
+        template <typename T>
+        T readItem()
+        {
+            T value;
+            readItems(&value, 1);
+            return value;
+        }
+        //! Reads a non-negative count, throwing on errors.
+        int readCount();
+        //! Reads a length-prefixed string, throwing on errors.
+        std::string readString();
+        //! Skips the padding up to the next multiple of #c_dataAlignment.
+        void skipPadding();
+
+        //! Returns the values of a column in a chunk.
+        ConstArrayRef<float> columnChunk(const ChunkInfo &chunk, int column) const
+        {
+            const float *values = reinterpret_cast<const float *>(
+                        data_ + chunk.valueOffset
+                        + static_cast<size_t>(column) * chunk.frameCount * sizeof(float));
+            return constArrayRefFromArray(values, chunk.frameCount);
+        }
+
+        //! Contents of the file.
+        const char                        *data_;
+        //! Size of the file.
+        size_t                             size_;
+        //! Size of the mapping, or zero if the file was read into \a buffer_.
+        size_t                             mappedSize_;
+        //! Contents of the file if it could not be mapped.
+        std::vector<char>                  buffer_;
+        //! Current read position in \a data_.
+        size_t                             position_;
+        //! Title read from the file.
+        std::string                        title_;
+        //! X axis label read from the file.
+        std::string                        xlabel_;
+        //! Legend strings read from the file.
+        std::vector<std::string>           legend_;
+        //! Index of the first column of each data set within a chunk.
+        std::vector<int>                   columnOffsets_;
+        //! X values for all frames.
+        std::vector<double>                x_;
+        //! Location of each chunk in the file.
+        std::vector<ChunkInfo>             chunks_;
+};
+
+AnalysisDataBinaryReader::Impl::~Impl()
+{
+#ifdef HAVE_SYS_MMAN_H
+    if (mappedSize_ > 0)
+    {
+        munmap(const_cast<char *>(data_), mappedSize_);
+    }
+#endif
+}
+
+void AnalysisDataBinaryReader::Impl::mapFile(const std::string &filename)
+{
+#ifdef HAVE_SYS_MMAN_H
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        GMX_THROW_WITH_ERRNO(
+                FileIOError(formatString("Could not open file '%s'", filename.c_str())),
+                "open", errno);
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0)
+    {
+        const int errorNumber = errno;
+        close(fd);
+        GMX_THROW_WITH_ERRNO(FileIOError("Error reading binary analysis data"),
+                             "fstat", errorNumber);
+    }
+    if (statbuf.st_size > 0)
+    {
+        if (static_cast<gmx_uint64_t>(statbuf.st_size)
+            > std::numeric_limits<size_t>::max())
+        {
+            close(fd);
+            GMX_THROW(FileIOError("Binary analysis data file is too large to map"));
+        }
+        void     *p           = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        const int errorNumber = errno;
+        close(fd);
+        if (p == MAP_FAILED)
+        {
+            GMX_THROW_WITH_ERRNO(FileIOError("Error reading binary analysis data"),
+                                 "mmap", errorNumber);
+        }
+        data_       = static_cast<const char *>(p);
+        size_       = statbuf.st_size;
+        mappedSize_ = size_;
+    }
+    else
+    {
+        close(fd);
+    }
+#else
+    FileGuard fp(openFile(filename, "rb"));
+    char      block[65536];
+    size_t    count;
+    while ((count = std::fread(block, 1, sizeof(block), fp.get())) > 0)
+    {
+        buffer_.insert(buffer_.end(), block, block + count);
+    }
+    if (std::ferror(fp.get()))
+    {
+        GMX_THROW_WITH_ERRNO(FileIOError("Error reading binary analysis data"),
+                             "fread", errno);
+    }
+    data_ = buffer_.empty() ? NULL : &buffer_[0];
+    size_ = buffer_.size();
+#endif
+}
+
+int AnalysisDataBinaryReader::Impl::readCount()
+{
+    const gmx_int32_t value = readItem<gmx_int32_t>();
+    if (value < 0)
+    {
+        GMX_THROW(InvalidInputError("Binary analysis data file is corrupted"));
+    }
+    return value;
+}
+
+std::string AnalysisDataBinaryReader::Impl::readString()
+{
+    std::vector<char> buffer(readCount());
+    if (!buffer.empty())
+    {
+        readItems(&buffer[0], buffer.size());
+    }
+    return std::string(buffer.begin(), buffer.end());
+}
+
+void AnalysisDataBinaryReader::Impl::skipPadding()
+{
+    position_ = std::min(size_, (position_ + c_dataAlignment - 1)
+                         / c_dataAlignment * c_dataAlignment);
+}
+
+void AnalysisDataBinaryReader::Impl::readHeader()
+{
+    if (size_ < sizeof(c_binaryDataMagic)
+        || std::memcmp(data_, c_binaryDataMagic, sizeof(c_binaryDataMagic)) != 0)
+    {
+        GMX_THROW(InvalidInputError("File is not a binary analysis data file"));
+    }
+    position_ = sizeof(c_binaryDataMagic);
+    if (readItem<gmx_int32_t>() != c_byteOrderMarker)
+    {
+        GMX_THROW(InvalidInputError("Binary analysis data file has been written "
+                                    "on a machine with a different byte order"));
+    }
+    const gmx_int32_t version = readItem<gmx_int32_t>();
+    if (version != c_binaryDataVersion)
+    {
+        GMX_THROW(InvalidInputError(
+                          formatString("Unsupported binary analysis data file "
+                                       "version %d", static_cast<int>(version))));
+    }
+    title_  = readString();
+    xlabel_ = readString();
+    const int legendCount = readCount();
+    for (int i = 0; i < legendCount; ++i)
+    {
+        legend_.push_back(readString());
+    }
+    const int dataSetCount = readCount();
+    int       columnCount  = 0;
+    for (int i = 0; i < dataSetCount; ++i)
+    {
+        columnOffsets_.push_back(columnCount);
+        const int count = readCount();
+        if (count > std::numeric_limits<int>::max() - columnCount)
+        {
+            GMX_THROW(InvalidInputError("Binary analysis data file is corrupted"));
+        }
+        columnCount += count;
+    }
+    columnOffsets_.push_back(columnCount);
+    skipPadding();
+}
+
+bool AnalysisDataBinaryReader::Impl::readChunk()
+{
+    if (position_ == size_)
+    {
+        return false;
+    }
+    const gmx_int32_t frameCount = readItem<gmx_int32_t>();
+    readItem<gmx_int32_t>();
+    if (frameCount <= 0
+        || frameCount > std::numeric_limits<int>::max() - static_cast<int>(x_.size()))
+    {
+        GMX_THROW(InvalidInputError("Binary analysis data file is corrupted"));
+    }
+    const size_t frameSize = sizeof(double)
+        + static_cast<size_t>(columnOffsets_.back()) * sizeof(float);
+    if (static_cast<size_t>(frameCount) > (size_ - position_) / frameSize)
+    {
+        GMX_THROW(InvalidInputError("Binary analysis data file is truncated"));
+    }
+    ChunkInfo chunk;
+    chunk.firstFrame  = x_.size();
+    chunk.frameCount  = frameCount;
+    x_.resize(chunk.firstFrame + frameCount);
+    readItems(&x_[chunk.firstFrame], frameCount);
+    chunk.valueOffset = position_;
+    chunks_.push_back(chunk);
+    position_        += (frameSize - sizeof(double)) * frameCount;
+    skipPadding();
+    return true;
+}
+
+/********************************************************************
+ * AnalysisDataBinaryReader
+ */
+
+AnalysisDataBinaryReader::AnalysisDataBinaryReader(const std::string &filename)
+    : impl_(new Impl())
+{
+    impl_->mapFile(filename);
+    try
+    {
+        impl_->readHeader();
+        while (impl_->readChunk())
+        {
+        }
+    }
+    catch (GromacsException &ex)
+    {
+        ex.prependContext(formatString("Error reading file '%s'", filename.c_str()));
+        throw;
+    }
+}
+
+AnalysisDataBinaryReader::~AnalysisDataBinaryReader()
+{
+}
+
+const std::string &AnalysisDataBinaryReader::title() const
+{
+    return impl_->title_;
+}
+
+const std::string &AnalysisDataBinaryReader::xLabel() const
+{
+    return impl_->xlabel_;
+}
+
+const std::vector<std::string> &AnalysisDataBinaryReader::legend() const
+{
+    return impl_->legend_;
+}
+
+int AnalysisDataBinaryReader::dataSetCount() const
+{
+    return impl_->columnOffsets_.size() - 1;
+}
+
+int AnalysisDataBinaryReader::columnCount(int dataSet) const
+{
+    GMX_ASSERT(dataSet >= 0 && dataSet < dataSetCount(),
+               "Data set index out of range");
+    return impl_->columnOffsets_[dataSet + 1] - impl_->columnOffsets_[dataSet];
+}
+
+int AnalysisDataBinaryReader::frameCount() const
+{
+    return impl_->x_.size();
+}
+
+double AnalysisDataBinaryReader::x(int frame) const
+{
+    GMX_ASSERT(frame >= 0 && frame < frameCount(), "Frame index out of range");
+    return impl_->x_[frame];
+}
+
+int AnalysisDataBinaryReader::chunkCount() const
+{
+    return impl_->chunks_.size();
+}
+
+int AnalysisDataBinaryReader::chunkFirstFrame(int chunk) const
+{
+    GMX_ASSERT(chunk >= 0 && chunk < chunkCount(), "Chunk index out of range");
+    return impl_->chunks_[chunk].firstFrame;
+}
+
+ConstArrayRef<float>
+AnalysisDataBinaryReader::columnChunk(int chunk, int dataSet, int column) const
+{
+    GMX_ASSERT(chunk >= 0 && chunk < chunkCount(), "Chunk index out of range");
+    GMX_ASSERT(column >= 0 && column < columnCount(dataSet),
+               "Column index out of range");
+    return impl_->columnChunk(impl_->chunks_[chunk],
+                              impl_->columnOffsets_[dataSet] + column);
+}
+
+std::vector<float>
+AnalysisDataBinaryReader::column(int dataSet, int column) const
+{
+    GMX_ASSERT(column >= 0 && column < columnCount(dataSet),
+               "Column index out of range");
+    std::vector<float> values;
+    values.reserve(frameCount());
+    for (size_t i = 0; i < impl_->chunks_.size(); ++i)
+    {
+        ConstArrayRef<float> chunkValues
+            = impl_->columnChunk(impl_->chunks_[i],
+                                 impl_->columnOffsets_[dataSet] + column);
+        values.insert(values.end(), chunkValues.begin(), chunkValues.end());
+    }
+    return values;
+}
+
+} // namespace gmx
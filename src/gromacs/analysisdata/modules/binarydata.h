@@ -0,0 +1,207 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \file
+ * \brief
+ * Declares gmx::AnalysisDataBinaryWriterModule and
+ * gmx::AnalysisDataBinaryReader.
+ *
+ * \author Teemu Murtola <teemu.murtola@gmail.com>
+ * \inpublicapi
+ * \ingroup module_analysisdata
+ */
+#ifndef GMX_ANALYSISDATA_MODULES_BINARYDATA_H
+#define GMX_ANALYSISDATA_MODULES_BINARYDATA_H
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "gromacs/analysisdata/datamodule.h"
+#include "gromacs/utility/arrayref.h"
+#include "gromacs/utility/classhelpers.h"
+#include "gromacs/utility/real.h"
+
+namespace gmx
+{
+
+/*! \brief
+ * Data module for writing data into a binary column-oriented file.
+ *
+ * This module provides a compact alternative to AnalysisDataPlotModule for
+ * data with a large number of columns (e.g., per-atom values for each frame),
+ * where formatting the values as text dominates the run time and the file
+ * size.  The output can be read back with AnalysisDataBinaryReader.
+ *
+ * The frames are buffered in memory and written out in chunks that fit into
+ * the memory budget set with setChunkSize(), such that the buffer stays
+ * bounded also with millions of columns.  Within each chunk, the values for
+ * each column are stored contiguously as single-precision floating-point
+ * values, such that a single column can be read (or memory-mapped) without
+ * parsing the other columns.  Values that are not present are stored as NaN.  The x values are
+ * stored in double precision.
+ *
+ * The file starts with a header that contains the title, x axis label, legend
+ * strings, and the number of columns in each data set.  All values are stored
+ * in the native byte order, and a marker in the header is used to detect
+ * files written with a different byte order.
+ *
+ * Multiple data sets are supported.  Multipoint data is not supported.
+ *
+ * \inpublicapi
+ * \ingroup module_analysisdata
+ */
+class AnalysisDataBinaryWriterModule : public AnalysisDataModuleSerial
+{
+    public:
+        AnalysisDataBinaryWriterModule();
+        virtual ~AnalysisDataBinaryWriterModule();
+
+        /*! \brief
+         * Set the output file name.
+         *
+         * If no file name is set (or if \p filename is empty), no output occurs.
+         */
+        void setFileName(const std::string &filename);
+        /*! \brief
+         * Sets the memory used for buffering frames before they are written.
+         *
+         * \param[in] bytes  Memory budget for a chunk (must be > 0).
+         *
+         * Each chunk contains as many frames as fit into \p bytes (but at
+         * least one).  Larger chunks make the column arrays in the file
+         * longer, but require more memory during writing.
+         * The default is 64 MiB.
+         */
+        void setChunkSize(size_t bytes);
+        //! Set title to store in the file.
+        void setTitle(const std::string &title);
+        //! Set x axis label to store in the file.
+        void setXLabel(const std::string &label);
+        /*! \brief
+         * Add a legend string for the next column.
+         *
+         * The legend strings are stored as such in the file, and are not
+         * interpreted in any way.
+         */
+        void appendLegend(const std::string &setname);
+
+        virtual int flags() const;
+
+        virtual void dataStarted(AbstractAnalysisData *data);
+        virtual void frameStarted(const AnalysisDataFrameHeader &header);
+        virtual void pointsAdded(const AnalysisDataPointSetRef &points);
+        virtual void frameFinished(const AnalysisDataFrameHeader &header);
+        virtual void dataFinished();
+
+    private:
+        class Impl;
+
+        PrivateImplPointer<Impl> impl_;
+};
+
+/*! \brief
+ * Reads a file written by AnalysisDataBinaryWriterModule.
+ *
+ * The file is memory-mapped (or read into memory on systems without mmap()),
+ * and only the header and the x values are parsed in the constructor.
+ * The values of a column are contiguous within each chunk of the file, and
+ * columnChunk() returns them without copying.  column() collects the values
+ * of a column over all chunks.
+ *
+ * \inpublicapi
+ * \ingroup module_analysisdata
+ */
+class AnalysisDataBinaryReader
+{
+    public:
+        /*! \brief
+         * Reads a binary data file.
+         *
+         * \param[in] filename  Name of the file to read.
+         * \throws    std::bad_alloc if out of memory.
+         * \throws    FileIOError if the file cannot be opened or read.
+         * \throws    InvalidInputError if the file is not a valid binary
+         *      analysis data file.
+         */
+        explicit AnalysisDataBinaryReader(const std::string &filename);
+        ~AnalysisDataBinaryReader();
+
+        //! Returns the title stored in the file.
+        const std::string &title() const;
+        //! Returns the x axis label stored in the file.
+        const std::string &xLabel() const;
+        //! Returns the legend strings stored in the file.
+        const std::vector<std::string> &legend() const;
+
+        //! Returns the number of data sets in the file.
+        int dataSetCount() const;
+        //! Returns the number of columns in a data set.
+        int columnCount(int dataSet) const;
+        //! Returns the number of frames in the file.
+        int frameCount() const;
+        //! Returns the x value for a frame.
+        double x(int frame) const;
+        //! Returns the number of chunks in the file.
+        int chunkCount() const;
+        //! Returns the index of the first frame in a chunk.
+        int chunkFirstFrame(int chunk) const;
+        /*! \brief
+         * Returns the values of a column for the frames in a chunk.
+         *
+         * The returned array points into the mapped file, and is valid as long
+         * as the reader exists.  Missing values are NaN.
+         */
+        ConstArrayRef<float> columnChunk(int chunk, int dataSet, int column) const;
+        /*! \brief
+         * Returns the values of a column for all frames.
+         *
+         * The values are copied from all chunks.  Missing values are NaN.
+         */
+        std::vector<float> column(int dataSet, int column) const;
+
+    private:
+        class Impl;
+
+        PrivateImplPointer<Impl> impl_;
+};
+
+//! Smart pointer to manage an AnalysisDataBinaryWriterModule object.
+typedef boost::shared_ptr<AnalysisDataBinaryWriterModule>
+    AnalysisDataBinaryWriterModulePointer;
+
+} // namespace gmx
+
+#endif
@@ -81,6 +81,29 @@ void AnalysisDataFrameAverager::addPoints(const AnalysisDataPointSetRef &points)
 
 }
 
+void AnalysisDataFrameAverager::combine(const AnalysisDataFrameAverager &other)
+{
+    GMX_RELEASE_ASSERT(other.values_.size() == values_.size(),
+                       "Cannot combine averagers with different column counts");
+    for (size_t i = 0; i < values_.size(); ++i)
+    {
+        AverageItem       &item      = values_[i];
+        const AverageItem &otherItem = other.values_[i];
+        if (otherItem.samples == 0)
+        {
+            continue;
+        }
+        // Pairwise combination of the partial sums (Chan et al.), which keeps
+        // the numerical stability of the accumulation in addValue().
+        const int    samples = item.samples + otherItem.samples;
+        const double delta   = otherItem.average - item.average;
+        item.average    += delta * otherItem.samples / samples;
+        item.squaredSum += otherItem.squaredSum
+            + delta * delta * item.samples * otherItem.samples / samples;
+        item.samples     = samples;
+    }
+}
+
 void AnalysisDataFrameAverager::finish()
 {
     bFinished_ = true;
@@ -110,6 +110,19 @@ class AnalysisDataFrameAverager
          * does not need to be called for every frame.
          */
         void addPoints(const AnalysisDataPointSetRef &points);
+        /*! \brief
+         * Combines values accumulated in another averager into this one.
+         *
+         * \param[in] other  Averager to combine into this one.
+         *
+         * After the call, this averager contains the same averages and
+         * variances as if all the values added to \p other had been added to
+         * this averager.  This allows accumulating independent frames into
+         * separate averagers (e.g., for frames processed in parallel), and
+         * combining them at the end.
+         * \p other must have the same number of columns as this averager.
+         */
+        void combine(const AnalysisDataFrameAverager &other);
         /*! \brief
          * Finalizes the calculation of the averages and variances.
          *
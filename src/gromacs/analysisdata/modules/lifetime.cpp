@@ -69,8 +69,33 @@ class AnalysisDataLifetimeModule::Impl
         //! Container type for storing a histogram during the calculation.
         typedef std::deque<int> LifetimeHistogram;
 
+        /*! \brief
+         * Continuously present interval for a single data column.
+         *
+         * Only the start and the end of the interval are stored, such that
+         * the accumulation only needs to touch columns that are present in
+         * a frame.
+         */
+        struct Interval
+        {
+            //! Initializes an interval that has never been present.
+            Interval() : firstFrame(-1), lastFrame(-1) {}
+
+            //! Returns the length of the interval (zero if never present).
+            int length() const { return lastFrame - firstFrame; }
+
+            //! Index of the first frame of the current interval.
+            int firstFrame;
+            /*! \brief
+             * One past the index of the last frame where the column was
+             * present.
+             */
+            int lastFrame;
+        };
+
         //! Initializes the implementation class with empty/default values.
-        Impl() : firstx_(0.0), lastx_(0.0), frameCount_(0), bCumulative_(false)
+        Impl() : firstx_(0.0), lastx_(0.0), frameCount_(0), currentFrame_(0),
+                 bCumulative_(false)
         {
         }
 
@@ -99,16 +124,20 @@ class AnalysisDataLifetimeModule::Impl
         real                            lastx_;
         //! Total number of frames (used for normalization and output spacing).
         int                             frameCount_;
+        //! Index of the frame currently being processed.
+        int                             currentFrame_;
         //! Whether to add subintervals of longer intervals explicitly.
         bool                            bCumulative_;
         /*! \brief
-         * Length of current continuously present interval for each data column.
+         * Latest continuously present interval for each data column.
          *
-         * While frame N has been processed, stores the length of an interval
-         * for each data column where that column has been continuously present
-         * up to and including frame N.
+         * While frame N has been processed, stores for each data column the
+         * last interval where that column has been continuously present.
+         * If the interval does not extend to frame N, it has not yet been
+         * added to the histogram; this is done when the column is present the
+         * next time (or at the end of the data).
          */
-        std::vector<std::vector<int> >  currentLifetimes_;
+        std::vector<std::vector<Interval> > currentLifetimes_;
         /*! \brief
          * Accumulated lifetime histograms for each data set.
          */
@@ -131,7 +160,8 @@ void AnalysisDataLifetimeModule::setCumulative(bool bCumulative)
 
 int AnalysisDataLifetimeModule::flags() const
 {
-    return efAllowMulticolumn | efAllowMissing | efAllowMultipleDataSets;
+    return efAllowMultipoint | efAllowMulticolumn | efAllowMissing
+           | efAllowMultipleDataSets;
 }
 
 void
@@ -141,7 +171,8 @@ AnalysisDataLifetimeModule::dataStarted(AbstractAnalysisData *data)
     impl_->lifetimeHistograms_.reserve(data->dataSetCount());
     for (int i = 0; i < data->dataSetCount(); ++i)
     {
-        impl_->currentLifetimes_.push_back(std::vector<int>(data->columnCount(i), 0));
+        impl_->currentLifetimes_.push_back(
+                std::vector<Impl::Interval>(data->columnCount(i)));
         impl_->lifetimeHistograms_.push_back(std::deque<int>());
     }
 }
@@ -153,7 +184,8 @@ AnalysisDataLifetimeModule::frameStarted(const AnalysisDataFrameHeader &header)
     {
         impl_->firstx_ = header.x();
     }
-    impl_->lastx_ = header.x();
+    impl_->lastx_        = header.x();
+    impl_->currentFrame_ = header.index();
     ++impl_->frameCount_;
     // TODO: Check the input for even spacing.
 }
@@ -161,24 +193,28 @@ AnalysisDataLifetimeModule::frameStarted(const AnalysisDataFrameHeader &header)
 void
 AnalysisDataLifetimeModule::pointsAdded(const AnalysisDataPointSetRef &points)
 {
-    const int dataSet = points.dataSetIndex();
-    // This assumption is strictly not necessary, but this is how the
-    // framework works currently, and makes the code below simpler.
-    GMX_ASSERT(points.firstColumn() == 0
-               && points.lastColumn() == static_cast<int>(impl_->currentLifetimes_[dataSet].size()) - 1,
-               "Point set should cover all columns");
+    // Columns that do not appear in any point set for a frame are treated
+    // as absent, so the point sets only need to cover the present columns.
+    // This makes the cost proportional to the number of present values, and
+    // allows sparse multipoint input.
+    const int                    dataSet   = points.dataSetIndex();
+    const int                    frame     = impl_->currentFrame_;
+    std::vector<Impl::Interval> &intervals = impl_->currentLifetimes_[dataSet];
     for (int i = 0; i < points.columnCount(); ++i)
     {
         // TODO: Perhaps add control over how this is determined?
         const bool bPresent = points.present(i) && points.y(i) > 0.0;
         if (bPresent)
         {
-            ++impl_->currentLifetimes_[dataSet][i];
-        }
-        else if (impl_->currentLifetimes_[dataSet][i] > 0)
-        {
-            impl_->addLifetime(dataSet, impl_->currentLifetimes_[dataSet][i]);
-            impl_->currentLifetimes_[dataSet][i] = 0;
+            Impl::Interval &interval = intervals[points.firstColumn() + i];
+            if (interval.lastFrame < frame)
+            {
+                // The column was absent in the previous frame: the previous
+                // interval ended there.
+                impl_->addLifetime(dataSet, interval.length());
+                interval.firstFrame = frame;
+            }
+            interval.lastFrame = frame + 1;
         }
     }
 }
@@ -191,12 +227,12 @@ AnalysisDataLifetimeModule::frameFinished(const AnalysisDataFrameHeader & /*head
 void
 AnalysisDataLifetimeModule::dataFinished()
 {
-    // Need to process the elements present in the last frame explicitly.
+    // Need to process the last interval for each column explicitly.
     for (size_t i = 0; i < impl_->currentLifetimes_.size(); ++i)
     {
         for (size_t j = 0; j < impl_->currentLifetimes_[i].size(); ++j)
         {
-            impl_->addLifetime(i, impl_->currentLifetimes_[i][j]);
+            impl_->addLifetime(i, impl_->currentLifetimes_[i][j].length());
         }
     }
     impl_->currentLifetimes_.clear();
@@ -56,6 +56,10 @@ namespace gmx
  * The input data set is treated as a boolean array: each value that is present
  * (AnalysisDataValue::isPresent() returns true) and is >0 is treated as
  * present, other values are treated as absent.
+ * Columns that are not part of any point set in a frame are also treated as
+ * absent, so multipoint data can be used to provide only the present columns
+ * for each frame.  The memory use is proportional to the number of columns,
+ * and the processing time to the number of present values.
  * For each input data set, analyzes the columns to identify the intervals
  * where a column is continuously present.
  * Produces a histogram from the lengths of these intervals.
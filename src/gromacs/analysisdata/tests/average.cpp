@@ -53,6 +53,7 @@
 #include <gtest/gtest.h>
 
 #include "gromacs/analysisdata/analysisdata.h"
+#include "gromacs/analysisdata/paralleloptions.h"
 
 #include "gromacs/analysisdata/tests/datatest.h"
 #include "testutils/testasserts.h"
@@ -201,6 +202,50 @@ TEST_F(AverageModuleTest, HandlesMultipointData)
     ASSERT_NO_THROW_GMX(presentAllData(input, &data));
 }
 
+TEST_F(AverageModuleTest, HandlesParallelOutOfOrderFrames)
+{
+    const AnalysisDataTestInput &input = MultipointInputData::get();
+    gmx::AnalysisData            serialData;
+    gmx::AnalysisData            parallelData;
+    ASSERT_NO_THROW_GMX(setupDataObject(input, &serialData));
+    ASSERT_NO_THROW_GMX(setupDataObject(input, &parallelData));
+
+    gmx::AnalysisDataAverageModulePointer serialModule(
+            new gmx::AnalysisDataAverageModule);
+    gmx::AnalysisDataAverageModulePointer parallelModule(
+            new gmx::AnalysisDataAverageModule);
+    serialData.addModule(serialModule);
+    parallelData.addModule(parallelModule);
+
+    ASSERT_NO_THROW_GMX(presentAllData(input, &serialData));
+
+    gmx::AnalysisDataHandle          handle1;
+    gmx::AnalysisDataHandle          handle2;
+    gmx::AnalysisDataParallelOptions options(2);
+    ASSERT_NO_THROW_GMX(handle1 = parallelData.startData(options));
+    ASSERT_NO_THROW_GMX(handle2 = parallelData.startData(options));
+    ASSERT_NO_THROW_GMX(presentDataFrame(input, 1, handle1));
+    ASSERT_NO_THROW_GMX(presentDataFrame(input, 0, handle2));
+    ASSERT_NO_THROW_GMX(parallelData.finishFrameSerial(0));
+    ASSERT_NO_THROW_GMX(parallelData.finishFrameSerial(1));
+    ASSERT_NO_THROW_GMX(presentDataFrame(input, 2, handle1));
+    ASSERT_NO_THROW_GMX(parallelData.finishFrameSerial(2));
+    ASSERT_NO_THROW_GMX(handle1.finishData());
+    ASSERT_NO_THROW_GMX(handle2.finishData());
+
+    for (int i = 0; i < input.columnCount(0); ++i)
+    {
+        EXPECT_EQ(serialModule->sampleCount(0, i),
+                  parallelModule->sampleCount(0, i));
+        EXPECT_REAL_EQ_TOL(serialModule->average(0, i),
+                           parallelModule->average(0, i),
+                           gmx::test::defaultRealTolerance());
+        EXPECT_REAL_EQ_TOL(serialModule->standardDeviation(0, i),
+                           parallelModule->standardDeviation(0, i),
+                           gmx::test::defaultRealTolerance());
+    }
+}
+
 TEST_F(AverageModuleTest, HandlesMultipleDataSets)
 {
     const AnalysisDataTestInput &input = MultiDataSetInputData::get();
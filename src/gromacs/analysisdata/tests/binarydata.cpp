@@ -0,0 +1,207 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for functionality of analysis data binary output.
+ *
+ * These tests check that gmx::AnalysisDataBinaryWriterModule writes files
+ * that gmx::AnalysisDataBinaryReader reads back with the same contents.
+ *
+ * \ingroup module_analysisdata
+ */
+#include "gmxpre.h"
+
+#include "gromacs/analysisdata/modules/binarydata.h"
+
+#include <cmath>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "gromacs/analysisdata/analysisdata.h"
+#include "gromacs/utility/exceptions.h"
+#include "gromacs/utility/textwriter.h"
+
+#include "gromacs/analysisdata/tests/datatest.h"
+#include "testutils/testasserts.h"
+#include "testutils/testfilemanager.h"
+
+using gmx::test::AnalysisDataTestInput;
+
+namespace
+{
+
+// Input data with multiple data sets and missing values.
+class MultiDataSetInputData
+{
+    public:
+        static const AnalysisDataTestInput &get()
+        {
+#ifndef STATIC_ANON_NAMESPACE_BUG
+            static MultiDataSetInputData singleton;
+            return singleton.data_;
+#else
+            static MultiDataSetInputData singleton_binarydata;
+            return singleton_binarydata.data_;
+#endif
+        }
+
+        MultiDataSetInputData() : data_(2, false)
+        {
+            using gmx::test::AnalysisDataTestInputFrame;
+            data_.setColumnCount(0, 3);
+            data_.setColumnCount(1, 2);
+            AnalysisDataTestInputFrame &frame1 = data_.addFrame(1.0);
+            frame1.addPointSetWithValues(0, 0, 1.0, 2.0, 3.0);
+            frame1.addPointSetWithValues(1, 0, 4.0, 5.0);
+            AnalysisDataTestInputFrame &frame2 = data_.addFrame(2.0);
+            frame2.addPointSetWithValues(0, 0, 1.5, 2.5, 3.5);
+            frame2.addPointSetWithValues(1, 0, 4.5, 5.5);
+            AnalysisDataTestInputFrame &frame3 = data_.addFrame(3.0);
+            frame3.addPointSetWithValues(0, 0, -1.0, -2.0, -3.0);
+            frame3.addPointSetWithValues(1, 0, -4.0, -5.0);
+        }
+
+    private:
+        AnalysisDataTestInput  data_;
+};
+
+/********************************************************************
+ * Tests for gmx::AnalysisDataBinaryWriterModule.
+ */
+
+//! Test fixture for gmx::AnalysisDataBinaryWriterModule.
+class BinaryDataTest : public gmx::test::AnalysisDataTestFixture
+{
+    public:
+        /*! \brief
+         * Writes \p input into a file with a given chunk size in bytes.
+         *
+         * \returns Name of the written file.
+         */
+        std::string writeData(const AnalysisDataTestInput &input,
+                              size_t                       chunkSize)
+        {
+            const std::string filename
+                = tempFiles_.getTemporaryFilePath("data.bin");
+            gmx::AnalysisData data;
+            setupDataObject(input, &data);
+
+            gmx::AnalysisDataBinaryWriterModulePointer module(
+                    new gmx::AnalysisDataBinaryWriterModule);
+            module->setFileName(filename);
+            module->setChunkSize(chunkSize);
+            module->setTitle("Title");
+            module->setXLabel("Time");
+            module->appendLegend("first");
+            module->appendLegend("second");
+            data.addModule(module);
+            presentAllData(input, &data);
+            return filename;
+        }
+
+        //! Checks that \p reader contains the same values as \p input.
+        void checkData(const AnalysisDataTestInput         &input,
+                       const gmx::AnalysisDataBinaryReader &reader)
+        {
+            ASSERT_EQ(input.dataSetCount(), reader.dataSetCount());
+            ASSERT_EQ(input.frameCount(), reader.frameCount());
+            for (int i = 0; i < input.dataSetCount(); ++i)
+            {
+                ASSERT_EQ(input.columnCount(i), reader.columnCount(i));
+            }
+            for (int f = 0; f < input.frameCount(); ++f)
+            {
+                const gmx::test::AnalysisDataTestInputFrame &frame = input.frame(f);
+                EXPECT_REAL_EQ_TOL(frame.x(), reader.x(f),
+                                   gmx::test::defaultRealTolerance());
+                for (int p = 0; p < frame.pointSetCount(); ++p)
+                {
+                    const gmx::test::AnalysisDataTestInputPointSet &points
+                        = frame.pointSet(p);
+                    for (int j = 0; j < points.size(); ++j)
+                    {
+                        const float value
+                            = reader.column(points.dataSetIndex(),
+                                            points.firstColumn() + j)[f];
+                        EXPECT_FLOAT_EQ(points.y(j), value);
+                    }
+                }
+            }
+        }
+
+        gmx::test::TestFileManager tempFiles_;
+};
+
+TEST_F(BinaryDataTest, WritesAndReadsData)
+{
+    const AnalysisDataTestInput &input    = MultiDataSetInputData::get();
+    const std::string            filename = writeData(input, 1000);
+
+    gmx::AnalysisDataBinaryReader reader(filename);
+    EXPECT_EQ("Title", reader.title());
+    EXPECT_EQ("Time", reader.xLabel());
+    ASSERT_EQ(2U, reader.legend().size());
+    EXPECT_EQ("first", reader.legend()[0]);
+    EXPECT_EQ("second", reader.legend()[1]);
+    checkData(input, reader);
+}
+
+TEST_F(BinaryDataTest, HandlesMultipleChunks)
+{
+    const AnalysisDataTestInput &input    = MultiDataSetInputData::get();
+    // Two frames of five columns and an x value fit into a chunk.
+    const std::string            filename
+        = writeData(input, 2*(sizeof(double) + 5*sizeof(float)));
+
+    gmx::AnalysisDataBinaryReader reader(filename);
+    checkData(input, reader);
+    ASSERT_EQ(2, reader.chunkCount());
+    EXPECT_EQ(2, reader.chunkFirstFrame(1));
+    gmx::ConstArrayRef<float> values = reader.columnChunk(1, 1, 1);
+    ASSERT_EQ(1U, values.size());
+    EXPECT_FLOAT_EQ(-5.0, values[0]);
+}
+
+TEST_F(BinaryDataTest, RejectsInvalidFile)
+{
+    const std::string filename = tempFiles_.getTemporaryFilePath("data.xvg");
+    gmx::TextWriter::writeFileFromString(filename, "1.0 2.0 3.0\n");
+    EXPECT_THROW_GMX(gmx::AnalysisDataBinaryReader reader(filename),
+                     gmx::InvalidInputError);
+}
+
+} // namespace
@@ -88,6 +88,39 @@ class SimpleInputData
         AnalysisDataTestInput  data_;
 };
 
+// Sparse multipoint input data for gmx::AnalysisDataLifetimeModule tests.
+// Corresponds to SimpleInputData, but only present columns are included.
+class MultipointInputData
+{
+    public:
+        static const AnalysisDataTestInput &get()
+        {
+#ifndef STATIC_ANON_NAMESPACE_BUG
+            static MultipointInputData singleton;
+            return singleton.data_;
+#else
+            static MultipointInputData singleton_lifetime;
+            return singleton_lifetime.data_;
+#endif
+        }
+
+        MultipointInputData() : data_(1, true)
+        {
+            using gmx::test::AnalysisDataTestInputFrame;
+            data_.setColumnCount(0, 3);
+            AnalysisDataTestInputFrame &frame1 = data_.addFrame(1.0);
+            frame1.addPointSetWithValues(0, 0, 1.0, 1.0, 1.0);
+            AnalysisDataTestInputFrame &frame2 = data_.addFrame(2.0);
+            frame2.addPointSetWithValues(0, 0, 1.0);
+            frame2.addPointSetWithValues(0, 2, 1.0);
+            AnalysisDataTestInputFrame &frame3 = data_.addFrame(3.0);
+            frame3.addPointSetWithValues(0, 1, 1.0, 1.0);
+        }
+
+    private:
+        AnalysisDataTestInput  data_;
+};
+
 // Input data with multiple data sets for gmx::AnalysisDataLifetimeModule tests.
 class MultiDataSetInputData
 {
@@ -165,6 +198,23 @@ TEST_F(LifetimeModuleTest, CumulativeTest)
     ASSERT_NO_THROW_GMX(presentAllData(input, &data));
 }
 
+TEST_F(LifetimeModuleTest, HandlesMultipointData)
+{
+    const AnalysisDataTestInput &input = MultipointInputData::get();
+    gmx::AnalysisData            data;
+    ASSERT_NO_THROW_GMX(setupDataObject(input, &data));
+
+    gmx::AnalysisDataLifetimeModulePointer module(
+            new gmx::AnalysisDataLifetimeModule);
+    module->setCumulative(false);
+    data.addModule(module);
+
+    ASSERT_NO_THROW_GMX(addStaticCheckerModule(input, &data));
+    ASSERT_NO_THROW_GMX(addReferenceCheckerModule("InputData", &data));
+    ASSERT_NO_THROW_GMX(addReferenceCheckerModule("Lifetime", module.get()));
+    ASSERT_NO_THROW_GMX(presentAllData(input, &data));
+}
+
 TEST_F(LifetimeModuleTest, HandlesMultipleDataSets)
 {
     const AnalysisDataTestInput &input = MultiDataSetInputData::get();
@@ -60,8 +60,8 @@
 #include "gromacs/legacyheaders/names.h"
 #include "gromacs/math/vec.h"
 #include "gromacs/utility/arraysize.h"
+#include "gromacs/utility/exceptions.h"
 #include "gromacs/utility/fatalerror.h"
-#include "gromacs/utility/futil.h"
 #include "gromacs/utility/real.h"
 #include "gromacs/utility/smalloc.h"
 
@@ -81,43 +81,6 @@ static gmx_bool  bACFinit = FALSE;
 /*! \brief Data structure for storing command line variables. */
 static t_acf     acf;
 
-enum {
-    enNorm, enCos, enSin
-};
-
-/*! \brief Routine to compute ACF using FFT. */
-static void low_do_four_core(int nfour, int nframes, real c1[], real cfour[],
-                             int nCos)
-{
-    int  i = 0;
-
-    switch (nCos)
-    {
-        case enNorm:
-            for (i = 0; (i < nframes); i++)
-            {
-                cfour[i] = c1[i];
-            }
-            break;
-        case enCos:
-            for (i = 0; (i < nframes); i++)
-            {
-                cfour[i] = cos(c1[i]);
-            }
-            break;
-        case enSin:
-            for (i = 0; (i < nframes); i++)
-            {
-                cfour[i] = sin(c1[i]);
-            }
-            break;
-        default:
-            gmx_fatal(FARGS, "nCos = %d, %s %d", nCos, __FILE__, __LINE__);
-    }
-
-    many_auto_correl(1, nframes, nfour, &cfour);
-}
-
 /*! \brief Routine to comput ACF without FFT. */
 static void do_ac_core(int nframes, int nout,
                        real corr[], real c1[], int nrestart,
@@ -316,71 +279,55 @@ void norm_and_scale_vectors(int nframes, real c1[], real scale)
     }
 }
 
-/*! \brief Debugging */
-static void dump_tmp(char *s, int n, real c[])
+/*! \brief Returns the number of functions per item to correlate with FFTs. */
+static int four_nseries(unsigned long mode)
 {
-    FILE *fp;
-    int   i;
-
-    fp = gmx_ffopen(s, "w");
-    for (i = 0; (i < n); i++)
+    if (MODE(eacNormal))
+    {
+        return 1;
+    }
+    else if (MODE(eacCos))
+    {
+        /* The cosine and sine terms */
+        return 2;
+    }
+    else if (MODE(eacP2))
+    {
+        /* The squares and the products of pairs of the vector elements */
+        return 2*DIM;
+    }
+    else if (MODE(eacP1) || MODE(eacVector))
     {
-        fprintf(fp, "%10d  %10g\n", i, c[i]);
+        return DIM;
     }
-    gmx_ffclose(fp);
+    gmx_fatal(FARGS, "\nUnknown mode in do_autocorr (%lu)", mode);
+
+    return 0;
 }
 
-/*! \brief High level ACF routine. */
-void do_four_core(unsigned long mode, int nfour, int nf2, int nframes,
-                  real c1[], real csum[], real ctmp[])
+/*! \brief Fills the nf2 points of the functions of item c1 to correlate. */
+static void four_fill_series(unsigned long mode, int nf2, int nframes,
+                             real c1[], real **ser)
 {
-    real   *cfour;
-    char    buf[32];
-    real    fac;
-    int     j, m, m1;
-
-    snew(cfour, nfour);
+    int j, m;
 
     if (MODE(eacNormal))
     {
-        /********************************************
-         *  N O R M A L
-         ********************************************/
-        low_do_four_core(nfour, nf2, c1, csum, enNorm);
-    }
-    else if (MODE(eacCos))
-    {
-        /***************************************************
-         * C O S I N E
-         ***************************************************/
-        /* Copy the data to temp array. Since we need it twice
-         * we can't overwrite original.
-         */
         for (j = 0; (j < nf2); j++)
         {
-            ctmp[j] = c1[j];
+            ser[0][j] = c1[j];
         }
-
-        /* Cosine term of AC function */
-        low_do_four_core(nfour, nf2, ctmp, cfour, enCos);
-        for (j = 0; (j < nf2); j++)
-        {
-            c1[j]  = cfour[j];
-        }
-
-        /* Sine term of AC function */
-        low_do_four_core(nfour, nf2, ctmp, cfour, enSin);
+    }
+    else if (MODE(eacCos))
+    {
         for (j = 0; (j < nf2); j++)
         {
-            c1[j]  += cfour[j];
-            csum[j] = c1[j];
+            ser[0][j] = cos(c1[j]);
+            ser[1][j] = sin(c1[j]);
         }
     }
     else if (MODE(eacP2))
     {
-        /***************************************************
-         * Legendre polynomials
-         ***************************************************/
         /* First normalize the vectors */
         norm_and_scale_vectors(nframes, c1, 1.0);
 
@@ -413,75 +360,17 @@ void do_four_core(unsigned long mode, int nfour, int nf2, int nframes,
          *                         2<uXuY> + 2<uXuZ> + 2<uYuZ>) - 0.5]
          *
          */
-
-        /* Because of normalization the number of -0.5 to subtract
-         * depends on the number of data points!
-         */
-        for (j = 0; (j < nf2); j++)
-        {
-            csum[j]  = -0.5*(nf2-j);
-        }
-
-        /***** DIAGONAL ELEMENTS ************/
-        for (m = 0; (m < DIM); m++)
-        {
-            /* Copy the vector data in a linear array */
-            for (j = 0; (j < nf2); j++)
-            {
-                ctmp[j]  = sqr(c1[DIM*j+m]);
-            }
-            if (debug)
-            {
-                sprintf(buf, "c1diag%d.xvg", m);
-                dump_tmp(buf, nf2, ctmp);
-            }
-
-            low_do_four_core(nfour, nf2, ctmp, cfour, enNorm);
-
-            if (debug)
-            {
-                sprintf(buf, "c1dfout%d.xvg", m);
-                dump_tmp(buf, nf2, cfour);
-            }
-            fac = 1.5;
-            for (j = 0; (j < nf2); j++)
-            {
-                csum[j] += fac*(cfour[j]);
-            }
-        }
-        /******* OFF-DIAGONAL ELEMENTS **********/
         for (m = 0; (m < DIM); m++)
         {
-            /* Copy the vector data in a linear array */
-            m1 = (m+1) % DIM;
             for (j = 0; (j < nf2); j++)
             {
-                ctmp[j] = c1[DIM*j+m]*c1[DIM*j+m1];
-            }
-
-            if (debug)
-            {
-                sprintf(buf, "c1off%d.xvg", m);
-                dump_tmp(buf, nf2, ctmp);
-            }
-            low_do_four_core(nfour, nf2, ctmp, cfour, enNorm);
-            if (debug)
-            {
-                sprintf(buf, "c1ofout%d.xvg", m);
-                dump_tmp(buf, nf2, cfour);
-            }
-            fac = 3.0;
-            for (j = 0; (j < nf2); j++)
-            {
-                csum[j] += fac*cfour[j];
+                ser[m][j]     = sqr(c1[DIM*j+m]);
+                ser[DIM+m][j] = c1[DIM*j+m]*c1[DIM*j+(m+1) % DIM];
             }
         }
     }
     else if (MODE(eacP1) || MODE(eacVector))
     {
-        /***************************************************
-         * V E C T O R & P1
-         ***************************************************/
         if (MODE(eacP1))
         {
             /* First normalize the vectors */
@@ -492,34 +381,105 @@ void do_four_core(unsigned long mode, int nfour, int nf2, int nframes,
          * First for XX, then for YY, then for ZZ
          * After that we sum them and normalise
          */
-        for (j = 0; (j < nf2); j++)
-        {
-            csum[j] = 0.0;
-        }
         for (m = 0; (m < DIM); m++)
         {
-            /* Copy the vector data in a linear array */
             for (j = 0; (j < nf2); j++)
             {
-                ctmp[j] = c1[DIM*j+m];
+                ser[m][j] = c1[DIM*j+m];
             }
-            low_do_four_core(nfour, nf2, ctmp, cfour, enNorm);
-            for (j = 0; (j < nf2); j++)
+        }
+    }
+}
+
+/*! \brief Combines the correlated functions of an item into its ACF in c1. */
+static void four_combine(unsigned long mode, int nf2, int nframes,
+                         real **ser, real c1[])
+{
+    real csum;
+    int  j, m;
+
+    for (j = 0; (j < nf2); j++)
+    {
+        if (MODE(eacNormal))
+        {
+            csum = ser[0][j];
+        }
+        else if (MODE(eacCos))
+        {
+            csum = ser[0][j] + ser[1][j];
+        }
+        else if (MODE(eacP2))
+        {
+            /* Because of normalization the number of -0.5 to subtract
+             * depends on the number of data points!
+             */
+            csum = -0.5*(nf2-j);
+            for (m = 0; (m < DIM); m++)
+            {
+                csum += 1.5*ser[m][j];
+            }
+            for (m = 0; (m < DIM); m++)
+            {
+                csum += 3.0*ser[DIM+m][j];
+            }
+        }
+        else
+        {
+            csum = 0;
+            for (m = 0; (m < DIM); m++)
             {
-                csum[j] += cfour[j];
+                csum += ser[m][j];
             }
         }
+        c1[j] = csum/(real)(nframes-j);
     }
-    else
+}
+
+/*! \brief Computes the ACFs of nitem items using FFTs.
+ *
+ * The items are processed in chunks; all functions to correlate for
+ * the items in a chunk are passed to many_auto_correl at once, which
+ * batches the FFTs and distributes them over the threads.
+ */
+static void do_four_core(unsigned long mode, int nfour, int nframes,
+                         int nitem, real **c1, gmx_bool bVerbose)
+{
+    real  *buf, **ser;
+    int    nser, nchunk;
+
+    nser   = four_nseries(mode);
+    /* Limit the work buffer to 2^24 reals */
+    nchunk = std::max(1, std::min(nitem, (1 << 24)/(nser*nfour)));
+    snew(buf, static_cast<size_t>(nchunk)*nser*nfour);
+    snew(ser, nchunk*nser);
+    for (int s = 0; s < nchunk*nser; s++)
     {
-        gmx_fatal(FARGS, "\nUnknown mode in do_autocorr (%d)", mode);
+        ser[s] = buf + static_cast<size_t>(s)*nfour;
     }
 
-    sfree(cfour);
-    for (j = 0; (j < nf2); j++)
+    for (int i0 = 0; i0 < nitem; i0 += nchunk)
     {
-        c1[j] = csum[j]/(real)(nframes-j);
+        int n = std::min(nchunk, nitem - i0);
+
+        if (bVerbose)
+        {
+            fprintf(stderr, "\rThingie %d", i0 + n);
+        }
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            four_fill_series(mode, nframes, nframes, c1[i0 + i], ser + i*nser);
+        }
+        many_auto_correl(n*nser, nframes, nfour, ser);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            four_combine(mode, nframes, nframes, ser + i*nser, c1[i0 + i]);
+        }
     }
+
+    sfree(ser);
+    sfree(buf);
 }
 
 void low_do_autocorr(const char *fn, const output_env_t oenv, const char *title,
@@ -531,8 +491,7 @@ void low_do_autocorr(const char *fn, const output_env_t oenv, const char *title,
 {
     FILE       *fp, *gp = NULL;
     int         i, k, nfour;
-    real       *csum;
-    real       *ctmp, *fit;
+    real       *fit;
     real        c0, sum, Ct2av, Ctav;
     gmx_bool    bFour = acf.bFour;
 
@@ -590,43 +549,39 @@ void low_do_autocorr(const char *fn, const output_env_t oenv, const char *title,
                     title, nfour);
         }
 
-        /* Allocate temp arrays */
-        snew(csum, nfour);
-        snew(ctmp, nfour);
+        do_four_core(mode, nfour, nframes, nitem, c1, bVerbose);
     }
     else
     {
-        nfour = 0; /* To keep the compiler happy */
-        snew(csum, nframes);
-        snew(ctmp, nframes);
-    }
-
-    /* Loop over items (e.g. molecules or dihedrals)
-     * In this loop the actual correlation functions are computed, but without
-     * normalizing them.
-     */
-    for (int i = 0; i < nitem; i++)
-    {
-        if (bVerbose && (((i % 100) == 0) || (i == nitem-1)))
+        /* Loop over items (e.g. molecules or dihedrals)
+         * In this loop the actual correlation functions are computed, but without
+         * normalizing them.
+         */
+#pragma omp parallel
         {
-            fprintf(stderr, "\rThingie %d", i+1);
-        }
+            try
+            {
+                real *ctmp;
 
-        if (bFour)
-        {
-            do_four_core(mode, nfour, nframes, nframes, c1[i], csum, ctmp);
-        }
-        else
-        {
-            do_ac_core(nframes, nout, ctmp, c1[i], nrestart, mode);
+                snew(ctmp, nframes);
+#pragma omp for schedule(dynamic)
+                for (int i = 0; i < nitem; i++)
+                {
+                    if (bVerbose && (((i % 100) == 0) || (i == nitem-1)))
+                    {
+                        fprintf(stderr, "\rThingie %d", i+1);
+                    }
+                    do_ac_core(nframes, nout, ctmp, c1[i], nrestart, mode);
+                }
+                sfree(ctmp);
+            }
+            GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
         }
     }
     if (bVerbose)
     {
         fprintf(stderr, "\n");
     }
-    sfree(ctmp);
-    sfree(csum);
 
     if (fn)
     {
@@ -45,6 +45,7 @@
 #include "crosscorr.h"
 
 #include "gromacs/fft/fft.h"
+#include "gromacs/math/gmxcomplex.h"
 #include "gromacs/utility/smalloc.h"
 
 /*! \brief
@@ -61,81 +62,64 @@ static int zeroPaddingSize(int n)
 /*! \brief
  * Compute complex conjugate. Output in the first input variable.
  *
- * \param[in] in1 first complex number
- * \param[in] in2 second complex number
+ * \param[in,out] in1 first complex number, replaced by the product
+ * \param[in]     in2 second complex number, which is conjugated
  */
-static void complexConjugatMult(double in1[], double in2[])
+static void complexConjugatMult(t_complex *in1, const t_complex *in2)
 {
-    double res[2];
-    res[0]  = in1[0] * in2[0] + in1[1] * in2[1];
-    res[1]  = in1[0] * -in2[1] + in1[1] * in2[0];
-    in1[0]  = res[0];
-    in1[1]  = res[1];
+    t_complex res;
+    res.re  = in1->re * in2->re + in1->im * in2->im;
+    res.im  = in1->re * -in2->im + in1->im * in2->re;
+    *in1    = res;
 }
 
 /*! \brief
  * Compute one cross correlation corr = f x g using FFT.
  *
+ * f and g are copied into zero-padded t_complex buffers of
+ * zeroPaddingSize(n) elements, which are transformed in place.
+ *
  * \param[in] n number of data point
  * \param[in] f first function
  * \param[in] g second function
  * \param[out] corr output correlation
- * \param[in] fft FFT data structure
+ * \param[in] fft FFT data structure, set up for complex transforms
+ *            of zeroPaddingSize(n) elements
  */
 static void cross_corr_low(int n, real f[], real g[], real corr[], gmx_fft_t fft)
 {
     int             i;
     const int       size = zeroPaddingSize(n);
-    double    **    in1, ** in2;
+    t_complex      *in1, *in2;
+
+    /* snew() already provides the zero padding */
     snew(in1, size);
     snew(in2, size);
 
-    for (i = 0; i < size; i++)
-    {
-        snew(in1[i], 2);
-        snew(in2[i], 2);
-    }
-
     for (i = 0; i < n; i++)
     {
-        in1[i][0]  = (double)f[i];
-        in1[i][1]  = 0;
-        in2[i][0]  = (double)g[i];
-        in2[i][1]  = 0;
-    }
-    for (; i < size; i++)
-    {
-        in1[i][0]  = 0;
-        in1[i][1]  = 0;
-        in2[i][0]  = 0;
-        in2[i][1]  = 0;
+        in1[i].re  = f[i];
+        in2[i].re  = g[i];
     }
 
-
     gmx_fft_1d(fft, GMX_FFT_FORWARD, in1, in1);
     gmx_fft_1d(fft, GMX_FFT_FORWARD, in2, in2);
 
     for (i = 0; i < size; i++)
     {
-        complexConjugatMult(in1[i], in2[i]);
-        in1[i][0] /= size;
+        complexConjugatMult(&in1[i], &in2[i]);
+        in1[i].re /= size;
+        in1[i].im /= size;
     }
     gmx_fft_1d(fft, GMX_FFT_BACKWARD, in1, in1);
 
     for (i = 0; i < n; i++)
     {
-        corr[i] = (real)(in1[i][0]);
-    }
-
-    for (i = 0; i < size; i++)
-    {
-        sfree(in1[i]);
-        sfree(in2[i]);
+        corr[i] = in1[i].re;
     }
 
     sfree(in1);
     sfree(in2);
-
 }
 
 void cross_corr(int n, real f[], real g[], real corr[])
@@ -51,67 +51,107 @@
 #include <algorithm>
 
 #include "gromacs/fft/fft.h"
+#include "gromacs/utility/exceptions.h"
+#include "gromacs/utility/gmxassert.h"
 #include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 
+/*! \brief Number of functions transformed together in one batched FFT */
+static const int c_batchSize = 16;
+
 int many_auto_correl(int nfunc, int ndata, int nfft, real **c)
 {
-    #pragma omp parallel
+    int nbatch, bsize, ret;
+
+    GMX_RELEASE_ASSERT(nfft % 2 == 0, "The FFT length should be even");
+
+    bsize  = std::max(1, std::min(nfunc, c_batchSize));
+    nbatch = (nfunc + bsize - 1)/bsize;
+    ret    = 0;
+#pragma omp parallel
     {
-        typedef real complex[2];
-        int          i, j;
-        gmx_fft_t    fft1;
-        complex     *in, *out;
-        int          i0, i1;
-        int          nthreads, thread_id;
-
-        nthreads  = gmx_omp_get_max_threads();
-        thread_id = gmx_omp_get_thread_num();
-        if ((0 == thread_id))
-        {
-            // fprintf(stderr, "There are %d threads for correlation functions\n", nthreads);
-        }
-        i0 = thread_id*nfunc/nthreads;
-        i1 = std::min(nfunc, (thread_id+1)*nfunc/nthreads);
-
-        gmx_fft_init_1d(&fft1, nfft, GMX_FFT_FLAG_CONSERVATIVE);
-        /* Allocate temporary arrays */
-        snew(in, nfft);
-        snew(out, nfft);
-        for (i = i0; (i < i1); i++)
+        try
         {
-            for (j = 0; j < ndata; j++)
-            {
-                in[j][0] = c[i][j];
-                in[j][1] = 0;
-            }
-            for (; (j < nfft); j++)
-            {
-                in[j][0] = in[j][1] = 0;
-            }
+            gmx_fft_t fft;
+            real     *in, *out;
+            int       dist, nc, status;
 
-            gmx_fft_1d(fft1, GMX_FFT_BACKWARD, (void *)in, (void *)out);
-            for (j = 0; j < nfft; j++)
-            {
-                in[j][0] = (out[j][0]*out[j][0] + out[j][1]*out[j][1])/nfft;
-                in[j][1] = 0;
-            }
-            for (; (j < nfft); j++)
+            /* The real data and its transform of nfft/2+1 complex numbers
+             * use the same storage per function, with dist reals.
+             */
+            nc     = nfft/2 + 1;
+            dist   = 2*nc;
+            status = gmx_fft_init_many_1d_real(&fft, nfft, bsize, GMX_FFT_FLAG_CONSERVATIVE);
+            snew_aligned(in, bsize*dist, 32);
+            snew_aligned(out, bsize*dist, 32);
+
+#pragma omp for schedule(dynamic)
+            for (int b = 0; b < nbatch; b++)
             {
-                in[j][0] = in[j][1] = 0;
+                int i0 = b*bsize;
+                int n  = std::min(bsize, nfunc - i0);
+
+                /* Fill the batch, padding with zeros */
+                for (int s = 0; s < bsize; s++)
+                {
+                    real *row = in + s*dist;
+                    int   j   = 0;
+
+                    if (s < n)
+                    {
+                        for (; j < ndata; j++)
+                        {
+                            row[j] = c[i0 + s][j];
+                        }
+                    }
+                    for (; j < dist; j++)
+                    {
+                        row[j] = 0;
+                    }
+                }
+
+                if (status == 0)
+                {
+                    status = gmx_fft_many_1d_real(fft, GMX_FFT_REAL_TO_COMPLEX, in, out);
+                }
+                /* The power spectrum is the transform of the autocorrelation */
+                for (int s = 0; s < bsize; s++)
+                {
+                    real *row = out + s*dist;
+
+                    for (int k = 0; k < nc; k++)
+                    {
+                        row[2*k]   = (row[2*k]*row[2*k] + row[2*k+1]*row[2*k+1])/nfft;
+                        row[2*k+1] = 0;
+                    }
+                }
+                if (status == 0)
+                {
+                    status = gmx_fft_many_1d_real(fft, GMX_FFT_COMPLEX_TO_REAL, out, in);
+                }
+
+                for (int s = 0; s < n; s++)
+                {
+                    real *row = in + s*dist;
+
+                    for (int j = 0; j < nfft; j++)
+                    {
+                        c[i0 + s][j] = row[j]/ndata;
+                    }
+                }
             }
 
-            gmx_fft_1d(fft1, GMX_FFT_FORWARD, (void *)in, (void *)out);
-            for (j = 0; (j < nfft); j++)
+            if (status != 0)
             {
-                c[i][j] = out[j][0]/ndata;
+#pragma omp critical
+                ret = status;
             }
+            gmx_many_fft_destroy(fft);
+            sfree_aligned(in);
+            sfree_aligned(out);
         }
-        /* Free the memory */
-        gmx_fft_destroy(fft1);
-        sfree(in);
-        sfree(out);
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
     }
-    // gmx_fft_cleanup();
-    return 0;
+
+    return ret;
 }
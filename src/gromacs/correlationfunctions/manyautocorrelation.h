@@ -1,7 +1,7 @@
 /*
  * This file is part of the GROMACS molecular simulation package.
  *
- * Copyright (c) 2014, by the GROMACS development team, led by
+ * Copyright (c) 2014,2015, by the GROMACS development team, led by
  * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
  * and including many others, as listed in the AUTHORS file in the
  * top-level source directory and at http://www.gromacs.org.
@@ -59,11 +59,15 @@ extern "C" {
  * a symmetric function that is useful for further FFT:ing, for instance in order to
  * compute spectra.
  *
- * The functions uses OpenMP parallellization.
+ * The functions are transformed in batches with real-to-complex FFTs,
+ * which are distributed over the OpenMP threads, such that a single call
+ * with many functions uses all cores. Each thread sets up its FFT plan
+ * and aligned work buffers once per call, so it is much more efficient
+ * to pass all functions in one call than to call this per function.
  *
  * \param[in] nfunc   Number of data functions to autocorrelate
  * \param[in] ndata   Number of valid data points in the data
- * \param[in] nfft    Length of the data arrays, this should at least be 50% larger than ndata. The c arrays will filled with zero beyond ndata before computing the correlation.
+ * \param[in] nfft    Length of the data arrays, this should be even and at least be 50% larger than ndata. The c arrays will filled with zero beyond ndata before computing the correlation.
  * \param[inout] c    Data array of size nfunc x nfft, will also be used for output
  * \return fft error code, or zero if everything went fine (see fft/fft.h)
  */
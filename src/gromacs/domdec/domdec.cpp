@@ -392,6 +392,13 @@ typedef struct gmx_domdec_comm
     int        nalloc_int2;
     vec_rvec_t vbuf2;
 
+    /* Outstanding receive and send of the first halo pulse,
+     * started by dd_move_x_start or dd_move_f_start.
+     */
+    dd_comm_request_t move_req[2];
+    gmx_bool          bMoveXStarted;
+    gmx_bool          bMoveFStarted;
+
     /* Communication buffers for local redistribution */
     int  **cggl_flag;
     int    cggl_flag_nalloc[DIM*2];
@@ -697,9 +704,12 @@ void dd_get_constraint_range(gmx_domdec_t *dd, int *at_start, int *at_end)
     *at_end   = dd->comm->nat[ddnatCON];
 }
 
-void dd_move_x(gmx_domdec_t *dd, matrix box, rvec x[])
+/*! \brief Packs the coordinates of pulse \p p along dimension index \p d
+ * and starts sending them, after posting the receive for our halo */
+static void dd_move_x_pulse_start(gmx_domdec_t *dd, matrix box, rvec x[],
+                                  int d, int p, int nzone, int nat_tot)
 {
-    int                    nzone, nat_tot, n, d, p, i, j, at0, at1, zone;
+    int                    n, i, j, at0, at1;
     int                   *index, *cgindex;
     gmx_domdec_comm_t     *comm;
     gmx_domdec_comm_dim_t *cd;
@@ -713,108 +723,221 @@ void dd_move_x(gmx_domdec_t *dd, matrix box, rvec x[])
 
     buf = comm->vbuf.v;
 
-    nzone   = 1;
-    nat_tot = dd->nat_home;
-    for (d = 0; d < dd->ndim; d++)
+    bPBC   = (dd->ci[dd->dim[d]] == 0);
+    bScrew = (bPBC && dd->bScrewPBC && dd->dim[d] == XX);
+    if (bPBC)
     {
-        bPBC   = (dd->ci[dd->dim[d]] == 0);
-        bScrew = (bPBC && dd->bScrewPBC && dd->dim[d] == XX);
-        if (bPBC)
-        {
-            copy_rvec(box[dd->dim[d]], shift);
-        }
-        cd = &comm->cd[d];
-        for (p = 0; p < cd->np; p++)
+        copy_rvec(box[dd->dim[d]], shift);
+    }
+    cd    = &comm->cd[d];
+    ind   = &cd->ind[p];
+    index = ind->index;
+
+    if (cd->bInPlace)
+    {
+        rbuf = x + nat_tot;
+    }
+    else
+    {
+        rbuf = comm->vbuf2.v;
+    }
+    /* Post the receive before packing, so the coordinates
+     * can arrive while we are packing our send buffer.
+     */
+    dd_irecv_rvec(dd, d, dddirBackward,
+                  rbuf, ind->nrecv[nzone+1], &comm->move_req[0]);
+
+    n     = 0;
+    if (!bPBC)
+    {
+        for (i = 0; i < ind->nsend[nzone]; i++)
         {
-            ind   = &cd->ind[p];
-            index = ind->index;
-            n     = 0;
-            if (!bPBC)
+            at0 = cgindex[index[i]];
+            at1 = cgindex[index[i]+1];
+            for (j = at0; j < at1; j++)
             {
-                for (i = 0; i < ind->nsend[nzone]; i++)
-                {
-                    at0 = cgindex[index[i]];
-                    at1 = cgindex[index[i]+1];
-                    for (j = at0; j < at1; j++)
-                    {
-                        copy_rvec(x[j], buf[n]);
-                        n++;
-                    }
-                }
+                copy_rvec(x[j], buf[n]);
+                n++;
             }
-            else if (!bScrew)
+        }
+    }
+    else if (!bScrew)
+    {
+        for (i = 0; i < ind->nsend[nzone]; i++)
+        {
+            at0 = cgindex[index[i]];
+            at1 = cgindex[index[i]+1];
+            for (j = at0; j < at1; j++)
             {
-                for (i = 0; i < ind->nsend[nzone]; i++)
-                {
-                    at0 = cgindex[index[i]];
-                    at1 = cgindex[index[i]+1];
-                    for (j = at0; j < at1; j++)
-                    {
-                        /* We need to shift the coordinates */
-                        rvec_add(x[j], shift, buf[n]);
-                        n++;
-                    }
-                }
+                /* We need to shift the coordinates */
+                rvec_add(x[j], shift, buf[n]);
+                n++;
             }
-            else
+        }
+    }
+    else
+    {
+        for (i = 0; i < ind->nsend[nzone]; i++)
+        {
+            at0 = cgindex[index[i]];
+            at1 = cgindex[index[i]+1];
+            for (j = at0; j < at1; j++)
             {
-                for (i = 0; i < ind->nsend[nzone]; i++)
-                {
-                    at0 = cgindex[index[i]];
-                    at1 = cgindex[index[i]+1];
-                    for (j = at0; j < at1; j++)
-                    {
-                        /* Shift x */
-                        buf[n][XX] = x[j][XX] + shift[XX];
-                        /* Rotate y and z.
-                         * This operation requires a special shift force
-                         * treatment, which is performed in calc_vir.
-                         */
-                        buf[n][YY] = box[YY][YY] - x[j][YY];
-                        buf[n][ZZ] = box[ZZ][ZZ] - x[j][ZZ];
-                        n++;
-                    }
-                }
+                /* Shift x */
+                buf[n][XX] = x[j][XX] + shift[XX];
+                /* Rotate y and z.
+                 * This operation requires a special shift force
+                 * treatment, which is performed in calc_vir.
+                 */
+                buf[n][YY] = box[YY][YY] - x[j][YY];
+                buf[n][ZZ] = box[ZZ][ZZ] - x[j][ZZ];
+                n++;
             }
+        }
+    }
 
-            if (cd->bInPlace)
+    dd_isend_rvec(dd, d, dddirBackward,
+                  buf, ind->nsend[nzone+1], &comm->move_req[1]);
+}
+
+/*! \brief Waits for the coordinates of pulse \p p along dimension
+ * index \p d and stores them in \p x */
+static void dd_move_x_pulse_finish(gmx_domdec_t *dd, rvec x[],
+                                   int d, int p, int nzone)
+{
+    int                    i, j, zone;
+    gmx_domdec_comm_t     *comm;
+    gmx_domdec_comm_dim_t *cd;
+    gmx_domdec_ind_t      *ind;
+    rvec                  *rbuf;
+
+    comm = dd->comm;
+    cd   = &comm->cd[d];
+    ind  = &cd->ind[p];
+
+    dd_wait_rvec(&comm->move_req[0]);
+    dd_wait_rvec(&comm->move_req[1]);
+
+    if (!cd->bInPlace)
+    {
+        rbuf = comm->vbuf2.v;
+        j    = 0;
+        for (zone = 0; zone < nzone; zone++)
+        {
+            for (i = ind->cell2at0[zone]; i < ind->cell2at1[zone]; i++)
             {
-                rbuf = x + nat_tot;
+                copy_rvec(rbuf[j], x[i]);
+                j++;
             }
-            else
+        }
+    }
+}
+
+void dd_move_x_start(gmx_domdec_t *dd, matrix box, rvec x[])
+{
+    gmx_domdec_comm_t *comm;
+
+    comm = dd->comm;
+
+    /* Only one halo communication can be in flight */
+    assert(!comm->bMoveXStarted && !comm->bMoveFStarted);
+
+    /* Only the first pulse along the first dimension can be started
+     * here, all later pulses also send coordinates we receive.
+     */
+    if (dd->ndim > 0 && comm->cd[0].np > 0)
+    {
+        dd_move_x_pulse_start(dd, box, x, 0, 0, 1, dd->nat_home);
+    }
+    comm->bMoveXStarted = TRUE;
+}
+
+void dd_move_x_finish(gmx_domdec_t *dd, matrix box, rvec x[])
+{
+    int                    nzone, nat_tot, d, p;
+    gmx_domdec_comm_t     *comm;
+    gmx_domdec_comm_dim_t *cd;
+
+    comm = dd->comm;
+
+    assert(comm->bMoveXStarted);
+
+    nzone   = 1;
+    nat_tot = dd->nat_home;
+    for (d = 0; d < dd->ndim; d++)
+    {
+        cd = &comm->cd[d];
+        for (p = 0; p < cd->np; p++)
+        {
+            if (d > 0 || p > 0)
             {
-                rbuf = comm->vbuf2.v;
+                dd_move_x_pulse_start(dd, box, x, d, p, nzone, nat_tot);
             }
-            /* Send and receive the coordinates */
-            dd_sendrecv_rvec(dd, d, dddirBackward,
-                             buf,  ind->nsend[nzone+1],
-                             rbuf, ind->nrecv[nzone+1]);
-            if (!cd->bInPlace)
+            dd_move_x_pulse_finish(dd, x, d, p, nzone);
+            nat_tot += cd->ind[p].nrecv[nzone+1];
+        }
+        nzone += nzone;
+    }
+    comm->bMoveXStarted = FALSE;
+}
+
+void dd_move_x(gmx_domdec_t *dd, matrix box, rvec x[])
+{
+    dd_move_x_start(dd, box, x);
+    dd_move_x_finish(dd, box, x);
+}
+
+/*! \brief Starts sending the halo forces of pulse \p p along dimension
+ * index \p d, after posting the receive for the forces on our atoms */
+static void dd_move_f_pulse_start(gmx_domdec_t *dd, rvec f[],
+                                  int d, int p, int nzone, int nat_tot)
+{
+    int                    i, j, zone;
+    gmx_domdec_comm_t     *comm;
+    gmx_domdec_comm_dim_t *cd;
+    gmx_domdec_ind_t      *ind;
+    rvec                  *sbuf;
+
+    comm = dd->comm;
+    cd   = &comm->cd[d];
+    ind  = &cd->ind[p];
+
+    /* Post the receive before packing, so the forces
+     * can arrive while we are packing our send buffer.
+     */
+    dd_irecv_rvec(dd, d, dddirForward,
+                  comm->vbuf.v, ind->nsend[nzone+1], &comm->move_req[0]);
+    if (cd->bInPlace)
+    {
+        sbuf = f + nat_tot;
+    }
+    else
+    {
+        sbuf = comm->vbuf2.v;
+        j    = 0;
+        for (zone = 0; zone < nzone; zone++)
+        {
+            for (i = ind->cell2at0[zone]; i < ind->cell2at1[zone]; i++)
             {
-                j = 0;
-                for (zone = 0; zone < nzone; zone++)
-                {
-                    for (i = ind->cell2at0[zone]; i < ind->cell2at1[zone]; i++)
-                    {
-                        copy_rvec(rbuf[j], x[i]);
-                        j++;
-                    }
-                }
+                copy_rvec(f[i], sbuf[j]);
+                j++;
             }
-            nat_tot += ind->nrecv[nzone+1];
         }
-        nzone += nzone;
     }
+    dd_isend_rvec(dd, d, dddirForward,
+                  sbuf, ind->nrecv[nzone+1], &comm->move_req[1]);
 }
 
-void dd_move_f(gmx_domdec_t *dd, rvec f[], rvec *fshift)
+/*! \brief Waits for the forces of pulse \p p along dimension index \p d
+ * and adds them to \p f and, when needed, to \p fshift */
+static void dd_move_f_pulse_finish(gmx_domdec_t *dd, rvec f[], rvec *fshift,
+                                   int d, int p, int nzone)
 {
-    int                    nzone, nat_tot, n, d, p, i, j, at0, at1, zone;
+    int                    n, i, j, at0, at1;
     int                   *index, *cgindex;
     gmx_domdec_comm_t     *comm;
-    gmx_domdec_comm_dim_t *cd;
     gmx_domdec_ind_t      *ind;
-    rvec                  *buf, *sbuf;
+    rvec                  *buf;
     ivec                   vis;
     int                    is;
     gmx_bool               bShiftForcesNeedPbc, bScrew;
@@ -825,107 +948,141 @@ void dd_move_f(gmx_domdec_t *dd, rvec f[], rvec *fshift)
 
     buf = comm->vbuf.v;
 
-    nzone   = comm->zones.n/2;
-    nat_tot = dd->nat_tot;
-    for (d = dd->ndim-1; d >= 0; d--)
+    /* Only forces in domains near the PBC boundaries need to
+       consider PBC in the treatment of fshift */
+    bShiftForcesNeedPbc   = (dd->ci[dd->dim[d]] == 0);
+    bScrew                = (bShiftForcesNeedPbc && dd->bScrewPBC && dd->dim[d] == XX);
+    if (fshift == NULL && !bScrew)
     {
-        /* Only forces in domains near the PBC boundaries need to
-           consider PBC in the treatment of fshift */
-        bShiftForcesNeedPbc   = (dd->ci[dd->dim[d]] == 0);
-        bScrew                = (bShiftForcesNeedPbc && dd->bScrewPBC && dd->dim[d] == XX);
-        if (fshift == NULL && !bScrew)
-        {
-            bShiftForcesNeedPbc = FALSE;
-        }
-        /* Determine which shift vector we need */
-        clear_ivec(vis);
-        vis[dd->dim[d]] = 1;
-        is              = IVEC2IS(vis);
+        bShiftForcesNeedPbc = FALSE;
+    }
+    /* Determine which shift vector we need */
+    clear_ivec(vis);
+    vis[dd->dim[d]] = 1;
+    is              = IVEC2IS(vis);
 
-        cd = &comm->cd[d];
-        for (p = cd->np-1; p >= 0; p--)
+    ind = &comm->cd[d].ind[p];
+
+    dd_wait_rvec(&comm->move_req[0]);
+    dd_wait_rvec(&comm->move_req[1]);
+
+    index = ind->index;
+    /* Add the received forces */
+    n = 0;
+    if (!bShiftForcesNeedPbc)
+    {
+        for (i = 0; i < ind->nsend[nzone]; i++)
         {
-            ind      = &cd->ind[p];
-            nat_tot -= ind->nrecv[nzone+1];
-            if (cd->bInPlace)
+            at0 = cgindex[index[i]];
+            at1 = cgindex[index[i]+1];
+            for (j = at0; j < at1; j++)
             {
-                sbuf = f + nat_tot;
+                rvec_inc(f[j], buf[n]);
+                n++;
             }
-            else
+        }
+    }
+    else if (!bScrew)
+    {
+        /* fshift should always be defined if this function is
+         * called when bShiftForcesNeedPbc is true */
+        assert(NULL != fshift);
+        for (i = 0; i < ind->nsend[nzone]; i++)
+        {
+            at0 = cgindex[index[i]];
+            at1 = cgindex[index[i]+1];
+            for (j = at0; j < at1; j++)
             {
-                sbuf = comm->vbuf2.v;
-                j    = 0;
-                for (zone = 0; zone < nzone; zone++)
-                {
-                    for (i = ind->cell2at0[zone]; i < ind->cell2at1[zone]; i++)
-                    {
-                        copy_rvec(f[i], sbuf[j]);
-                        j++;
-                    }
-                }
+                rvec_inc(f[j], buf[n]);
+                /* Add this force to the shift force */
+                rvec_inc(fshift[is], buf[n]);
+                n++;
             }
-            /* Communicate the forces */
-            dd_sendrecv_rvec(dd, d, dddirForward,
-                             sbuf, ind->nrecv[nzone+1],
-                             buf,  ind->nsend[nzone+1]);
-            index = ind->index;
-            /* Add the received forces */
-            n = 0;
-            if (!bShiftForcesNeedPbc)
+        }
+    }
+    else
+    {
+        for (i = 0; i < ind->nsend[nzone]; i++)
+        {
+            at0 = cgindex[index[i]];
+            at1 = cgindex[index[i]+1];
+            for (j = at0; j < at1; j++)
             {
-                for (i = 0; i < ind->nsend[nzone]; i++)
+                /* Rotate the force */
+                f[j][XX] += buf[n][XX];
+                f[j][YY] -= buf[n][YY];
+                f[j][ZZ] -= buf[n][ZZ];
+                if (fshift)
                 {
-                    at0 = cgindex[index[i]];
-                    at1 = cgindex[index[i]+1];
-                    for (j = at0; j < at1; j++)
-                    {
-                        rvec_inc(f[j], buf[n]);
-                        n++;
-                    }
+                    /* Add this force to the shift force */
+                    rvec_inc(fshift[is], buf[n]);
                 }
+                n++;
             }
-            else if (!bScrew)
-            {
-                /* fshift should always be defined if this function is
-                 * called when bShiftForcesNeedPbc is true */
-                assert(NULL != fshift);
-                for (i = 0; i < ind->nsend[nzone]; i++)
-                {
-                    at0 = cgindex[index[i]];
-                    at1 = cgindex[index[i]+1];
-                    for (j = at0; j < at1; j++)
-                    {
-                        rvec_inc(f[j], buf[n]);
-                        /* Add this force to the shift force */
-                        rvec_inc(fshift[is], buf[n]);
-                        n++;
-                    }
-                }
-            }
-            else
+        }
+    }
+}
+
+void dd_move_f_start(gmx_domdec_t *dd, rvec f[])
+{
+    gmx_domdec_comm_t     *comm;
+    gmx_domdec_comm_dim_t *cd;
+    gmx_domdec_ind_t      *ind;
+    int                    d, nzone;
+
+    comm = dd->comm;
+
+    /* Only one halo communication can be in flight */
+    assert(!comm->bMoveXStarted && !comm->bMoveFStarted);
+
+    /* Only the last pulse along the last dimension can be started here,
+     * the forces we receive need to be added before earlier pulses.
+     */
+    d = dd->ndim - 1;
+    if (d >= 0 && comm->cd[d].np > 0)
+    {
+        cd    = &comm->cd[d];
+        ind   = &cd->ind[cd->np-1];
+        nzone = comm->zones.n/2;
+        dd_move_f_pulse_start(dd, f, d, cd->np-1, nzone,
+                              dd->nat_tot - ind->nrecv[nzone+1]);
+    }
+    comm->bMoveFStarted = TRUE;
+}
+
+void dd_move_f_finish(gmx_domdec_t *dd, rvec f[], rvec *fshift)
+{
+    int                    nzone, nat_tot, d, p;
+    gmx_domdec_comm_t     *comm;
+    gmx_domdec_comm_dim_t *cd;
+
+    comm = dd->comm;
+
+    assert(comm->bMoveFStarted);
+
+    nzone   = comm->zones.n/2;
+    nat_tot = dd->nat_tot;
+    for (d = dd->ndim-1; d >= 0; d--)
+    {
+        cd = &comm->cd[d];
+        for (p = cd->np-1; p >= 0; p--)
+        {
+            nat_tot -= cd->ind[p].nrecv[nzone+1];
+            if (d < dd->ndim-1 || p < cd->np-1)
             {
-                for (i = 0; i < ind->nsend[nzone]; i++)
-                {
-                    at0 = cgindex[index[i]];
-                    at1 = cgindex[index[i]+1];
-                    for (j = at0; j < at1; j++)
-                    {
-                        /* Rotate the force */
-                        f[j][XX] += buf[n][XX];
-                        f[j][YY] -= buf[n][YY];
-                        f[j][ZZ] -= buf[n][ZZ];
-                        if (fshift)
-                        {
-                            /* Add this force to the shift force */
-                            rvec_inc(fshift[is], buf[n]);
-                        }
-                        n++;
-                    }
-                }
+                dd_move_f_pulse_start(dd, f, d, p, nzone, nat_tot);
             }
+            dd_move_f_pulse_finish(dd, f, fshift, d, p, nzone);
         }
         nzone /= 2;
     }
+    comm->bMoveFStarted = FALSE;
+}
+
+void dd_move_f(gmx_domdec_t *dd, rvec f[], rvec *fshift)
+{
+    dd_move_f_start(dd, f);
+    dd_move_f_finish(dd, f, fshift);
 }
 
 void dd_atom_spread_real(gmx_domdec_t *dd, real v[])
@@ -2541,8 +2698,13 @@ static void dd_set_cginfo(int *index_gl, int cg0, int cg1,
     }
 }
 
+/* Sets the local to global and global to local atom indices for the charge
+ * groups from cg_start onwards. With bChange, the ga2la entries for home
+ * atoms may already be present, in which case they are changed in place.
+ */
 static void make_dd_indices(gmx_domdec_t *dd,
-                            const int *gcgs_index, int cg_start)
+                            const int *gcgs_index, int cg_start,
+                            gmx_bool bChange)
 {
     int          nzone, zone, zone1, cg0, cg1, cg1_p1, cg, cg_gl, a, a_gl;
     int         *zone2cg, *zone_ncg1, *index_gl, *gatindex;
@@ -2595,14 +2757,28 @@ static void make_dd_indices(gmx_domdec_t *dd,
                 for (a_gl = gcgs_index[cg_gl]; a_gl < gcgs_index[cg_gl+1]; a_gl++)
                 {
                     gatindex[a] = a_gl;
-                    ga2la_set(dd->ga2la, a_gl, a, zone1);
+                    if (bChange && zone == 0)
+                    {
+                        ga2la_set_or_change(dd->ga2la, a_gl, a, zone1);
+                    }
+                    else
+                    {
+                        ga2la_set(dd->ga2la, a_gl, a, zone1);
+                    }
                     a++;
                 }
             }
             else
             {
                 gatindex[a] = cg_gl;
-                ga2la_set(dd->ga2la, cg_gl, a, zone1);
+                if (bChange && zone == 0)
+                {
+                    ga2la_set_or_change(dd->ga2la, cg_gl, a, zone1);
+                }
+                else
+                {
+                    ga2la_set(dd->ga2la, cg_gl, a, zone1);
+                }
                 a++;
             }
         }
@@ -9461,7 +9637,7 @@ void dd_partition_system(FILE                *fplog,
     rvec               cell_ns_x0, cell_ns_x1;
     int                i, n, ncgindex_set, ncg_home_old = -1, ncg_moved, nat_f_novirsum;
     gmx_bool           bBoxChanged, bNStGlobalComm, bDoDLB, bCheckWhetherToTurnDlbOn, bTurnOnDLB, bLogLoad;
-    gmx_bool           bRedist, bSortCG, bResortAll;
+    gmx_bool           bRedist, bSortCG, bResortAll, bChangeIndices;
     ivec               ncells_old = {0, 0, 0}, ncells_new = {0, 0, 0}, np;
     real               grid_density;
     char               sbuf[22];
@@ -9644,7 +9820,7 @@ void dd_partition_system(FILE                *fplog,
 
         /* Build the new indices */
         rebuild_cgindex(dd, cgs_gl->index, state_local);
-        make_dd_indices(dd, cgs_gl->index, 0);
+        make_dd_indices(dd, cgs_gl->index, 0, FALSE);
         ncgindex_set = dd->ncg_home;
 
         if (fr->cutoff_scheme == ecutsGROUP)
@@ -9708,6 +9884,8 @@ void dd_partition_system(FILE                *fplog,
 
     ncg_home_old = dd->ncg_home;
 
+    bChangeIndices = FALSE;
+
     ncg_moved = 0;
     if (bRedist)
     {
@@ -9811,9 +9989,14 @@ void dd_partition_system(FILE                *fplog,
         }
         dd_sort_state(dd, fr->cg_cm, fr, state_local,
                       bResortAll ? -1 : ncg_home_old);
-        /* Rebuild all the indices */
-        ga2la_clear(dd->ga2la);
-        ncgindex_set = 0;
+        /* Rebuild all the indices. The ga2la entries of atoms that left
+         * and of the old halo have already been deleted, so we can change
+         * the entries of the home atoms in place. This avoids clearing
+         * the whole ga2la, which scales with the system size when
+         * it is a direct array.
+         */
+        ncgindex_set   = 0;
+        bChangeIndices = TRUE;
 
         wallcycle_sub_stop(wcycle, ewcsDD_GRID);
     }
@@ -9824,7 +10007,7 @@ void dd_partition_system(FILE                *fplog,
     setup_dd_communication(dd, state_local->box, &ddbox, fr, state_local, f);
 
     /* Set the indices */
-    make_dd_indices(dd, cgs_gl->index, ncgindex_set);
+    make_dd_indices(dd, cgs_gl->index, ncgindex_set, bChangeIndices);
 
     /* Set the charge group boundaries for neighbor searching */
     set_cg_boundaries(&comm->zones);
@@ -236,6 +236,19 @@ float dd_pme_f_ratio(gmx_domdec_t *dd);
 /*! \brief Communicate the coordinates to the neighboring cells and do pbc. */
 void dd_move_x(gmx_domdec_t *dd, matrix box, rvec x[]);
 
+/*! \brief Start communicating the coordinates to the neighboring cells.
+ *
+ * Starts the first communication pulse of dd_move_x() with non-blocking
+ * communication, so work that only needs the home atoms can be done
+ * while the coordinates are in flight. The home atom coordinates
+ * should not be modified and the halo part of \p x should not be
+ * accessed before dd_move_x_finish() has been called.
+ */
+void dd_move_x_start(gmx_domdec_t *dd, matrix box, rvec x[]);
+
+/*! \brief Complete the communication started with dd_move_x_start(). */
+void dd_move_x_finish(gmx_domdec_t *dd, matrix box, rvec x[]);
+
 /*! \brief Sum the forces over the neighboring cells.
  *
  * When fshift!=NULL the shift forces are updated to obtain
@@ -243,6 +256,18 @@ void dd_move_x(gmx_domdec_t *dd, matrix box, rvec x[]);
  */
 void dd_move_f(gmx_domdec_t *dd, rvec f[], rvec *fshift);
 
+/*! \brief Start sending the halo forces to the neighboring cells.
+ *
+ * Starts the first communication pulse of dd_move_f() with non-blocking
+ * communication. Forces on home atoms can still be added before
+ * dd_move_f_finish() is called, the halo part of \p f should not be
+ * modified.
+ */
+void dd_move_f_start(gmx_domdec_t *dd, rvec f[]);
+
+/*! \brief Complete the communication started with dd_move_f_start(). */
+void dd_move_f_finish(gmx_domdec_t *dd, rvec f[], rvec *fshift);
+
 /*! \brief Communicate a real for each atom to the neighboring cells. */
 void dd_atom_spread_real(gmx_domdec_t *dd, real v[]);
 
@@ -154,6 +154,59 @@ void dd_sendrecv_rvec(const gmx_domdec_t gmx_unused *dd,
 #endif
 }
 
+void dd_irecv_rvec(const gmx_domdec_t gmx_unused *dd,
+                   int gmx_unused ddimind, int gmx_unused direction,
+                   rvec gmx_unused *buf_r, int gmx_unused n_r,
+                   dd_comm_request_t *req)
+{
+    req->bActive = FALSE;
+#ifdef GMX_MPI
+    int rank_r;
+
+    rank_r = dd->neighbor[ddimind][direction == dddirForward ? 1 : 0];
+
+    if (n_r)
+    {
+        MPI_Irecv(buf_r[0], n_r*sizeof(rvec), MPI_BYTE, rank_r, 0,
+                  dd->mpi_comm_all, &req->req);
+        req->bActive = TRUE;
+    }
+#endif
+}
+
+void dd_isend_rvec(const gmx_domdec_t gmx_unused *dd,
+                   int gmx_unused ddimind, int gmx_unused direction,
+                   rvec gmx_unused *buf_s, int gmx_unused n_s,
+                   dd_comm_request_t *req)
+{
+    req->bActive = FALSE;
+#ifdef GMX_MPI
+    int rank_s;
+
+    rank_s = dd->neighbor[ddimind][direction == dddirForward ? 0 : 1];
+
+    if (n_s)
+    {
+        MPI_Isend(buf_s[0], n_s*sizeof(rvec), MPI_BYTE, rank_s, 0,
+                  dd->mpi_comm_all, &req->req);
+        req->bActive = TRUE;
+    }
+#endif
+}
+
+void dd_wait_rvec(dd_comm_request_t gmx_unused *req)
+{
+#ifdef GMX_MPI
+    MPI_Status stat;
+
+    if (req->bActive)
+    {
+        MPI_Wait(&req->req, &stat);
+        req->bActive = FALSE;
+    }
+#endif
+}
+
 void dd_sendrecv2_rvec(const gmx_domdec_t gmx_unused *dd,
                        int gmx_unused ddimind,
                        rvec gmx_unused *buf_s_fw, int gmx_unused n_s_fw,
@@ -49,6 +49,7 @@
 #define GMX_DOMDEC_DOMDEC_NETWORK_H
 
 #include "gromacs/legacyheaders/typedefs.h"
+#include "gromacs/utility/gmxmpi.h"
 
 /* \brief */
 enum {
@@ -90,6 +91,47 @@ dd_sendrecv_rvec(const gmx_domdec_t *dd,
                  rvec *buf_r, int n_r);
 
 
+/*! \brief Non-blocking send or receive posted with dd_isend_rvec() or dd_irecv_rvec() */
+typedef struct {
+    MPI_Request req;     /**< The MPI request, only valid when bActive=TRUE */
+    gmx_bool    bActive; /**< Whether the communication is outstanding */
+} dd_comm_request_t;
+
+/*! \brief Posts a non-blocking receive of rvec's in the comm. region
+ * one cell along the domain decomposition
+ *
+ * Receives the data that the neighbor sends in the dimension indexed by
+ * ddimind in \p direction. Posting the receive before packing the send
+ * buffer lets the data arrive directly in \p buf_r, also when the neighbor
+ * is ready earlier. The receive has to be completed with dd_wait_rvec().
+ */
+void
+dd_irecv_rvec(const gmx_domdec_t *dd,
+              int ddimind, int direction,
+              rvec *buf_r, int n_r,
+              dd_comm_request_t *req);
+
+/*! \brief Starts a non-blocking send of rvec's one cell along the domain
+ * decomposition
+ *
+ * Together with dd_irecv_rvec() this performs the same communication
+ * as dd_sendrecv_rvec(). \p buf_s should not be modified before
+ * the send has been completed with dd_wait_rvec().
+ */
+void
+dd_isend_rvec(const gmx_domdec_t *dd,
+              int ddimind, int direction,
+              rvec *buf_s, int n_s,
+              dd_comm_request_t *req);
+
+/*! \brief Waits for the completion of a send or receive started with
+ * dd_isend_rvec() or dd_irecv_rvec()
+ *
+ * Does nothing when \p req is not active.
+ */
+void
+dd_wait_rvec(dd_comm_request_t *req);
+
 /*! \brief Move revc's in the comm. region one cell along the domain decomposition
  *
  * Moves in dimension indexed by ddimind, simultaneously in the forward
@@ -1162,7 +1162,7 @@ static real dd_dist2(t_pbc *pbc_null, rvec *cg_cm, const int *la2lc, int i, int
 /*! \brief Append t_blocka block structures 1 to nsrc in src to *dest */
 static void combine_blocka(t_blocka *dest, const thread_work_t *src, int nsrc)
 {
-    int ni, na, s, i;
+    int ni, na, s;
 
     ni = src[nsrc-1].excl.nr;
     na = 0;
@@ -1180,19 +1180,34 @@ static void combine_blocka(t_blocka *dest, const thread_work_t *src, int nsrc)
         dest->nalloc_a = over_alloc_large(dest->nra+na);
         srenew(dest->a, dest->nalloc_a);
     }
+    /* Each thread copies its own part. The offsets in dest are the sums
+     * of the sizes of the parts of the lower threads.
+     */
+#pragma omp parallel for num_threads(nsrc - 1) schedule(static)
     for (s = 1; s < nsrc; s++)
     {
-        for (i = dest->nr+1; i < src[s].excl.nr+1; i++)
+        int i, t, nr0, nra0;
+
+        nr0  = (s == 1 ? dest->nr : src[s-1].excl.nr);
+        nra0 = dest->nra;
+        for (t = 1; t < s; t++)
         {
-            dest->index[i] = dest->nra + src[s].excl.index[i];
+            nra0 += src[t].excl.nra;
+        }
+        for (i = nr0+1; i < src[s].excl.nr+1; i++)
+        {
+            dest->index[i] = nra0 + src[s].excl.index[i];
         }
         for (i = 0; i < src[s].excl.nra; i++)
         {
-            dest->a[dest->nra+i] = src[s].excl.a[i];
+            dest->a[nra0+i] = src[s].excl.a[i];
         }
-        dest->nr   = src[s].excl.nr;
+    }
+    for (s = 1; s < nsrc; s++)
+    {
         dest->nra += src[s].excl.nra;
     }
+    dest->nr = ni;
 }
 
 /*! \brief Append t_idef structures 1 to nsrc in src to *dest,
@@ -1201,11 +1216,12 @@ static void combine_blocka(t_blocka *dest, const thread_work_t *src, int nsrc)
 static void combine_idef(t_idef *dest, const thread_work_t *src, int nsrc,
                          gmx_vsite_t *vsite)
 {
-    int ftype;
+    int ftype, s;
 
+    /* Ensure we have enough space, the copying is done in parallel below */
     for (ftype = 0; ftype < F_NRE; ftype++)
     {
-        int n, s;
+        int n;
 
         n = 0;
         for (s = 1; s < nsrc; s++)
@@ -1224,13 +1240,11 @@ static void combine_idef(t_idef *dest, const thread_work_t *src, int nsrc,
                 srenew(ild->iatoms, ild->nalloc);
             }
 
-            gmx_bool vpbc;
-            int      nral1 = 0, ftv = 0;
-
-            vpbc = ((interaction_function[ftype].flags & IF_VSITE) &&
-                    vsite->vsite_pbc_loc != NULL);
-            if (vpbc)
+            if ((interaction_function[ftype].flags & IF_VSITE) &&
+                vsite->vsite_pbc_loc != NULL)
             {
+                int nral1, ftv;
+
                 nral1 = 1 + NRAL(ftype);
                 ftv   = ftype - F_VSITE2;
                 if ((ild->nr + n)/nral1 > vsite->vsite_pbc_loc_nalloc[ftv])
@@ -1241,35 +1255,66 @@ static void combine_idef(t_idef *dest, const thread_work_t *src, int nsrc,
                            vsite->vsite_pbc_loc_nalloc[ftv]);
                 }
             }
+        }
+    }
 
-            for (s = 1; s < nsrc; s++)
+    /* Each thread copies its own part of all ilists. The offsets in dest
+     * are the sums of the sizes of the parts of the lower threads.
+     */
+#pragma omp parallel for num_threads(nsrc - 1) schedule(static)
+    for (s = 1; s < nsrc; s++)
+    {
+        int ftype_s;
+
+        for (ftype_s = 0; ftype_s < F_NRE; ftype_s++)
+        {
+            const t_ilist *ils;
+            t_ilist       *ild;
+            int            nr0, t, i;
+
+            ils = &src[s].idef.il[ftype_s];
+            if (ils->nr == 0)
             {
-                const t_ilist *ils;
-                int            i;
+                continue;
+            }
+            ild = &dest->il[ftype_s];
+            nr0 = ild->nr;
+            for (t = 1; t < s; t++)
+            {
+                nr0 += src[t].idef.il[ftype_s].nr;
+            }
+            for (i = 0; i < ils->nr; i++)
+            {
+                ild->iatoms[nr0+i] = ils->iatoms[i];
+            }
+            if ((interaction_function[ftype_s].flags & IF_VSITE) &&
+                vsite->vsite_pbc_loc != NULL)
+            {
+                int nral1, ftv;
 
-                ils = &src[s].idef.il[ftype];
-                for (i = 0; i < ils->nr; i++)
+                nral1 = 1 + NRAL(ftype_s);
+                ftv   = ftype_s - F_VSITE2;
+                for (i = 0; i < ils->nr; i += nral1)
                 {
-                    ild->iatoms[ild->nr+i] = ils->iatoms[i];
-                }
-                if (vpbc)
-                {
-                    for (i = 0; i < ils->nr; i += nral1)
-                    {
-                        vsite->vsite_pbc_loc[ftv][(ild->nr+i)/nral1] =
-                            src[s].vsite_pbc[ftv][i/nral1];
-                    }
+                    vsite->vsite_pbc_loc[ftv][(nr0+i)/nral1] =
+                        src[s].vsite_pbc[ftv][i/nral1];
                 }
-
-                ild->nr += ils->nr;
             }
         }
     }
 
+    for (ftype = 0; ftype < F_NRE; ftype++)
+    {
+        for (s = 1; s < nsrc; s++)
+        {
+            dest->il[ftype].nr += src[s].idef.il[ftype].nr;
+        }
+    }
+
     /* Position restraints need an additional treatment */
     if (dest->il[F_POSRES].nr > 0)
     {
-        int n, s, i;
+        int n, i;
 
         n = dest->il[F_POSRES].nr/2;
         if (n > dest->iparams_posres_nalloc)
@@ -0,0 +1,223 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief Tests for the global to local atom lookup tables
+ * in gmx_ga2la.h and gmx_hash.h.
+ *
+ * \ingroup module_domdec
+ */
+#include "gmxpre.h"
+
+#include <map>
+
+#include <gtest/gtest.h>
+
+#include "gromacs/legacyheaders/gmx_ga2la.h"
+#include "gromacs/legacyheaders/gmx_hash.h"
+#include "gromacs/utility/smalloc.h"
+
+namespace
+{
+
+//! Simple deterministic generator for keys and operations.
+class KeyGenerator
+{
+    public:
+        //! Initializes the generator with \p seed.
+        explicit KeyGenerator(unsigned int seed) : state_(seed) {}
+
+        //! Returns a pseudo-random integer in [0, \p range).
+        int next(int range)
+        {
+            state_ = state_*1664525U + 1013904223U;
+            return static_cast<int>((state_ >> 8) % static_cast<unsigned int>(range));
+        }
+
+    private:
+        unsigned int state_;
+};
+
+//! Reference map from global to (local, cell).
+typedef std::map<int, std::pair<int, int> > ReferenceMap;
+
+/*! \brief
+ * Applies random insertions, changes and deletions to \p ga2la and
+ * checks all lookups against a std::map.
+ */
+void testGa2laAgainstReference(gmx_ga2la_t ga2la, int nat_tot, int nkey_max)
+{
+    KeyGenerator generator(12345);
+    ReferenceMap reference;
+
+    for (int op = 0; op < 20*nkey_max; op++)
+    {
+        int a_gl = generator.next(nat_tot);
+        int type = generator.next(4);
+        if (type == 0 || static_cast<int>(reference.size()) >= nkey_max)
+        {
+            ga2la_del(ga2la, a_gl);
+            reference.erase(a_gl);
+        }
+        else if (type == 1)
+        {
+            int a_loc = generator.next(nkey_max);
+            int cell  = generator.next(8);
+            ga2la_set_or_change(ga2la, a_gl, a_loc, cell);
+            reference[a_gl] = std::make_pair(a_loc, cell);
+        }
+        else if (reference.find(a_gl) == reference.end())
+        {
+            int a_loc = generator.next(nkey_max);
+            int cell  = generator.next(8);
+            ga2la_set(ga2la, a_gl, a_loc, cell);
+            reference[a_gl] = std::make_pair(a_loc, cell);
+        }
+        else
+        {
+            int a_loc = generator.next(nkey_max);
+            ga2la_change_la(ga2la, a_gl, a_loc);
+            reference[a_gl].first = a_loc;
+        }
+    }
+
+    for (int a_gl = 0; a_gl < nat_tot; a_gl++)
+    {
+        ReferenceMap::const_iterator ref = reference.find(a_gl);
+        int                          a_loc, cell;
+        bool                         bPresent = ga2la_get(ga2la, a_gl, &a_loc, &cell);
+        ASSERT_EQ(ref != reference.end(), bPresent) << "global atom " << a_gl;
+        if (bPresent)
+        {
+            EXPECT_EQ(ref->second.first, a_loc);
+            EXPECT_EQ(ref->second.second, cell);
+            EXPECT_EQ(ref->second.second == 0, ga2la_is_home(ga2la, a_gl));
+        }
+        else
+        {
+            EXPECT_FALSE(ga2la_is_home(ga2la, a_gl));
+        }
+    }
+
+    ga2la_clear(ga2la);
+    for (ReferenceMap::const_iterator ref = reference.begin(); ref != reference.end(); ++ref)
+    {
+        int a_loc, cell;
+        EXPECT_FALSE(ga2la_get(ga2la, ref->first, &a_loc, &cell));
+    }
+}
+
+//! Frees \p ga2la.
+void freeGa2la(gmx_ga2la_t ga2la)
+{
+    sfree(ga2la->laa);
+    sfree(ga2la->lal);
+    sfree(ga2la);
+}
+
+TEST(Ga2laTest, DirectArrayMatchesReference)
+{
+    const int   nat_tot = 2000;
+    gmx_ga2la_t ga2la   = ga2la_init(nat_tot, nat_tot/2);
+    EXPECT_TRUE(ga2la->bAll);
+    testGa2laAgainstReference(ga2la, nat_tot, nat_tot/2);
+    freeGa2la(ga2la);
+}
+
+TEST(Ga2laTest, HashTableMatchesReference)
+{
+    const int   nat_tot = 100000;
+    gmx_ga2la_t ga2la   = ga2la_init(nat_tot, 1000);
+    EXPECT_FALSE(ga2la->bAll);
+    testGa2laAgainstReference(ga2la, nat_tot, 1000);
+    freeGa2la(ga2la);
+}
+
+TEST(Ga2laTest, HashTableGrowsBeyondEstimate)
+{
+    const int   nat_tot = 100000;
+    gmx_ga2la_t ga2la   = ga2la_init(nat_tot, 100);
+    EXPECT_FALSE(ga2la->bAll);
+    testGa2laAgainstReference(ga2la, nat_tot, 5000);
+    freeGa2la(ga2la);
+}
+
+TEST(GmxHashTest, MatchesReference)
+{
+    const int              nkey_max = 3000;
+    gmx_hash_t             hash     = gmx_hash_init(100);
+    KeyGenerator           generator(54321);
+    std::map<int, int>     reference;
+
+    for (int op = 0; op < 20*nkey_max; op++)
+    {
+        int key  = generator.next(1000000);
+        int type = generator.next(3);
+        if (type == 0 || static_cast<int>(reference.size()) >= nkey_max)
+        {
+            if (reference.erase(key) > 0)
+            {
+                gmx_hash_del(hash, key);
+            }
+        }
+        else
+        {
+            int value = generator.next(nkey_max);
+            gmx_hash_change_or_set(hash, key, value);
+            reference[key] = value;
+        }
+    }
+    EXPECT_EQ(static_cast<int>(reference.size()), hash->nkey);
+
+    KeyGenerator lookup(54321);
+    for (int i = 0; i < 20*nkey_max; i++)
+    {
+        int                                key = lookup.next(1000000);
+        std::map<int, int>::const_iterator ref = reference.find(key);
+        EXPECT_EQ(ref != reference.end() ? ref->second : -1,
+                  gmx_hash_get_minone(hash, key)) << "key " << key;
+    }
+
+    gmx_hash_clear_and_optimize(hash);
+    EXPECT_EQ(0, hash->nkey);
+    for (std::map<int, int>::const_iterator ref = reference.begin(); ref != reference.end(); ++ref)
+    {
+        EXPECT_EQ(-1, gmx_hash_get_minone(hash, ref->first));
+    }
+
+    sfree(hash->hash);
+    sfree(hash);
+}
+
+} // namespace
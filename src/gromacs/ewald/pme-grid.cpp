@@ -764,20 +764,23 @@ void pmegrids_init(pmegrids_t *grids,
 
 void pmegrids_destroy(pmegrids_t *grids)
 {
-    int t;
+    int d;
 
     if (grids->grid.grid != NULL)
     {
-        sfree(grids->grid.grid);
+        sfree_aligned(grids->grid.grid);
 
-        if (grids->nthread > 0)
+        if (grids->grid_th != NULL)
         {
-            for (t = 0; t < grids->nthread; t++)
-            {
-                sfree(grids->grid_th[t].grid);
-            }
+            /* The thread-local grids all point into grid_all */
+            sfree_aligned(grids->grid_all);
             sfree(grids->grid_th);
         }
+        for (d = 0; d < DIM; d++)
+        {
+            sfree(grids->g2t[d]);
+        }
+        sfree(grids->g2t);
     }
 }
 
@@ -164,8 +164,7 @@ int gmx_pme_destroy(FILE *log, struct gmx_pme_t **pmedata)
     for (i = 0; i < (*pmedata)->ngrids; ++i)
     {
         pmegrids_destroy(&(*pmedata)->pmegrid[i]);
-        sfree((*pmedata)->fftgrid[i]);
-        sfree((*pmedata)->cfftgrid[i]);
+        /* fftgrid and cfftgrid are owned and freed by the FFT setup */
         gmx_parallel_3dfft_destroy((*pmedata)->pfft_setup[i]);
     }
 
@@ -87,6 +87,11 @@ struct ener_file
     t_fileio  *fio;
     int        framenr;
     real       frametime;
+    gmx_bool   bDouble;           /* Is the file in double precision?       */
+    int        nre_select;        /* Number of terms in bSelectTerm          */
+    gmx_bool  *bSelectTerm;       /* Which terms to read, NULL: all          */
+    gmx_bool   bSelectBlocks;     /* Do we only read the selected blocks?    */
+    gmx_bool   bSelectBlock[enxNR]; /* Which blocks to read                  */
 };
 
 static void enxsubblock_init(t_enxsubblock *sb)
@@ -747,6 +752,7 @@ void close_enx(ener_file_t ef)
     {
         gmx_file("Cannot close energy file; it might be corrupt, or maybe you are out of disk space?");
     }
+    sfree(ef->bSelectTerm);
 }
 
 /*!\brief Return TRUE if a file exists but is empty, otherwise FALSE.
@@ -806,6 +812,7 @@ ener_file_t open_enx(const char *fn, const char *mode)
               (nre*4*(long int)sizeof(float) == fr->e_size)) ) )
         {
             fprintf(stderr, "Opened %s as single precision energy file\n", fn);
+            ef->bDouble = FALSE;
             free_enxnms(nre, nms);
         }
         else
@@ -824,6 +831,7 @@ ener_file_t open_enx(const char *fn, const char *mode)
             {
                 fprintf(stderr, "Opened %s as double precision energy file\n",
                         fn);
+                ef->bDouble = TRUE;
             }
             else
             {
@@ -928,12 +936,183 @@ static void convert_full_sums(ener_old_t *ener_old, t_enxframe *fr)
     ener_old->step_prev = fr->step;
 }
 
+/* Returns the size in bytes of the data of subblock sub in the file,
+ * or -1 when the size depends on the data itself, as for strings.
+ */
+static gmx_off_t enxsubblock_file_size(const t_enxsubblock *sub)
+{
+    switch (sub->type)
+    {
+        case xdr_datatype_float:
+            return sub->nr*(gmx_off_t)4;
+        case xdr_datatype_double:
+        case xdr_datatype_int64:
+            return sub->nr*(gmx_off_t)8;
+        case xdr_datatype_int:
+        case xdr_datatype_char:
+            /* XDR stores each char in 4 bytes */
+            return sub->nr*(gmx_off_t)4;
+        default:
+            return -1;
+    }
+}
+
+static gmx_bool enx_skip_bytes(ener_file_t ef, gmx_off_t nbytes)
+{
+    return (nbytes == 0 ||
+            gmx_fio_seek(ef->fio, gmx_fio_ftell(ef->fio) + nbytes) == 0);
+}
+
+static gmx_bool do_enxsubblock(ener_file_t ef, t_enxsubblock *sub)
+{
+    gmx_bool bOK = FALSE;
+
+    switch (sub->type)
+    {
+        case xdr_datatype_float:
+            bOK = gmx_fio_ndo_float(ef->fio, sub->fval, sub->nr);
+            break;
+        case xdr_datatype_double:
+            bOK = gmx_fio_ndo_double(ef->fio, sub->dval, sub->nr);
+            break;
+        case xdr_datatype_int:
+            bOK = gmx_fio_ndo_int(ef->fio, sub->ival, sub->nr);
+            break;
+        case xdr_datatype_int64:
+            bOK = gmx_fio_ndo_int64(ef->fio, sub->lval, sub->nr);
+            break;
+        case xdr_datatype_char:
+            bOK = gmx_fio_ndo_uchar(ef->fio, sub->cval, sub->nr);
+            break;
+        case xdr_datatype_string:
+            bOK = gmx_fio_ndo_string(ef->fio, sub->sval, sub->nr);
+            break;
+        default:
+            gmx_incons("Reading unknown block data type: this file is corrupted or from the future");
+    }
+
+    return bOK;
+}
+
+/* Reads or writes the energies and blocks following the frame header.
+ * When reading, the terms and blocks that are not selected in ef are
+ * skipped in the file, with bSkipAll everything is skipped
+ * (apart from string subblocks, which have to be decoded to know their size).
+ */
+static gmx_bool do_enx_data(ener_file_t ef, t_enxframe *fr, int file_version,
+                            gmx_bool bSkipAll)
+{
+    int        i, b, s;
+    gmx_bool   bRead, bOK, bSums, bSelTerms, bSkip;
+    gmx_off_t  realsize, nskip, size;
+    real       tmp1, tmp2, rdum;
+
+    bOK   = TRUE;
+    bRead = gmx_fio_getread(ef->fio);
+
+    /* Do not store sums of length 1,
+     * since this does not add information.
+     */
+    bSums     = (file_version == 1 || (bRead && fr->nsum > 0) || fr->nsum > 1);
+    bSelTerms = (bRead && ef->bSelectTerm != NULL &&
+                 fr->nre == ef->nre_select && !ef->eo.bOldFileOpen);
+    realsize  = (ef->bDouble ? sizeof(double) : sizeof(float));
+
+    nskip = 0;
+    for (i = 0; i < fr->nre; i++)
+    {
+        if (bRead && (bSkipAll || (bSelTerms && !ef->bSelectTerm[i])))
+        {
+            nskip += (1 + (bSums ? 2 : 0) + (file_version == 1 ? 1 : 0))*realsize;
+            continue;
+        }
+        bOK   = bOK && enx_skip_bytes(ef, nskip);
+        nskip = 0;
+
+        bOK = bOK && gmx_fio_do_real(ef->fio, fr->ener[i].e);
+
+        if (bSums)
+        {
+            tmp1 = fr->ener[i].eav;
+            bOK  = bOK && gmx_fio_do_real(ef->fio, tmp1);
+            if (bRead)
+            {
+                fr->ener[i].eav = tmp1;
+            }
+
+            /* This is to save only in single precision (unless compiled in DP) */
+            tmp2 = fr->ener[i].esum;
+            bOK  = bOK && gmx_fio_do_real(ef->fio, tmp2);
+            if (bRead)
+            {
+                fr->ener[i].esum = tmp2;
+            }
+
+            if (file_version == 1)
+            {
+                /* Old, unused real */
+                rdum = 0;
+                bOK  = bOK && gmx_fio_do_real(ef->fio, rdum);
+            }
+        }
+    }
+
+    /* Here we can not check for file_version==1, since one could have
+     * continued an old format simulation with a new one with mdrun -append.
+     */
+    if (bRead && ef->eo.bOldFileOpen)
+    {
+        /* Convert old full simulation sums to sums between energy frames */
+        convert_full_sums(&(ef->eo), fr);
+    }
+    /* read the blocks */
+    for (b = 0; b < fr->nblock; b++)
+    {
+        t_enxblock *blk = &(fr->block[b]); /* shortcut */
+
+        bSkip = (bRead &&
+                 (bSkipAll ||
+                  (ef->bSelectBlocks && blk->id >= 0 && blk->id < enxNR &&
+                   !ef->bSelectBlock[blk->id])));
+
+        /* now read the subblocks. */
+        for (s = 0; s < blk->nsub; s++)
+        {
+            t_enxsubblock *sub = &(blk->sub[s]); /* shortcut */
+
+            size = enxsubblock_file_size(sub);
+            if (bSkip && size >= 0)
+            {
+                nskip += size;
+                continue;
+            }
+            bOK   = bOK && enx_skip_bytes(ef, nskip);
+            nskip = 0;
+
+            if (bRead)
+            {
+                enxsubblock_alloc(sub);
+            }
+
+            /* read/write data */
+            bOK = do_enxsubblock(ef, sub) && bOK;
+        }
+        if (bSkip)
+        {
+            /* Signal that the data of this block has not been read */
+            blk->nsub = 0;
+        }
+    }
+    bOK = bOK && enx_skip_bytes(ef, nskip);
+
+    return bOK;
+}
+
 gmx_bool do_enx(ener_file_t ef, t_enxframe *fr)
 {
     int           file_version = -1;
     int           i, b;
-    gmx_bool      bRead, bOK, bOK1, bSane;
-    real          tmp1, tmp2, rdum;
+    gmx_bool      bRead, bOK, bSane;
     /*int       d_size;*/
 
     bOK   = TRUE;
@@ -1001,91 +1180,7 @@ gmx_bool do_enx(ener_file_t ef, t_enxframe *fr)
         fr->e_alloc = fr->nre;
     }
 
-    for (i = 0; i < fr->nre; i++)
-    {
-        bOK = bOK && gmx_fio_do_real(ef->fio, fr->ener[i].e);
-
-        /* Do not store sums of length 1,
-         * since this does not add information.
-         */
-        if (file_version == 1 ||
-            (bRead && fr->nsum > 0) || fr->nsum > 1)
-        {
-            tmp1 = fr->ener[i].eav;
-            bOK  = bOK && gmx_fio_do_real(ef->fio, tmp1);
-            if (bRead)
-            {
-                fr->ener[i].eav = tmp1;
-            }
-
-            /* This is to save only in single precision (unless compiled in DP) */
-            tmp2 = fr->ener[i].esum;
-            bOK  = bOK && gmx_fio_do_real(ef->fio, tmp2);
-            if (bRead)
-            {
-                fr->ener[i].esum = tmp2;
-            }
-
-            if (file_version == 1)
-            {
-                /* Old, unused real */
-                rdum = 0;
-                bOK  = bOK && gmx_fio_do_real(ef->fio, rdum);
-            }
-        }
-    }
-
-    /* Here we can not check for file_version==1, since one could have
-     * continued an old format simulation with a new one with mdrun -append.
-     */
-    if (bRead && ef->eo.bOldFileOpen)
-    {
-        /* Convert old full simulation sums to sums between energy frames */
-        convert_full_sums(&(ef->eo), fr);
-    }
-    /* read the blocks */
-    for (b = 0; b < fr->nblock; b++)
-    {
-        /* now read the subblocks. */
-        int nsub = fr->block[b].nsub; /* shortcut */
-        int i;
-
-        for (i = 0; i < nsub; i++)
-        {
-            t_enxsubblock *sub = &(fr->block[b].sub[i]); /* shortcut */
-
-            if (bRead)
-            {
-                enxsubblock_alloc(sub);
-            }
-
-            /* read/write data */
-            switch (sub->type)
-            {
-                case xdr_datatype_float:
-                    bOK1 = gmx_fio_ndo_float(ef->fio, sub->fval, sub->nr);
-                    break;
-                case xdr_datatype_double:
-                    bOK1 = gmx_fio_ndo_double(ef->fio, sub->dval, sub->nr);
-                    break;
-                case xdr_datatype_int:
-                    bOK1 = gmx_fio_ndo_int(ef->fio, sub->ival, sub->nr);
-                    break;
-                case xdr_datatype_int64:
-                    bOK1 = gmx_fio_ndo_int64(ef->fio, sub->lval, sub->nr);
-                    break;
-                case xdr_datatype_char:
-                    bOK1 = gmx_fio_ndo_uchar(ef->fio, sub->cval, sub->nr);
-                    break;
-                case xdr_datatype_string:
-                    bOK1 = gmx_fio_ndo_string(ef->fio, sub->sval, sub->nr);
-                    break;
-                default:
-                    gmx_incons("Reading unknown block data type: this file is corrupted or from the future");
-            }
-            bOK = bOK && bOK1;
-        }
-    }
+    bOK = do_enx_data(ef, fr, file_version, FALSE);
 
     if (!bRead)
     {
@@ -1114,6 +1209,133 @@ gmx_bool do_enx(ener_file_t ef, t_enxframe *fr)
     return TRUE;
 }
 
+void enx_select_terms(ener_file_t ef, int nre, const gmx_bool *bSelect)
+{
+    int i;
+
+    sfree(ef->bSelectTerm);
+    ef->bSelectTerm = NULL;
+    ef->nre_select  = 0;
+    if (bSelect != NULL)
+    {
+        snew(ef->bSelectTerm, nre);
+        for (i = 0; i < nre; i++)
+        {
+            ef->bSelectTerm[i] = bSelect[i];
+        }
+        ef->nre_select = nre;
+    }
+}
+
+void enx_select_blocks(ener_file_t ef, const gmx_bool *bSelect)
+{
+    int i;
+
+    ef->bSelectBlocks = (bSelect != NULL);
+    for (i = 0; i < enxNR; i++)
+    {
+        ef->bSelectBlock[i] = (bSelect == NULL || bSelect[i]);
+    }
+}
+
+gmx_bool build_enx_index(ener_file_t ef, t_enxindex *index)
+{
+    t_enxframe *fr;
+    FILE       *fp;
+    gmx_off_t   start, offset, fsize;
+    int         file_version = -1;
+    gmx_bool    bOK          = TRUE;
+
+    index->nframes = 0;
+    index->nalloc  = 0;
+    index->offset  = NULL;
+    index->t       = NULL;
+    index->step    = NULL;
+
+    if (ef->eo.bOldFileOpen)
+    {
+        /* The energy sums in old files are converted using the previous
+         * frame, so we can not start reading at an arbitrary frame.
+         */
+        return FALSE;
+    }
+
+    /* Seeking does not fail beyond the end of the file,
+     * so we need the file size to detect an incomplete last frame.
+     */
+    start = gmx_fio_ftell(ef->fio);
+    fp    = gmx_fio_getfp(ef->fio);
+    gmx_fseek(fp, 0, SEEK_END);
+    fsize = gmx_ftell(fp);
+    gmx_fio_seek(ef->fio, start);
+
+    snew(fr, 1);
+    init_enxframe(fr);
+    offset = start;
+    while (do_eheader(ef, &file_version, fr, -1, NULL, &bOK) &&
+           do_enx_data(ef, fr, file_version, TRUE) &&
+           gmx_fio_ftell(ef->fio) <= fsize)
+    {
+        if (index->nframes >= index->nalloc)
+        {
+            index->nalloc = over_alloc_large(index->nframes + 1);
+            srenew(index->offset, index->nalloc);
+            srenew(index->t, index->nalloc);
+            srenew(index->step, index->nalloc);
+        }
+        index->offset[index->nframes] = offset;
+        index->t[index->nframes]      = fr->t;
+        index->step[index->nframes]   = fr->step;
+        index->nframes++;
+
+        offset = gmx_fio_ftell(ef->fio);
+    }
+    free_enxframe(fr);
+    sfree(fr);
+
+    gmx_fio_seek(ef->fio, start);
+
+    return TRUE;
+}
+
+void free_enx_index(t_enxindex *index)
+{
+    sfree(index->offset);
+    sfree(index->t);
+    sfree(index->step);
+    index->nframes = 0;
+    index->nalloc  = 0;
+}
+
+int enx_index_find_time(const t_enxindex *index, double t)
+{
+    int f;
+
+    /* Times need not be monotonic in appended or concatenated files,
+     * so we do not use bisection.
+     */
+    f = 0;
+    while (f < index->nframes && index->t[f] < t)
+    {
+        f++;
+    }
+
+    return f;
+}
+
+void seek_enx_frame(ener_file_t ef, const t_enxindex *index, int frame)
+{
+    if (frame < 0 || frame >= index->nframes)
+    {
+        gmx_incons("Seeking to a frame outside the energy file index");
+    }
+    if (gmx_fio_seek(ef->fio, index->offset[frame]) != 0)
+    {
+        gmx_file("Cannot seek in energy file");
+    }
+    ef->framenr = frame;
+}
+
 static real find_energy(const char *name, int nre, gmx_enxnm_t *enm,
                         t_enxframe *fr)
 {
@@ -41,6 +41,7 @@
 #include "gromacs/legacyheaders/types/energy.h"
 #include "gromacs/legacyheaders/types/inputrec.h"
 #include "gromacs/legacyheaders/types/state.h"
+#include "gromacs/utility/futil.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -149,6 +150,15 @@ typedef struct {
 /* file handle */
 typedef struct ener_file *ener_file_t;
 
+/* Random-access index of the frames in an energy file */
+typedef struct {
+    int          nframes;      /* Number of complete frames in the file         */
+    gmx_off_t   *offset;       /* File offset of the header of each frame       */
+    double      *t;            /* Time of each frame                            */
+    gmx_int64_t *step;         /* Step of each frame                            */
+    int          nalloc;       /* Allocation size of the arrays                 */
+} t_enxindex;
+
 /*
  * An energy file is read like this:
  *
@@ -187,6 +197,46 @@ void free_enxnms(int n, gmx_enxnm_t *nms);
 gmx_bool do_enx(ener_file_t ef, t_enxframe *fr);
 /* Reads enx_frames, memory in fr is (re)allocated if necessary */
 
+void enx_select_terms(ener_file_t ef, int nre, const gmx_bool *bSelect);
+/* Only read the energy terms i with bSelect[i] set in subsequent calls
+ * to do_enx(), the data of the other terms is skipped in the file
+ * and their values in the frame are not updated.
+ * nre should be the number of terms returned by do_enxnms(),
+ * frames with a different number of terms are read completely.
+ * Passing bSelect=NULL reads all terms again.
+ * The selection is ignored for pre-4.1 files, since their sums
+ * can only be converted with all terms present.
+ */
+
+void enx_select_blocks(ener_file_t ef, const gmx_bool *bSelect);
+/* Only read the blocks with id i < enxNR that have bSelect[i] set
+ * in subsequent calls to do_enx(). Unselected blocks are skipped
+ * in the file and returned with nsub=0. Blocks with ids unknown
+ * to this code are always read. bSelect=NULL reads all blocks again.
+ */
+
+gmx_bool build_enx_index(ener_file_t ef, t_enxindex *index);
+/* Scans the frame headers from the current file position, which should
+ * be directly after do_enxnms(), to the end of the file without
+ * decoding the energies and blocks, and stores the frame offsets
+ * in index. The file position is restored afterwards.
+ * Returns FALSE when the file can not be indexed, i.e. for pre-4.1
+ * files where the energy sums of a frame depend on the previous frame.
+ */
+
+void free_enx_index(t_enxindex *index);
+/* Frees the memory in index (except index itself) */
+
+int enx_index_find_time(const t_enxindex *index, double t);
+/* Returns the first frame in index with time >= t,
+ * or index->nframes when there is no such frame.
+ */
+
+void seek_enx_frame(ener_file_t ef, const t_enxindex *index, int frame);
+/* Positions ef such that the next call to do_enx() reads frame
+ * number frame of index, 0 <= frame < index->nframes.
+ */
+
 void get_enx_state(const char *fn, real t,
                    struct gmx_groups_t *groups, t_inputrec *ir,
                    t_state *state);
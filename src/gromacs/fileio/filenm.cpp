@@ -165,6 +165,7 @@ static const t_deffile
     { eftXDR, ".mtx", "hessian", "-m", "Hessian matrix"},
     { eftASC, ".edi", "sam",    NULL, "ED sampling input"},
     { eftASC, ".cub", "pot",  NULL, "Gaussian cube file" },
+    { eftXDR, ".mrc", "map", NULL, "Binary MRC/CCP4 volume map" },
     { eftASC, ".xpm", "root", NULL, "X PixMap compatible matrix file" },
     { eftASC, "", "rundir", NULL, "Run directory" }
 };
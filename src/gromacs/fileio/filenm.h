@@ -61,7 +61,7 @@ enum GromacsFileType {
     efMAP, efEPS, efMAT, efM2P,
     efMTX,
     efEDI,
-    efCUB,
+    efCUB, efMRC,
     efXPM,
     efRND,
     efNR
@@ -38,11 +38,24 @@
 
 #include "cmat.h"
 
+#include "config.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
 #include <algorithm>
 
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "gromacs/fileio/matio.h"
 #include "gromacs/fileio/xvgr.h"
 #include "gromacs/math/vec.h"
+#include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/futil.h"
 #include "gromacs/utility/smalloc.h"
 
@@ -66,6 +79,71 @@ t_mat *init_mat(int n1, gmx_bool b1D)
     return m;
 }
 
+t_mat *init_mat_compact(int n1, real maxval, const char *fn)
+{
+    t_mat      *m;
+    gmx_int64_t nelem;
+
+    snew(m, 1);
+    m->n1     = n1;
+    m->nn     = 0;
+    m->b1D    = FALSE;
+    m->maxrms = 0;
+    m->minrms = 1e20;
+    m->sumrms = 0;
+    m->mat    = NULL;
+    m->cscale = (maxval > 0 ? maxval : 1)/USHRT_MAX;
+
+    nelem     = std::max(static_cast<gmx_int64_t>(n1)*(n1 - 1)/2,
+                         static_cast<gmx_int64_t>(1));
+    if (fn != NULL)
+    {
+#ifdef HAVE_SYS_MMAN_H
+        size_t nbytes = nelem*sizeof(*m->cmat);
+        int    fd;
+        void  *p;
+
+        fd = open(fn, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0)
+        {
+            gmx_fatal(FARGS, "Could not create the matrix file %s: %s",
+                      fn, std::strerror(errno));
+        }
+        if (ftruncate(fd, nbytes) != 0)
+        {
+            gmx_fatal(FARGS, "Could not resize the matrix file %s to %g GB: %s",
+                      fn, nbytes/1e9, std::strerror(errno));
+        }
+        p = mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            gmx_fatal(FARGS, "Could not memory-map the matrix file %s: %s",
+                      fn, std::strerror(errno));
+        }
+        close(fd);
+        /* The mapping stays valid and the disk space is released when
+         * it is unmapped, also when we do not exit normally.
+         */
+        unlink(fn);
+        m->cmat    = static_cast<unsigned short *>(p);
+        m->cmapped = nbytes;
+#else
+        fprintf(stderr, "NOTE: Memory-mapped files are not supported on this system,\n"
+                "      the matrix is kept in memory instead of in %s\n", fn);
+#endif
+    }
+    if (m->cmat == NULL)
+    {
+        snew(m->cmat, nelem);
+    }
+
+    snew(m->erow, n1);
+    snew(m->m_ind, n1);
+    reset_index(m);
+
+    return m;
+}
+
 void copy_t_mat(t_mat *dst, t_mat *src)
 {
     int i, j;
@@ -127,7 +205,23 @@ void reset_index(t_mat *m)
 
 void set_mat_entry(t_mat *m, int i, int j, real val)
 {
-    m->mat[i][j] = m->mat[j][i] = val;
+    if (m->cmat != NULL)
+    {
+        if (i != j)
+        {
+            int         ii  = std::min(i, j);
+            int         jj  = std::max(i, j);
+            gmx_int64_t idx = static_cast<gmx_int64_t>(ii)*(2*m->n1 - ii - 1)/2 + (jj - ii - 1);
+            real        q   = val/m->cscale + 0.5;
+
+            m->cmat[idx]    = (q >= USHRT_MAX ? USHRT_MAX :
+                               (q <= 0 ? 0 : static_cast<unsigned short>(q)));
+        }
+    }
+    else
+    {
+        m->mat[i][j] = m->mat[j][i] = val;
+    }
     m->maxrms    = std::max(m->maxrms, val);
     if (j != i)
     {
@@ -139,7 +233,23 @@ void set_mat_entry(t_mat *m, int i, int j, real val)
 
 void done_mat(t_mat **m)
 {
-    done_matrix((*m)->n1, &((*m)->mat));
+    if ((*m)->cmat != NULL)
+    {
+#ifdef HAVE_SYS_MMAN_H
+        if ((*m)->cmapped > 0)
+        {
+            munmap((*m)->cmat, (*m)->cmapped);
+        }
+        else
+#endif
+        {
+            sfree((*m)->cmat);
+        }
+    }
+    else
+    {
+        done_matrix((*m)->n1, &((*m)->mat));
+    }
     sfree((*m)->m_ind);
     sfree((*m)->erow);
     sfree(*m);
@@ -153,7 +263,7 @@ real mat_energy(t_mat *m)
 
     for (j = 0; (j < m->nn-1); j++)
     {
-        emat += sqr(m->mat[j][j+1]);
+        emat += sqr(get_mat_entry(m, j, j+1));
     }
     return emat;
 }
@@ -238,7 +348,37 @@ void low_rmsd_dist(const char *fn, real maxrms, int nn, real **mat,
 
 void rmsd_distribution(const char *fn, t_mat *rms, const output_env_t oenv)
 {
-    low_rmsd_dist(fn, rms->maxrms, rms->nn, rms->mat, oenv);
+    FILE *fp;
+    int   i, j, *histo, x;
+    real  fac;
+
+    if (rms->cmat == NULL)
+    {
+        low_rmsd_dist(fn, rms->maxrms, rms->nn, rms->mat, oenv);
+        return;
+    }
+
+    /* Stream over the packed upper triangle */
+    fac = 100/rms->maxrms;
+    snew(histo, 101);
+    for (i = 0; i < rms->nn; i++)
+    {
+        for (j = i+1; j < rms->nn; j++)
+        {
+            x = static_cast<int>(fac*get_mat_entry(rms, i, j)+0.5);
+            if (x <= 100)
+            {
+                histo[x]++;
+            }
+        }
+    }
+    fp = xvgropen(fn, "RMS Distribution", "RMS (nm)", "a.u.", oenv);
+    for (i = 0; (i < 101); i++)
+    {
+        fprintf(fp, "%10g  %10d\n", i/fac, histo[i]);
+    }
+    xvgrclose(fp);
+    sfree(histo);
 }
 
 t_clustid *new_clustid(int n1)
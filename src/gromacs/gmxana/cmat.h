@@ -55,12 +55,16 @@ typedef struct {
 } t_clustid;
 
 typedef struct {
-    int      n1, nn;
-    int     *m_ind;
-    gmx_bool b1D;
-    real     minrms, maxrms, sumrms;
-    real    *erow;
-    real   **mat;
+    int             n1, nn;
+    int            *m_ind;
+    gmx_bool        b1D;
+    real            minrms, maxrms, sumrms;
+    real           *erow;
+    real          **mat;
+    /* Compact storage, used instead of mat when not NULL */
+    unsigned short *cmat;    /* Quantized upper triangle, packed by rows */
+    real            cscale;  /* Value of one quantization step */
+    gmx_int64_t     cmapped; /* Size in bytes of the file mapping, 0 if none */
 } t_mat;
 
 /* The matrix is indexed using the matrix index */
@@ -68,6 +72,43 @@ typedef struct {
 
 extern t_mat *init_mat(int n1, gmx_bool b1D);
 
+extern t_mat *init_mat_compact(int n1, real maxval, const char *fn);
+/* Returns a symmetric n1 x n1 matrix that stores only the upper triangle,
+ * quantized to 16 bits over the range [0,maxval]; values above maxval
+ * are stored as maxval. This needs a quarter of the memory of init_mat,
+ * with a resolution of maxval/65535.
+ * When fn!=NULL, the storage is a memory-mapped file fn, so that the
+ * matrix does not need to fit in memory. The file is removed directly
+ * after mapping it; its disk space is released by done_mat.
+ * Of the functions below, only set_mat_entry, get_mat_entry,
+ * mat_energy, rmsd_distribution and done_mat support compact matrices.
+ */
+
+/* Returns element (i,j) of a dense or compact matrix */
+static gmx_inline real get_mat_entry(const t_mat *m, int i, int j)
+{
+    int         k;
+    gmx_int64_t idx;
+
+    if (m->cmat == NULL)
+    {
+        return m->mat[i][j];
+    }
+    if (i == j)
+    {
+        return 0;
+    }
+    if (i > j)
+    {
+        k = i;
+        i = j;
+        j = k;
+    }
+    idx = ((gmx_int64_t)i)*(2*m->n1 - i - 1)/2 + (j - i - 1);
+
+    return m->cmat[idx]*m->cscale;
+}
+
 extern void copy_t_mat(t_mat *dst, t_mat *src);
 
 extern void enlarge_mat(t_mat *m, int deltan);
@@ -0,0 +1,721 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+#include "gmxpre.h"
+
+#include "densgrid.h"
+
+#include "config.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+
+#include "gromacs/math/vec.h"
+#include "gromacs/utility/fatalerror.h"
+#include "gromacs/utility/futil.h"
+#include "gromacs/utility/gmxomp.h"
+#include "gromacs/utility/smalloc.h"
+
+/* Conversion factor to compensate for the VMD plugin conversion of cube files */
+static const double bohr = 0.529177249;
+
+/* Maximum memory in bytes for the thread-local copies of a grid, above
+ * this the threads spread onto a single grid with atomic updates.
+ */
+static const gmx_int64_t c_maxThreadGridBytes = 1024*1024*1024LL;
+
+/* The number of points for which grid coordinates are computed at once */
+#define DENSGRID_BLOCK 64
+
+struct t_densgrid_thread {
+    double      *grid;     /* Thread-local grid, NULL when spreading on g->grid */
+    gmx_int64_t  nout;     /* Number of points outside the grid */
+    int          nw_alloc; /* Allocation size of k and w */
+    int         *k[DIM];   /* Cell indices along each dimension for a point */
+    real        *w[DIM];   /* Spreading weights along each dimension */
+    /* Padding to avoid false sharing between threads */
+    char         pad[64];
+};
+
+t_densgrid *init_densgrid(int ndim, const int n[], const int axis[],
+                          const gmx_bool bPeriodic[], int spread, real sigma)
+{
+    t_densgrid *g;
+    int         d, t;
+
+    if (ndim < 1 || ndim > DIM)
+    {
+        gmx_incons("Density grids should have one to three dimensions");
+    }
+    if (spread == edgsGAUSS && sigma <= 0)
+    {
+        gmx_fatal(FARGS, "The width of the Gaussian should be larger than zero");
+    }
+
+    snew(g, 1);
+    g->ndim   = ndim;
+    g->spread = spread;
+    g->sigma  = sigma;
+    g->ncell  = 1;
+    for (d = 0; d < DIM; d++)
+    {
+        if (d < ndim)
+        {
+            if (n[d] <= 0)
+            {
+                gmx_fatal(FARGS, "The number of grid cells (%d) should be positive", n[d]);
+            }
+            g->n[d]         = n[d];
+            g->axis[d]      = axis[d];
+            g->bPeriodic[d] = bPeriodic[d];
+        }
+        else
+        {
+            g->n[d]         = 1;
+            g->axis[d]      = 0;
+            g->bPeriodic[d] = TRUE;
+        }
+        g->ncell *= g->n[d];
+    }
+    snew(g->grid, g->ncell);
+
+    g->nthreads = gmx_omp_get_max_threads();
+    g->bShared  = (g->nthreads == 1 ||
+                   g->nthreads*g->ncell*static_cast<gmx_int64_t>(sizeof(double)) > c_maxThreadGridBytes);
+    snew(g->th, g->nthreads);
+    for (t = 0; t < g->nthreads; t++)
+    {
+        /* The thread-local grids are allocated zeroed and only touched
+         * by their own threads, which places them in local memory.
+         */
+        if (!g->bShared)
+        {
+            snew(g->th[t].grid, g->ncell);
+        }
+    }
+
+    return g;
+}
+
+static void densgrid_alloc_weights(t_densgrid_thread *th, int nw)
+{
+    int d;
+
+    if (nw > th->nw_alloc)
+    {
+        th->nw_alloc = nw;
+        for (d = 0; d < DIM; d++)
+        {
+            srenew(th->k[d], th->nw_alloc);
+            srenew(th->w[d], th->nw_alloc);
+        }
+    }
+}
+
+/* Adds the weights of one point for the cells k[d][0..nw[d]) along
+ * each dimension to the grid, zero weights are out of the grid.
+ */
+static gmx_inline void scatter_point(double *grid, gmx_bool bAtomic,
+                                     const int n[], const int nw[],
+                                     int *const k[], real *const w[],
+                                     real weight)
+{
+    int         j0, j1, j2;
+    gmx_int64_t c0, c1, c;
+    double      w0, w1, wc;
+
+    for (j0 = 0; j0 < nw[XX]; j0++)
+    {
+        if (w[XX][j0] == 0)
+        {
+            continue;
+        }
+        c0 = k[XX][j0];
+        w0 = weight*w[XX][j0];
+        for (j1 = 0; j1 < nw[YY]; j1++)
+        {
+            if (w[YY][j1] == 0)
+            {
+                continue;
+            }
+            c1 = c0*n[YY] + k[YY][j1];
+            w1 = w0*w[YY][j1];
+            for (j2 = 0; j2 < nw[ZZ]; j2++)
+            {
+                if (w[ZZ][j2] == 0)
+                {
+                    continue;
+                }
+                c  = c1*n[ZZ] + k[ZZ][j2];
+                wc = w1*w[ZZ][j2];
+                if (bAtomic)
+                {
+#pragma omp atomic
+                    grid[c] += wc;
+                }
+                else
+                {
+                    grid[c] += wc;
+                }
+            }
+        }
+    }
+}
+
+/* Sets the cells and weights for linear spreading along one dimension,
+ * returns FALSE when the point is outside a non-periodic grid.
+ */
+static gmx_inline gmx_bool linear_weights(real u, int n, gmx_bool bPeriodic,
+                                          int *k, real *w)
+{
+    real v, f;
+    int  j, k0;
+
+    /* Interpolate between the two nearest cell centers */
+    v    = u - 0.5;
+    k0   = static_cast<int>(std::floor(v));
+    f    = v - k0;
+    w[0] = 1 - f;
+    w[1] = f;
+    for (j = 0; j < 2; j++)
+    {
+        k[j] = k0 + j;
+        if (bPeriodic)
+        {
+            k[j] = (k[j] < 0 ? k[j] + n : (k[j] >= n ? k[j] - n : k[j]));
+        }
+        else if (k[j] < 0 || k[j] >= n)
+        {
+            k[j] = 0;
+            w[j] = 0;
+        }
+    }
+
+    return (bPeriodic || (u >= 0 && u < n));
+}
+
+/* Sets the cells and weights for Gaussian spreading with width s in grid
+ * units along one dimension, returns the number of cells, negative when
+ * the point is outside a non-periodic grid.
+ */
+static int gauss_weights(real u, real s, int n, gmx_bool bPeriodic,
+                         int *k, real *w)
+{
+    int    kmin, kmax, nw, j;
+    real   inv2s2, dx;
+    double wsum;
+
+    kmin   = static_cast<int>(std::floor(u - DENSGRID_GAUSS_CUTOFF*s));
+    kmax   = static_cast<int>(std::floor(u + DENSGRID_GAUSS_CUTOFF*s));
+    nw     = kmax - kmin + 1;
+    inv2s2 = 0.5/(s*s);
+    wsum   = 0;
+    for (j = 0; j < nw; j++)
+    {
+        dx    = kmin + j + 0.5 - u;
+        w[j]  = std::exp(-inv2s2*dx*dx);
+        wsum += w[j];
+    }
+    if (wsum > 0)
+    {
+        for (j = 0; j < nw; j++)
+        {
+            w[j] /= wsum;
+        }
+    }
+    else
+    {
+        /* The Gaussian is much narrower than a cell */
+        kmin = static_cast<int>(std::floor(u));
+        nw   = 1;
+        w[0] = 1;
+    }
+    for (j = 0; j < nw; j++)
+    {
+        k[j] = kmin + j;
+        if (bPeriodic)
+        {
+            k[j] -= n*static_cast<int>(std::floor(k[j]/static_cast<real>(n)));
+        }
+        else if (k[j] < 0 || k[j] >= n)
+        {
+            k[j] = 0;
+            w[j] = 0;
+        }
+    }
+
+    return (bPeriodic || (u >= 0 && u < n)) ? nw : -nw;
+}
+
+void spread_densgrid(t_densgrid *g, int thread,
+                     const real origin[], const real invspacing[],
+                     int nr, const atom_id *index, const rvec x[],
+                     const real *weight, real scale)
+{
+    t_densgrid_thread *th;
+    double            *grid;
+    gmx_bool           bAtomic;
+    real               u[DIM][DENSGRID_BLOCK], wb[DENSGRID_BLOCK];
+    int                kb[DIM][DENSGRID_BLOCK];
+    real               nreal[DIM], s[DIM], margin[DIM];
+    int                nw[DIM], ndim, d, a, i0, nb, b, nwmax, nwd;
+    gmx_int64_t        c;
+    gmx_bool           bIn;
+
+    if (thread < 0 || thread >= g->nthreads)
+    {
+        gmx_incons("Spreading onto a density grid from an unknown thread");
+    }
+    th      = &g->th[thread];
+    grid    = (g->bShared ? g->grid : th->grid);
+    bAtomic = (g->bShared && g->nthreads > 1);
+    ndim    = g->ndim;
+
+    nwmax = 2;
+    for (d = 0; d < DIM; d++)
+    {
+        nreal[d] = g->n[d];
+        s[d]     = 0;
+        if (d < ndim && g->spread == edgsGAUSS)
+        {
+            s[d]  = g->sigma*invspacing[d];
+            nwmax = std::max(nwmax, 2*static_cast<int>(std::ceil(DENSGRID_GAUSS_CUTOFF*s[d])) + 2);
+        }
+        /* Points further than this outside the grid do not contribute */
+        margin[d] = 2 + DENSGRID_GAUSS_CUTOFF*s[d];
+    }
+    densgrid_alloc_weights(th, nwmax);
+    for (d = ndim; d < DIM; d++)
+    {
+        nw[d]       = 1;
+        th->k[d][0] = 0;
+        th->w[d][0] = 1;
+    }
+
+    for (i0 = 0; i0 < nr; i0 += DENSGRID_BLOCK)
+    {
+        nb = std::min(DENSGRID_BLOCK, nr - i0);
+
+        /* Compute the grid coordinates of the block, branch-free such that
+         * the compiler can vectorize the loops.
+         */
+        for (d = 0; d < ndim; d++)
+        {
+            const real o  = origin[d];
+            const real is = invspacing[d];
+            const real nd = nreal[d];
+            const real lo = -margin[d];
+            const real hi = nd + margin[d];
+
+            a = g->axis[d];
+            if (index != NULL)
+            {
+                for (b = 0; b < nb; b++)
+                {
+                    u[d][b] = (x[index[i0 + b]][a] - o)*is;
+                }
+            }
+            else
+            {
+                for (b = 0; b < nb; b++)
+                {
+                    u[d][b] = (x[i0 + b][a] - o)*is;
+                }
+            }
+            if (g->bPeriodic[d])
+            {
+                for (b = 0; b < nb; b++)
+                {
+                    u[d][b] -= nd*std::floor(u[d][b]/nd);
+                }
+            }
+            else
+            {
+                /* Limit the range, such that the conversion to int is safe */
+                for (b = 0; b < nb; b++)
+                {
+                    u[d][b] = std::min(std::max(u[d][b], lo), hi);
+                }
+            }
+            for (b = 0; b < nb; b++)
+            {
+                kb[d][b] = static_cast<int>(std::floor(u[d][b]));
+            }
+        }
+        if (weight == NULL)
+        {
+            for (b = 0; b < nb; b++)
+            {
+                wb[b] = scale;
+            }
+        }
+        else if (index != NULL)
+        {
+            for (b = 0; b < nb; b++)
+            {
+                wb[b] = scale*weight[index[i0 + b]];
+            }
+        }
+        else
+        {
+            for (b = 0; b < nb; b++)
+            {
+                wb[b] = scale*weight[i0 + b];
+            }
+        }
+
+        /* Scatter the weights onto the grid */
+        switch (g->spread)
+        {
+            case edgsNGP:
+                for (b = 0; b < nb; b++)
+                {
+                    c   = 0;
+                    bIn = TRUE;
+                    for (d = 0; d < ndim; d++)
+                    {
+                        if (kb[d][b] < 0 || kb[d][b] >= g->n[d])
+                        {
+                            if (g->bPeriodic[d])
+                            {
+                                /* Only when rounding gave exactly n */
+                                kb[d][b] = 0;
+                            }
+                            else
+                            {
+                                bIn = FALSE;
+                            }
+                        }
+                        c = c*g->n[d] + kb[d][b];
+                    }
+                    if (!bIn)
+                    {
+                        th->nout++;
+                    }
+                    else if (bAtomic)
+                    {
+#pragma omp atomic
+                        grid[c] += wb[b];
+                    }
+                    else
+                    {
+                        grid[c] += wb[b];
+                    }
+                }
+                break;
+            case edgsLINEAR:
+                for (b = 0; b < nb; b++)
+                {
+                    bIn = TRUE;
+                    for (d = 0; d < ndim; d++)
+                    {
+                        nw[d] = 2;
+                        bIn   = linear_weights(u[d][b], g->n[d], g->bPeriodic[d],
+                                               th->k[d], th->w[d]) && bIn;
+                    }
+                    if (!bIn)
+                    {
+                        th->nout++;
+                    }
+                    scatter_point(grid, bAtomic, g->n, nw, th->k, th->w, wb[b]);
+                }
+                break;
+            case edgsGAUSS:
+                for (b = 0; b < nb; b++)
+                {
+                    bIn = TRUE;
+                    for (d = 0; d < ndim; d++)
+                    {
+                        nwd = gauss_weights(u[d][b], s[d], g->n[d], g->bPeriodic[d],
+                                            th->k[d], th->w[d]);
+                        if (nwd < 0)
+                        {
+                            bIn = FALSE;
+                            nwd = -nwd;
+                        }
+                        nw[d] = nwd;
+                    }
+                    if (!bIn)
+                    {
+                        th->nout++;
+                    }
+                    scatter_point(grid, bAtomic, g->n, nw, th->k, th->w, wb[b]);
+                }
+                break;
+            default:
+                gmx_incons("Unknown density grid spreading scheme");
+        }
+    }
+}
+
+void reduce_densgrid(t_densgrid *g)
+{
+    gmx_int64_t c;
+    int         t;
+
+    if (g->bShared)
+    {
+        return;
+    }
+
+#pragma omp parallel for num_threads(g->nthreads) schedule(static) private(t)
+    for (c = 0; c < g->ncell; c++)
+    {
+        double sum = 0;
+        for (t = 0; t < g->nthreads; t++)
+        {
+            sum               += g->th[t].grid[c];
+            g->th[t].grid[c]   = 0;
+        }
+        g->grid[c] += sum;
+    }
+}
+
+gmx_int64_t densgrid_nr_outside(const t_densgrid *g)
+{
+    gmx_int64_t nout;
+    int         t;
+
+    nout = 0;
+    for (t = 0; t < g->nthreads; t++)
+    {
+        nout += g->th[t].nout;
+    }
+
+    return nout;
+}
+
+void done_densgrid(t_densgrid *g)
+{
+    int t, d;
+
+    for (t = 0; t < g->nthreads; t++)
+    {
+        sfree(g->th[t].grid);
+        for (d = 0; d < DIM; d++)
+        {
+            sfree(g->th[t].k[d]);
+            sfree(g->th[t].w[d]);
+        }
+    }
+    sfree(g->th);
+    sfree(g->grid);
+    sfree(g);
+}
+
+void init_frame_batch(t_frame_batch *fb, int nalloc, int natoms)
+{
+    int f;
+
+    fb->nalloc  = nalloc;
+    fb->nframes = 0;
+    fb->natoms  = natoms;
+    snew(fb->x, nalloc);
+    for (f = 0; f < nalloc; f++)
+    {
+        snew(fb->x[f], natoms);
+    }
+    snew(fb->box, nalloc);
+    snew(fb->t, nalloc);
+}
+
+gmx_bool add_frame_batch(t_frame_batch *fb, real t, const matrix box,
+                         const atom_id *index, const rvec x[])
+{
+    int i;
+
+    if (fb->nframes >= fb->nalloc)
+    {
+        gmx_incons("Adding a frame to a full frame batch");
+    }
+    if (index != NULL)
+    {
+        for (i = 0; i < fb->natoms; i++)
+        {
+            copy_rvec(x[index[i]], fb->x[fb->nframes][i]);
+        }
+    }
+    else
+    {
+        std::memcpy(fb->x[fb->nframes], x, fb->natoms*sizeof(rvec));
+    }
+    copy_mat(box, fb->box[fb->nframes]);
+    fb->t[fb->nframes] = t;
+    fb->nframes++;
+
+    return (fb->nframes == fb->nalloc);
+}
+
+void done_frame_batch(t_frame_batch *fb)
+{
+    int f;
+
+    for (f = 0; f < fb->nalloc; f++)
+    {
+        sfree(fb->x[f]);
+    }
+    sfree(fb->x);
+    sfree(fb->box);
+    sfree(fb->t);
+}
+
+void write_densgrid_cube(const char *fn, const char *title, const char *comment,
+                         int nat, const int *atomnr, const rvec xat[],
+                         const double origin[], double spacing,
+                         const int n[], const double *data, double scale)
+{
+    FILE *fp;
+    int   i, j, k;
+
+    fp = gmx_ffopen(fn, "w");
+    fprintf(fp, "%s\n", title);
+    fprintf(fp, "%s\n", comment);
+    fprintf(fp, "%5d%12.6f%12.6f%12.6f\n", nat,
+            origin[XX]*10./bohr, origin[YY]*10./bohr, origin[ZZ]*10./bohr);
+    fprintf(fp, "%5d%12.6f%12.6f%12.6f\n", n[XX], spacing*10./bohr, 0., 0.);
+    fprintf(fp, "%5d%12.6f%12.6f%12.6f\n", n[YY], 0., spacing*10./bohr, 0.);
+    fprintf(fp, "%5d%12.6f%12.6f%12.6f\n", n[ZZ], 0., 0., spacing*10./bohr);
+    for (i = 0; i < nat; i++)
+    {
+        fprintf(fp, "%5d%12.6f%12.6f%12.6f%12.6f\n", atomnr[i], 0.,
+                xat[i][XX]*10./bohr, xat[i][YY]*10./bohr, xat[i][ZZ]*10./bohr);
+    }
+    for (i = 0; i < n[XX]; i++)
+    {
+        for (j = 0; j < n[YY]; j++)
+        {
+            for (k = 0; k < n[ZZ]; k++)
+            {
+                fprintf(fp, "%12.6f ", scale*data[(static_cast<gmx_int64_t>(i)*n[YY] + j)*n[ZZ] + k]);
+            }
+            fprintf(fp, "\n");
+        }
+        fprintf(fp, "\n");
+    }
+    gmx_ffclose(fp);
+}
+
+/* Stores a 32-bit int or float at word w (counting from 1) of an MRC header */
+static void mrc_set_int(char *header, int w, gmx_int32_t i)
+{
+    std::memcpy(header + 4*(w - 1), &i, sizeof(i));
+}
+
+static void mrc_set_float(char *header, int w, float f)
+{
+    std::memcpy(header + 4*(w - 1), &f, sizeof(f));
+}
+
+void write_densgrid_mrc(const char *fn, const char *label,
+                        const double origin[], double spacing,
+                        const int n[], const double *data, double scale)
+{
+    FILE       *fp;
+    char        header[1024];
+    float      *row;
+    double      v, dmin, dmax, sum, sum2, mean;
+    gmx_int64_t c, ncell;
+    int         i, j, k, d;
+
+    ncell = static_cast<gmx_int64_t>(n[XX])*n[YY]*n[ZZ];
+    dmin  = 0;
+    dmax  = 0;
+    sum   = 0;
+    sum2  = 0;
+    for (c = 0; c < ncell; c++)
+    {
+        v     = scale*data[c];
+        dmin  = (c == 0 || v < dmin) ? v : dmin;
+        dmax  = (c == 0 || v > dmax) ? v : dmax;
+        sum  += v;
+        sum2 += v*v;
+    }
+    mean = (ncell > 0 ? sum/ncell : 0);
+
+    /* The header of the MRC 2014 format, with lengths in Angstrom */
+    std::memset(header, 0, sizeof(header));
+    for (d = 0; d < DIM; d++)
+    {
+        mrc_set_int(header, 1 + d, n[d]);              /* NX, NY, NZ */
+        mrc_set_int(header, 8 + d, n[d]);              /* MX, MY, MZ */
+        mrc_set_float(header, 11 + d, n[d]*spacing*10);
+        mrc_set_float(header, 14 + d, 90);
+        mrc_set_int(header, 17 + d, 1 + d);            /* MAPC, MAPR, MAPS */
+        mrc_set_float(header, 50 + d, origin[d]*10);
+    }
+    mrc_set_int(header, 4, 2);                         /* 32-bit floats */
+    mrc_set_float(header, 20, dmin);
+    mrc_set_float(header, 21, dmax);
+    mrc_set_float(header, 22, mean);
+    mrc_set_int(header, 23, 1);                        /* Space group P1 */
+    mrc_set_int(header, 28, 20140);                    /* NVERSION */
+    std::memcpy(header + 4*52, "MAP ", 4);
+#if GMX_INTEGER_BIG_ENDIAN
+    header[4*53]     = 0x11;
+    header[4*53 + 1] = 0x11;
+#else
+    header[4*53]     = 0x44;
+    header[4*53 + 1] = 0x44;
+#endif
+    mrc_set_float(header, 55, std::sqrt(std::max(sum2/std::max(ncell, static_cast<gmx_int64_t>(1)) - mean*mean, 0.0)));
+    mrc_set_int(header, 56, 1);                        /* One label */
+    std::strncpy(header + 4*56, label, 80);
+
+    fp = gmx_ffopen(fn, "wb");
+    if (fwrite(header, 1, sizeof(header), fp) != sizeof(header))
+    {
+        gmx_file(fn);
+    }
+    /* The map is stored with x running fastest */
+    snew(row, n[XX]);
+    for (k = 0; k < n[ZZ]; k++)
+    {
+        for (j = 0; j < n[YY]; j++)
+        {
+            for (i = 0; i < n[XX]; i++)
+            {
+                row[i] = scale*data[(static_cast<gmx_int64_t>(i)*n[YY] + j)*n[ZZ] + k];
+            }
+            if (fwrite(row, sizeof(float), n[XX], fp) != static_cast<size_t>(n[XX]))
+            {
+                gmx_file(fn);
+            }
+        }
+    }
+    sfree(row);
+    gmx_ffclose(fp);
+}
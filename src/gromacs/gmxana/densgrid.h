@@ -0,0 +1,166 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+
+#ifndef _densgrid_h
+#define _densgrid_h
+
+#include "gromacs/math/vectypes.h"
+#include "gromacs/topology/atom_id.h"
+#include "gromacs/utility/basedefinitions.h"
+#include "gromacs/utility/real.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Schemes for spreading a point onto a density grid: the enum follows
+ * the etENUM convention, such that nenum() of
+ * { NULL, "bin", "linear", "gauss", NULL } gives the scheme.
+ */
+enum {
+    edgsSEL, edgsNGP, edgsLINEAR, edgsGAUSS, edgsNR
+};
+
+/* The number of standard deviations at which the Gaussian is cut off */
+#define DENSGRID_GAUSS_CUTOFF 3
+
+typedef struct t_densgrid_thread t_densgrid_thread;
+
+typedef struct {
+    int                 ndim;         /* Number of grid dimensions, 1 to 3            */
+    int                 n[DIM];       /* Number of cells, 1 for unused dimensions     */
+    int                 axis[DIM];    /* Coordinate component used for each dimension */
+    gmx_bool            bPeriodic[DIM];
+    int                 spread;       /* The spreading scheme, edgs...                */
+    real                sigma;        /* Gaussian width (nm) with edgsGAUSS           */
+    gmx_int64_t         ncell;        /* Number of grid cells                         */
+    int                 nthreads;     /* Number of threads that can spread            */
+    gmx_bool            bShared;      /* All threads spread atomically onto grid      */
+    double             *grid;         /* The grid, last dimension running fastest     */
+    t_densgrid_thread  *th;           /* Thread-local grids and buffers               */
+} t_densgrid;
+
+t_densgrid *init_densgrid(int ndim, const int n[], const int axis[],
+                          const gmx_bool bPeriodic[], int spread, real sigma);
+/* Returns an empty grid of ndim dimensions with n[d] cells along
+ * dimension d, which bins coordinate component axis[d]. Along periodic
+ * dimensions the points are wrapped onto the grid, along the other
+ * dimensions contributions outside the grid are dropped.
+ * Every OpenMP thread spreads onto its own copy of the grid, unless
+ * the copies would take too much memory, in which case all threads
+ * spread onto one grid with atomic updates.
+ */
+
+void spread_densgrid(t_densgrid *g, int thread,
+                     const real origin[], const real invspacing[],
+                     int nr, const atom_id *index, const rvec x[],
+                     const real *weight, real scale);
+/* Spreads the nr points x[index[i]] (x[i] when index==NULL) with
+ * weight scale*weight[index[i]] (scale when weight==NULL) onto the
+ * grid, using the scheme of g. Along grid dimension d, the grid
+ * coordinate of a point is (x[axis[d]] - origin[d])*invspacing[d] and
+ * cell k covers grid coordinates k to k+1. With edgsNGP the whole weight
+ * goes to the cell containing the point; with edgsLINEAR it is
+ * distributed over the 2^ndim nearest cell centers (cloud-in-cell);
+ * with edgsGAUSS it is distributed over the cells within
+ * DENSGRID_GAUSS_CUTOFF*sigma with weights normalized to one along each
+ * dimension. thread should be the OpenMP thread number of the caller,
+ * different threads can spread onto the same grid simultaneously.
+ * The grid coordinates are computed in vectorizable loops over blocks
+ * of points, the weights are then scattered.
+ */
+
+void reduce_densgrid(t_densgrid *g);
+/* Adds the thread-local grids to g->grid and clears them.
+ * Must be called outside an OpenMP parallel region.
+ */
+
+gmx_int64_t densgrid_nr_outside(const t_densgrid *g);
+/* Returns the number of points spread so far that were outside the
+ * grid along a non-periodic dimension.
+ */
+
+void done_densgrid(t_densgrid *g);
+/* Frees all memory of g, including g itself */
+
+/* A batch of trajectory frames that can be processed in parallel */
+typedef struct {
+    int      nalloc;  /* Maximum number of frames */
+    int      nframes; /* Number of frames in the batch */
+    int      natoms;
+    rvec   **x;
+    matrix  *box;
+    real    *t;
+} t_frame_batch;
+
+void init_frame_batch(t_frame_batch *fb, int nalloc, int natoms);
+/* Initializes a batch of at most nalloc frames of natoms atoms.
+ * Frames are read sequentially into the batch, after which the frames
+ * in the batch are processed in parallel, one frame per OpenMP thread.
+ */
+
+gmx_bool add_frame_batch(t_frame_batch *fb, real t, const matrix box,
+                         const atom_id *index, const rvec x[]);
+/* Copies the natoms coordinates x[index[i]] (x[i] when index==NULL) of
+ * a frame into the batch, returns TRUE when the batch is full.
+ */
+
+void done_frame_batch(t_frame_batch *fb);
+/* Frees the memory of the batch */
+
+void write_densgrid_cube(const char *fn, const char *title, const char *comment,
+                         int nat, const int *atomnr, const rvec xat[],
+                         const double origin[], double spacing,
+                         const int n[], const double *data, double scale);
+/* Writes the n[XX]*n[YY]*n[ZZ] values data, scaled by scale, with the z
+ * index running fastest, in Gaussian cube format to fn. origin is the
+ * position of the first grid point and spacing the distance between
+ * grid points (nm). The nat atoms with atomic numbers atomnr and
+ * positions xat (nm) are written to the header.
+ */
+
+void write_densgrid_mrc(const char *fn, const char *label,
+                        const double origin[], double spacing,
+                        const int n[], const double *data, double scale);
+/* As write_densgrid_cube, but writes a binary MRC/CCP4 map with 32-bit
+ * floating point values, as read by most visualization programs.
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -36,6 +36,9 @@
  */
 #include "gmxpre.h"
 
+#include "config.h"
+
+#include <climits>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -49,6 +52,7 @@
 #include "gromacs/fileio/xvgr.h"
 #include "gromacs/gmxana/cmat.h"
 #include "gromacs/gmxana/gmx_ana.h"
+#include "gromacs/gmxana/rmsdmat.h"
 #include "gromacs/legacyheaders/typedefs.h"
 #include "gromacs/legacyheaders/viewit.h"
 #include "gromacs/linearalgebra/eigensolver.h"
@@ -62,6 +66,7 @@
 #include "gromacs/utility/cstringutil.h"
 #include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/futil.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 
 /* print to two file pointers at once (i.e. stderr and log) */
@@ -358,94 +363,80 @@ static int nrnb_comp(const void *a, const void *b)
     return db->nr - da->nr;
 }
 
-void gather(t_mat *m, real cutoff, t_clusters *clust)
+/* Returns the root of the tree of structure i, halving the path */
+static int find_root(int *parent, int i)
 {
-    t_clustid *c;
-    t_dist    *d;
-    int        i, j, k, nn, cid, n1, diff;
-    gmx_bool   bChange;
-
-    /* First we sort the entries in the RMSD matrix */
-    n1 = m->nn;
-    nn = ((n1-1)*n1)/2;
-    snew(d, nn);
-    for (i = k = 0; (i < n1); i++)
+    while (parent[i] != i)
     {
-        for (j = i+1; (j < n1); j++, k++)
-        {
-            d[k].i    = i;
-            d[k].j    = j;
-            d[k].dist = m->mat[i][j];
-        }
+        parent[i] = parent[parent[i]];
+        i         = parent[i];
     }
-    if (k != nn)
+    return i;
+}
+
+void gather(t_mat *m, real cutoff, t_clusters *clust)
+{
+    int *parent, *cid;
+    int  i, j, ri, rj, n1, ncl;
+
+    /* Link all pairs of structures closer than cutoff in a single pass
+     * over the upper triangle of the matrix. With the lowest index as
+     * the root of each tree, the clusters are numbered in order of
+     * their first structure. This only needs memory linear in the
+     * number of structures, so it also works for compact matrices.
+     */
+    n1 = m->nn;
+    snew(parent, n1);
+    for (i = 0; i < n1; i++)
     {
-        gmx_incons("gather algortihm");
+        parent[i] = i;
     }
-    qsort(d, nn, sizeof(d[0]), rms_dist_comp);
-
-    /* Now we make a cluster index for all of the conformations */
-    c = new_clustid(n1);
-
-    /* Now we check the closest structures, and equalize their cluster numbers */
     fprintf(stderr, "Linking structures ");
-    do
+    for (i = 0; i < n1; i++)
     {
-        fprintf(stderr, "*");
-        bChange = FALSE;
-        for (k = 0; (k < nn) && (d[k].dist < cutoff); k++)
+        for (j = i+1; j < n1; j++)
         {
-            diff = c[d[k].j].clust - c[d[k].i].clust;
-            if (diff)
+            if (get_mat_entry(m, i, j) < cutoff)
             {
-                bChange = TRUE;
-                if (diff > 0)
+                ri = find_root(parent, i);
+                rj = find_root(parent, j);
+                if (ri != rj)
                 {
-                    c[d[k].j].clust = c[d[k].i].clust;
-                }
-                else
-                {
-                    c[d[k].i].clust = c[d[k].j].clust;
+                    parent[std::max(ri, rj)] = std::min(ri, rj);
                 }
             }
         }
+        if (i%(1+n1/100) == 0)
+        {
+            fprintf(stderr, "%3d%%\b\b\b\b", (i*100+1)/n1);
+        }
     }
-    while (bChange);
-    fprintf(stderr, "\nSorting and renumbering clusters\n");
-    /* Sort on cluster number */
-    qsort(c, n1, sizeof(c[0]), clust_id_comp);
+    fprintf(stderr, "%3d%%\n", 100);
 
     /* Renumber clusters */
-    cid = 1;
-    for (k = 1; k < n1; k++)
+    snew(cid, n1);
+    ncl = 0;
+    for (i = 0; i < n1; i++)
     {
-        if (c[k].clust != c[k-1].clust)
+        ri = find_root(parent, i);
+        if (ri == i)
         {
-            c[k-1].clust = cid;
-            cid++;
-        }
-        else
-        {
-            c[k-1].clust = cid;
+            cid[i] = ++ncl;
         }
+        clust->cl[i] = cid[ri];
     }
-    c[k-1].clust = cid;
     if (debug)
     {
-        for (k = 0; (k < n1); k++)
+        for (i = 0; (i < n1); i++)
         {
             fprintf(debug, "Cluster index for conformation %d: %d\n",
-                    c[k].conf, c[k].clust);
+                    i, clust->cl[i]);
         }
     }
-    clust->ncl = cid;
-    for (k = 0; k < n1; k++)
-    {
-        clust->cl[c[k].conf] = c[k].clust;
-    }
+    clust->ncl = ncl;
 
-    sfree(c);
-    sfree(d);
+    sfree(cid);
+    sfree(parent);
 }
 
 gmx_bool jp_same(int **nnb, int i, int j, int P)
@@ -670,43 +661,48 @@ static void dump_nnb (FILE *fp, const char *title, int n1, t_nnb *nnb)
     }
 }
 
-static void gromos(int n1, real **mat, real rmsdcut, t_clusters *clust)
+/* Adds structure j to the neighbor list of nnb */
+static void add_nnb(t_nnb *nnb, int j)
+{
+    if (nnb->nr % 10 == 0)
+    {
+        srenew(nnb->nb, nnb->nr + 10);
+    }
+    nnb->nb[nnb->nr++] = j;
+}
+
+static void gromos(t_mat *m, real rmsdcut, t_clusters *clust)
 {
-    t_dist *row;
     t_nnb  *nnb;
-    int     i, j, k, j1, maxval;
+    int     n1, i, j, k, j1;
 
-    /* Put all neighbors nearer than rmsdcut in the list */
+    /* Put all neighbors nearer than rmsdcut in the list. We only pass
+     * over the upper triangle of the matrix, row by row, which keeps
+     * the lists sorted and accesses compact matrices sequentially.
+     */
     fprintf(stderr, "Making list of neighbors within cutoff ");
+    n1 = m->nn;
     snew(nnb, n1);
-    snew(row, n1);
     for (i = 0; (i < n1); i++)
     {
-        maxval = 0;
-        k      = 0;
-        /* put all neighbors within cut-off in list */
-        for (j = 0; j < n1; j++)
+        if (get_mat_entry(m, i, i) < rmsdcut)
+        {
+            add_nnb(&nnb[i], i);
+        }
+        for (j = i+1; j < n1; j++)
         {
-            if (mat[i][j] < rmsdcut)
+            if (get_mat_entry(m, i, j) < rmsdcut)
             {
-                if (k >= maxval)
-                {
-                    maxval += 10;
-                    srenew(nnb[i].nb, maxval);
-                }
-                nnb[i].nb[k] = j;
-                k++;
+                add_nnb(&nnb[i], j);
+                add_nnb(&nnb[j], i);
             }
         }
-        /* store nr of neighbors, we'll need that */
-        nnb[i].nr = k;
         if (i%(1+n1/100) == 0)
         {
             fprintf(stderr, "%3d%%\b\b\b\b", (i*100+1)/n1);
         }
     }
     fprintf(stderr, "%3d%%\n", 100);
-    sfree(row);
 
     /* sort neighbor list on number of neighbors, largest first */
     qsort(nnb, n1, sizeof(nnb[0]), nrnb_comp);
@@ -825,6 +821,60 @@ rvec **read_whole_trj(const char *fn, int isize, atom_id index[], int skip,
     return xx;
 }
 
+/* Returns an upper bound for the distances between the nf structures in
+ * xx, used as the range of a compact matrix. The RMSD of two structures
+ * is at most the sum of their RMS distances to any reference structure;
+ * with fitting this can be the origin, as the structures are centered.
+ * The RMS distance deviation is at most the largest distance of two
+ * atoms within a structure.
+ */
+static real compact_mat_bound(int nf, rvec **xx, int isize, real *mass,
+                              gmx_bool bFit, gmx_bool bRMSdist)
+{
+    real bound = 0;
+    int  f, i;
+
+    for (f = 0; f < nf; f++)
+    {
+        if (bRMSdist)
+        {
+            rvec xc;
+            real r2max = 0;
+
+            clear_rvec(xc);
+            for (i = 0; i < isize; i++)
+            {
+                rvec_inc(xc, xx[f][i]);
+            }
+            svmul(1.0/isize, xc, xc);
+            for (i = 0; i < isize; i++)
+            {
+                r2max = std::max(r2max, distance2(xx[f][i], xc));
+            }
+            bound = std::max(bound, static_cast<real>(2*std::sqrt(r2max)));
+        }
+        else
+        {
+            double msd0 = 0, msdc = 0, wsum = 0, r;
+
+            for (i = 0; i < isize; i++)
+            {
+                msd0 += mass[i]*distance2(xx[f][i], xx[0][i]);
+                msdc += mass[i]*norm2(xx[f][i]);
+                wsum += mass[i];
+            }
+            r = std::sqrt(msd0/wsum);
+            if (bFit)
+            {
+                r = std::min(r, std::sqrt(msdc/wsum));
+            }
+            bound = std::max(bound, static_cast<real>(2*r));
+        }
+    }
+
+    return bound;
+}
+
 static int plot_clusters(int nf, real **mat, t_clusters *clust,
                          int minstruct)
 {
@@ -993,7 +1043,7 @@ static void ana_trans(t_clusters *clust, int nf,
     sfree(axis);
 }
 
-static void analyze_clusters(int nf, t_clusters *clust, real **rmsd,
+static void analyze_clusters(int nf, t_clusters *clust, t_mat *rmsd,
                              int natom, t_atoms *atoms, rvec *xtps,
                              real *mass, rvec **xx, real *time,
                              int ifsize, atom_id *fitidx,
@@ -1161,11 +1211,11 @@ static void analyze_clusters(int nf, t_clusters *clust, real **rmsd,
                 {
                     if (i < i1)
                     {
-                        r += rmsd[structure[i]][structure[i1]];
+                        r += get_mat_entry(rmsd, structure[i], structure[i1]);
                     }
                     else
                     {
-                        r += rmsd[structure[i1]][structure[i]];
+                        r += get_mat_entry(rmsd, structure[i1], structure[i]);
                     }
                 }
                 r /= (nstr - 1);
@@ -1239,7 +1289,7 @@ static void analyze_clusters(int nf, t_clusters *clust, real **rmsd,
                         {
                             if (bWrite[i1])
                             {
-                                bWrite[i] = rmsd[structure[i1]][structure[i]] > rmsmin;
+                                bWrite[i] = get_mat_entry(rmsd, structure[i1], structure[i]) > rmsmin;
                             }
                         }
                     }
@@ -1334,7 +1384,9 @@ int gmx_cluster(int argc, char *argv[])
         "Distances between structures can be determined from a trajectory",
         "or read from an [REF].xpm[ref] matrix file with the [TT]-dm[tt] option.",
         "RMS deviation after fitting or RMS deviation of atom-pair distances",
-        "can be used to define the distance between structures.[PAR]",
+        "can be used to define the distance between structures.",
+        "The RMS deviation matrix is computed in parallel; the number of",
+        "threads can be set with [TT]-nt[tt].[PAR]",
 
         "single linkage: add a structure to a cluster when its distance to any",
         "element of the cluster is less than [TT]cutoff[tt].[PAR]",
@@ -1373,6 +1425,14 @@ int gmx_cluster(int argc, char *argv[])
         "file. When writing all structures, separate numbered files are made",
         "for each cluster.[PAR]",
 
+        "For very many structures, the linkage and gromos methods can use",
+        "[TT]-compact[tt], which stores only the upper half of the matrix",
+        "with 16-bit resolution, using 2 bytes per pair of structures.",
+        "The matrix can be stored in a temporary file given by",
+        "[TT]-matfile[tt], which the operating system pages in and out",
+        "as needed, such that it does not need to fit in memory.",
+        "The [TT]-o[tt] matrix is then not written.[PAR]",
+
         "Two output files are always written:",
         "",
         " * [TT]-o[tt] writes the RMSD values in the upper left half of the matrix",
@@ -1405,11 +1465,11 @@ int gmx_cluster(int argc, char *argv[])
     };
 
     FILE              *fp, *log;
-    int                nf, i, i1, i2, j;
+    int                nf, i, i0, i1, i2, j, nchunk, n0, n2;
     gmx_int64_t        nrms = 0;
 
     matrix             box;
-    rvec              *xtps, *usextps, *x1, **xx = NULL;
+    rvec              *xtps, *usextps, **xx = NULL;
     const char        *fn, *trx_out_fn;
     t_clusters         clust;
     t_mat             *rms, *orig = NULL;
@@ -1423,7 +1483,7 @@ int gmx_cluster(int argc, char *argv[])
     int                isize = 0, ifsize = 0, iosize = 0;
     atom_id           *index = NULL, *fitidx = NULL, *outidx = NULL;
     char              *grpname;
-    real               rmsd, **d1, **d2, *time = NULL, time_invfac, *mass = NULL;
+    real               *rmsdmat, **d1, **d2, *time = NULL, time_invfac, *mass = NULL;
     char               buf[STRLEN], buf1[80], title[STRLEN];
     gmx_bool           bAnalyze, bUseRmsdCut, bJP_RMSD = FALSE, bReadMat, bReadTraj, bPBC = TRUE;
 
@@ -1444,9 +1504,11 @@ int gmx_cluster(int argc, char *argv[])
     static int   nlevels  = 40, skip = 1;
     static real  scalemax = -1.0, rmsdcut = 0.1, rmsmin = 0.0;
     gmx_bool     bRMSdist = FALSE, bBinary = FALSE, bAverage = FALSE, bFit = TRUE;
+    gmx_bool     bCompact = FALSE;
     static int   niter    = 10000, nrandom = 0, seed = 1993, write_ncl = 0, write_nst = 1, minstruct = 1;
     static real  kT       = 1e-3;
     static int   M        = 10, P = 3;
+    static int   nthreads = -1;
     output_env_t oenv;
     gmx_rmpbc_t  gpbc = NULL;
 
@@ -1493,7 +1555,13 @@ int gmx_cluster(int argc, char *argv[])
           "Boltzmann weighting factor for Monte Carlo optimization "
           "(zero turns off uphill steps)" },
         { "-pbc", FALSE, etBOOL,
-          { &bPBC }, "PBC check" }
+          { &bPBC }, "PBC check" },
+        { "-compact", FALSE, etBOOL, {&bCompact},
+          "Store the RMSD matrix compactly, optionally in the file given by [TT]-matfile[tt] (only linkage and gromos)" },
+#ifdef GMX_OPENMP
+        { "-nt", FALSE, etINT, {&nthreads},
+          "Number of threads used for the RMSD matrix (if -1, all threads will be used or what is specified by the environment variable OMP_NUM_THREADS)"},
+#endif
     };
     t_filenm     fnm[] = {
         { efTRX, "-f",     NULL,        ffOPTRD },
@@ -1510,7 +1578,8 @@ int gmx_cluster(int argc, char *argv[])
         { efXPM, "-tr",   "clust-trans", ffOPTWR},
         { efXVG, "-ntr",  "clust-trans", ffOPTWR},
         { efXVG, "-clid", "clust-id",   ffOPTWR},
-        { efTRX, "-cl",   "clusters.pdb", ffOPTWR }
+        { efTRX, "-cl",   "clusters.pdb", ffOPTWR },
+        { efDAT, "-matfile", "rmsd-mat", ffOPTWR }
     };
 #define NFILE asize(fnm)
 
@@ -1522,6 +1591,11 @@ int gmx_cluster(int argc, char *argv[])
         return 0;
     }
 
+    if (nthreads > 0)
+    {
+        gmx_omp_set_num_threads(nthreads);
+    }
+
     /* parse options */
     bReadMat   = opt2bSet("-dm", NFILE, fnm);
     bReadTraj  = opt2bSet("-f", NFILE, fnm) || !bReadMat;
@@ -1563,6 +1637,18 @@ int gmx_cluster(int argc, char *argv[])
     bAnalyze = (method == m_linkage || method == m_jarvis_patrick ||
                 method == m_gromos );
 
+    if (bCompact)
+    {
+        if (method != m_linkage && method != m_gromos)
+        {
+            gmx_fatal(FARGS, "A compact matrix can only be used with the linkage and gromos methods");
+        }
+        if (bReadMat || bBinary)
+        {
+            gmx_fatal(FARGS, "A compact matrix can not be used with -dm or -binary");
+        }
+    }
+
     /* Open log file */
     log = ftp2FILE(efLOG, NFILE, fnm, "w");
 
@@ -1740,32 +1826,58 @@ int gmx_cluster(int argc, char *argv[])
     }
     else   /* !bReadMat */
     {
-        rms  = init_mat(nf, method == m_diagonalize);
+        if (bCompact)
+        {
+            real bound = compact_mat_bound(nf, xx, isize, mass, bFit, bRMSdist);
+
+            ffprintf_g(stderr, log, buf, "Storing the matrix compactly with a resolution of %g nm\n",
+                       bound/USHRT_MAX);
+            rms = init_mat_compact(nf, bound, opt2fn_null("-matfile", NFILE, fnm));
+        }
+        else
+        {
+            rms = init_mat(nf, method == m_diagonalize);
+        }
         nrms = (static_cast<gmx_int64_t>(nf)*static_cast<gmx_int64_t>(nf-1))/2;
         if (!bRMSdist)
         {
             fprintf(stderr, "Computing %dx%d RMS deviation matrix\n", nf, nf);
-            /* Initialize work array */
-            snew(x1, isize);
-            for (i1 = 0; i1 < nf; i1++)
+            /* Compute chunks of rows, such that the temporary storage
+             * stays small compared to the matrix itself.
+             */
+            nchunk = std::min(nf, std::max(64, (1 << 24)/std::max(nf, 1)));
+            snew(rmsdmat, static_cast<gmx_int64_t>(nchunk)*nf);
+            for (i0 = 0; i0 < nf; i0 += nchunk)
             {
-                for (i2 = i1+1; i2 < nf; i2++)
+                real *rect;
+
+                n0   = std::min(nchunk, nf - i0);
+                n2   = nf - i0 - n0;
+                rect = rmsdmat + static_cast<gmx_int64_t>(n0)*(n0 - 1)/2;
+                calc_rmsd_mat(isize, mass, bFit, isize, NULL, mass, FALSE,
+                              n0, xx + i0, 0, NULL, FALSE, rmsdmat);
+                if (n2 > 0)
                 {
-                    for (i = 0; i < isize; i++)
+                    calc_rmsd_mat(isize, mass, bFit, isize, NULL, mass, FALSE,
+                                  n0, xx + i0, n2, xx + i0 + n0, FALSE, rect);
+                }
+                for (i1 = 0; i1 < n0; i1++)
+                {
+                    for (i2 = i1+1; i2 < n0; i2++)
                     {
-                        copy_rvec(xx[i1][i], x1[i]);
+                        set_mat_entry(rms, i0 + i1, i0 + i2,
+                                      rmsdmat[rmsd_mat_index(n0, i1, i2)]);
                     }
-                    if (bFit)
+                    for (i2 = 0; i2 < n2; i2++)
                     {
-                        do_fit(isize, mass, xx[i2], x1);
+                        set_mat_entry(rms, i0 + i1, i0 + n0 + i2,
+                                      rect[static_cast<gmx_int64_t>(i1)*n2 + i2]);
                     }
-                    rmsd = rmsdev(isize, mass, xx[i2], x1);
-                    set_mat_entry(rms, i1, i2, rmsd);
+                    nrms -= nf-(i0+i1)-1;
                 }
-                nrms -= nf-i1-1;
                 fprintf(stderr, "\r# RMSD calculations left: " "%" GMX_PRId64 "   ", nrms);
             }
-            sfree(x1);
+            sfree(rmsdmat);
         }
         else /* bRMSdist */
         {
@@ -1803,7 +1915,7 @@ int gmx_cluster(int argc, char *argv[])
     }
     ffprintf_gg(stderr, log, buf, "The RMSD ranges from %g to %g nm\n",
                 rms->minrms, rms->maxrms);
-    ffprintf_g(stderr, log, buf, "Average RMSD is %g\n", 2*rms->sumrms/(nf*(nf-1)));
+    ffprintf_g(stderr, log, buf, "Average RMSD is %g\n", 2*rms->sumrms/(static_cast<double>(nf)*(nf-1)));
     ffprintf_d(stderr, log, buf, "Number of structures for matrix %d\n", nf);
     ffprintf_g(stderr, log, buf, "Energy of the matrix is %g.\n", mat_energy(rms));
     if (bUseRmsdCut && (rmsdcut < rms->minrms || rmsdcut > rms->maxrms) )
@@ -1877,7 +1989,7 @@ int gmx_cluster(int argc, char *argv[])
             jarvis_patrick(rms->nn, rms->mat, M, P, bJP_RMSD ? rmsdcut : -1, &clust);
             break;
         case m_gromos:
-            gromos(rms->nn, rms->mat, rmsdcut, &clust);
+            gromos(rms, rmsdcut, &clust);
             break;
         default:
             gmx_fatal(FARGS, "DEATH HORROR unknown method \"%s\"", methodname[0]);
@@ -1891,13 +2003,17 @@ int gmx_cluster(int argc, char *argv[])
 
     if (bAnalyze)
     {
-        if (minstruct > 1)
+        /* With a compact matrix there is no full matrix to mark the clusters in */
+        if (!bCompact)
         {
-            ncluster = plot_clusters(nf, rms->mat, &clust, minstruct);
-        }
-        else
-        {
-            mark_clusters(nf, rms->mat, rms->maxrms, &clust);
+            if (minstruct > 1)
+            {
+                ncluster = plot_clusters(nf, rms->mat, &clust, minstruct);
+            }
+            else
+            {
+                mark_clusters(nf, rms->mat, rms->maxrms, &clust);
+            }
         }
         init_t_atoms(&useatoms, isize, FALSE);
         snew(usextps, isize);
@@ -1910,7 +2026,7 @@ int gmx_cluster(int argc, char *argv[])
             copy_rvec(xtps[index[i]], usextps[i]);
         }
         useatoms.nr = isize;
-        analyze_clusters(nf, &clust, rms->mat, isize, &useatoms, usextps, mass, xx, time,
+        analyze_clusters(nf, &clust, rms, isize, &useatoms, usextps, mass, xx, time,
                          ifsize, fitidx, iosize, outidx,
                          bReadTraj ? trx_out_fn : NULL,
                          opt2fn_null("-sz", NFILE, fnm),
@@ -1937,35 +2053,43 @@ int gmx_cluster(int argc, char *argv[])
         }
     }
 
-    fp = opt2FILE("-o", NFILE, fnm, "w");
-    fprintf(stderr, "Writing rms distance/clustering matrix ");
-    if (bReadMat)
+    if (bCompact)
     {
-        write_xpm(fp, 0, readmat[0].title, readmat[0].legend, readmat[0].label_x,
-                  readmat[0].label_y, nf, nf, readmat[0].axis_x, readmat[0].axis_y,
-                  rms->mat, 0.0, rms->maxrms, rlo_top, rhi_top, &nlevels);
+        fprintf(stderr, "Not writing the rms distance/clustering matrix %s with -compact\n",
+                opt2fn("-o", NFILE, fnm));
     }
     else
     {
-        sprintf(buf, "Time (%s)", output_env_get_time_unit(oenv));
-        sprintf(title, "RMS%sDeviation / Cluster Index",
-                bRMSdist ? " Distance " : " ");
-        if (minstruct > 1)
+        fp = opt2FILE("-o", NFILE, fnm, "w");
+        fprintf(stderr, "Writing rms distance/clustering matrix ");
+        if (bReadMat)
         {
-            write_xpm_split(fp, 0, title, "RMSD (nm)", buf, buf,
-                            nf, nf, time, time, rms->mat, 0.0, rms->maxrms, &nlevels,
-                            rlo_top, rhi_top, 0.0, ncluster,
-                            &ncluster, TRUE, rlo_bot, rhi_bot);
+            write_xpm(fp, 0, readmat[0].title, readmat[0].legend, readmat[0].label_x,
+                      readmat[0].label_y, nf, nf, readmat[0].axis_x, readmat[0].axis_y,
+                      rms->mat, 0.0, rms->maxrms, rlo_top, rhi_top, &nlevels);
         }
         else
         {
-            write_xpm(fp, 0, title, "RMSD (nm)", buf, buf,
-                      nf, nf, time, time, rms->mat, 0.0, rms->maxrms,
-                      rlo_top, rhi_top, &nlevels);
+            sprintf(buf, "Time (%s)", output_env_get_time_unit(oenv));
+            sprintf(title, "RMS%sDeviation / Cluster Index",
+                    bRMSdist ? " Distance " : " ");
+            if (minstruct > 1)
+            {
+                write_xpm_split(fp, 0, title, "RMSD (nm)", buf, buf,
+                                nf, nf, time, time, rms->mat, 0.0, rms->maxrms, &nlevels,
+                                rlo_top, rhi_top, 0.0, ncluster,
+                                &ncluster, TRUE, rlo_bot, rhi_bot);
+            }
+            else
+            {
+                write_xpm(fp, 0, title, "RMSD (nm)", buf, buf,
+                          nf, nf, time, time, rms->mat, 0.0, rms->maxrms,
+                          rlo_top, rhi_top, &nlevels);
+            }
         }
+        fprintf(stderr, "\n");
+        gmx_ffclose(fp);
     }
-    fprintf(stderr, "\n");
-    gmx_ffclose(fp);
     if (NULL != orig)
     {
         fp = opt2FILE("-om", NFILE, fnm, "w");
@@ -1979,7 +2103,10 @@ int gmx_cluster(int argc, char *argv[])
         sfree(orig);
     }
     /* now show what we've done */
-    do_view(oenv, opt2fn("-o", NFILE, fnm), "-nxy");
+    if (!bCompact)
+    {
+        do_view(oenv, opt2fn("-o", NFILE, fnm), "-nxy");
+    }
     do_view(oenv, opt2fn_null("-sz", NFILE, fnm), "-nxy");
     if (method == m_diagonalize)
     {
@@ -36,9 +36,13 @@
  */
 #include "gmxpre.h"
 
+#include "config.h"
+
 #include <cmath>
 #include <cstring>
 
+#include <algorithm>
+
 #include "gromacs/commandline/pargs.h"
 #include "gromacs/fileio/confio.h"
 #include "gromacs/fileio/matio.h"
@@ -52,14 +56,396 @@
 #include "gromacs/math/do_fit.h"
 #include "gromacs/math/vec.h"
 #include "gromacs/pbcutil/rmpbc.h"
+#include "gromacs/random/random.h"
 #include "gromacs/topology/index.h"
 #include "gromacs/utility/arraysize.h"
 #include "gromacs/utility/cstringutil.h"
+#include "gromacs/utility/exceptions.h"
 #include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/futil.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 #include "gromacs/utility/sysinfo.h"
 
+/* Number of frames that are multiplied with a block of vectors at once */
+#define COVAR_FRAME_BATCH 32
+
+/* Everything needed to make a pass over the fitted coordinates
+ * for the matrix-free partial diagonalization.
+ */
+typedef struct {
+    const char     *trxfile;
+    output_env_t    oenv;
+    gmx_rmpbc_t     gpbc;    /* NULL when not removing PBC */
+    gmx_bool        bFit;
+    gmx_bool        bRef;
+    int             nfit;
+    atom_id        *ifit;
+    real           *w_rls;
+    rvec           *xref;
+    int             natoms;
+    atom_id        *index;
+    rvec           *xav;
+    real           *sqrtm;
+    int             nframes; /* The number of frames to use */
+} t_covar_stream;
+
+/* Adds the contribution of nf mass-weighted deviation frames xb to y = C q,
+ * a is working space for nf*nb values.
+ * q and y are ndim x nb and stored row-wise, so the inner loops run
+ * over the nb vectors and can be vectorized.
+ */
+static void covar_add_frames(int ndim, int nf, const double *xb,
+                             int nb, const double *q, double *a, double *y)
+{
+#pragma omp parallel
+    {
+        try
+        {
+            int f, i, c;
+
+            /* a = xb q */
+#pragma omp for schedule(static)
+            for (f = 0; f < nf; f++)
+            {
+                const double *x  = xb + static_cast<size_t>(f)*ndim;
+                double       *af = a + f*nb;
+
+                for (c = 0; c < nb; c++)
+                {
+                    af[c] = 0;
+                }
+                for (i = 0; i < ndim; i++)
+                {
+                    const double *qi = q + static_cast<size_t>(i)*nb;
+
+                    for (c = 0; c < nb; c++)
+                    {
+                        af[c] += x[i]*qi[c];
+                    }
+                }
+            }
+            /* y += xb^T a, each thread updates its own rows of y */
+#pragma omp for schedule(static)
+            for (i = 0; i < ndim; i++)
+            {
+                double *yi = y + static_cast<size_t>(i)*nb;
+
+                for (f = 0; f < nf; f++)
+                {
+                    const double  xfi = xb[static_cast<size_t>(f)*ndim + i];
+                    const double *af  = a + f*nb;
+
+                    for (c = 0; c < nb; c++)
+                    {
+                        yi[c] += xfi*af[c];
+                    }
+                }
+            }
+        }
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+    }
+}
+
+/* Computes y = C q for the nb vectors in q with one pass over the trajectory,
+ * without constructing the covariance matrix C. When trace!=NULL,
+ * the trace of C is returned in *trace.
+ */
+static void covar_times_block(const t_covar_stream *cs, int nb,
+                              const double *q, double *y, double *trace)
+{
+    t_trxstatus *status;
+    rvec        *xread;
+    matrix       box;
+    real         t;
+    double      *xb, *a, *x, dx, sum2;
+    int          ndim, nat, nframes, nf, i, d;
+
+    ndim = cs->natoms*DIM;
+    snew(xb, static_cast<size_t>(COVAR_FRAME_BATCH)*ndim);
+    snew(a, COVAR_FRAME_BATCH*nb);
+    for (i = 0; i < ndim*nb; i++)
+    {
+        y[i] = 0;
+    }
+
+    sum2    = 0;
+    nframes = 0;
+    nf      = 0;
+    nat     = read_first_x(cs->oenv, &status, cs->trxfile, &t, &xread, box);
+    do
+    {
+        nframes++;
+        if (cs->gpbc != NULL)
+        {
+            gmx_rmpbc(cs->gpbc, nat, box, xread);
+        }
+        if (cs->bFit)
+        {
+            reset_x(cs->nfit, cs->ifit, nat, NULL, xread, cs->w_rls);
+            do_fit(nat, cs->w_rls, cs->xref, xread);
+        }
+        x = xb + static_cast<size_t>(nf)*ndim;
+        for (i = 0; i < cs->natoms; i++)
+        {
+            for (d = 0; d < DIM; d++)
+            {
+                if (cs->bRef)
+                {
+                    dx = xread[cs->index[i]][d] - cs->xref[cs->index[i]][d];
+                }
+                else
+                {
+                    dx = xread[cs->index[i]][d] - cs->xav[i][d];
+                }
+                x[DIM*i+d] = cs->sqrtm[i]*dx;
+                sum2      += x[DIM*i+d]*x[DIM*i+d];
+            }
+        }
+        nf++;
+        if (nf == COVAR_FRAME_BATCH)
+        {
+            covar_add_frames(ndim, nf, xb, nb, q, a, y);
+            nf = 0;
+        }
+    }
+    while (nframes < cs->nframes &&
+           read_next_x(cs->oenv, status, &t, xread, box));
+    close_trj(status);
+    if (nf > 0)
+    {
+        covar_add_frames(ndim, nf, xb, nb, q, a, y);
+    }
+    sfree(xread);
+    sfree(a);
+    sfree(xb);
+
+    for (i = 0; i < ndim*nb; i++)
+    {
+        y[i] /= nframes;
+    }
+    if (trace != NULL)
+    {
+        *trace = sum2/nframes;
+    }
+}
+
+/* Orthonormalizes the nb columns of the row-wise stored ndim x nb block q
+ * with two passes of modified Gram-Schmidt. Columns that are (close to)
+ * linearly dependent on the previous ones are replaced by random vectors.
+ */
+static void orthonormalize_block(int ndim, int nb, double *q, gmx_rng_t rng)
+{
+    int    c, p, i, pass;
+    double dot, norm, norm0;
+
+    c = 0;
+    while (c < nb)
+    {
+        norm0 = 0;
+        for (i = 0; i < ndim; i++)
+        {
+            norm0 += q[i*nb+c]*q[i*nb+c];
+        }
+        for (pass = 0; pass < 2; pass++)
+        {
+            for (p = 0; p < c; p++)
+            {
+                dot = 0;
+                for (i = 0; i < ndim; i++)
+                {
+                    dot += q[i*nb+p]*q[i*nb+c];
+                }
+                for (i = 0; i < ndim; i++)
+                {
+                    q[i*nb+c] -= dot*q[i*nb+p];
+                }
+            }
+        }
+        norm = 0;
+        for (i = 0; i < ndim; i++)
+        {
+            norm += q[i*nb+c]*q[i*nb+c];
+        }
+        if (norm <= 1e-20*norm0 || norm == 0)
+        {
+            /* The block is rank deficient, continue with a random direction */
+            for (i = 0; i < ndim; i++)
+            {
+                q[i*nb+c] = gmx_rng_gaussian_real(rng);
+            }
+            continue;
+        }
+        norm = 1/std::sqrt(norm);
+        for (i = 0; i < ndim; i++)
+        {
+            q[i*nb+c] *= norm;
+        }
+        c++;
+    }
+}
+
+/* Rayleigh-Ritz step: given orthonormal q and y = C q, rotates q and y
+ * such that q contains the Ritz vectors, ordered by decreasing
+ * Ritz values, which are returned in lambda.
+ */
+static void rayleigh_ritz(int ndim, int nb, double *q, double *y, double *lambda)
+{
+    real   *t, *w, *v;
+    double  dot;
+    int     c1, c2, i;
+
+    snew(t, nb*nb);
+    snew(w, nb);
+    snew(v, nb*nb);
+    for (c1 = 0; c1 < nb; c1++)
+    {
+        for (c2 = c1; c2 < nb; c2++)
+        {
+            /* Average q^T y and y^T q to get an exactly symmetric matrix */
+            dot = 0;
+            for (i = 0; i < ndim; i++)
+            {
+                dot += q[i*nb+c1]*y[i*nb+c2] + y[i*nb+c1]*q[i*nb+c2];
+            }
+            t[c1*nb+c2] = 0.5*dot;
+            t[c2*nb+c1] = 0.5*dot;
+        }
+    }
+    /* The eigenvalues are returned in ascending order */
+    eigensolver(t, nb, 0, nb, w, v);
+    for (c1 = 0; c1 < nb; c1++)
+    {
+        lambda[c1] = w[nb-1-c1];
+    }
+
+#pragma omp parallel
+    {
+        try
+        {
+            double *tq, *ty;
+            int     i, c, p;
+
+            snew(tq, nb);
+            snew(ty, nb);
+#pragma omp for schedule(static)
+            for (i = 0; i < ndim; i++)
+            {
+                double *qi = q + static_cast<size_t>(i)*nb;
+                double *yi = y + static_cast<size_t>(i)*nb;
+
+                for (c = 0; c < nb; c++)
+                {
+                    const real *vc = v + (nb-1-c)*nb;
+
+                    tq[c] = 0;
+                    ty[c] = 0;
+                    for (p = 0; p < nb; p++)
+                    {
+                        tq[c] += qi[p]*vc[p];
+                        ty[c] += yi[p]*vc[p];
+                    }
+                }
+                for (c = 0; c < nb; c++)
+                {
+                    qi[c] = tq[c];
+                    yi[c] = ty[c];
+                }
+            }
+            sfree(ty);
+            sfree(tq);
+        }
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+    }
+
+    sfree(v);
+    sfree(w);
+    sfree(t);
+}
+
+/* Determines the nvec largest eigenvalues and eigenvectors of the covariance
+ * matrix by subspace iteration with a random start block and Rayleigh-Ritz
+ * projection. Each iteration is one pass over the trajectory.
+ * Returns the eigenvalues in decreasing order in eigval and the eigenvectors
+ * as rows in eigvec, the trace of the covariance matrix is returned in *trace.
+ */
+static void covar_partial_eigen(const t_covar_stream *cs, int nvec, real tol,
+                                real *eigval, real *eigvec, real *trace)
+{
+    gmx_rng_t rng;
+    double   *q, *y, *lambda, tr, r2, rmax;
+    int       ndim, nb, iter, c, i;
+    gmx_bool  bConverged;
+    const int maxiter = 100;
+
+    ndim = cs->natoms*DIM;
+    /* Oversampling speeds up the convergence of the wanted vectors */
+    nb   = std::min(ndim, nvec + std::max(nvec, 10));
+
+    snew(q, static_cast<size_t>(ndim)*nb);
+    snew(y, static_cast<size_t>(ndim)*nb);
+    snew(lambda, nb);
+
+    /* Use a fixed seed, so results are reproducible */
+    rng = gmx_rng_init(1993);
+    for (i = 0; i < ndim*nb; i++)
+    {
+        q[i] = gmx_rng_gaussian_real(rng);
+    }
+    orthonormalize_block(ndim, nb, q, rng);
+
+    tr         = 0;
+    bConverged = FALSE;
+    for (iter = 1; iter <= maxiter && !bConverged; iter++)
+    {
+        covar_times_block(cs, nb, q, y, iter == 1 ? &tr : NULL);
+        rayleigh_ritz(ndim, nb, q, y, lambda);
+
+        /* Check the residuals |C q - lambda q| of the wanted vectors */
+        rmax = 0;
+        for (c = 0; c < nvec; c++)
+        {
+            r2 = 0;
+            for (i = 0; i < ndim; i++)
+            {
+                r2 += dsqr(y[i*nb+c] - lambda[c]*q[i*nb+c]);
+            }
+            rmax = std::max(rmax, std::sqrt(r2));
+        }
+        fprintf(stderr, "Iteration %3d: largest eigenvalue %g, max. residual %g\n",
+                iter, lambda[0], rmax);
+        bConverged = (rmax <= tol*lambda[0]);
+        if (!bConverged && iter < maxiter)
+        {
+            for (i = 0; i < ndim*nb; i++)
+            {
+                q[i] = y[i];
+            }
+            orthonormalize_block(ndim, nb, q, rng);
+        }
+    }
+    if (!bConverged)
+    {
+        fprintf(stderr, "\nWARNING: the eigenvectors did not converge to a relative residual of %g in %d iterations\n",
+                tol, maxiter);
+    }
+
+    for (c = 0; c < nvec; c++)
+    {
+        eigval[c] = lambda[c];
+        for (i = 0; i < ndim; i++)
+        {
+            eigvec[static_cast<size_t>(c)*ndim+i] = q[i*nb+c];
+        }
+    }
+    *trace = tr;
+
+    gmx_rng_destroy(rng);
+    sfree(lambda);
+    sfree(y);
+    sfree(q);
+}
+
 int gmx_covar(int argc, char *argv[])
 {
     const char     *desc[] = {
@@ -93,10 +479,21 @@ int gmx_covar(int argc, char *argv[])
         "of atoms involved. It is easy to run out of memory, in which",
         "case this tool will probably exit with a 'Segmentation fault'. You",
         "should consider carefully whether a reduced set of atoms will meet",
-        "your needs for lower costs."
+        "your needs for lower costs.",
+        "[PAR]",
+        "For large systems, [TT]-nvec[tt] computes only the given number of",
+        "eigenvectors with the largest eigenvalues, without ever constructing",
+        "the covariance matrix. This uses subspace iteration starting from a",
+        "random block of vectors, where each iteration multiplies the block",
+        "with the covariance matrix in one pass over the trajectory.",
+        "The memory usage is then linear in the number of atoms.",
+        "The iterations stop when the residuals of all requested eigenvectors",
+        "are below [TT]-tol[tt] times the largest eigenvalue.",
+        "The matrix output options can not be used in this mode."
     };
     static gmx_bool bFit = TRUE, bRef = FALSE, bM = FALSE, bPBC = TRUE;
-    static int      end  = -1;
+    static int      end  = -1, nvec = 0, nthreads = -1;
+    static real     tol  = 1e-4;
     t_pargs         pa[] = {
         { "-fit",  FALSE, etBOOL, {&bFit},
           "Fit to a reference structure"},
@@ -107,7 +504,15 @@ int gmx_covar(int argc, char *argv[])
         { "-last",  FALSE, etINT, {&end},
           "Last eigenvector to write away (-1 is till the last)" },
         { "-pbc",  FALSE,  etBOOL, {&bPBC},
-          "Apply corrections for periodic boundary conditions" }
+          "Apply corrections for periodic boundary conditions" },
+        { "-nvec", FALSE, etINT, {&nvec},
+          "Only compute this number of eigenvectors, without constructing the covariance matrix (0 is all, with the full matrix)" },
+        { "-tol",  FALSE, etREAL, {&tol},
+          "Relative tolerance for the eigenvector residuals with [TT]-nvec[tt]" },
+#ifdef GMX_OPENMP
+        { "-nt", FALSE, etINT, {&nthreads},
+          "Number of threads used with [TT]-nvec[tt] (if -1, all threads will be used or what is specified by the environment variable OMP_NUM_THREADS)" },
+#endif
     };
     FILE           *out = NULL; /* initialization makes all compilers happy */
     t_trxstatus    *status;
@@ -116,7 +521,7 @@ int gmx_covar(int argc, char *argv[])
     t_atoms        *atoms;
     rvec           *x, *xread, *xref, *xav, *xproj;
     matrix          box, zerobox;
-    real           *sqrtm, *mat, *eigenvalues, sum, trace, inv_nframes;
+    real           *sqrtm, *mat = NULL, *eigenvalues, sum, trace, inv_nframes;
     real            t, tstart, tend, **mat2;
     real            xj, *w_rls = NULL;
     real            min, max, *axis;
@@ -135,6 +540,8 @@ int gmx_covar(int argc, char *argv[])
     real           *eigenvectors;
     output_env_t    oenv;
     gmx_rmpbc_t     gpbc = NULL;
+    t_covar_stream  cs;
+    gmx_bool        bReverse;
 
     t_filenm        fnm[] = {
         { efTRX, "-f",  NULL, ffREAD },
@@ -169,6 +576,19 @@ int gmx_covar(int argc, char *argv[])
     xpmfile    = opt2fn_null("-xpm", NFILE, fnm);
     xpmafile   = opt2fn_null("-xpma", NFILE, fnm);
 
+    if (nthreads > 0)
+    {
+        gmx_omp_set_num_threads(nthreads);
+    }
+    if (nvec < 0)
+    {
+        gmx_fatal(FARGS, "The number of eigenvectors should be positive");
+    }
+    if (nvec > 0 && (asciifile || xpmfile || xpmafile))
+    {
+        gmx_fatal(FARGS, "The covariance matrix can not be written with -nvec, since it is not constructed");
+    }
+
     read_tps_conf(fitfile, &top, &ePBC, &xref, NULL, box, TRUE);
     atoms = &top.atoms;
 
@@ -253,15 +673,23 @@ int gmx_covar(int argc, char *argv[])
     snew(x, natoms);
     snew(xav, natoms);
     ndim = natoms*DIM;
-    if (std::sqrt(static_cast<real>(GMX_INT64_MAX)) < static_cast<real>(ndim))
+    if (nvec == 0)
     {
-        gmx_fatal(FARGS, "Number of degrees of freedoms to large for matrix.\n");
+        if (std::sqrt(static_cast<real>(GMX_INT64_MAX)) < static_cast<real>(ndim))
+        {
+            gmx_fatal(FARGS, "Number of degrees of freedoms to large for matrix.\n");
+        }
+        snew(mat, ndim*ndim);
+    }
+    else
+    {
+        nvec = std::min(nvec, static_cast<int>(ndim));
     }
-    snew(mat, ndim*ndim);
 
     fprintf(stderr, "Calculating the average structure ...\n");
     nframes0 = 0;
     nat      = read_first_x(oenv, &status, trxfile, &t, &xread, box);
+    tstart   = t;
     if (nat != atoms->nr)
     {
         fprintf(stderr, "\nWARNING: number of atoms in tpx (%d) and trajectory (%d) do not match\n", natoms, nat);
@@ -269,6 +697,7 @@ int gmx_covar(int argc, char *argv[])
     do
     {
         nframes0++;
+        tend = t;
         /* calculate x: a fitted struture of the selected atoms */
         if (bPBC)
         {
@@ -300,238 +729,279 @@ int gmx_covar(int argc, char *argv[])
                            atoms, xread, NULL, epbcNONE, zerobox, natoms, index);
     sfree(xread);
 
-    fprintf(stderr, "Constructing covariance matrix (%dx%d) ...\n", static_cast<int>(ndim), static_cast<int>(ndim));
-    nframes = 0;
-    nat     = read_first_x(oenv, &status, trxfile, &t, &xread, box);
-    tstart  = t;
-    do
+    if (bRef)
     {
-        nframes++;
-        tend = t;
-        /* calculate x: a (fitted) structure of the selected atoms */
-        if (bPBC)
+        /* copy the reference structure to the ouput array x */
+        snew(xproj, natoms);
+        for (i = 0; i < natoms; i++)
         {
-            gmx_rmpbc(gpbc, nat, box, xread);
+            copy_rvec(xref[index[i]], xproj[i]);
         }
-        if (bFit)
+    }
+    else
+    {
+        xproj = xav;
+    }
+
+    if (nvec > 0)
+    {
+        fprintf(stderr, "Computing the %d largest eigenvalues of the covariance matrix (%dx%d) ...\n",
+                nvec, static_cast<int>(ndim), static_cast<int>(ndim));
+        cs.trxfile = trxfile;
+        cs.oenv    = oenv;
+        cs.gpbc    = gpbc;
+        cs.bFit    = bFit;
+        cs.bRef    = bRef;
+        cs.nfit    = nfit;
+        cs.ifit    = ifit;
+        cs.w_rls   = w_rls;
+        cs.xref    = xref;
+        cs.natoms  = natoms;
+        cs.index   = index;
+        cs.xav     = xav;
+        cs.sqrtm   = sqrtm;
+        cs.nframes = nframes0;
+
+        snew(eigenvalues, nvec);
+        snew(mat, static_cast<size_t>(nvec)*ndim);
+        covar_partial_eigen(&cs, nvec, tol, eigenvalues, mat, &trace);
+        gmx_rmpbc_done(gpbc);
+        nframes = nframes0;
+
+        fprintf(stderr, "\nTrace of the covariance matrix: %g (%snm^2)\n",
+                trace, bM ? "u " : "");
+        sum = 0;
+        for (i = 0; i < nvec; i++)
         {
-            reset_x(nfit, ifit, nat, NULL, xread, w_rls);
-            do_fit(nat, w_rls, xref, xread);
+            sum += eigenvalues[i];
         }
-        if (bRef)
+        fprintf(stderr, "\nSum of the %d largest eigenvalues: %g (%snm^2), %.1f%% of the trace\n",
+                nvec, sum, bM ? "u " : "", 100*sum/trace);
+        /* The eigenvalues and vectors are in decreasing order */
+        bReverse = FALSE;
+    }
+    else
+    {
+        fprintf(stderr, "Constructing covariance matrix (%dx%d) ...\n", static_cast<int>(ndim), static_cast<int>(ndim));
+        nframes = 0;
+        nat     = read_first_x(oenv, &status, trxfile, &t, &xread, box);
+        tstart  = t;
+        do
         {
-            for (i = 0; i < natoms; i++)
+            nframes++;
+            tend = t;
+            /* calculate x: a (fitted) structure of the selected atoms */
+            if (bPBC)
             {
-                rvec_sub(xread[index[i]], xref[index[i]], x[i]);
+                gmx_rmpbc(gpbc, nat, box, xread);
             }
-        }
-        else
-        {
-            for (i = 0; i < natoms; i++)
+            if (bFit)
+            {
+                reset_x(nfit, ifit, nat, NULL, xread, w_rls);
+                do_fit(nat, w_rls, xref, xread);
+            }
+            if (bRef)
+            {
+                for (i = 0; i < natoms; i++)
+                {
+                    rvec_sub(xread[index[i]], xref[index[i]], x[i]);
+                }
+            }
+            else
+            {
+                for (i = 0; i < natoms; i++)
+                {
+                    rvec_sub(xread[index[i]], xav[i], x[i]);
+                }
+            }
+
+            for (j = 0; j < natoms; j++)
             {
-                rvec_sub(xread[index[i]], xav[i], x[i]);
+                for (dj = 0; dj < DIM; dj++)
+                {
+                    k  = ndim*(DIM*j+dj);
+                    xj = x[j][dj];
+                    for (i = j; i < natoms; i++)
+                    {
+                        l = k+DIM*i;
+                        for (d = 0; d < DIM; d++)
+                        {
+                            mat[l+d] += x[i][d]*xj;
+                        }
+                    }
+                }
             }
         }
+        while (read_next_x(oenv, status, &t, xread, box) &&
+               (bRef || nframes < nframes0));
+        close_trj(status);
+        gmx_rmpbc_done(gpbc);
+
+        fprintf(stderr, "Read %d frames\n", nframes);
 
+        /* correct the covariance matrix for the mass */
+        inv_nframes = 1.0/nframes;
         for (j = 0; j < natoms; j++)
         {
             for (dj = 0; dj < DIM; dj++)
             {
-                k  = ndim*(DIM*j+dj);
-                xj = x[j][dj];
                 for (i = j; i < natoms; i++)
                 {
-                    l = k+DIM*i;
+                    k = ndim*(DIM*j+dj)+DIM*i;
                     for (d = 0; d < DIM; d++)
                     {
-                        mat[l+d] += x[i][d]*xj;
+                        mat[k+d] = mat[k+d]*inv_nframes*sqrtm[i]*sqrtm[j];
                     }
                 }
             }
         }
-    }
-    while (read_next_x(oenv, status, &t, xread, box) &&
-           (bRef || nframes < nframes0));
-    close_trj(status);
-    gmx_rmpbc_done(gpbc);
-
-    fprintf(stderr, "Read %d frames\n", nframes);
 
-    if (bRef)
-    {
-        /* copy the reference structure to the ouput array x */
-        snew(xproj, natoms);
-        for (i = 0; i < natoms; i++)
-        {
-            copy_rvec(xref[index[i]], xproj[i]);
-        }
-    }
-    else
-    {
-        xproj = xav;
-    }
-
-    /* correct the covariance matrix for the mass */
-    inv_nframes = 1.0/nframes;
-    for (j = 0; j < natoms; j++)
-    {
-        for (dj = 0; dj < DIM; dj++)
+        /* symmetrize the matrix */
+        for (j = 0; j < ndim; j++)
         {
-            for (i = j; i < natoms; i++)
+            for (i = j; i < ndim; i++)
             {
-                k = ndim*(DIM*j+dj)+DIM*i;
-                for (d = 0; d < DIM; d++)
-                {
-                    mat[k+d] = mat[k+d]*inv_nframes*sqrtm[i]*sqrtm[j];
-                }
+                mat[ndim*i+j] = mat[ndim*j+i];
             }
         }
-    }
 
-    /* symmetrize the matrix */
-    for (j = 0; j < ndim; j++)
-    {
-        for (i = j; i < ndim; i++)
+        trace = 0;
+        for (i = 0; i < ndim; i++)
         {
-            mat[ndim*i+j] = mat[ndim*j+i];
+            trace += mat[i*ndim+i];
         }
-    }
+        fprintf(stderr, "\nTrace of the covariance matrix: %g (%snm^2)\n",
+                trace, bM ? "u " : "");
 
-    trace = 0;
-    for (i = 0; i < ndim; i++)
-    {
-        trace += mat[i*ndim+i];
-    }
-    fprintf(stderr, "\nTrace of the covariance matrix: %g (%snm^2)\n",
-            trace, bM ? "u " : "");
-
-    if (asciifile)
-    {
-        out = gmx_ffopen(asciifile, "w");
-        for (j = 0; j < ndim; j++)
+        if (asciifile)
         {
-            for (i = 0; i < ndim; i += 3)
+            out = gmx_ffopen(asciifile, "w");
+            for (j = 0; j < ndim; j++)
             {
-                fprintf(out, "%g %g %g\n",
-                        mat[ndim*j+i], mat[ndim*j+i+1], mat[ndim*j+i+2]);
+                for (i = 0; i < ndim; i += 3)
+                {
+                    fprintf(out, "%g %g %g\n",
+                            mat[ndim*j+i], mat[ndim*j+i+1], mat[ndim*j+i+2]);
+                }
             }
+            gmx_ffclose(out);
         }
-        gmx_ffclose(out);
-    }
 
-    if (xpmfile)
-    {
-        min = 0;
-        max = 0;
-        snew(mat2, ndim);
-        for (j = 0; j < ndim; j++)
+        if (xpmfile)
         {
-            mat2[j] = &(mat[ndim*j]);
-            for (i = 0; i <= j; i++)
+            min = 0;
+            max = 0;
+            snew(mat2, ndim);
+            for (j = 0; j < ndim; j++)
             {
-                if (mat2[j][i] < min)
-                {
-                    min = mat2[j][i];
-                }
-                if (mat2[j][j] > max)
+                mat2[j] = &(mat[ndim*j]);
+                for (i = 0; i <= j; i++)
                 {
-                    max = mat2[j][i];
+                    if (mat2[j][i] < min)
+                    {
+                        min = mat2[j][i];
+                    }
+                    if (mat2[j][j] > max)
+                    {
+                        max = mat2[j][i];
+                    }
                 }
             }
+            snew(axis, ndim);
+            for (i = 0; i < ndim; i++)
+            {
+                axis[i] = i+1;
+            }
+            rlo.r   = 0; rlo.g = 0; rlo.b = 1;
+            rmi.r   = 1; rmi.g = 1; rmi.b = 1;
+            rhi.r   = 1; rhi.g = 0; rhi.b = 0;
+            out     = gmx_ffopen(xpmfile, "w");
+            nlevels = 80;
+            write_xpm3(out, 0, "Covariance", bM ? "u nm^2" : "nm^2",
+                       "dim", "dim", ndim, ndim, axis, axis,
+                       mat2, min, 0.0, max, rlo, rmi, rhi, &nlevels);
+            gmx_ffclose(out);
+            sfree(axis);
+            sfree(mat2);
         }
-        snew(axis, ndim);
-        for (i = 0; i < ndim; i++)
-        {
-            axis[i] = i+1;
-        }
-        rlo.r   = 0; rlo.g = 0; rlo.b = 1;
-        rmi.r   = 1; rmi.g = 1; rmi.b = 1;
-        rhi.r   = 1; rhi.g = 0; rhi.b = 0;
-        out     = gmx_ffopen(xpmfile, "w");
-        nlevels = 80;
-        write_xpm3(out, 0, "Covariance", bM ? "u nm^2" : "nm^2",
-                   "dim", "dim", ndim, ndim, axis, axis,
-                   mat2, min, 0.0, max, rlo, rmi, rhi, &nlevels);
-        gmx_ffclose(out);
-        sfree(axis);
-        sfree(mat2);
-    }
 
-    if (xpmafile)
-    {
-        min = 0;
-        max = 0;
-        snew(mat2, ndim/DIM);
-        for (i = 0; i < ndim/DIM; i++)
-        {
-            snew(mat2[i], ndim/DIM);
-        }
-        for (j = 0; j < ndim/DIM; j++)
+        if (xpmafile)
         {
-            for (i = 0; i <= j; i++)
+            min = 0;
+            max = 0;
+            snew(mat2, ndim/DIM);
+            for (i = 0; i < ndim/DIM; i++)
             {
-                mat2[j][i] = 0;
-                for (d = 0; d < DIM; d++)
-                {
-                    mat2[j][i] += mat[ndim*(DIM*j+d)+DIM*i+d];
-                }
-                if (mat2[j][i] < min)
-                {
-                    min = mat2[j][i];
-                }
-                if (mat2[j][j] > max)
+                snew(mat2[i], ndim/DIM);
+            }
+            for (j = 0; j < ndim/DIM; j++)
+            {
+                for (i = 0; i <= j; i++)
                 {
-                    max = mat2[j][i];
+                    mat2[j][i] = 0;
+                    for (d = 0; d < DIM; d++)
+                    {
+                        mat2[j][i] += mat[ndim*(DIM*j+d)+DIM*i+d];
+                    }
+                    if (mat2[j][i] < min)
+                    {
+                        min = mat2[j][i];
+                    }
+                    if (mat2[j][j] > max)
+                    {
+                        max = mat2[j][i];
+                    }
+                    mat2[i][j] = mat2[j][i];
                 }
-                mat2[i][j] = mat2[j][i];
             }
+            snew(axis, ndim/DIM);
+            for (i = 0; i < ndim/DIM; i++)
+            {
+                axis[i] = i+1;
+            }
+            rlo.r   = 0; rlo.g = 0; rlo.b = 1;
+            rmi.r   = 1; rmi.g = 1; rmi.b = 1;
+            rhi.r   = 1; rhi.g = 0; rhi.b = 0;
+            out     = gmx_ffopen(xpmafile, "w");
+            nlevels = 80;
+            write_xpm3(out, 0, "Covariance", bM ? "u nm^2" : "nm^2",
+                       "atom", "atom", ndim/DIM, ndim/DIM, axis, axis,
+                       mat2, min, 0.0, max, rlo, rmi, rhi, &nlevels);
+            gmx_ffclose(out);
+            sfree(axis);
+            for (i = 0; i < ndim/DIM; i++)
+            {
+                sfree(mat2[i]);
+            }
+            sfree(mat2);
         }
-        snew(axis, ndim/DIM);
-        for (i = 0; i < ndim/DIM; i++)
-        {
-            axis[i] = i+1;
-        }
-        rlo.r   = 0; rlo.g = 0; rlo.b = 1;
-        rmi.r   = 1; rmi.g = 1; rmi.b = 1;
-        rhi.r   = 1; rhi.g = 0; rhi.b = 0;
-        out     = gmx_ffopen(xpmafile, "w");
-        nlevels = 80;
-        write_xpm3(out, 0, "Covariance", bM ? "u nm^2" : "nm^2",
-                   "atom", "atom", ndim/DIM, ndim/DIM, axis, axis,
-                   mat2, min, 0.0, max, rlo, rmi, rhi, &nlevels);
-        gmx_ffclose(out);
-        sfree(axis);
-        for (i = 0; i < ndim/DIM; i++)
-        {
-            sfree(mat2[i]);
-        }
-        sfree(mat2);
-    }
 
 
-    /* call diagonalization routine */
+        /* call diagonalization routine */
 
-    snew(eigenvalues, ndim);
-    snew(eigenvectors, ndim*ndim);
+        snew(eigenvalues, ndim);
+        snew(eigenvectors, ndim*ndim);
 
-    std::memcpy(eigenvectors, mat, ndim*ndim*sizeof(real));
-    fprintf(stderr, "\nDiagonalizing ...\n");
-    fflush(stderr);
-    eigensolver(eigenvectors, ndim, 0, ndim, eigenvalues, mat);
-    sfree(eigenvectors);
+        std::memcpy(eigenvectors, mat, ndim*ndim*sizeof(real));
+        fprintf(stderr, "\nDiagonalizing ...\n");
+        fflush(stderr);
+        eigensolver(eigenvectors, ndim, 0, ndim, eigenvalues, mat);
+        sfree(eigenvectors);
 
-    /* now write the output */
+        /* now write the output */
 
-    sum = 0;
-    for (i = 0; i < ndim; i++)
-    {
-        sum += eigenvalues[i];
-    }
-    fprintf(stderr, "\nSum of the eigenvalues: %g (%snm^2)\n",
-            sum, bM ? "u " : "");
-    if (std::abs(trace-sum) > 0.01*trace)
-    {
-        fprintf(stderr, "\nWARNING: eigenvalue sum deviates from the trace of the covariance matrix\n");
+        sum = 0;
+        for (i = 0; i < ndim; i++)
+        {
+            sum += eigenvalues[i];
+        }
+        fprintf(stderr, "\nSum of the eigenvalues: %g (%snm^2)\n",
+                sum, bM ? "u " : "");
+        if (std::abs(trace-sum) > 0.01*trace)
+        {
+            fprintf(stderr, "\nWARNING: eigenvalue sum deviates from the trace of the covariance matrix\n");
+        }
+        bReverse = TRUE;
     }
 
     /* Set 'end', the maximum eigenvector and -value index used for output */
@@ -549,6 +1019,10 @@ int gmx_covar(int argc, char *argv[])
             end = ndim;
         }
     }
+    if (nvec > 0)
+    {
+        end = std::min(end, nvec);
+    }
 
     fprintf(stderr, "\nWriting eigenvalues to %s\n", eigvalfile);
 
@@ -558,7 +1032,8 @@ int gmx_covar(int argc, char *argv[])
                    "Eigenvector index", str, oenv);
     for (i = 0; (i < end); i++)
     {
-        fprintf (out, "%10d %g\n", static_cast<int>(i+1), eigenvalues[ndim-1-i]);
+        fprintf (out, "%10d %g\n", static_cast<int>(i+1),
+                 bReverse ? eigenvalues[ndim-1-i] : eigenvalues[i]);
     }
     xvgrclose(out);
 
@@ -584,7 +1059,7 @@ int gmx_covar(int argc, char *argv[])
         WriteXref = eWXR_NOFIT;
     }
 
-    write_eigenvectors(eigvecfile, natoms, mat, TRUE, 1, end,
+    write_eigenvectors(eigvecfile, natoms, mat, bReverse, 1, end,
                        WriteXref, x, bDiffMass1, xproj, bM, eigenvalues);
 
     out = gmx_ffopen(logfile, "w");
@@ -623,11 +1098,21 @@ int gmx_covar(int argc, char *argv[])
     {
         fprintf(out, "Fit is %smass weighted\n", bDiffMass1 ? "" : "non-");
     }
-    fprintf(out, "Diagonalized the %dx%d covariance matrix\n", static_cast<int>(ndim), static_cast<int>(ndim));
-    fprintf(out, "Trace of the covariance matrix before diagonalizing: %g\n",
-            trace);
-    fprintf(out, "Trace of the covariance matrix after diagonalizing: %g\n\n",
-            sum);
+    if (nvec > 0)
+    {
+        fprintf(out, "Computed the %d largest eigenvalues of the %dx%d covariance matrix without constructing it\n",
+                nvec, static_cast<int>(ndim), static_cast<int>(ndim));
+        fprintf(out, "Trace of the covariance matrix: %g\n", trace);
+        fprintf(out, "Sum of the computed eigenvalues: %g\n\n", sum);
+    }
+    else
+    {
+        fprintf(out, "Diagonalized the %dx%d covariance matrix\n", static_cast<int>(ndim), static_cast<int>(ndim));
+        fprintf(out, "Trace of the covariance matrix before diagonalizing: %g\n",
+                trace);
+        fprintf(out, "Trace of the covariance matrix after diagonalizing: %g\n\n",
+                sum);
+    }
 
     fprintf(out, "Wrote %d eigenvalues to %s\n", static_cast<int>(end), eigvalfile);
     if (WriteXref == eWXR_YES)
@@ -36,14 +36,19 @@
  */
 #include "gmxpre.h"
 
+#include "config.h"
+
 #include <cctype>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
 
+#include <algorithm>
+
 #include "gromacs/commandline/pargs.h"
 #include "gromacs/fileio/trxio.h"
 #include "gromacs/fileio/xvgr.h"
+#include "gromacs/gmxana/densgrid.h"
 #include "gromacs/gmxana/gmx_ana.h"
 #include "gromacs/gmxana/gstat.h"
 #include "gromacs/legacyheaders/typedefs.h"
@@ -55,9 +60,11 @@
 #include "gromacs/topology/index.h"
 #include "gromacs/utility/arraysize.h"
 #include "gromacs/utility/cstringutil.h"
+#include "gromacs/utility/exceptions.h"
 #include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/futil.h"
 #include "gromacs/utility/gmxassert.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 
 typedef struct {
@@ -167,183 +174,106 @@ void center_coords(t_atoms *atoms, atom_id *index_center, int ncenter,
     }
 }
 
-void calc_electron_density(const char *fn, atom_id **index, int gnx[],
-                           double ***slDensity, int *nslices, t_topology *top,
-                           int ePBC,
-                           int axis, int nr_grps, real *slWidth,
-                           t_electron eltab[], int nr, gmx_bool bCenter,
-                           atom_id *index_center, int ncenter,
-                           gmx_bool bRelative, const output_env_t oenv)
+void calc_electron_weights(atom_id **index, int gnx[], int nr_grps,
+                           t_topology *top, t_electron eltab[], int nr,
+                           real weight[])
 {
-    rvec        *x0;            /* coordinates without pbc */
-    matrix       box;           /* box (3x3) */
-    double       invvol;
-    int          natoms;        /* nr. atoms in trj */
-    t_trxstatus *status;
-    int          i, n,          /* loop indices */
-                 nr_frames = 0, /* number of frames */
-                 slice;         /* current slice */
-    t_electron  *found;         /* found by bsearch */
-    t_electron   sought;        /* thingie thought by bsearch */
-    real         boxSz, aveBox;
-    gmx_rmpbc_t  gpbc = NULL;
-
-    real         t,
-                 z;
-
-    if (axis < 0 || axis >= DIM)
-    {
-        gmx_fatal(FARGS, "Invalid axes. Terminating\n");
-    }
-
-    if ((natoms = read_first_x(oenv, &status, fn, &t, &x0, box)) == 0)
-    {
-        gmx_fatal(FARGS, "Could not read coordinates from statusfile\n");
-    }
-
-    aveBox = 0;
-
-    if (!*nslices)
-    {
-        *nslices = static_cast<int>(box[axis][axis] * 10); /* default value */
-        fprintf(stderr, "\nDividing the box in %d slices\n", *nslices);
-    }
+    int         n, i;
+    t_electron *found;  /* found by bsearch */
+    t_electron  sought; /* thingie thought by bsearch */
 
-    snew(*slDensity, nr_grps);
-    for (i = 0; i < nr_grps; i++)
-    {
-        snew((*slDensity)[i], *nslices);
-    }
-
-    gpbc = gmx_rmpbc_init(&top->idef, ePBC, top->atoms.nr);
-    /*********** Start processing trajectory ***********/
-    do
+    for (n = 0; n < nr_grps; n++)
     {
-        gmx_rmpbc(gpbc, natoms, box, x0);
-
-        /* Translate atoms so the com of the center-group is in the
-         * box geometrical center.
-         */
-        if (bCenter)
+        for (i = 0; i < gnx[n]; i++)
         {
-            center_coords(&top->atoms, index_center, ncenter, box, x0);
-        }
-
-        invvol   = *nslices/(box[XX][XX]*box[YY][YY]*box[ZZ][ZZ]);
-
-        if (bRelative)
-        {
-            *slWidth = 1.0/(*nslices);
-            boxSz    = 1.0;
-        }
-        else
-        {
-            *slWidth = box[axis][axis]/(*nslices);
-            boxSz    = box[axis][axis];
-        }
+            sought.nr_el    = 0;
+            sought.atomname = *(top->atoms.atomname[index[n][i]]);
 
-        aveBox += box[axis][axis];
+            found = (t_electron *)
+                bsearch((const void *)&sought,
+                        (const void *)eltab, nr, sizeof(t_electron),
+                        (int(*)(const void*, const void*))compare);
 
-        for (n = 0; n < nr_grps; n++)
-        {
-            for (i = 0; i < gnx[n]; i++) /* loop over all atoms in index file */
+            if (found == NULL)
             {
-                z = x0[index[n][i]][axis];
-                while (z < 0)
-                {
-                    z += box[axis][axis];
-                }
-                while (z > box[axis][axis])
-                {
-                    z -= box[axis][axis];
-                }
-
-                if (bRelative)
-                {
-                    z = z/box[axis][axis];
-                }
-
-                /* determine which slice atom is in */
-                if (bCenter)
-                {
-                    slice = static_cast<int>(std::floor( (z-(boxSz/2.0)) / (*slWidth) ) + *nslices/2);
-                }
-                else
-                {
-                    slice = static_cast<int>(z / (*slWidth));
-                }
-                sought.nr_el    = 0;
-                sought.atomname = gmx_strdup(*(top->atoms.atomname[index[n][i]]));
-
-                /* now find the number of electrons. This is not efficient. */
-                found = (t_electron *)
-                    bsearch((const void *)&sought,
-                            (const void *)eltab, nr, sizeof(t_electron),
-                            (int(*)(const void*, const void*))compare);
-
-                if (found == NULL)
-                {
-                    fprintf(stderr, "Couldn't find %s. Add it to the .dat file\n",
-                            *(top->atoms.atomname[index[n][i]]));
-                }
-                else
-                {
-                    (*slDensity)[n][slice] += (found->nr_el -
-                                               top->atoms.atom[index[n][i]].q)*invvol;
-                }
-                free(sought.atomname);
+                fprintf(stderr, "Couldn't find %s. Add it to the .dat file\n",
+                        *(top->atoms.atomname[index[n][i]]));
+                weight[index[n][i]] = 0;
+            }
+            else
+            {
+                weight[index[n][i]] = found->nr_el - top->atoms.atom[index[n][i]].q;
             }
         }
-        nr_frames++;
     }
-    while (read_next_x(oenv, status, &t, x0, box));
-    gmx_rmpbc_done(gpbc);
-
-    /*********** done with status file **********/
-    close_trj(status);
+}
 
-/* slDensity now contains the total number of electrons per slice, summed
-   over all frames. Now divide by nr_frames and volume of slice
+/* Spreads the frames in fb onto the slices of each group, in parallel
+ * over the frames, and empties the batch
  */
+static void spread_density_frames(t_densgrid **grid, t_frame_batch *fb,
+                                  t_topology *top, atom_id **index, int gnx[],
+                                  const real weight[], int nslices, int axis,
+                                  int nr_grps, gmx_bool bCenter,
+                                  atom_id *index_center, int ncenter)
+{
+    int f;
 
-    fprintf(stderr, "\nRead %d frames from trajectory. Counting electrons\n",
-            nr_frames);
-
-    if (bRelative)
-    {
-        aveBox  /= nr_frames;
-        *slWidth = aveBox/(*nslices);
-    }
-
-    for (n = 0; n < nr_grps; n++)
+#pragma omp parallel for schedule(static) num_threads(std::min(fb->nframes, grid[0]->nthreads))
+    for (f = 0; f < fb->nframes; f++)
     {
-        for (i = 0; i < *nslices; i++)
+        try
         {
-            (*slDensity)[n][i] /= nr_frames;
+            int    thread = gmx_omp_get_thread_num();
+            rvec  *x0     = fb->x[f];
+            real   origin, invspacing, invvol, boxSz;
+            int    n;
+
+            /* Translate atoms so the com of the center-group is in the
+             * box geometrical center.
+             */
+            if (bCenter)
+            {
+                center_coords(&top->atoms, index_center, ncenter, fb->box[f], x0);
+            }
+
+            invvol     = nslices/(fb->box[f][XX][XX]*fb->box[f][YY][YY]*fb->box[f][ZZ][ZZ]);
+            boxSz      = fb->box[f][axis][axis];
+            invspacing = nslices/boxSz;
+            /* With centering slice nslices/2 starts at the box center */
+            origin     = (bCenter ? 0.5*boxSz - (nslices/2)/invspacing : 0);
+
+            for (n = 0; n < nr_grps; n++)
+            {
+                spread_densgrid(grid[n], thread, &origin, &invspacing,
+                                gnx[n], index[n], x0, weight, invvol);
+            }
         }
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
     }
-
-    sfree(x0); /* free memory used by coordinate array */
+    fb->nframes = 0;
 }
 
 void calc_density(const char *fn, atom_id **index, int gnx[],
+                  const real weight[],
                   double ***slDensity, int *nslices, t_topology *top, int ePBC,
                   int axis, int nr_grps, real *slWidth, gmx_bool bCenter,
                   atom_id *index_center, int ncenter,
-                  gmx_bool bRelative, const output_env_t oenv)
+                  gmx_bool bRelative, int spread, real sigma,
+                  const output_env_t oenv)
 {
-    rvec        *x0;            /* coordinates without pbc */
-    matrix       box;           /* box (3x3) */
-    double       invvol;
-    int          natoms;        /* nr. atoms in trj */
-    t_trxstatus *status;
-    int          i, n,          /* loop indices */
-                 nr_frames = 0, /* number of frames */
-                 slice;         /* current slice */
-    real         t,
-                 z;
-    real         boxSz, aveBox;
-    gmx_rmpbc_t  gpbc = NULL;
+    rvec          *x0;            /* coordinates without pbc */
+    matrix         box;           /* box (3x3) */
+    int            natoms;        /* nr. atoms in trj */
+    t_trxstatus   *status;
+    int            i, n,          /* loop indices */
+                   nr_frames = 0; /* number of frames */
+    real           t;
+    real           aveBox, lastBox;
+    gmx_bool       bPeriodic = TRUE;
+    t_densgrid   **grid;          /* slices per group */
+    t_frame_batch  fb;
+    gmx_rmpbc_t    gpbc = NULL;
 
     if (axis < 0 || axis >= DIM)
     {
@@ -363,11 +293,15 @@ void calc_density(const char *fn, atom_id **index, int gnx[],
         fprintf(stderr, "\nDividing the box in %d slices\n", *nslices);
     }
 
-    snew(*slDensity, nr_grps);
-    for (i = 0; i < nr_grps; i++)
+    /* The slices are periodic along the axis, which takes care of atoms
+     * that are outside the box, also after centering.
+     */
+    snew(grid, nr_grps);
+    for (n = 0; n < nr_grps; n++)
     {
-        snew((*slDensity)[i], *nslices);
+        grid[n] = init_densgrid(1, nslices, &axis, &bPeriodic, spread, sigma);
     }
+    init_frame_batch(&fb, grid[0]->nthreads, natoms);
 
     gpbc = gmx_rmpbc_init(&top->idef, ePBC, top->atoms.nr);
     /*********** Start processing trajectory ***********/
@@ -375,83 +309,27 @@ void calc_density(const char *fn, atom_id **index, int gnx[],
     {
         gmx_rmpbc(gpbc, natoms, box, x0);
 
-        /* Translate atoms so the com of the center-group is in the
-         * box geometrical center.
-         */
-        if (bCenter)
-        {
-            center_coords(&top->atoms, index_center, ncenter, box, x0);
-        }
-
-        invvol   = *nslices/(box[XX][XX]*box[YY][YY]*box[ZZ][ZZ]);
-
-        if (bRelative)
-        {
-            *slWidth = 1.0/(*nslices);
-            boxSz    = 1.0;
-        }
-        else
-        {
-            *slWidth = box[axis][axis]/(*nslices);
-            boxSz    = box[axis][axis];
-        }
-
         aveBox += box[axis][axis];
+        lastBox = box[axis][axis];
 
-        for (n = 0; n < nr_grps; n++)
+        /* The frames are binned in parallel batches */
+        if (add_frame_batch(&fb, t, box, NULL, x0))
         {
-            for (i = 0; i < gnx[n]; i++) /* loop over all atoms in index file */
-            {
-                z = x0[index[n][i]][axis];
-                while (z < 0)
-                {
-                    z += box[axis][axis];
-                }
-                while (z > box[axis][axis])
-                {
-                    z -= box[axis][axis];
-                }
-
-                if (bRelative)
-                {
-                    z = z/box[axis][axis];
-                }
-
-                /* determine which slice atom is in */
-                if (bCenter)
-                {
-                    slice = static_cast<int>(std::floor( (z-(boxSz/2.0)) / (*slWidth) ) + *nslices/2);
-                }
-                else
-                {
-                    slice = static_cast<int>(std::floor(z / (*slWidth)));
-                }
-
-                /* Slice should already be 0<=slice<nslices, but we just make
-                 * sure we are not hit by IEEE rounding errors since we do
-                 * math operations after applying PBC above.
-                 */
-                if (slice < 0)
-                {
-                    slice += *nslices;
-                }
-                else if (slice >= *nslices)
-                {
-                    slice -= *nslices;
-                }
-
-                (*slDensity)[n][slice] += top->atoms.atom[index[n][i]].m*invvol;
-            }
+            spread_density_frames(grid, &fb, top, index, gnx, weight, *nslices, axis,
+                                  nr_grps, bCenter, index_center, ncenter);
         }
         nr_frames++;
     }
     while (read_next_x(oenv, status, &t, x0, box));
+    spread_density_frames(grid, &fb, top, index, gnx, weight, *nslices, axis,
+                          nr_grps, bCenter, index_center, ncenter);
+    done_frame_batch(&fb);
     gmx_rmpbc_done(gpbc);
 
     /*********** done with status file **********/
     close_trj(status);
 
-    /* slDensity now contains the total mass per slice, summed over all
+    /* The grids now contain the total weight per slice, summed over all
        frames. Now divide by nr_frames and volume of slice
      */
 
@@ -463,14 +341,23 @@ void calc_density(const char *fn, atom_id **index, int gnx[],
         aveBox  /= nr_frames;
         *slWidth = aveBox/(*nslices);
     }
+    else
+    {
+        *slWidth = lastBox/(*nslices);
+    }
 
+    snew(*slDensity, nr_grps);
     for (n = 0; n < nr_grps; n++)
     {
+        reduce_densgrid(grid[n]);
+        snew((*slDensity)[n], *nslices);
         for (i = 0; i < *nslices; i++)
         {
-            (*slDensity)[n][i] /= nr_frames;
+            (*slDensity)[n][i] = grid[n]->grid[i]/nr_frames;
         }
+        done_densgrid(grid[n]);
     }
+    sfree(grid);
 
     sfree(x0); /* free memory used by coordinate array */
 }
@@ -564,7 +451,10 @@ int gmx_density(int argc, char *argv[])
         "bZ/2 if you center based on the entire system.",
         "Note that this behaviour has changed in GROMACS 5.0; earlier versions",
         "merely performed a static binning in (0,bZ) and shifted the output. Now",
-        "we compute the center for each frame and bin in (-bZ/2,bZ/2).[PAR]",
+        "we compute the center for each frame and bin in (-bZ/2,bZ/2).",
+        "The center is the center of mass of the group for all density types.",
+        "Before GROMACS 5.2, number densities centered on the geometric center",
+        "and charge densities on the charge-weighted center.[PAR]",
 
         "Option [TT]-symm[tt] symmetrizes the output around the center. This will",
         "automatically turn on [TT]-center[tt] too.",
@@ -587,6 +477,15 @@ int gmx_density(int argc, char *argv[])
         "The number of electrons for each atom is modified by its atomic",
         "partial charge.[PAR]",
 
+        "By default each atom is counted in the slice it is in. With",
+        "[TT]-spread linear[tt] it is distributed over the two nearest slices,",
+        "and with [TT]-spread gauss[tt] over a Gaussian with width [TT]-sigma[tt],",
+        "which gives smoother profiles with thin slices. Frames are processed",
+        "in parallel, see [TT]-nt[tt]. The slice of an atom is computed",
+        "from its coordinate times the number of slices over the box size.",
+        "Atoms within rounding distance of a slice boundary can therefore",
+        "end up in the neighboring slice compared with versions before 5.2.[PAR]",
+
         "IMPORTANT CONSIDERATIONS FOR BILAYERS[PAR]",
         "One of the most common usage scenarios is to calculate the density of various",
         "groups across a lipid bilayer, typically with the z axis being the normal",
@@ -629,6 +528,9 @@ int gmx_density(int argc, char *argv[])
     static gmx_bool    bSymmetrize = FALSE;
     static gmx_bool    bCenter     = FALSE;
     static gmx_bool    bRelative   = FALSE;
+    static const char *espread[]   = { NULL, "bin", "linear", "gauss", NULL };
+    static real        sigma       = 0.1;
+    static int         nthreads    = -1;
 
     t_pargs            pa[]        = {
         { "-d", FALSE, etSTR, {&axtitle},
@@ -644,7 +546,15 @@ int gmx_density(int argc, char *argv[])
         { "-symm",     FALSE, etBOOL, {&bSymmetrize},
           "Symmetrize the density along the axis, with respect to the center. Useful for bilayers." },
         { "-relative", FALSE, etBOOL, {&bRelative},
-          "Use relative coordinates for changing boxes and scale output by average dimensions." }
+          "Use relative coordinates for changing boxes and scale output by average dimensions." },
+        { "-spread",   FALSE, etENUM, {espread},
+          "How to spread each atom over the slices" },
+        { "-sigma",    FALSE, etREAL, {&sigma},
+          "Width of the Gaussian with [TT]-spread gauss[tt] (nm)" },
+#ifdef GMX_OPENMP
+        { "-nt",       FALSE, etINT, {&nthreads},
+          "Number of threads used by [THISMODULE] (if -1, all threads will be used or what is specified by the environment variable OMP_NUM_THREADS)" },
+#endif
     };
 
     const char        *bugs[] = {
@@ -659,6 +569,7 @@ int gmx_density(int argc, char *argv[])
     int                ncenter;        /* size of centering group    */
     int               *ngx;            /* sizes of groups            */
     t_electron        *el_tab;         /* tabel with nr. of electrons*/
+    real              *weight;         /* contribution of each atom  */
     t_topology        *top;            /* topology               */
     int                ePBC;
     atom_id           *index_center;   /* index for centering group  */
@@ -684,6 +595,11 @@ int gmx_density(int argc, char *argv[])
 
     GMX_RELEASE_ASSERT(dens_opt[0] != NULL, "Option setting inconsistency; dens_opt[0] is NULL");
 
+    if (nthreads > 0)
+    {
+        gmx_omp_set_num_threads(nthreads);
+    }
+
     if (bSymmetrize && !bCenter)
     {
         fprintf(stderr, "Can not symmetrize without centering. Turning on -center\n");
@@ -693,18 +609,14 @@ int gmx_density(int argc, char *argv[])
     axis = toupper(axtitle[0]) - 'X';
 
     top = read_top(ftp2fn(efTPR, NFILE, fnm), &ePBC); /* read topology file */
-    if (dens_opt[0][0] == 'n')
-    {
-        for (i = 0; (i < top->atoms.nr); i++)
-        {
-            top->atoms.atom[i].m = 1;
-        }
-    }
-    else if (dens_opt[0][0] == 'c')
+    snew(weight, top->atoms.nr);
+    for (i = 0; (i < top->atoms.nr); i++)
     {
-        for (i = 0; (i < top->atoms.nr); i++)
+        switch (dens_opt[0][0])
         {
-            top->atoms.atom[i].m = top->atoms.atom[i].q;
+            case 'n': weight[i] = 1;                    break;
+            case 'c': weight[i] = top->atoms.atom[i].q; break;
+            default:  weight[i] = top->atoms.atom[i].m; break;
         }
     }
 
@@ -736,18 +648,13 @@ int gmx_density(int argc, char *argv[])
         nr_electrons =  get_electrons(&el_tab, ftp2fn(efDAT, NFILE, fnm));
         fprintf(stderr, "Read %d atomtypes from datafile\n", nr_electrons);
 
-        calc_electron_density(ftp2fn(efTRX, NFILE, fnm), index, ngx, &density,
-                              &nslices, top, ePBC, axis, ngrps, &slWidth, el_tab,
-                              nr_electrons, bCenter, index_center, ncenter,
-                              bRelative, oenv);
-    }
-    else
-    {
-        calc_density(ftp2fn(efTRX, NFILE, fnm), index, ngx, &density, &nslices, top,
-                     ePBC, axis, ngrps, &slWidth, bCenter, index_center, ncenter,
-                     bRelative, oenv);
+        calc_electron_weights(index, ngx, ngrps, top, el_tab, nr_electrons, weight);
     }
 
+    calc_density(ftp2fn(efTRX, NFILE, fnm), index, ngx, weight, &density, &nslices, top,
+                 ePBC, axis, ngrps, &slWidth, bCenter, index_center, ncenter,
+                 bRelative, nenum(espread), sigma, oenv);
+
     plot_density(density, opt2fn("-o", NFILE, fnm),
                  nslices, ngrps, grpname, slWidth, dens_opt,
                  bCenter, bRelative, bSymmetrize, oenv);
@@ -36,13 +36,18 @@
  */
 #include "gmxpre.h"
 
+#include "config.h"
+
 #include <cmath>
 #include <cstring>
 
+#include <algorithm>
+
 #include "gromacs/commandline/pargs.h"
 #include "gromacs/fileio/confio.h"
 #include "gromacs/fileio/matio.h"
 #include "gromacs/fileio/trxio.h"
+#include "gromacs/gmxana/densgrid.h"
 #include "gromacs/gmxana/gmx_ana.h"
 #include "gromacs/gmxana/gstat.h"
 #include "gromacs/legacyheaders/txtdump.h"
@@ -53,11 +58,155 @@
 #include "gromacs/topology/index.h"
 #include "gromacs/utility/arraysize.h"
 #include "gromacs/utility/cstringutil.h"
+#include "gromacs/utility/exceptions.h"
 #include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/futil.h"
 #include "gromacs/utility/gmxassert.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 
+/* The settings of a planar or axial-radial density map */
+typedef struct {
+    gmx_bool   bRadial;
+    gmx_bool   bXmin, bXmax;
+    real       xmin, xmax;
+    int        cav, c1, c2;   /* Averaging and map directions */
+    int        n1, n2;
+    int        nmpower;
+    int        ePBC;
+    real       amax, rmax;
+    real       invspa, invspz;
+    gmx_bool   bMirror;
+    int        nindex;
+    atom_id   *index;         /* Analysis atoms for the axial-radial map */
+    int       *gnx;           /* The groups defining the axis */
+    atom_id  **ind;
+    t_atoms   *atoms;
+} t_densmap;
+
+/* Spreads one frame onto the map. For a planar map x contains only the
+ * nindex analysis atoms, for an axial-radial map all atoms. sel and xr
+ * are thread-local buffers of nindex elements.
+ */
+static void spread_densmap_frame(t_densgrid *g, int thread, const t_densmap *dm,
+                                 matrix box, const rvec x[],
+                                 atom_id *sel, rvec *xr)
+{
+    t_pbc    pbc;
+    rvec     xcom[2], direction, center, dx;
+    real     origin[2], invspacing[2], invcellvol, m, mtot, axial, r;
+    int      i, j, k, l, nsel;
+
+    origin[0] = 0;
+    origin[1] = 0;
+    if (!dm->bRadial)
+    {
+        invcellvol = dm->n1*dm->n2;
+        if (dm->nmpower == -3)
+        {
+            invcellvol /= det(box);
+        }
+        else if (dm->nmpower == -2)
+        {
+            invcellvol /= box[dm->c1][dm->c1]*box[dm->c2][dm->c2];
+        }
+        nsel = 0;
+        if (dm->bXmin || dm->bXmax)
+        {
+            for (i = 0; i < dm->nindex; i++)
+            {
+                if ((!dm->bXmin || x[i][dm->cav] >= dm->xmin) &&
+                    (!dm->bXmax || x[i][dm->cav] <= dm->xmax))
+                {
+                    sel[nsel++] = i;
+                }
+            }
+        }
+        invspacing[0] = dm->n1/box[dm->c1][dm->c1];
+        invspacing[1] = dm->n2/box[dm->c2][dm->c2];
+        spread_densgrid(g, thread, origin, invspacing,
+                        (dm->bXmin || dm->bXmax) ? nsel : dm->nindex,
+                        (dm->bXmin || dm->bXmax) ? sel : NULL,
+                        x, NULL, invcellvol);
+    }
+    else
+    {
+        set_pbc(&pbc, dm->ePBC, box);
+        for (i = 0; i < 2; i++)
+        {
+            if (dm->gnx[i] == 1)
+            {
+                /* One atom, just copy the coordinates */
+                copy_rvec(x[dm->ind[i][0]], xcom[i]);
+            }
+            else
+            {
+                /* Calculate the center of mass */
+                clear_rvec(xcom[i]);
+                mtot = 0;
+                for (j = 0; j < dm->gnx[i]; j++)
+                {
+                    k = dm->ind[i][j];
+                    m = dm->atoms->atom[k].m;
+                    for (l = 0; l < DIM; l++)
+                    {
+                        xcom[i][l] += m*x[k][l];
+                    }
+                    mtot += m;
+                }
+                svmul(1/mtot, xcom[i], xcom[i]);
+            }
+        }
+        pbc_dx(&pbc, xcom[1], xcom[0], direction);
+        for (i = 0; i < DIM; i++)
+        {
+            center[i] = xcom[0][i] + 0.5*direction[i];
+        }
+        unitv(direction, direction);
+        /* Store the axial and radial coordinates, shifted to the grid */
+        for (i = 0; i < dm->nindex; i++)
+        {
+            j = dm->index[i];
+            pbc_dx(&pbc, x[j], center, dx);
+            axial = iprod(dx, direction);
+            r     = std::sqrt(norm2(dx) - axial*axial);
+            if (dm->bMirror)
+            {
+                r += dm->rmax;
+            }
+            xr[i][XX] = axial + dm->amax;
+            xr[i][YY] = r;
+            xr[i][ZZ] = 0;
+        }
+        invspacing[0] = dm->invspa;
+        invspacing[1] = dm->invspz;
+        spread_densgrid(g, thread, origin, invspacing, dm->nindex, NULL, xr, NULL, 1);
+    }
+}
+
+/* Spreads the frames in fb onto the map, in parallel over the frames,
+ * and empties the batch
+ */
+static void spread_densmap_frames(t_densgrid *g, t_frame_batch *fb,
+                                  const t_densmap *dm, atom_id **sel, rvec **xr)
+{
+    int f;
+
+#pragma omp parallel for schedule(static) num_threads(std::min(fb->nframes, g->nthreads))
+    for (f = 0; f < fb->nframes; f++)
+    {
+        try
+        {
+            int thread = gmx_omp_get_thread_num();
+
+            spread_densmap_frame(g, thread, dm, fb->box[f], fb->x[f],
+                                 sel[thread], xr[thread]);
+        }
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+    }
+    fb->nframes = 0;
+}
+
 int gmx_densmap(int argc, char *argv[])
 {
     const char        *desc[] = {
@@ -92,13 +241,22 @@ int gmx_densmap(int argc, char *argv[])
         "Option [TT]count[tt] produces the count for each grid cell.",
         "When you do not want the scale in the output to go",
         "from zero to the maximum density, you can set the maximum",
-        "with the option [TT]-dmax[tt]."
+        "with the option [TT]-dmax[tt].",
+        "[PAR]",
+        "By default each atom is counted in the grid cell it is in.",
+        "With [TT]-spread linear[tt] each atom is distributed linearly over",
+        "the four nearest cells, with [TT]-spread gauss[tt] over a Gaussian",
+        "of width [TT]-sigma[tt], which gives smoother maps for short trajectories.",
+        "The frames are processed in parallel with OpenMP threads, see [TT]-nt[tt]."
     };
-    static int         n1      = 0, n2 = 0;
-    static real        xmin    = -1, xmax = -1, bin = 0.02, dmin = 0, dmax = 0, amax = 0, rmax = 0;
-    static gmx_bool    bMirror = FALSE, bSums = FALSE;
-    static const char *eaver[] = { NULL, "z", "y", "x", NULL };
-    static const char *eunit[] = { NULL, "nm-3", "nm-2", "count", NULL };
+    static int         n1        = 0, n2 = 0;
+    static real        xmin      = -1, xmax = -1, bin = 0.02, dmin = 0, dmax = 0, amax = 0, rmax = 0;
+    static gmx_bool    bMirror   = FALSE, bSums = FALSE;
+    static const char *eaver[]   = { NULL, "z", "y", "x", NULL };
+    static const char *eunit[]   = { NULL, "nm-3", "nm-2", "count", NULL };
+    static const char *espread[] = { NULL, "bin", "linear", "gauss", NULL };
+    static real        sigma     = 0.02;
+    static int         nthreads  = -1;
 
     t_pargs            pa[] = {
         { "-bin", FALSE, etREAL, {&bin},
@@ -127,23 +285,37 @@ int gmx_densmap(int argc, char *argv[])
           "Minimum density in output"},
         { "-dmax", FALSE, etREAL, {&dmax},
           "Maximum density in output (0 means calculate it)"},
+        { "-spread", FALSE, etENUM, {espread},
+          "How to spread each atom over the grid cells" },
+        { "-sigma", FALSE, etREAL, {&sigma},
+          "Width of the Gaussian with [TT]-spread gauss[tt] (nm)" },
+#ifdef GMX_OPENMP
+        { "-nt", FALSE, etINT, {&nthreads},
+          "Number of threads used by [THISMODULE] (if -1, all threads will be used or what is specified by the environment variable OMP_NUM_THREADS)" },
+#endif
     };
     gmx_bool           bXmin, bXmax, bRadial;
     FILE              *fp;
     t_trxstatus       *status;
     t_topology         top;
     int                ePBC = -1;
-    rvec              *x, xcom[2], direction, center, dx;
+    rvec              *x;
     matrix             box;
-    real               t, m, mtot;
-    t_pbc              pbc;
+    real               t;
     int                cav = 0, c1 = 0, c2 = 0;
     char             **grpname, buf[STRLEN];
     const char        *unit;
-    int                i, j, k, l, ngrps, anagrp, *gnx = NULL, nindex, nradial = 0, nfr, nmpower;
+    int                i, j, k, ngrps, anagrp, *gnx = NULL, nindex, nradial = 0, nfr, nmpower;
+    int                natoms, ngrid[2], gaxis[2];
+    gmx_bool           bPeriodic[2];
     atom_id          **ind = NULL, *index;
-    real             **grid, maxgrid, m1, m2, box1, box2, *tickx, *tickz, invcellvol;
-    real               invspa = 0, invspz = 0, axial, r, vol_old, vol, rowsum;
+    real             **grid, maxgrid, box1, box2, *tickx, *tickz;
+    real               invspa = 0, invspz = 0, vol_old, vol, rowsum;
+    t_densmap          dm;
+    t_densgrid        *dgrid;
+    t_frame_batch      fb;
+    atom_id          **sel;
+    rvec             **xr;
     int                nlev   = 51;
     t_rgb              rlo    = {1, 1, 1}, rhi = {0, 0, 0};
     output_env_t       oenv;
@@ -166,6 +338,11 @@ int gmx_densmap(int argc, char *argv[])
         return 0;
     }
 
+    if (nthreads > 0)
+    {
+        gmx_omp_set_num_threads(nthreads);
+    }
+
     bXmin   = opt2parg_bSet("-xmin", npargs, pa);
     bXmax   = opt2parg_bSet("-xmax", npargs, pa);
     bRadial = (amax > 0 || rmax > 0);
@@ -235,7 +412,7 @@ int gmx_densmap(int argc, char *argv[])
         case 'z': cav = ZZ; c1 = XX; c2 = YY; break;
     }
 
-    read_first_x(oenv, &status, ftp2fn(efTRX, NFILE, fnm), &t, &x, box);
+    natoms = read_first_x(oenv, &status, ftp2fn(efTRX, NFILE, fnm), &t, &x, box);
 
     if (!bRadial)
     {
@@ -266,10 +443,55 @@ int gmx_densmap(int argc, char *argv[])
         }
     }
 
-    snew(grid, n1);
-    for (i = 0; i < n1; i++)
+    dm.bRadial = bRadial;
+    dm.bXmin   = bXmin;
+    dm.bXmax   = bXmax;
+    dm.xmin    = xmin;
+    dm.xmax    = xmax;
+    dm.cav     = cav;
+    dm.c1      = c1;
+    dm.c2      = c2;
+    dm.n1      = n1;
+    dm.n2      = n2;
+    dm.nmpower = nmpower;
+    dm.ePBC    = ePBC;
+    dm.amax    = amax;
+    dm.rmax    = rmax;
+    dm.invspa  = invspa;
+    dm.invspz  = invspz;
+    dm.bMirror = bMirror;
+    dm.nindex  = nindex;
+    dm.index   = index;
+    dm.gnx     = gnx;
+    dm.ind     = ind;
+    dm.atoms   = &top.atoms;
+
+    ngrid[0] = n1;
+    ngrid[1] = n2;
+    if (!bRadial)
     {
-        snew(grid[i], n2);
+        gaxis[0]     = c1;
+        gaxis[1]     = c2;
+        bPeriodic[0] = TRUE;
+        bPeriodic[1] = TRUE;
+    }
+    else
+    {
+        gaxis[0]     = XX;
+        gaxis[1]     = YY;
+        bPeriodic[0] = FALSE;
+        bPeriodic[1] = FALSE;
+    }
+    dgrid = init_densgrid(2, ngrid, gaxis, bPeriodic, nenum(espread), sigma);
+
+    /* The planar map only needs the analysis atoms */
+    init_frame_batch(&fb, dgrid->nthreads, bRadial ? natoms : nindex);
+    snew(sel, dgrid->nthreads);
+    snew(xr, dgrid->nthreads);
+    for (i = 0; i < dgrid->nthreads; i++)
+    {
+        snew(sel[i], nindex);
+        snew(xr[i], nindex);
     }
 
     box1 = 0;
@@ -277,101 +499,37 @@ int gmx_densmap(int argc, char *argv[])
     nfr  = 0;
     do
     {
-        if (!bRadial)
+        box1 += box[c1][c1];
+        box2 += box[c2][c2];
+        if (add_frame_batch(&fb, t, box, bRadial ? NULL : index, x))
         {
-            box1      += box[c1][c1];
-            box2      += box[c2][c2];
-            invcellvol = n1*n2;
-            if (nmpower == -3)
-            {
-                invcellvol /= det(box);
-            }
-            else if (nmpower == -2)
-            {
-                invcellvol /= box[c1][c1]*box[c2][c2];
-            }
-            for (i = 0; i < nindex; i++)
-            {
-                j = index[i];
-                if ((!bXmin || x[j][cav] >= xmin) &&
-                    (!bXmax || x[j][cav] <= xmax))
-                {
-                    m1 = x[j][c1]/box[c1][c1];
-                    if (m1 >= 1)
-                    {
-                        m1 -= 1;
-                    }
-                    if (m1 < 0)
-                    {
-                        m1 += 1;
-                    }
-                    m2 = x[j][c2]/box[c2][c2];
-                    if (m2 >= 1)
-                    {
-                        m2 -= 1;
-                    }
-                    if (m2 < 0)
-                    {
-                        m2 += 1;
-                    }
-                    grid[static_cast<int>(m1*n1)][static_cast<int>(m2*n2)] += invcellvol;
-                }
-            }
-        }
-        else
-        {
-            set_pbc(&pbc, ePBC, box);
-            for (i = 0; i < 2; i++)
-            {
-                if (gnx[i] == 1)
-                {
-                    /* One atom, just copy the coordinates */
-                    copy_rvec(x[ind[i][0]], xcom[i]);
-                }
-                else
-                {
-                    /* Calculate the center of mass */
-                    clear_rvec(xcom[i]);
-                    mtot = 0;
-                    for (j = 0; j < gnx[i]; j++)
-                    {
-                        k = ind[i][j];
-                        m = top.atoms.atom[k].m;
-                        for (l = 0; l < DIM; l++)
-                        {
-                            xcom[i][l] += m*x[k][l];
-                        }
-                        mtot += m;
-                    }
-                    svmul(1/mtot, xcom[i], xcom[i]);
-                }
-            }
-            pbc_dx(&pbc, xcom[1], xcom[0], direction);
-            for (i = 0; i < DIM; i++)
-            {
-                center[i] = xcom[0][i] + 0.5*direction[i];
-            }
-            unitv(direction, direction);
-            for (i = 0; i < nindex; i++)
-            {
-                j = index[i];
-                pbc_dx(&pbc, x[j], center, dx);
-                axial = iprod(dx, direction);
-                r     = std::sqrt(norm2(dx) - axial*axial);
-                if (axial >= -amax && axial < amax && r < rmax)
-                {
-                    if (bMirror)
-                    {
-                        r += rmax;
-                    }
-                    grid[static_cast<int>((axial + amax)*invspa)][static_cast<int>(r*invspz)] += 1;
-                }
-            }
+            spread_densmap_frames(dgrid, &fb, &dm, sel, xr);
         }
         nfr++;
     }
     while (read_next_x(oenv, status, &t, x, box));
     close_trj(status);
+    spread_densmap_frames(dgrid, &fb, &dm, sel, xr);
+    reduce_densgrid(dgrid);
+
+    snew(grid, n1);
+    for (i = 0; i < n1; i++)
+    {
+        snew(grid[i], n2);
+        for (j = 0; j < n2; j++)
+        {
+            grid[i][j] = dgrid->grid[i*n2 + j];
+        }
+    }
+    for (i = 0; i < dgrid->nthreads; i++)
+    {
+        sfree(sel[i]);
+        sfree(xr[i]);
+    }
+    sfree(sel);
+    sfree(xr);
+    done_frame_batch(&fb);
+    done_densgrid(dgrid);
 
     /* normalize gridpoints */
     maxgrid = 0;
@@ -509,7 +509,10 @@ int gmx_eneconv(int argc, char *argv[])
         "converting to a different format if necessary (indicated by file",
         "extentions).[PAR]",
         "[TT]-settime[tt] is applied first, then [TT]-dt[tt]/[TT]-offset[tt]",
-        "followed by [TT]-b[tt] and [TT]-e[tt] to select which frames to write."
+        "followed by [TT]-b[tt] and [TT]-e[tt] to select which frames to write.",
+        "Frames before the begin time and frames already present in an",
+        "earlier file are skipped using only the frame headers.",
+        "With [TT]-rmdh[tt] the free energy blocks are not read at all."
     };
     const char     *bugs[] = {
         "When combining trajectories the sigma and E^2 (necessary for statistics) are not updated correctly. Only the actual energy is correct. One thus has to compute statistics in another way."
@@ -537,6 +540,11 @@ int gmx_eneconv(int argc, char *argv[])
     t_enxblock     *blocks          = NULL;
     int             nblocks         = 0;
     int             nblocks_alloc   = 0;
+    t_enxindex      enxindex;
+    gmx_bool        bIndex;
+    gmx_bool        bSelBlock[enxNR];
+    double          tj;
+    int             j;
 
     t_filenm        fnm[] = {
         { efEDR, "-f", NULL,    ffRDMULT },
@@ -621,6 +629,19 @@ int gmx_eneconv(int argc, char *argv[])
         in         = open_enx(fnms[f], "r");
         enm        = NULL;
         do_enxnms(in, &this_nre, &enm);
+        if (remove_dh)
+        {
+            /* Do not decode the free energy blocks we throw away */
+            for (i = 0; i < enxNR; i++)
+            {
+                bSelBlock[i] = (i != enxDHCOLL && i != enxDH && i != enxDHHIST);
+            }
+            enx_select_blocks(in, bSelBlock);
+        }
+        /* With a begin time or overlapping files we might skip frames,
+         * which we can do with the frame headers only.
+         */
+        bIndex = ((begin >= 0 || f > 0) && build_enx_index(in, &enxindex));
         if (f == 0)
         {
             if (scalefac != 1)
@@ -647,6 +668,28 @@ int gmx_eneconv(int argc, char *argv[])
                     cont_type[f+1] = TIME_EXPLICIT;
                 }
                 bNewFile = FALSE;
+
+                if (bIndex)
+                {
+                    /* Find the first frame after this one that we might
+                     * write or that ends reading of this file.
+                     */
+                    for (j = 1; j < enxindex.nframes - 1; j++)
+                    {
+                        tj = tadjust + enxindex.t[j];
+                        if (!(tj <= last_t ||
+                              (begin >= 0 && tj < begin - GMX_REAL_EPS &&
+                               tj <= settime[f+1] + GMX_REAL_EPS &&
+                               !(bError && end > 0 && tj > end + GMX_REAL_EPS))))
+                        {
+                            break;
+                        }
+                    }
+                    if (j > 1)
+                    {
+                        seek_enx_frame(in, &enxindex, j);
+                    }
+                }
             }
 
             if (tadjust + fr->t <= last_t)
@@ -861,6 +904,10 @@ int gmx_eneconv(int argc, char *argv[])
         }
 
         /* move energies to lastee */
+        if (bIndex)
+        {
+            free_enx_index(&enxindex);
+        }
         close_enx(in);
         free_enxnms(this_nre, enm);
 
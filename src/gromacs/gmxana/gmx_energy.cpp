@@ -36,6 +36,8 @@
  */
 #include "gmxpre.h"
 
+#include "config.h"
+
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -46,6 +48,7 @@
 #include "gromacs/correlationfunctions/autocorr.h"
 #include "gromacs/fileio/enxio.h"
 #include "gromacs/fileio/gmxfio.h"
+#include "gromacs/fileio/timecontrol.h"
 #include "gromacs/fileio/tpxio.h"
 #include "gromacs/fileio/trxio.h"
 #include "gromacs/fileio/xvgr.h"
@@ -61,8 +64,10 @@
 #include "gromacs/topology/mtop_util.h"
 #include "gromacs/utility/arraysize.h"
 #include "gromacs/utility/cstringutil.h"
+#include "gromacs/utility/exceptions.h"
 #include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/gmxassert.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 
 static real       minthird = -1.0/3.0, minsixth = -1.0/6.0;
@@ -689,184 +694,206 @@ static void set_ee_av(ener_ee_t *eee)
     eee->nst = 0;
 }
 
-static void calc_averages(int nset, enerdata_t *edat, int nbmin, int nbmax)
+/* Computes the average, rmsd, drift and error estimate of set i,
+ * eee is working space for nbmax+1 block averages.
+ */
+static void calc_set_averages(enerdata_t *edat, int i, int nbmin, int nbmax,
+                              ener_ee_t *eee)
 {
-    int             nb, i, f, nee;
+    int             nb, f, nee;
     double          sum, sum2, sump, see2;
     gmx_int64_t     np, p, bound_nb;
     enerdat_t      *ed;
     exactsum_t     *es;
-    gmx_bool        bAllZero;
     double          x, sx, sy, sxx, sxy;
-    ener_ee_t      *eee;
 
-    /* Check if we have exact statistics over all points */
-    for (i = 0; i < nset; i++)
+    ed = &edat->s[i];
+
+    sum  = 0;
+    sum2 = 0;
+    np   = 0;
+    sx   = 0;
+    sy   = 0;
+    sxx  = 0;
+    sxy  = 0;
+    for (nb = nbmin; nb <= nbmax; nb++)
+    {
+        eee[nb].b     = 0;
+        clear_ee_sum(&eee[nb].sum);
+        eee[nb].nst     = 0;
+        eee[nb].nst_min = 0;
+    }
+    for (f = 0; f < edat->nframes; f++)
     {
-        ed             = &edat->s[i];
-        ed->bExactStat = FALSE;
-        if (edat->bHaveSums)
+        es = &ed->es[f];
+
+        if (ed->bExactStat)
         {
-            /* All energy file sum entries 0 signals no exact sums.
-             * But if all energy values are 0, we still have exact sums.
-             */
-            bAllZero = TRUE;
-            for (f = 0; f < edat->nframes && !ed->bExactStat; f++)
+            /* Add the sum and the sum of variances to the totals. */
+            p     = edat->points[f];
+            sump  = es->sum;
+            sum2 += es->sum2;
+            if (np > 0)
             {
-                if (ed->ener[i] != 0)
-                {
-                    bAllZero = FALSE;
-                }
-                ed->bExactStat = (ed->es[f].sum != 0);
-            }
-            if (bAllZero)
-            {
-                ed->bExactStat = TRUE;
+                sum2 += dsqr(sum/np - (sum + es->sum)/(np + p))
+                    *np*(np + p)/p;
             }
         }
-    }
+        else
+        {
+            /* Add a single value to the sum and sum of squares. */
+            p     = 1;
+            sump  = ed->ener[f];
+            sum2 += dsqr(sump);
+        }
 
-    snew(eee, nbmax+1);
-    for (i = 0; i < nset; i++)
-    {
-        ed = &edat->s[i];
+        /* sum has to be increased after sum2 */
+        np  += p;
+        sum += sump;
+
+        /* For the linear regression use variance 1/p.
+         * Note that sump is the sum, not the average, so we don't need p*.
+         */
+        x    = edat->step[f] - 0.5*(edat->steps[f] - 1);
+        sx  += p*x;
+        sy  += sump;
+        sxx += p*x*x;
+        sxy += x*sump;
 
-        sum  = 0;
-        sum2 = 0;
-        np   = 0;
-        sx   = 0;
-        sy   = 0;
-        sxx  = 0;
-        sxy  = 0;
         for (nb = nbmin; nb <= nbmax; nb++)
         {
-            eee[nb].b     = 0;
-            clear_ee_sum(&eee[nb].sum);
-            eee[nb].nst     = 0;
-            eee[nb].nst_min = 0;
-        }
-        for (f = 0; f < edat->nframes; f++)
-        {
-            es = &ed->es[f];
-
+            /* Check if the current end step is closer to the desired
+             * block boundary than the next end step.
+             */
+            bound_nb = (edat->step[0]-1)*nb + edat->nsteps*(eee[nb].b+1);
+            if (eee[nb].nst > 0 &&
+                bound_nb - edat->step[f-1]*nb < edat->step[f]*nb - bound_nb)
+            {
+                set_ee_av(&eee[nb]);
+            }
+            if (f == 0)
+            {
+                eee[nb].nst = 1;
+            }
+            else
+            {
+                eee[nb].nst += edat->step[f] - edat->step[f-1];
+            }
             if (ed->bExactStat)
             {
-                /* Add the sum and the sum of variances to the totals. */
-                p     = edat->points[f];
-                sump  = es->sum;
-                sum2 += es->sum2;
-                if (np > 0)
-                {
-                    sum2 += dsqr(sum/np - (sum + es->sum)/(np + p))
-                        *np*(np + p)/p;
-                }
+                add_ee_sum(&eee[nb].sum, es->sum, edat->points[f]);
             }
             else
             {
-                /* Add a single value to the sum and sum of squares. */
-                p     = 1;
-                sump  = ed->ener[f];
-                sum2 += dsqr(sump);
+                add_ee_sum(&eee[nb].sum, edat->s[i].ener[f], 1);
             }
-
-            /* sum has to be increased after sum2 */
-            np  += p;
-            sum += sump;
-
-            /* For the linear regression use variance 1/p.
-             * Note that sump is the sum, not the average, so we don't need p*.
-             */
-            x    = edat->step[f] - 0.5*(edat->steps[f] - 1);
-            sx  += p*x;
-            sy  += sump;
-            sxx += p*x*x;
-            sxy += x*sump;
-
-            for (nb = nbmin; nb <= nbmax; nb++)
-            {
-                /* Check if the current end step is closer to the desired
-                 * block boundary than the next end step.
-                 */
-                bound_nb = (edat->step[0]-1)*nb + edat->nsteps*(eee[nb].b+1);
-                if (eee[nb].nst > 0 &&
-                    bound_nb - edat->step[f-1]*nb < edat->step[f]*nb - bound_nb)
-                {
-                    set_ee_av(&eee[nb]);
-                }
-                if (f == 0)
-                {
-                    eee[nb].nst = 1;
-                }
-                else
-                {
-                    eee[nb].nst += edat->step[f] - edat->step[f-1];
-                }
-                if (ed->bExactStat)
-                {
-                    add_ee_sum(&eee[nb].sum, es->sum, edat->points[f]);
-                }
-                else
-                {
-                    add_ee_sum(&eee[nb].sum, edat->s[i].ener[f], 1);
-                }
-                bound_nb = (edat->step[0]-1)*nb + edat->nsteps*(eee[nb].b+1);
-                if (edat->step[f]*nb >= bound_nb)
-                {
-                    set_ee_av(&eee[nb]);
-                }
+            bound_nb = (edat->step[0]-1)*nb + edat->nsteps*(eee[nb].b+1);
+            if (edat->step[f]*nb >= bound_nb)
+            {
+                set_ee_av(&eee[nb]);
             }
         }
+    }
 
-        edat->s[i].av = sum/np;
-        if (ed->bExactStat)
-        {
-            edat->s[i].rmsd = std::sqrt(sum2/np);
-        }
-        else
-        {
-            edat->s[i].rmsd = std::sqrt(sum2/np - dsqr(edat->s[i].av));
-        }
+    edat->s[i].av = sum/np;
+    if (ed->bExactStat)
+    {
+        edat->s[i].rmsd = std::sqrt(sum2/np);
+    }
+    else
+    {
+        edat->s[i].rmsd = std::sqrt(sum2/np - dsqr(edat->s[i].av));
+    }
 
-        if (edat->nframes > 1)
+    if (edat->nframes > 1)
+    {
+        edat->s[i].slope = (np*sxy - sx*sy)/(np*sxx - sx*sx);
+    }
+    else
+    {
+        edat->s[i].slope = 0;
+    }
+
+    nee  = 0;
+    see2 = 0;
+    for (nb = nbmin; nb <= nbmax; nb++)
+    {
+        /* Check if we actually got nb blocks and if the smallest
+         * block is not shorter than 80% of the average.
+         */
+        if (debug)
         {
-            edat->s[i].slope = (np*sxy - sx*sy)/(np*sxx - sx*sx);
+            char buf1[STEPSTRSIZE], buf2[STEPSTRSIZE];
+            fprintf(debug, "Requested %d blocks, we have %d blocks, min %s nsteps %s\n",
+                    nb, eee[nb].b,
+                    gmx_step_str(eee[nb].nst_min, buf1),
+                    gmx_step_str(edat->nsteps, buf2));
         }
-        else
+        if (eee[nb].b == nb && 5*nb*eee[nb].nst_min >= 4*edat->nsteps)
         {
-            edat->s[i].slope = 0;
+            see2 += calc_ee2(nb, &eee[nb].sum);
+            nee++;
         }
+    }
+    if (nee > 0)
+    {
+        edat->s[i].ee = std::sqrt(see2/nee);
+    }
+    else
+    {
+        edat->s[i].ee = -1;
+    }
+}
 
-        nee  = 0;
-        see2 = 0;
-        for (nb = nbmin; nb <= nbmax; nb++)
+static void calc_averages(int nset, enerdata_t *edat, int nbmin, int nbmax)
+{
+    int             i, f;
+    enerdat_t      *ed;
+    gmx_bool        bAllZero;
+
+    /* Check if we have exact statistics over all points */
+    for (i = 0; i < nset; i++)
+    {
+        ed             = &edat->s[i];
+        ed->bExactStat = FALSE;
+        if (edat->bHaveSums)
         {
-            /* Check if we actually got nb blocks and if the smallest
-             * block is not shorter than 80% of the average.
+            /* All energy file sum entries 0 signals no exact sums.
+             * But if all energy values are 0, we still have exact sums.
              */
-            if (debug)
+            bAllZero = TRUE;
+            for (f = 0; f < edat->nframes && !ed->bExactStat; f++)
             {
-                char buf1[STEPSTRSIZE], buf2[STEPSTRSIZE];
-                fprintf(debug, "Requested %d blocks, we have %d blocks, min %s nsteps %s\n",
-                        nb, eee[nb].b,
-                        gmx_step_str(eee[nb].nst_min, buf1),
-                        gmx_step_str(edat->nsteps, buf2));
+                if (ed->ener[i] != 0)
+                {
+                    bAllZero = FALSE;
+                }
+                ed->bExactStat = (ed->es[f].sum != 0);
             }
-            if (eee[nb].b == nb && 5*nb*eee[nb].nst_min >= 4*edat->nsteps)
+            if (bAllZero)
             {
-                see2 += calc_ee2(nb, &eee[nb].sum);
-                nee++;
+                ed->bExactStat = TRUE;
             }
         }
-        if (nee > 0)
-        {
-            edat->s[i].ee = std::sqrt(see2/nee);
-        }
-        else
+    }
+
+    /* The sets are independent, so we can process them in parallel */
+#pragma omp parallel if (nset > 1)
+    {
+        try
         {
-            edat->s[i].ee = -1;
+            ener_ee_t *eee;
+
+            snew(eee, nbmax+1);
+#pragma omp for schedule(dynamic)
+            for (i = 0; i < nset; i++)
+            {
+                calc_set_averages(edat, i, nbmin, nbmax, eee);
+            }
+            sfree(eee);
         }
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
     }
-    sfree(eee);
 }
 
 static enerdata_t *calc_sum(int nset, enerdata_t *edat, int nbmin, int nbmax)
@@ -1483,6 +1510,8 @@ static void fec(const char *ene2fn, const char *runavgfn,
     double       dE, sum;
     gmx_enxnm_t *enm = NULL;
     t_enxframe  *fr;
+    gmx_bool    *bSelTerm;
+    gmx_bool     bSelBlock[enxNR];
     char         buf[22];
 
     /* read second energy file */
@@ -1491,6 +1520,23 @@ static void fec(const char *ene2fn, const char *runavgfn,
     enx = open_enx(ene2fn, "r");
     do_enxnms(enx, &(fr->nre), &enm);
 
+    /* We only need the selected terms and none of the blocks */
+    snew(bSelTerm, fr->nre);
+    for (i = 0; i < nset; i++)
+    {
+        if (set[i] < fr->nre)
+        {
+            bSelTerm[set[i]] = TRUE;
+        }
+    }
+    enx_select_terms(enx, fr->nre, bSelTerm);
+    sfree(bSelTerm);
+    for (i = 0; i < enxNR; i++)
+    {
+        bSelBlock[i] = FALSE;
+    }
+    enx_select_blocks(enx, bSelBlock);
+
     snew(eneset2, nset+1);
     nenergy2  = 0;
     maxenergy = 0;
@@ -1935,13 +1981,20 @@ int gmx_energy(int argc, char *argv[])
         "where E[SUB]A[sub] and E[SUB]B[sub] are the energies from the first and second energy",
         "files, and the average is over the ensemble A. The running average",
         "of the free energy difference is printed to a file specified by [TT]-ravg[tt].",
-        "[BB]Note[bb] that the energies must both be calculated from the same trajectory."
+        "[BB]Note[bb] that the energies must both be calculated from the same trajectory.[PAR]",
+
+        "Only the selected terms and the blocks needed for the requested output",
+        "are decoded from the energy file. With [TT]-b[tt] the frame headers",
+        "are scanned first, so the frames before the begin time are skipped",
+        "without reading their contents. The averages and error estimates",
+        "of the selected terms are computed in parallel."
 
     };
     static gmx_bool    bSum    = FALSE, bFee = FALSE, bPrAll = FALSE, bFluct = FALSE, bDriftCorr = FALSE;
     static gmx_bool    bDp     = FALSE, bMutot = FALSE, bOrinst = FALSE, bOvec = FALSE, bFluctProps = FALSE;
     static int         skip    = 0, nmol = 1, nbmin = 5, nbmax = 5;
     static real        reftemp = 300.0, ezero = 0;
+    static int         nthreads = -1;
     t_pargs            pa[]    = {
         { "-fee",   FALSE, etBOOL,  {&bFee},
           "Do a free energy estimate" },
@@ -1974,7 +2027,11 @@ int gmx_energy(int argc, char *argv[])
         { "-orinst", FALSE, etBOOL, {&bOrinst},
           "Analyse instantaneous orientation data" },
         { "-ovec", FALSE, etBOOL, {&bOvec},
-          "Also plot the eigenvectors with [TT]-oten[tt]" }
+          "Also plot the eigenvectors with [TT]-oten[tt]" },
+#ifdef GMX_OPENMP
+        { "-nt", FALSE, etINT, {&nthreads},
+          "Number of threads used for the averages and error estimates (if -1, all threads will be used or what is specified by the environment variable OMP_NUM_THREADS)" },
+#endif
     };
     const char       * drleg[] = {
         "Running average",
@@ -2023,6 +2080,9 @@ int gmx_energy(int argc, char *argv[])
     t_enxblock        *blk_disre = NULL;
     int                ndisre    = 0;
     int                dh_blocks = 0, dh_hists = 0, dh_samples = 0, dh_lambdas = 0;
+    gmx_bool          *bSelTerm  = NULL;
+    gmx_bool           bSelBlock[enxNR];
+    t_enxindex         enxindex;
 
     t_filenm           fnm[] = {
         { efEDR, "-f",    NULL,      ffREAD  },
@@ -2055,6 +2115,11 @@ int gmx_energy(int argc, char *argv[])
         return 0;
     }
 
+    if (nthreads > 0)
+    {
+        gmx_omp_set_num_threads(nthreads);
+    }
+
     bDRAll = opt2bSet("-pairs", NFILE, fnm);
     bDisRe = opt2bSet("-viol", NFILE, fnm) || bDRAll;
     bORA   = opt2bSet("-ora", NFILE, fnm);
@@ -2319,6 +2384,45 @@ int gmx_energy(int argc, char *argv[])
         get_dhdl_parms(ftp2fn(efTPR, NFILE, fnm), &ir);
     }
 
+    /* Only decode the energy terms and blocks that we use */
+    snew(bSelTerm, nre);
+    if (!bDisRe && !bDHDL)
+    {
+        for (i = 0; i < nset; i++)
+        {
+            bSelTerm[set[i]] = TRUE;
+        }
+    }
+    enx_select_terms(fp, nre, bSelTerm);
+    sfree(bSelTerm);
+    for (i = 0; i < enxNR; i++)
+    {
+        bSelBlock[i] = FALSE;
+    }
+    bSelBlock[enxOR]     = (bORIRE && !bOrinst);
+    bSelBlock[enxORI]    = (bORIRE && bOrinst);
+    bSelBlock[enxORT]    = bOTEN;
+    bSelBlock[enxDISRE]  = bDisRe;
+    bSelBlock[enxDHCOLL] = bDHDL;
+    bSelBlock[enxDHHIST] = bDHDL;
+    bSelBlock[enxDH]     = bDHDL;
+    enx_select_blocks(fp, bSelBlock);
+
+    /* With a begin time, locate the first frame from the frame headers */
+    if (bTimeSet(TBEGIN) && build_enx_index(fp, &enxindex))
+    {
+        i = 0;
+        while (i < enxindex.nframes && check_times(enxindex.t[i]) < 0)
+        {
+            i++;
+        }
+        if (i < enxindex.nframes)
+        {
+            seek_enx_frame(fp, &enxindex, i);
+        }
+        free_enx_index(&enxindex);
+    }
+
     /* Initiate energies and set them to zero */
     edat.nsteps    = 0;
     edat.npoints   = 0;
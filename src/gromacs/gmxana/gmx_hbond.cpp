@@ -49,6 +49,7 @@
 #include "gromacs/correlationfunctions/crosscorr.h"
 #include "gromacs/correlationfunctions/expfit.h"
 #include "gromacs/correlationfunctions/integrate.h"
+#include "gromacs/correlationfunctions/manyautocorrelation.h"
 #include "gromacs/fileio/matio.h"
 #include "gromacs/fileio/tpxio.h"
 #include "gromacs/fileio/trxio.h"
@@ -127,18 +128,29 @@ typedef struct {
 typedef int     t_icell[grNR];
 typedef atom_id h_id[MAXHYDRO];
 
+/* Run-length encoded existence of a hbond over the frames.
+ * The hbond is present in frames run[2*i] <= frame < run[2*i+1]
+ * for i = 0, ..., nrun-1. The runs are sorted and do not touch,
+ * so the memory use scales with the number of times the hbond
+ * forms and breaks instead of with the number of frames.
+ */
+typedef struct {
+    int      nrun, nalloc;
+    int     *run;
+} t_hbexist;
+
 typedef struct {
     int      history[MAXHYDRO];
     /* Has this hbond existed ever? If so as hbDist or hbHB or both.
      * Result is stored as a bitmap (1 = hbDist) || (2 = hbHB)
      */
-    /* Bitmask array which tells whether a hbond is present
-     * at a given time. Either of these may be NULL
+    /* Existence of the hbond per hydrogen over time.
+     * Either of these may be NULL
      */
     int            n0;                 /* First frame a HB was found     */
-    int            nframes, maxframes; /* Amount of frames in this hbond */
-    unsigned int **h;
-    unsigned int **g;
+    int            nframes;            /* Amount of frames in this hbond */
+    t_hbexist    **h;
+    t_hbexist    **g;
     /* See Xu and Berne, JPCB 105 (2001), p. 11929. We define the
      * function g(t) = [1-h(t)] H(t) where H(t) is one when the donor-
      * acceptor distance is less than the user-specified distance (typically
@@ -146,6 +158,13 @@ typedef struct {
      */
 } t_hbond;
 
+/* The hbonds of a single donor, sorted on acceptor index */
+typedef struct {
+    int       nr, nalloc;
+    int      *acc;            /* Acceptor indices                  */
+    t_hbond **hb;             /* The hbond with each acceptor      */
+} t_hblist;
+
 typedef struct {
     int      nra, max_nra;
     atom_id *acc;             /* Atom numbers of the acceptors     */
@@ -165,7 +184,6 @@ typedef struct {
 
 typedef struct {
     gmx_bool        bHBmap, bDAnr;
-    int             wordlen;
     /* The following arrays are nframes long */
     int             nframes, max_frames, maxhydro;
     int            *nhb, *ndist;
@@ -176,9 +194,9 @@ typedef struct {
     /* These structures are initialized from the topology at start up */
     t_donors        d;
     t_acceptors     a;
-    /* This holds a matrix with all possible hydrogen bonds */
+    /* This holds, per donor, the hydrogen bonds that have been found */
     int             nrhb, nrdist;
-    t_hbond      ***hbmap;
+    t_hblist       *hbmap;
 } t_hbdata;
 
 /* Changed argument 'bMerge' into 'oneHB' below,
@@ -192,7 +210,6 @@ static t_hbdata *mk_hbdata(gmx_bool bHBmap, gmx_bool bDAnr, gmx_bool oneHB)
     t_hbdata *hb;
 
     snew(hb, 1);
-    hb->wordlen = 8*sizeof(unsigned int);
     hb->bHBmap  = bHBmap;
     hb->bDAnr   = bDAnr;
     if (oneHB)
@@ -208,21 +225,72 @@ static t_hbdata *mk_hbdata(gmx_bool bHBmap, gmx_bool bDAnr, gmx_bool oneHB)
 
 static void mk_hbmap(t_hbdata *hb)
 {
-    int  i, j;
-
     snew(hb->hbmap, hb->d.nrd);
-    for (i = 0; (i < hb->d.nrd); i++)
+}
+
+/* Returns the position of acceptor ia in the sorted list l,
+ * or the position where it should be inserted.
+ */
+static int hblist_search(const t_hblist *l, int ia)
+{
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = l->nr;
+    while (lo < hi)
     {
-        snew(hb->hbmap[i], hb->a.nra);
-        if (hb->hbmap[i] == NULL)
+        mid = (lo + hi)/2;
+        if (l->acc[mid] < ia)
         {
-            gmx_fatal(FARGS, "Could not allocate enough memory for hbmap");
+            lo = mid + 1;
         }
-        for (j = 0; (j > hb->a.nra); j++)
+        else
         {
-            hb->hbmap[i][j] = NULL;
+            hi = mid;
         }
     }
+
+    return lo;
+}
+
+/* Returns the hbond between donor id and acceptor ia, NULL if it was never found */
+static t_hbond *get_hbond(t_hbdata *hb, int id, int ia)
+{
+    t_hblist *l = &hb->hbmap[id];
+    int       k = hblist_search(l, ia);
+
+    return (k < l->nr && l->acc[k] == ia) ? l->hb[k] : NULL;
+}
+
+/* Returns the hbond between donor id and acceptor ia, creates it when needed */
+static t_hbond *get_or_add_hbond(t_hbdata *hb, int id, int ia)
+{
+    t_hblist *l = &hb->hbmap[id];
+    int       i, k;
+
+    k = hblist_search(l, ia);
+    if (k < l->nr && l->acc[k] == ia)
+    {
+        return l->hb[k];
+    }
+    if (l->nr == l->nalloc)
+    {
+        l->nalloc = 2*l->nalloc + 4;
+        srenew(l->acc, l->nalloc);
+        srenew(l->hb, l->nalloc);
+    }
+    for (i = l->nr; i > k; i--)
+    {
+        l->acc[i] = l->acc[i-1];
+        l->hb[i]  = l->hb[i-1];
+    }
+    l->acc[k] = ia;
+    snew(l->hb[k], 1);
+    snew(l->hb[k]->h, hb->maxhydro);
+    snew(l->hb[k]->g, hb->maxhydro);
+    l->nr++;
+
+    return l->hb[k];
 }
 
 static void add_frames(t_hbdata *hb, int nframes)
@@ -243,90 +311,110 @@ static void add_frames(t_hbdata *hb, int nframes)
     hb->nframes = nframes;
 }
 
-#define OFFSET(frame) (frame / 32)
-#define MASK(frame)   (1 << (frame % 32))
-
-static void _set_hb(unsigned int hbexist[], unsigned int frame, gmx_bool bValue)
+/* Marks a hbond as present in frame. Since the trajectory is processed
+ * in order, frames are set in non-decreasing order and we only need to
+ * extend the last run or start a new one.
+ */
+static void _set_hb(t_hbexist *hbexist, int frame)
 {
-    if (bValue)
+    int n = hbexist->nrun;
+
+    if (n > 0 && frame < hbexist->run[2*n-1])
     {
-        hbexist[OFFSET(frame)] |= MASK(frame);
+        if (frame < hbexist->run[2*n-2])
+        {
+            gmx_incons("Hydrogen bond existence should be set in frame order");
+        }
+        return;
     }
-    else
+    if (n > 0 && frame == hbexist->run[2*n-1])
+    {
+        hbexist->run[2*n-1]++;
+        return;
+    }
+    if (n == hbexist->nalloc)
     {
-        hbexist[OFFSET(frame)] &= ~MASK(frame);
+        hbexist->nalloc = 2*hbexist->nalloc + 2;
+        srenew(hbexist->run, 2*hbexist->nalloc);
     }
+    hbexist->run[2*n]   = frame;
+    hbexist->run[2*n+1] = frame + 1;
+    hbexist->nrun++;
 }
 
-static gmx_bool is_hb(unsigned int hbexist[], int frame)
+static gmx_bool is_hb(const t_hbexist *hbexist, int frame)
 {
-    return ((hbexist[OFFSET(frame)] & MASK(frame)) != 0) ? 1 : 0;
+    int lo, hi, mid;
+
+    /* Find the last run that starts at or before frame */
+    lo = 0;
+    hi = hbexist->nrun;
+    while (lo < hi)
+    {
+        mid = (lo + hi)/2;
+        if (hbexist->run[2*mid] <= frame)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return (lo > 0 && frame < hbexist->run[2*lo-1]);
 }
 
-static void set_hb(t_hbdata *hb, int id, int ih, int ia, int frame, int ihb)
+static void done_hbexist(t_hbexist *hbexist)
 {
-    unsigned int *ghptr = NULL;
+    if (hbexist)
+    {
+        sfree(hbexist->run);
+        sfree(hbexist);
+    }
+}
+
+static void set_hb(t_hbond *hb, int ih, int frame, int ihb)
+{
+    t_hbexist *ghptr = NULL;
 
     if (ihb == hbHB)
     {
-        ghptr = hb->hbmap[id][ia]->h[ih];
+        ghptr = hb->h[ih];
     }
     else if (ihb == hbDist)
     {
-        ghptr = hb->hbmap[id][ia]->g[ih];
+        ghptr = hb->g[ih];
     }
     else
     {
         gmx_fatal(FARGS, "Incomprehensible iValue %d in set_hb", ihb);
     }
 
-    _set_hb(ghptr, frame-hb->hbmap[id][ia]->n0, TRUE);
+    _set_hb(ghptr, frame);
 }
 
-static void add_ff(t_hbdata *hbd, int id, int h, int ia, int frame, int ihb)
+static void add_ff(t_hbdata *hbd, t_hbond *hb, int id, int h, int frame, int ihb)
 {
-    int         i, j, n;
-    t_hbond    *hb       = hbd->hbmap[id][ia];
+    int         i;
     int         maxhydro = std::min(hbd->maxhydro, hbd->d.nhydro[id]);
-    int         wlen     = hbd->wordlen;
-    int         delta    = 32*wlen;
 
     if (!hb->h[0])
     {
-        hb->n0        = frame;
-        hb->maxframes = delta;
+        hb->n0 = frame;
         for (i = 0; (i < maxhydro); i++)
         {
-            snew(hb->h[i], hb->maxframes/wlen);
-            snew(hb->g[i], hb->maxframes/wlen);
+            snew(hb->h[i], 1);
+            snew(hb->g[i], 1);
         }
     }
     else
     {
         hb->nframes = frame-hb->n0;
-        /* We need a while loop here because hbonds may be returning
-         * after a long time.
-         */
-        while (hb->nframes >= hb->maxframes)
-        {
-            n = hb->maxframes + delta;
-            for (i = 0; (i < maxhydro); i++)
-            {
-                srenew(hb->h[i], n/wlen);
-                srenew(hb->g[i], n/wlen);
-                for (j = hb->maxframes/wlen; (j < n/wlen); j++)
-                {
-                    hb->h[i][j] = 0;
-                    hb->g[i][j] = 0;
-                }
-            }
-
-            hb->maxframes = n;
-        }
     }
     if (frame >= 0)
     {
-        set_hb(hbd, id, h, ia, frame, ihb);
+        set_hb(hb, h, frame, ihb);
     }
 
 }
@@ -414,6 +502,7 @@ static void add_hbond(t_hbdata *hb, int d, int a, int h, int grpd, int grpa,
 {
     int      k, id, ia, hh;
     gmx_bool daSwap = FALSE;
+    t_hbond *hbond  = NULL;
 
     if ((id = hb->d.dptr[d]) == NOTSET)
     {
@@ -498,13 +587,8 @@ static void add_hbond(t_hbdata *hb, int d, int a, int h, int grpd, int grpa,
 
 #pragma omp critical
             {
-                if (hb->hbmap[id][ia] == NULL)
-                {
-                    snew(hb->hbmap[id][ia], 1);
-                    snew(hb->hbmap[id][ia]->h, hb->maxhydro);
-                    snew(hb->hbmap[id][ia]->g, hb->maxhydro);
-                }
-                add_ff(hb, id, k, ia, frame, ihb);
+                hbond = get_or_add_hbond(hb, id, ia);
+                add_ff(hb, hbond, id, k, frame, ihb);
             }
         }
 
@@ -514,13 +598,13 @@ static void add_hbond(t_hbdata *hb, int d, int a, int h, int grpd, int grpa,
          */
         if (frame >= 0)
         {
-            hh = hb->hbmap[id][ia]->history[k];
+            hh = hbond->history[k];
             if (ihb == hbHB)
             {
                 hb->nhb[frame]++;
                 if (!(ISHB(hh)))
                 {
-                    hb->hbmap[id][ia]->history[k] = hh | 2;
+                    hbond->history[k] = hh | 2;
                     hb->nrhb++;
                 }
             }
@@ -531,7 +615,7 @@ static void add_hbond(t_hbdata *hb, int d, int a, int h, int grpd, int grpa,
                     hb->ndist[frame]++;
                     if (!(ISDIST(hh)))
                     {
-                        hb->hbmap[id][ia]->history[k] = hh | 1;
+                        hbond->history[k] = hh | 1;
                         hb->nrdist++;
                     }
                 }
@@ -1352,71 +1436,77 @@ static int is_hbond(t_hbdata *hb, int grpd, int grpa, int d, int a,
 /* Merging is now done on the fly, so do_merge is most likely obsolete now.
  * Will do some more testing before removing the function entirely.
  * - Erik Marklund, MAY 10 2010 */
-static void do_merge(t_hbdata *hb, int ntmp,
-                     unsigned int htmp[], unsigned int gtmp[],
-                     t_hbond *hb0, t_hbond *hb1)
+/* Sets dst to the union of the runs in a and b */
+static void merge_hbexist(t_hbexist *dst, const t_hbexist *a, const t_hbexist *b)
 {
-    /* Here we need to make sure we're treating periodicity in
-     * the right way for the geminate recombination kinetics. */
+    int ia, ib, n, b0, b1;
 
-    int       m, mm, n00, n01, nn0, nnframes;
-
-    /* Decide where to start from when merging */
-    n00      = hb0->n0;
-    n01      = hb1->n0;
-    nn0      = std::min(n00, n01);
-    nnframes = std::max(n00 + hb0->nframes, n01 + hb1->nframes) - nn0;
-    /* Initiate tmp arrays */
-    for (m = 0; (m < ntmp); m++)
-    {
-        htmp[m] = 0;
-        gtmp[m] = 0;
-    }
-    /* Fill tmp arrays with values due to first HB */
-    /* Once again '<' had to be replaced with '<='
-       to catch the last frame in which the hbond
-       appears.
-       - Erik Marklund, June 1, 2006 */
-    for (m = 0; (m <= hb0->nframes); m++)
+    n = 0;
+    if (dst->nalloc < a->nrun + b->nrun)
     {
-        mm       = m+n00-nn0;
-        htmp[mm] = is_hb(hb0->h[0], m);
+        dst->nalloc = a->nrun + b->nrun;
+        srenew(dst->run, 2*dst->nalloc);
     }
-    for (m = 0; (m <= hb0->nframes); m++)
+    ia = ib = 0;
+    while (ia < a->nrun || ib < b->nrun)
     {
-        mm       = m+n00-nn0;
-        gtmp[mm] = is_hb(hb0->g[0], m);
-    }
-    /* Next HB */
-    for (m = 0; (m <= hb1->nframes); m++)
-    {
-        mm       = m+n01-nn0;
-        htmp[mm] = htmp[mm] || is_hb(hb1->h[0], m);
-        gtmp[mm] = gtmp[mm] || is_hb(hb1->g[0], m);
-    }
-    /* Reallocate target array */
-    if (nnframes > hb0->maxframes)
-    {
-        srenew(hb0->h[0], 4+nnframes/hb->wordlen);
-        srenew(hb0->g[0], 4+nnframes/hb->wordlen);
+        /* Take the run that starts first */
+        if (ib == b->nrun || (ia < a->nrun && a->run[2*ia] <= b->run[2*ib]))
+        {
+            b0 = a->run[2*ia];
+            b1 = a->run[2*ia+1];
+            ia++;
+        }
+        else
+        {
+            b0 = b->run[2*ib];
+            b1 = b->run[2*ib+1];
+            ib++;
+        }
+        if (n > 0 && b0 <= dst->run[2*n-1])
+        {
+            dst->run[2*n-1] = std::max(dst->run[2*n-1], b1);
+        }
+        else
+        {
+            dst->run[2*n]   = b0;
+            dst->run[2*n+1] = b1;
+            n++;
+        }
     }
+    dst->nrun = n;
+}
 
-    /* Copy temp array to target array */
-    for (m = 0; (m <= nnframes); m++)
-    {
-        _set_hb(hb0->h[0], m, htmp[m]);
-        _set_hb(hb0->g[0], m, gtmp[m]);
-    }
+static void do_merge(t_hbond *hb0, t_hbond *hb1)
+{
+    /* Here we need to make sure we're treating periodicity in
+     * the right way for the geminate recombination kinetics. */
+
+    t_hbexist tmp;
+    int       nn0, nnframes;
+
+    /* Decide where to start from when merging */
+    nn0      = std::min(hb0->n0, hb1->n0);
+    nnframes = std::max(hb0->n0 + hb0->nframes, hb1->n0 + hb1->nframes) - nn0;
+
+    /* Merge the runs of both hbonds into the first one */
+    tmp.nrun   = 0;
+    tmp.nalloc = 0;
+    tmp.run    = NULL;
+    merge_hbexist(&tmp, hb0->h[0], hb1->h[0]);
+    std::swap(tmp, *hb0->h[0]);
+    merge_hbexist(&tmp, hb0->g[0], hb1->g[0]);
+    std::swap(tmp, *hb0->g[0]);
+    sfree(tmp.run);
 
     /* Set scalar variables */
-    hb0->n0        = nn0;
-    hb0->maxframes = nnframes;
+    hb0->n0      = nn0;
+    hb0->nframes = nnframes;
 }
 
 static void merge_hb(t_hbdata *hb, gmx_bool bTwo, gmx_bool bContact)
 {
-    int           i, inrnew, indnew, j, ii, jj, id, ia, ntmp;
-    unsigned int *htmp, *gtmp;
+    int           i, inrnew, indnew, j, ii, jj, id, ia;
     t_hbond      *hb0, *hb1;
 
     inrnew = hb->nrhb;
@@ -1425,26 +1515,24 @@ static void merge_hb(t_hbdata *hb, gmx_bool bTwo, gmx_bool bContact)
     /* Check whether donors are also acceptors */
     printf("Merging hbonds with Acceptor and Donor swapped\n");
 
-    ntmp = 2*hb->max_frames;
-    snew(gtmp, ntmp);
-    snew(htmp, ntmp);
     for (i = 0; (i < hb->d.nrd); i++)
     {
         fprintf(stderr, "\r%d/%d", i+1, hb->d.nrd);
         id = hb->d.don[i];
         ii = hb->a.aptr[id];
-        for (j = 0; (j < hb->a.nra); j++)
+        for (int k = 0; (k < hb->hbmap[i].nr); k++)
         {
+            j  = hb->hbmap[i].acc[k];
             ia = hb->a.acc[j];
             jj = hb->d.dptr[ia];
             if ((id != ia) && (ii != NOTSET) && (jj != NOTSET) &&
                 (!bTwo || (bTwo && (hb->d.grp[i] != hb->a.grp[j]))))
             {
-                hb0 = hb->hbmap[i][j];
-                hb1 = hb->hbmap[jj][ii];
+                hb0 = hb->hbmap[i].hb[k];
+                hb1 = get_hbond(hb, jj, ii);
                 if (hb0 && hb1 && ISHB(hb0->history[0]) && ISHB(hb1->history[0]))
                 {
-                    do_merge(hb, ntmp, htmp, gtmp, hb0, hb1);
+                    do_merge(hb0, hb1);
                     if (ISHB(hb1->history[0]))
                     {
                         inrnew--;
@@ -1462,8 +1550,8 @@ static void merge_hb(t_hbdata *hb, gmx_bool bTwo, gmx_bool bContact)
                     {
                         gmx_incons("Neither hydrogen bond nor distance");
                     }
-                    sfree(hb1->h[0]);
-                    sfree(hb1->g[0]);
+                    done_hbexist(hb1->h[0]);
+                    done_hbexist(hb1->g[0]);
                     hb1->h[0]       = NULL;
                     hb1->g[0]       = NULL;
                     hb1->history[0] = hbNo;
@@ -1476,8 +1564,6 @@ static void merge_hb(t_hbdata *hb, gmx_bool bTwo, gmx_bool bContact)
     printf("- Reduced number of distances from %d to %d\n", hb->nrdist, indnew);
     hb->nrhb   = inrnew;
     hb->nrdist = indnew;
-    sfree(gtmp);
-    sfree(htmp);
 }
 
 static void do_nhb_dist(FILE *fp, t_hbdata *hb, real t)
@@ -1513,9 +1599,9 @@ static void do_hblife(const char *fn, t_hbdata *hb, gmx_bool bMerge, gmx_bool bC
     FILE          *fp;
     const char    *leg[] = { "p(t)", "t p(t)" };
     int           *histo;
-    int            i, j, j0, k, m, nh, ihb, ohb, nhydro, ndump = 0;
+    int            i, j0, k, m, nh, r, nhydro, ndump = 0;
     int            nframes = hb->nframes;
-    unsigned int **h;
+    t_hbexist    **h;
     real           t, x1, dt;
     double         sum, integral;
     t_hbond       *hbh;
@@ -1525,61 +1611,49 @@ static void do_hblife(const char *fn, t_hbdata *hb, gmx_bool bMerge, gmx_bool bC
     /* Total number of hbonds analyzed here */
     for (i = 0; (i < hb->d.nrd); i++)
     {
-        for (k = 0; (k < hb->a.nra); k++)
+        for (k = 0; (k < hb->hbmap[i].nr); k++)
         {
-            hbh = hb->hbmap[i][k];
-            if (hbh)
+            hbh = hb->hbmap[i].hb[k];
+            if (bMerge)
             {
-                if (bMerge)
+                if (hbh->h[0])
                 {
-                    if (hbh->h[0])
-                    {
-                        h[0]   = hbh->h[0];
-                        nhydro = 1;
-                    }
-                    else
-                    {
-                        nhydro = 0;
-                    }
+                    h[0]   = hbh->h[0];
+                    nhydro = 1;
                 }
                 else
                 {
                     nhydro = 0;
-                    for (m = 0; (m < hb->maxhydro); m++)
+                }
+            }
+            else
+            {
+                nhydro = 0;
+                for (m = 0; (m < hb->maxhydro); m++)
+                {
+                    if (hbh->h[m])
                     {
-                        if (hbh->h[m])
-                        {
-                            h[nhydro++] = bContact ? hbh->g[m] : hbh->h[m];
-                        }
+                        h[nhydro++] = bContact ? hbh->g[m] : hbh->h[m];
                     }
                 }
-                for (nh = 0; (nh < nhydro); nh++)
+            }
+            for (nh = 0; (nh < nhydro); nh++)
+            {
+                /* The lifetime of each run that has been terminated
+                 * before the last frame this pair was found in.
+                 */
+                for (r = 0; (r < h[nh]->nrun); r++)
                 {
-                    ohb = 0;
-                    j0  = 0;
-
-                    for (j = 0; (j <= hbh->nframes); j++)
+                    if (debug && (ndump < 10))
                     {
-                        ihb      = is_hb(h[nh], j);
-                        if (debug && (ndump < 10))
-                        {
-                            fprintf(debug, "%5d  %5d\n", j, ihb);
-                        }
-                        if (ihb != ohb)
-                        {
-                            if (ihb)
-                            {
-                                j0 = j;
-                            }
-                            else
-                            {
-                                histo[j-j0]++;
-                            }
-                            ohb = ihb;
-                        }
+                        fprintf(debug, "%5d  %5d\n", h[nh]->run[2*r], h[nh]->run[2*r+1]);
+                    }
+                    if (h[nh]->run[2*r+1] <= hbh->n0 + hbh->nframes)
+                    {
+                        histo[h[nh]->run[2*r+1] - h[nh]->run[2*r]]++;
                     }
-                    ndump++;
                 }
+                ndump++;
             }
         }
     }
@@ -1643,11 +1717,11 @@ static void dump_ac(t_hbdata *hb, gmx_bool oneHB, int nDump)
         fprintf(fp, "%10.3f", hb->time[j]);
         for (i = nd = 0; (i < hb->d.nrd) && (nd < nDump); i++)
         {
-            for (k = 0; (k < hb->a.nra) && (nd < nDump); k++)
+            for (k = 0; (k < hb->hbmap[i].nr) && (nd < nDump); k++)
             {
                 bPrint = FALSE;
                 ihb    = idist = 0;
-                hbh    = hb->hbmap[i][k];
+                hbh    = hb->hbmap[i].hb[k];
                 if (oneHB)
                 {
                     if (hbh->h[0])
@@ -1914,13 +1988,31 @@ static void normalizeACF(real *ct, real *gt, int nhb, int len)
     }
 }
 
+/* Sets x[j] to 1 for the frames 0 <= j < n where the hbond exists, 0 otherwise */
+static void expand_hbexist(const t_hbexist *hbexist, int n, real x[])
+{
+    int j, r;
+
+    for (j = 0; (j < n); j++)
+    {
+        x[j] = 0;
+    }
+    for (r = 0; (r < hbexist->nrun); r++)
+    {
+        for (j = std::max(hbexist->run[2*r], 0); (j < std::min(hbexist->run[2*r+1], n)); j++)
+        {
+            x[j] = 1;
+        }
+    }
+}
+
 static void do_hbac(const char *fn, t_hbdata *hb,
                     int nDump, gmx_bool bMerge, gmx_bool bContact, real fit_start,
                     real temp, gmx_bool R2, const output_env_t oenv,
                     int nThreads)
 {
     FILE          *fp;
-    int            i, j, k, m, ihb, idist, n2, nn;
+    int            i, j, k, m, n2, nn;
 
     const char    *legLuzar[] = {
         "Ac\\sfin sys\\v{}\\z{}(t)",
@@ -1928,36 +2020,19 @@ static void do_hbac(const char *fn, t_hbdata *hb,
         "Cc\\scontact,hb\\v{}\\z{}(t)",
         "-dAc\\sfs\\v{}\\z{}/dt"
     };
-    gmx_bool       bNorm = FALSE, bOMP = FALSE;
     double         nhb   = 0;
-    real          *rhbex = NULL, *ht, *gt, *ght, *dght, *kt;
-    real          *ct, tail, tail2, dtail, *cct;
+    real          *buf, **rhbex, **ht, **gt, **dght, *kt;
+    real          *ct, *ght, tail, tail2, dtail, *cct;
     const real     tol     = 1e-3;
     int            nframes = hb->nframes;
-    unsigned int **h       = NULL, **g = NULL;
-    int            nh, nhbonds, nhydro;
+    t_hbexist    **h       = NULL, **g = NULL;
+    int            nhbonds, nalloc, nchunk, i0, *ndata;
     t_hbond       *hbh;
-    int            acType;
-    int           *dondata      = NULL;
-
-    enum {
-        AC_NONE, AC_NN, AC_GEM, AC_LUZAR
-    };
-
-#ifdef GMX_OPENMP
-    bOMP = TRUE;
-#else
-    bOMP = FALSE;
-#endif
 
     printf("Doing autocorrelation ");
-
-    acType = AC_LUZAR;
     printf("according to the theory of Luzar and Chandler.\n");
     fflush(stdout);
 
-    /* build hbexist matrix in reals for autocorr */
-    /* Allocate memory for computing ACF (rhbex) and aggregating the ACF (ct) */
     n2 = 1;
     while (n2 < nframes)
     {
@@ -1966,146 +2041,126 @@ static void do_hbac(const char *fn, t_hbdata *hb,
 
     nn = nframes/2;
 
-    if (acType != AC_NN || bOMP)
-    {
-        snew(h, hb->maxhydro);
-        snew(g, hb->maxhydro);
-    }
-
     /* Dump hbonds for debugging */
     dump_ac(hb, bMerge || bContact, nDump);
 
-    /* Total number of hbonds analyzed here */
+    /* Collect the existence functions of all hbonds analyzed here */
     nhbonds = 0;
-
-    if (acType != AC_LUZAR && bOMP)
+    nalloc  = 0;
+    for (i = 0; (i < hb->d.nrd); i++)
     {
-        nThreads = std::min((nThreads <= 0) ? INT_MAX : nThreads, gmx_omp_get_max_threads());
-
-        gmx_omp_set_num_threads(nThreads);
-        snew(dondata, nThreads);
-        for (i = 0; i < nThreads; i++)
+        for (k = 0; (k < hb->hbmap[i].nr); k++)
         {
-            dondata[i] = -1;
-        }
-        printf("ACF calculations parallelized with OpenMP using %i threads.\n"
-               "Expect close to linear scaling over this donor-loop.\n", nThreads);
-        fflush(stdout);
-        fprintf(stderr, "Donors: [thread no]\n");
-        {
-            char tmpstr[7];
-            for (i = 0; i < nThreads; i++)
+            hbh = hb->hbmap[i].hb[k];
+            for (m = 0; (m < ((bMerge || bContact) ? 1 : hb->maxhydro)); m++)
             {
-                snprintf(tmpstr, 7, "[%i]", i);
-                fprintf(stderr, "%-7s", tmpstr);
+                if (ISHB(hbh->history[m]))
+                {
+                    if (nhbonds == nalloc)
+                    {
+                        nalloc = over_alloc_large(nhbonds + 1);
+                        srenew(h, nalloc);
+                        srenew(g, nalloc);
+                    }
+                    h[nhbonds] = hbh->h[m];
+                    g[nhbonds] = hbh->g[m];
+                    nhbonds++;
+                }
             }
         }
-        fprintf(stderr, "\n");
     }
 
+#ifdef GMX_OPENMP
+    nThreads = std::min((nThreads <= 0) ? INT_MAX : nThreads, gmx_omp_get_max_threads());
+    gmx_omp_set_num_threads(nThreads);
+    printf("ACF calculations parallelized with OpenMP using %i threads.\n", nThreads);
+    fflush(stdout);
+#else
+    GMX_UNUSED_VALUE(nThreads);
+#endif
 
-    /* Build the ACF */
-    snew(rhbex, 2*n2);
-    snew(ct, 2*n2);
-    snew(gt, 2*n2);
-    snew(ht, 2*n2);
-    snew(ght, 2*n2);
-    snew(dght, 2*n2);
-
+    /* The hbonds are processed in chunks, the ACFs and cross correlations
+     * of each chunk are computed at once with batched FFTs in parallel.
+     */
+    nchunk = std::max(1, std::min(nhbonds, (1 << 24)/(5*n2)));
+    snew(buf, static_cast<size_t>(nchunk)*5*n2);
+    snew(rhbex, nchunk);
+    snew(ht, nchunk);
+    snew(gt, nchunk);
+    snew(dght, nchunk);
+    snew(ndata, nchunk);
+    for (i = 0; (i < nchunk); i++)
+    {
+        rhbex[i] = buf + static_cast<size_t>(i)*5*n2;
+        ht[i]    = rhbex[i] + 2*n2;
+        gt[i]    = ht[i] + n2;
+        dght[i]  = gt[i] + n2;
+        ndata[i] = n2;
+    }
+
+    snew(ct, n2);
+    snew(ght, n2);
     snew(kt, nn);
     snew(cct, nn);
 
-    for (i = 0; (i < hb->d.nrd); i++)
+    for (i0 = 0; (i0 < nhbonds); i0 += nchunk)
     {
-        for (k = 0; (k < hb->a.nra); k++)
-        {
-            nhydro = 0;
-            hbh    = hb->hbmap[i][k];
+        int n = std::min(nchunk, nhbonds - i0);
+
+        fprintf(stderr, "\rACF %d/%d", i0 + n, nhbonds);
 
-            if (hbh)
+#pragma omp parallel for reduction(+:nhb) schedule(static)
+        for (int s = 0; s < n; s++)
+        {
+            expand_hbexist(h[i0 + s], n2, ht[s]);
+            expand_hbexist(g[i0 + s], n2, gt[s]);
+            for (int j = 0; (j < nframes); j++)
             {
-                if (bMerge || bContact)
+                rhbex[s][j] = ht[s][j];
+                /* For contacts: if a second cut-off is provided, use it,
+                 * otherwise use g(t) = 1-h(t) */
+                if (!R2 && bContact)
                 {
-                    if (ISHB(hbh->history[0]))
-                    {
-                        h[0]   = hbh->h[0];
-                        g[0]   = hbh->g[0];
-                        nhydro = 1;
-                    }
+                    gt[s][j] = 1-ht[s][j];
                 }
                 else
                 {
-                    for (m = 0; (m < hb->maxhydro); m++)
-                    {
-                        if (bContact ? ISDIST(hbh->history[m]) : ISHB(hbh->history[m]))
-                        {
-                            g[nhydro] = hbh->g[m];
-                            h[nhydro] = hbh->h[m];
-                            nhydro++;
-                        }
-                    }
+                    gt[s][j] = gt[s][j]*(1-ht[s][j]);
                 }
+                nhb += ht[s][j];
+            }
+            for (int j = nframes; (j < n2); j++)
+            {
+                ht[s][j] = 0;
+                gt[s][j] = 0;
+            }
+        }
 
-                int nf = hbh->nframes;
-                for (nh = 0; (nh < nhydro); nh++)
-                {
-                    int nrint = bContact ? hb->nrdist : hb->nrhb;
-                    if ((((nhbonds+1) % 10) == 0) || (nhbonds+1 == nrint))
-                    {
-                        fprintf(stderr, "\rACF %d/%d", nhbonds+1, nrint);
-                    }
-                    nhbonds++;
-                    for (j = 0; (j < nframes); j++)
-                    {
-                        if (j <= nf)
-                        {
-                            ihb   = is_hb(h[nh], j);
-                            idist = is_hb(g[nh], j);
-                        }
-                        else
-                        {
-                            ihb = idist = 0;
-                        }
-                        rhbex[j] = ihb;
-                        /* For contacts: if a second cut-off is provided, use it,
-                         * otherwise use g(t) = 1-h(t) */
-                        if (!R2 && bContact)
-                        {
-                            gt[j]  = 1-ihb;
-                        }
-                        else
-                        {
-                            gt[j]  = idist*(1-ihb);
-                        }
-                        ht[j]    = rhbex[j];
-                        nhb     += ihb;
-                    }
-
-                    /* The autocorrelation function is normalized after summation only */
-                    low_do_autocorr(NULL, oenv, NULL, nframes, 1, -1, &rhbex, hb->time[1]-hb->time[0],
-                                    eacNormal, 1, FALSE, bNorm, FALSE, 0, -1, 0);
-
-                    /* Cross correlation analysis for thermodynamics */
-                    for (j = nframes; (j < n2); j++)
-                    {
-                        ht[j] = 0;
-                        gt[j] = 0;
-                    }
+        /* The autocorrelation function is normalized after summation only */
+        many_auto_correl(n, nframes, 2*n2, rhbex);
 
-                    cross_corr(n2, ht, gt, dght);
+        /* Cross correlation analysis for thermodynamics */
+        many_cross_corr(n, ndata, ht, gt, dght);
 
-                    for (j = 0; (j < nn); j++)
-                    {
-                        ct[j]  += rhbex[j];
-                        ght[j] += dght[j];
-                    }
-                }
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < nn; j++)
+        {
+            for (int s = 0; s < n; s++)
+            {
+                ct[j]  += rhbex[s][j]/(nframes - j);
+                ght[j] += dght[s][j];
             }
         }
     }
     fprintf(stderr, "\n");
     sfree(h);
     sfree(g);
+    sfree(rhbex);
+    sfree(ht);
+    sfree(gt);
+    sfree(dght);
+    sfree(ndata);
+    sfree(buf);
     normalizeACF(ct, ght, static_cast<int>(nhb), nn);
 
     /* Determine tail value for statistics */
@@ -2163,12 +2218,8 @@ static void do_hbac(const char *fn, t_hbdata *hb,
                  fit_start, temp);
 
     do_view(oenv, fn, NULL);
-    sfree(rhbex);
     sfree(ct);
-    sfree(gt);
-    sfree(ht);
     sfree(ght);
-    sfree(dght);
     sfree(cct);
     sfree(kt);
 }
@@ -2220,10 +2271,10 @@ static void analyse_donor_properties(FILE *fp, t_hbdata *hb, int nframes, real t
         {
             nb = 0;
             nhtot++;
-            for (j = 0; (j < hb->a.nra) && (nb == 0); j++)
+            for (j = 0; (j < hb->hbmap[i].nr) && (nb == 0); j++)
             {
-                if (hb->hbmap[i][j] && hb->hbmap[i][j]->h[k] &&
-                    is_hb(hb->hbmap[i][j]->h[k], nframes))
+                if (hb->hbmap[i].hb[j]->h[k] &&
+                    is_hb(hb->hbmap[i].hb[j]->h[k], nframes))
                 {
                     nb = 1;
                 }
@@ -2306,12 +2357,12 @@ static void dump_hbmap(t_hbdata *hb,
     for (i = 0; (i < hb->d.nrd); i++)
     {
         ddd = hb->d.don[i];
-        for (k = 0; (k < hb->a.nra); k++)
+        for (k = 0; (k < hb->hbmap[i].nr); k++)
         {
-            aaa = hb->a.acc[k];
+            aaa = hb->a.acc[hb->hbmap[i].acc[k]];
             for (m = 0; (m < hb->d.nhydro[i]); m++)
             {
-                if (hb->hbmap[i][k] && ISHB(hb->hbmap[i][k]->history[m]))
+                if (ISHB(hb->hbmap[i].hb[k]->history[m]))
                 {
                     sprintf(ds, "%s", mkatomname(atoms, ddd));
                     sprintf(as, "%s", mkatomname(atoms, aaa));
@@ -2839,7 +2890,6 @@ int gmx_hbond(int argc, char *argv[])
 
             p_hb[i]->bHBmap     = hb->bHBmap;
             p_hb[i]->bDAnr      = hb->bDAnr;
-            p_hb[i]->wordlen    = hb->wordlen;
             p_hb[i]->nframes    = hb->nframes;
             p_hb[i]->maxhydro   = hb->maxhydro;
             p_hb[i]->danr       = hb->danr;
@@ -3311,22 +3361,25 @@ int gmx_hbond(int argc, char *argv[])
                 y = 0;
                 for (id = 0; (id < hb->d.nrd); id++)
                 {
-                    for (ia = 0; (ia < hb->a.nra); ia++)
+                    for (ia = 0; (ia < hb->hbmap[id].nr); ia++)
                     {
                         for (hh = 0; (hh < hb->maxhydro); hh++)
                         {
-                            if (hb->hbmap[id][ia])
+                            t_hbond   *hbh = hb->hbmap[id].hb[ia];
+
+                            if (ISHB(hbh->history[hh]))
                             {
-                                if (ISHB(hb->hbmap[id][ia]->history[hh]))
+                                const t_hbexist *hbex = hbh->h[hh];
+
+                                range_check(y, 0, mat.ny);
+                                for (int r = 0; (r < hbex->nrun); r++)
                                 {
-                                    for (x = 0; (x <= hb->hbmap[id][ia]->nframes); x++)
+                                    for (x = hbex->run[2*r]; (x < hbex->run[2*r+1]); x++)
                                     {
-                                        int nn0 = hb->hbmap[id][ia]->n0;
-                                        range_check(y, 0, mat.ny);
-                                        mat.matrix[x+nn0][y] = is_hb(hb->hbmap[id][ia]->h[hh], x);
+                                        mat.matrix[x][y] = 1;
                                     }
-                                    y++;
                                 }
+                                y++;
                             }
                         }
                     }
@@ -36,10 +36,19 @@
  */
 #include "gmxpre.h"
 
+#include "config.h"
+
 #include <cmath>
 #include <cstring>
 
+#include <algorithm>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 #include "gromacs/commandline/pargs.h"
+#include "gromacs/fft/fft.h"
 #include "gromacs/fileio/confio.h"
 #include "gromacs/fileio/trxio.h"
 #include "gromacs/fileio/xvgr.h"
@@ -47,15 +56,18 @@
 #include "gromacs/gmxana/gstat.h"
 #include "gromacs/legacyheaders/typedefs.h"
 #include "gromacs/legacyheaders/viewit.h"
+#include "gromacs/math/gmxcomplex.h"
 #include "gromacs/math/utilities.h"
 #include "gromacs/math/vec.h"
 #include "gromacs/pbcutil/rmpbc.h"
 #include "gromacs/statistics/statistics.h"
 #include "gromacs/topology/index.h"
 #include "gromacs/utility/arraysize.h"
+#include "gromacs/utility/exceptions.h"
 #include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/futil.h"
 #include "gromacs/utility/gmxassert.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 
 #define FACTOR  1000.0  /* Convert nm^2/ps to 10e-5 cm^2/s */
@@ -93,6 +105,12 @@ typedef struct {
     int          *n_offs;
     int         **ndata;      /* the number of msds (particles/mols) per data
                                  point. */
+    gmx_bool      bFFT;       /* use all time origins through FFTs */
+    rvec        **xt;         /* with bFFT, the stored coordinates per group,
+                                 frame by frame */
+    int           nalloc_xt;  /* the number of frames allocated in xt */
+    gmx_int64_t   maxmem_xt;  /* the maximum size of xt in bytes, 0 is no
+                                 limit */
 } t_corr;
 
 typedef real t_calc_func (t_corr *curr, int nx, atom_id index[], int nx0, rvec xc[],
@@ -108,9 +126,24 @@ static gmx_bool in_data(t_corr *curr, int nx00)
     return curr->nframes-curr->n_offs[nx00];
 }
 
+/* Returns the size of the physical memory in bytes, or 0 when unknown */
+static gmx_int64_t physical_memory()
+{
+#if defined HAVE_UNISTD_H && defined _SC_PHYS_PAGES
+    long npages   = sysconf(_SC_PHYS_PAGES);
+    long pagesize = sysconf(_SC_PAGESIZE);
+
+    if (npages > 0 && pagesize > 0)
+    {
+        return static_cast<gmx_int64_t>(npages)*pagesize;
+    }
+#endif
+    return 0;
+}
+
 t_corr *init_corr(int nrgrp, int type, int axis, real dim_factor,
-                  int nmol, gmx_bool bTen, gmx_bool bMass, real dt, t_topology *top,
-                  real beginfit, real endfit)
+                  int nmol, gmx_bool bTen, gmx_bool bMass, gmx_bool bFFT,
+                  real fftmem, real dt, t_topology *top, real beginfit, real endfit)
 {
     t_corr  *curr;
     t_atoms *atoms;
@@ -129,6 +162,14 @@ t_corr *init_corr(int nrgrp, int type, int axis, real dim_factor,
     curr->nframes    = 0;
     curr->nlast      = 0;
     curr->dim_factor = dim_factor;
+    curr->bFFT       = bFFT;
+    curr->nalloc_xt  = 0;
+    curr->maxmem_xt  = (fftmem > 0 ? static_cast<gmx_int64_t>(fftmem*1e9) :
+                        physical_memory()/2);
+    if (bFFT)
+    {
+        snew(curr->xt, nrgrp);
+    }
 
     snew(curr->ndata, nrgrp);
     snew(curr->data, nrgrp);
@@ -184,8 +225,16 @@ static void corr_print(t_corr *curr, gmx_bool bTen, const char *fn, const char *
     out = xvgropen(fn, title, output_env_get_xvgr_tlabel(oenv), yaxis, oenv);
     if (DD)
     {
-        fprintf(out, "# MSD gathered over %g %s with %d restarts\n",
-                msdtime, output_env_get_time_unit(oenv), curr->nrestart);
+        if (curr->bFFT)
+        {
+            fprintf(out, "# MSD gathered over %g %s using all time origins\n",
+                    msdtime, output_env_get_time_unit(oenv));
+        }
+        else
+        {
+            fprintf(out, "# MSD gathered over %g %s with %d restarts\n",
+                    msdtime, output_env_get_time_unit(oenv), curr->nrestart);
+        }
         fprintf(out, "# Diffusion constants fitted from time %g to %g %s\n",
                 beginfit, endfit, output_env_get_time_unit(oenv));
         for (i = 0; i < curr->ngrp; i++)
@@ -544,6 +593,270 @@ static real calc1_mol(t_corr *curr, int nx, atom_id gmx_unused index[], int nx0,
     return gtot/nx;
 }
 
+/* with bFFT, called from corr_loop to store the coordinates of all groups,
+ * relative to the center of mass com when bRmCOMM is set */
+static void store_frame(t_corr *curr, gmx_bool bMol, int gnx[], atom_id *index[],
+                        rvec xc[], gmx_bool bRmCOMM, rvec com)
+{
+    int         g, i, ind;
+    gmx_int64_t framesize;
+    rvec       *xt;
+
+    if (curr->nframes >= curr->nalloc_xt)
+    {
+        /* Check the memory before allocating, since all frames are kept */
+        framesize = 0;
+        for (g = 0; g < curr->ngrp; g++)
+        {
+            framesize += gnx[g]*sizeof(rvec);
+        }
+        curr->nalloc_xt = over_alloc_large(curr->nframes + 1);
+        if (curr->maxmem_xt > 0 && curr->nalloc_xt*framesize > curr->maxmem_xt)
+        {
+            if ((curr->nframes + 1)*framesize > curr->maxmem_xt)
+            {
+                gmx_fatal(FARGS, "Storing the coordinates of more than %d frames for -fft needs more memory than the limit of %g GB (see -fftmem). Use fewer frames (-b, -e), fewer atoms or molecules, or the algorithm with restarts (without -fft).",
+                          curr->nframes, curr->maxmem_xt/1e9);
+            }
+            curr->nalloc_xt = curr->maxmem_xt/framesize;
+        }
+        for (g = 0; g < curr->ngrp; g++)
+        {
+            srenew(curr->xt[g], static_cast<size_t>(curr->nalloc_xt)*gnx[g]);
+        }
+    }
+    for (g = 0; g < curr->ngrp; g++)
+    {
+        xt = curr->xt[g] + static_cast<size_t>(curr->nframes)*gnx[g];
+        for (i = 0; i < gnx[g]; i++)
+        {
+            ind = (bMol ? i : index[g][i]);
+            if (bRmCOMM)
+            {
+                rvec_sub(xc[ind], com, xt[i]);
+            }
+            else
+            {
+                copy_rvec(xc[ind], xt[i]);
+            }
+        }
+    }
+}
+
+/* Computes the MSD of group nr over all time origins from the coordinates
+ * stored by store_frame. For a coordinate a(k) of N frames
+ *
+ *   sum_k (a(k+m) - a(k))^2 = sum_k (a(k)^2 + a(k+m)^2) - 2 sum_k a(k) a(k+m)
+ *
+ * with k from 0 to N-m-1. The first sum is updated from m-1 to m by
+ * removing two terms, the second is the autocorrelation, which we obtain
+ * for all m at once with a zero-padded FFT. The off-diagonal elements of
+ * the tensor follow in the same way from the cross-correlation of two
+ * coordinates. This is O(N log N) per particle; the particles are divided
+ * over the OpenMP threads.
+ */
+static void calc_msd_fft(t_corr *curr, int nr, int nx, atom_id index[],
+                         gmx_bool bMol, gmx_bool bTen)
+{
+    /* The components: the MSD, with bTen followed by xx, yy, zz, yx, zx, zy,
+     * each a sum over npair products of coordinates pa and pb.
+     */
+    const int tenA[] = { XX, YY, ZZ, YY, ZZ, ZZ };
+    const int tenB[] = { XX, YY, ZZ, XX, XX, YY };
+    int       npair[1 + asize(tenA)], pa[1 + asize(tenA)][DIM], pb[1 + asize(tenA)][DIM];
+    int       nframes, nfft, ncomp;
+    gmx_bool  bUse[DIM];
+    double   *sum, wtot;
+
+    nframes  = curr->nframes;
+    npair[0] = 0;
+    for (int d = 0; d < DIM; d++)
+    {
+        bUse[d] = (curr->type == NORMAL ||
+                   (curr->type == LATERAL && d != curr->axis) ||
+                   (curr->type >= X && curr->type <= Z && d == curr->type - X));
+        if (bUse[d])
+        {
+            pa[0][npair[0]] = d;
+            pb[0][npair[0]] = d;
+            npair[0]++;
+        }
+    }
+    ncomp = 1;
+    if (bTen)
+    {
+        for (int c = 0; c < asize(tenA); c++, ncomp++)
+        {
+            npair[ncomp]  = 1;
+            pa[ncomp][0]  = tenA[c];
+            pb[ncomp][0]  = tenB[c];
+        }
+    }
+    /* Pad to at least 2N to avoid wrap-around in the correlations */
+    nfft = 2;
+    while (nfft < 2*nframes)
+    {
+        nfft *= 2;
+    }
+    if (bMol)
+    {
+        snew(curr->lsq, 1);
+        snew(curr->lsq[0], curr->nmol);
+        for (int i = 0; i < curr->nmol; i++)
+        {
+            curr->lsq[0][i] = gmx_stats_init();
+        }
+    }
+
+    snew(sum, ncomp*nframes);
+    wtot = 0;
+#pragma omp parallel
+    {
+        try
+        {
+            gmx_fft_t  fft;
+            real      *xs[DIM], *corr;
+            t_complex *spec[DIM], *work;
+            double    *acc, wthread, w, q, mean;
+            int        i, ix, j, k, nc, a, b, c, d, m;
+
+            nc = nfft/2 + 1;
+            gmx_fft_init_1d_real(&fft, nfft, GMX_FFT_FLAG_NONE);
+            for (d = 0; d < DIM; d++)
+            {
+                snew(xs[d], nfft);
+                snew(spec[d], nc);
+            }
+            snew(corr, nfft);
+            snew(work, nc);
+            snew(acc, ncomp*nframes);
+            wthread = 0;
+
+#pragma omp for schedule(dynamic)
+            for (i = 0; i < nx; i++)
+            {
+                ix = (bMol ? i : index[i]);
+                w  = (curr->mass != NULL ? curr->mass[ix] : 1);
+                if (w == 0)
+                {
+                    continue;
+                }
+                wthread += w;
+
+                for (d = 0; d < DIM; d++)
+                {
+                    if (!bUse[d])
+                    {
+                        continue;
+                    }
+                    /* The MSD does not depend on the origin; subtracting
+                     * the mean avoids loss of precision in the difference
+                     * of the two large sums.
+                     */
+                    mean = 0;
+                    for (k = 0; k < nframes; k++)
+                    {
+                        mean += curr->xt[nr][static_cast<size_t>(k)*nx + i][d];
+                    }
+                    mean /= nframes;
+                    for (k = 0; k < nframes; k++)
+                    {
+                        xs[d][k] = curr->xt[nr][static_cast<size_t>(k)*nx + i][d] - mean;
+                    }
+                    gmx_fft_1d_real(fft, GMX_FFT_REAL_TO_COMPLEX, xs[d], spec[d]);
+                }
+
+                for (c = 0; c < ncomp; c++)
+                {
+                    /* The spectrum of sum_k a(k) b(k+m) + b(k) a(k+m),
+                     * which is 2 Re(A* B), normalized for the backward FFT.
+                     */
+                    for (k = 0; k < nc; k++)
+                    {
+                        work[k].re = 0;
+                        work[k].im = 0;
+                        for (j = 0; j < npair[c]; j++)
+                        {
+                            a           = pa[c][j];
+                            b           = pb[c][j];
+                            work[k].re += 2*(spec[a][k].re*spec[b][k].re +
+                                             spec[a][k].im*spec[b][k].im)/nfft;
+                        }
+                    }
+                    gmx_fft_1d_real(fft, GMX_FFT_COMPLEX_TO_REAL, work, corr);
+
+                    q = 0;
+                    for (j = 0; j < npair[c]; j++)
+                    {
+                        a = pa[c][j];
+                        b = pb[c][j];
+                        for (k = 0; k < nframes; k++)
+                        {
+                            q += 2*xs[a][k]*xs[b][k];
+                        }
+                    }
+                    for (m = 0; m < nframes; m++)
+                    {
+                        for (j = 0; j < npair[c] && m > 0; j++)
+                        {
+                            a  = pa[c][j];
+                            b  = pb[c][j];
+                            q -= xs[a][m-1]*xs[b][m-1] + xs[a][nframes-m]*xs[b][nframes-m];
+                        }
+                        acc[c*nframes + m] += w*(q - corr[m]);
+                        if (c == 0 && bMol)
+                        {
+                            real tt = curr->time[m];
+
+                            if (tt >= curr->beginfit && (curr->endfit < 0 || tt <= curr->endfit))
+                            {
+                                gmx_stats_add_point(curr->lsq[0][i], tt,
+                                                    (q - corr[m])/(nframes - m), 0, 0);
+                            }
+                        }
+                    }
+                }
+            }
+
+#pragma omp critical
+            {
+                for (k = 0; k < ncomp*nframes; k++)
+                {
+                    sum[k] += acc[k];
+                }
+                wtot += wthread;
+            }
+
+            gmx_fft_destroy(fft);
+            for (d = 0; d < DIM; d++)
+            {
+                sfree(xs[d]);
+                sfree(spec[d]);
+            }
+            sfree(corr);
+            sfree(work);
+            sfree(acc);
+        }
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+    }
+
+    /* Store the sums over the origins, do_corr divides by ndata */
+    for (int m = 0; m < nframes; m++)
+    {
+        curr->data[nr][m]  = sum[m]/wtot;
+        curr->ndata[nr][m] = nframes - m;
+        if (bTen)
+        {
+            clear_mat(curr->datam[nr][m]);
+            for (int c = 1; c < ncomp; c++)
+            {
+                curr->datam[nr][m][pa[c][0]][pb[c][0]] = sum[c*nframes + m]/wtot;
+            }
+        }
+    }
+    sfree(sum);
+}
+
 void printmol(t_corr *curr, const char *fn,
               const char *fn_pdb, int *molindex, t_topology *top,
               rvec *x, int ePBC, matrix box, const output_env_t oenv)
@@ -573,7 +886,7 @@ void printmol(t_corr *curr, const char *fn,
     for (i = 0; (i < curr->nmol); i++)
     {
         lsq1 = gmx_stats_init();
-        for (j = 0; (j < curr->nrestart); j++)
+        for (j = 0; (j < (curr->bFFT ? 1 : curr->nrestart)); j++)
         {
             real xx, yy, dx, dy;
 
@@ -714,7 +1027,7 @@ int corr_loop(t_corr *curr, const char *fn, t_topology *top, int ePBC,
 
 
         /* check whether we've reached a restart point */
-        if (bRmod(t, curr->t0, dt))
+        if (!curr->bFFT && bRmod(t, curr->t0, dt))
         {
             curr->nrestart++;
 
@@ -809,12 +1122,19 @@ int corr_loop(t_corr *curr, const char *fn, t_topology *top, int ePBC,
                      &top->atoms, com);
         }
 
-        /* loop over all groups in index file */
-        for (i = 0; (i < curr->ngrp); i++)
+        if (curr->bFFT)
         {
-            /* calculate something useful, like mean square displacements */
-            calc_corr(curr, i, gnx[i], index[i], xa[cur], (gnx_com != NULL), com,
-                      calc1, bTen);
+            store_frame(curr, bMol, gnx, index, xa[cur], (gnx_com != NULL), com);
+        }
+        else
+        {
+            /* loop over all groups in index file */
+            for (i = 0; (i < curr->ngrp); i++)
+            {
+                /* calculate something useful, like mean square displacements */
+                calc_corr(curr, i, gnx[i], index[i], xa[cur], (gnx_com != NULL), com,
+                          calc1, bTen);
+            }
         }
         cur    = prev;
         t_prev = t;
@@ -822,11 +1142,26 @@ int corr_loop(t_corr *curr, const char *fn, t_topology *top, int ePBC,
         curr->nframes++;
     }
     while (read_next_x(oenv, status, &t, x[cur], box));
-    fprintf(stderr, "\nUsed %d restart points spaced %g %s over %g %s\n\n",
-            curr->nrestart,
-            output_env_conv_time(oenv, dt), output_env_get_time_unit(oenv),
-            output_env_conv_time(oenv, curr->time[curr->nframes-1]),
-            output_env_get_time_unit(oenv) );
+    if (curr->bFFT)
+    {
+        for (i = 0; (i < curr->ngrp); i++)
+        {
+            calc_msd_fft(curr, i, gnx[i], index[i], bMol, bTen);
+            sfree(curr->xt[i]);
+        }
+        fprintf(stderr, "\nUsed all %d time origins over %g %s\n\n",
+                curr->nframes,
+                output_env_conv_time(oenv, curr->time[curr->nframes-1]),
+                output_env_get_time_unit(oenv) );
+    }
+    else
+    {
+        fprintf(stderr, "\nUsed %d restart points spaced %g %s over %g %s\n\n",
+                curr->nrestart,
+                output_env_conv_time(oenv, dt), output_env_get_time_unit(oenv),
+                output_env_conv_time(oenv, curr->time[curr->nframes-1]),
+                output_env_get_time_unit(oenv) );
+    }
 
     if (bMol)
     {
@@ -875,8 +1210,8 @@ static void index_atom2mol(int *n, int *index, t_block *mols)
 void do_corr(const char *trx_file, const char *ndx_file, const char *msd_file,
              const char *mol_file, const char *pdb_file, real t_pdb,
              int nrgrp, t_topology *top, int ePBC,
-             gmx_bool bTen, gmx_bool bMW, gmx_bool bRmCOMM,
-             int type, real dim_factor, int axis,
+             gmx_bool bTen, gmx_bool bMW, gmx_bool bRmCOMM, gmx_bool bFFT,
+             real fftmem, int type, real dim_factor, int axis,
              real dt, real beginfit, real endfit, const output_env_t oenv)
 {
     t_corr        *msd;
@@ -914,9 +1249,25 @@ void do_corr(const char *trx_file, const char *ndx_file, const char *msd_file,
     }
 
     msd = init_corr(nrgrp, type, axis, dim_factor,
-                    mol_file == NULL ? 0 : gnx[0], bTen, bMW, dt, top,
+                    mol_file == NULL ? 0 : gnx[0], bTen, bMW, bFFT, fftmem, dt, top,
                     beginfit, endfit);
 
+    if (bFFT)
+    {
+        gmx_int64_t framesize = 0;
+
+        for (i = 0; i < nrgrp; i++)
+        {
+            framesize += gnx[i]*sizeof(rvec);
+        }
+        fprintf(stderr, "\nWith -fft the coordinates of all frames are stored, which needs %g MB per 1000 frames", framesize*1000/1e6);
+        if (msd->maxmem_xt > 0)
+        {
+            fprintf(stderr, ", with a limit of %g GB", msd->maxmem_xt/1e9);
+        }
+        fprintf(stderr, "\n");
+    }
+
     nat_trx =
         corr_loop(msd, trx_file, top, ePBC, mol_file ? gnx[0] : 0, gnx, index,
                   (mol_file != NULL) ? calc1_mol : (bMW ? calc1_mw : calc1_norm),
@@ -1047,6 +1398,15 @@ int gmx_msd(int argc, char *argv[])
         "for each individual molecule a diffusion constant is computed for ",
         "its center of mass. The chosen index group will be split into ",
         "molecules.[PAR]",
+        "With [TT]-fft[tt], all frames are used as time origins and",
+        "[TT]-trestart[tt] is ignored. The MSD is then computed exactly",
+        "from the autocorrelation of the positions, using FFTs, which takes",
+        "O(T log T) time for T frames instead of O(T^2/trestart).",
+        "This stores the coordinates of the selected atoms or molecules",
+        "of all frames in memory, up to the limit set with [TT]-fftmem[tt].",
+        "The calculation is parallelized over",
+        "the atoms or molecules; the number of threads can be set with",
+        "[TT]-nt[tt].[PAR]",
         "The default way to calculate a MSD is by using mass-weighted averages.",
         "This can be turned off with [TT]-nomw[tt].[PAR]",
         "With the option [TT]-rmcomm[tt], the center of mass motion of a ",
@@ -1080,6 +1440,9 @@ int gmx_msd(int argc, char *argv[])
     static gmx_bool    bTen       = FALSE;
     static gmx_bool    bMW        = TRUE;
     static gmx_bool    bRmCOMM    = FALSE;
+    static gmx_bool    bFFT       = FALSE;
+    static real        fftmem     = 0;
+    static int         nthreads   = -1;
     t_pargs            pa[]       = {
         { "-type",    FALSE, etENUM, {normtype},
           "Compute diffusion coefficient in one direction" },
@@ -1097,10 +1460,18 @@ int gmx_msd(int argc, char *argv[])
           "The frame to use for option [TT]-pdb[tt] (%t)" },
         { "-trestart", FALSE, etTIME, {&dt},
           "Time between restarting points in trajectory (%t)" },
+        { "-fft", FALSE, etBOOL, {&bFFT},
+          "Use all frames as time origins, computing the MSD with FFTs" },
+        { "-fftmem", FALSE, etREAL, {&fftmem},
+          "Memory limit (GB) for the coordinates stored with [TT]-fft[tt], 0 is half of the physical memory" },
         { "-beginfit", FALSE, etTIME, {&beginfit},
           "Start time for fitting the MSD (%t), -1 is 10%" },
         { "-endfit", FALSE, etTIME, {&endfit},
-          "End time for fitting the MSD (%t), -1 is 90%" }
+          "End time for fitting the MSD (%t), -1 is 90%" },
+#ifdef GMX_OPENMP
+        { "-nt", FALSE, etINT, {&nthreads},
+          "Number of threads used with [TT]-fft[tt] (if -1, all threads will be used or what is specified by the environment variable OMP_NUM_THREADS)"},
+#endif
     };
 
     t_filenm           fnm[] = {
@@ -1129,6 +1500,10 @@ int gmx_msd(int argc, char *argv[])
     {
         return 0;
     }
+    if (nthreads > 0)
+    {
+        gmx_omp_set_num_threads(nthreads);
+    }
     trx_file = ftp2fn_null(efTRX, NFILE, fnm);
     tps_file = ftp2fn_null(efTPS, NFILE, fnm);
     ndx_file = ftp2fn_null(efNDX, NFILE, fnm);
@@ -1198,7 +1573,7 @@ int gmx_msd(int argc, char *argv[])
     }
 
     do_corr(trx_file, ndx_file, msd_file, mol_file, pdb_file, t_pdb, ngroup,
-            &top, ePBC, bTen, bMW, bRmCOMM, type, dim_factor, axis, dt, beginfit, endfit,
+            &top, ePBC, bTen, bMW, bRmCOMM, bFFT, fftmem, type, dim_factor, axis, dt, beginfit, endfit,
             oenv);
 
     view_all(oenv, NFILE, fnm);
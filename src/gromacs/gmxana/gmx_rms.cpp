@@ -36,6 +36,8 @@
  */
 #include "gmxpre.h"
 
+#include "config.h"
+
 #include <cmath>
 #include <cstdlib>
 
@@ -49,6 +51,7 @@
 #include "gromacs/gmxana/cmat.h"
 #include "gromacs/gmxana/gmx_ana.h"
 #include "gromacs/gmxana/princ.h"
+#include "gromacs/gmxana/rmsdmat.h"
 #include "gromacs/legacyheaders/copyrite.h"
 #include "gromacs/legacyheaders/typedefs.h"
 #include "gromacs/legacyheaders/viewit.h"
@@ -59,6 +62,7 @@
 #include "gromacs/utility/arraysize.h"
 #include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/futil.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 
 static void norm_princ(t_atoms *atoms, int isize, atom_id *index, int natoms,
@@ -119,7 +123,9 @@ int gmx_rms(int argc, char *argv[])
         "Option [TT]-m[tt] produces a matrix in [REF].xpm[ref] format of",
         "comparison values of each structure in the trajectory with respect to",
         "each other structure. This file can be visualized with for instance",
-        "[TT]xv[tt] and can be converted to postscript with [gmx-xpm2ps].[PAR]",
+        "[TT]xv[tt] and can be converted to postscript with [gmx-xpm2ps].",
+        "The matrix is computed in parallel; the number of threads can be",
+        "set with [TT]-nt[tt].[PAR]",
 
         "Option [TT]-fit[tt] controls the least-squares fitting of",
         "the structures on top of each other: complete fit (rotation and",
@@ -176,6 +182,7 @@ int gmx_rms(int argc, char *argv[])
     const char     *fitgraphlabel[efNR + 1] =
     { NULL, "lsq fit", "translational fit", "no fit" };
     static int      nrms          = 1;
+    static int      nthreads      = -1;
     static gmx_bool bMassWeighted = TRUE;
     t_pargs         pa[]          =
     {
@@ -212,6 +219,10 @@ int gmx_rms(int argc, char *argv[])
         { "-dlog", FALSE, etBOOL,
           { &bDeltaLog },
           "HIDDENUse a log x-axis in the delta t matrix" },
+#ifdef GMX_OPENMP
+        { "-nt", FALSE, etINT,
+          { &nthreads }, "Number of threads used for the comparison matrix (if -1, all threads will be used or what is specified by the environment variable OMP_NUM_THREADS)" },
+#endif
         { "-dmax", FALSE, etREAL,
           { &delta_maxy }, "HIDDENMaximum level in delta matrix" },
         { "-aver", FALSE, etINT,
@@ -237,7 +248,7 @@ int gmx_rms(int argc, char *argv[])
     int             ncons = 0;
     FILE           *fp;
     real            rlstot = 0, **rls, **rlsm = NULL, *time, *time2, *rlsnorm = NULL,
-    **rmsd_mat             = NULL, **bond_mat = NULL, *axis, *axis2, *del_xaxis,
+    **rmsd_mat             = NULL, *rmsd_elements = NULL, **bond_mat = NULL, *axis, *axis2, *del_xaxis,
     *del_yaxis, rmsd_max, rmsd_min, rmsd_avg, bond_max, bond_min, ang;
     real       **rmsdav_mat = NULL, av_tot, weight, weight_tot;
     real       **delta      = NULL, delta_max, delta_scalex = 0, delta_scaley = 0,
@@ -275,6 +286,10 @@ int gmx_rms(int argc, char *argv[])
     {
         return 0;
     }
+    if (nthreads > 0)
+    {
+        gmx_omp_set_num_threads(nthreads);
+    }
     /* parse enumerated options: */
     ewhat = nenum(what);
     if (ewhat == ewRho || ewhat == ewRhoSc)
@@ -859,7 +874,18 @@ int gmx_rms(int argc, char *argv[])
             }
         }
 
-        if (bFitAll)
+        if (bMat)
+        {
+            /* Compute all matrix elements at once, in parallel */
+            snew(rmsd_elements, bFile2 ?
+                 static_cast<gmx_int64_t>(tel_mat)*tel_mat2 :
+                 static_cast<gmx_int64_t>(tel_mat)*(tel_mat - 1)/2);
+            calc_rmsd_mat(n_ind_m, w_rls_m, bFitAll,
+                          irms[0], ind_rms_m, w_rms_m, ewhat != ewRMSD,
+                          tel_mat, mat_x, tel_mat2, bFile2 ? mat_x2 : NULL,
+                          TRUE, rmsd_elements);
+        }
+        if (bBond && bFitAll)
         {
             snew(mat_x2_j, natoms);
         }
@@ -877,25 +903,28 @@ int gmx_rms(int argc, char *argv[])
             }
             for (j = 0; j < tel_mat2; j++)
             {
-                if (bFitAll)
+                if (bBond)
                 {
-                    for (k = 0; k < n_ind_m; k++)
+                    if (bFitAll)
                     {
-                        copy_rvec(mat_x2[j][k], mat_x2_j[k]);
+                        for (k = 0; k < n_ind_m; k++)
+                        {
+                            copy_rvec(mat_x2[j][k], mat_x2_j[k]);
+                        }
+                        do_fit(n_ind_m, w_rls_m, mat_x[i], mat_x2_j);
+                    }
+                    else
+                    {
+                        mat_x2_j = mat_x2[j];
                     }
-                    do_fit(n_ind_m, w_rls_m, mat_x[i], mat_x2_j);
-                }
-                else
-                {
-                    mat_x2_j = mat_x2[j];
                 }
                 if (bMat)
                 {
                     if (bFile2 || (i < j))
                     {
-                        rmsd_mat[i][j] =
-                            calc_similar_ind(ewhat != ewRMSD, irms[0], ind_rms_m,
-                                             w_rms_m, mat_x[i], mat_x2_j);
+                        rmsd_mat[i][j] = rmsd_elements[bFile2 ?
+                                                       static_cast<gmx_int64_t>(i)*tel_mat2 + j :
+                                                       rmsd_mat_index(tel_mat, i, j)];
                         if (rmsd_mat[i][j] > rmsd_max)
                         {
                             rmsd_max = rmsd_mat[i][j];
@@ -939,6 +968,7 @@ int gmx_rms(int argc, char *argv[])
                 }
             }
         }
+        sfree(rmsd_elements);
         if (bFile2)
         {
             rmsd_avg /= tel_mat*tel_mat2;
@@ -34,13 +34,18 @@
  */
 #include "gmxpre.h"
 
+#include "config.h"
+
 #include <cmath>
 #include <cstdlib>
 
+#include <algorithm>
+
 #include "gromacs/commandline/pargs.h"
 #include "gromacs/fileio/confio.h"
 #include "gromacs/fileio/trx.h"
 #include "gromacs/fileio/trxio.h"
+#include "gromacs/gmxana/densgrid.h"
 #include "gromacs/gmxana/gmx_ana.h"
 #include "gromacs/legacyheaders/typedefs.h"
 #include "gromacs/math/vec.h"
@@ -49,10 +54,40 @@
 #include "gromacs/topology/index.h"
 #include "gromacs/utility/arraysize.h"
 #include "gromacs/utility/cstringutil.h"
+#include "gromacs/utility/exceptions.h"
+#include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/futil.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 
-static const double bohr = 0.529177249;  /* conversion factor to compensate for VMD plugin conversion... */
+/* Spreads the frames in fb onto the grid, in parallel over the frames,
+ * and empties the batch
+ */
+static void spread_spatial_frames(t_densgrid *g, t_frame_batch *fb,
+                                  const real origin[], const real invspacing[],
+                                  const double minbin[], const double maxbin[])
+{
+    int f;
+
+#pragma omp parallel for schedule(static) num_threads(std::min(fb->nframes, g->nthreads))
+    for (f = 0; f < fb->nframes; f++)
+    {
+        try
+        {
+            spread_densgrid(g, gmx_omp_get_thread_num(), origin, invspacing,
+                            fb->natoms, NULL, fb->x[f], NULL, 1);
+        }
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+    }
+    fb->nframes = 0;
+
+    if (densgrid_nr_outside(g) > 0)
+    {
+        gmx_fatal(FARGS, "There was an item outside of the allocated memory. Increase the value given with the -nab option.\n"
+                  "Memory was allocated for [%f,%f,%f]\tto\t[%f,%f,%f]",
+                  minbin[XX], minbin[YY], minbin[ZZ], maxbin[XX], maxbin[YY], maxbin[ZZ]);
+    }
+}
 
 int gmx_spatial(int argc, char *argv[])
 {
@@ -97,7 +132,19 @@ int gmx_spatial(int argc, char *argv[])
         "that are going to be used in the first and subsequent run through [gmx-trjconv].",
         "However, be sure to set the [TT]-nab[tt] option to a sufficiently high value since",
         "memory is allocated for cube bins based on the initial coordinates and the [TT]-nab[tt]",
-        "option value."
+        "option value.",
+        "",
+        "Performance options",
+        "^^^^^^^^^^^^^^^^^^^",
+        "",
+        "By default each atom is counted in the bin it is in. With [TT]-spread linear[tt]",
+        "the count is distributed linearly over the eight nearest bins, with",
+        "[TT]-spread gauss[tt] over a Gaussian of width [TT]-sigma[tt],",
+        "which gives smoother isosurfaces for short trajectories.",
+        "The frames are processed in parallel with OpenMP threads, each",
+        "thread accumulating onto its own copy of the grid, see [TT]-nt[tt].",
+        "The grid can also be written as a binary MRC/CCP4 map with [TT]-om[tt],",
+        "which is more compact and faster to load than the cube file."
     };
     const char     *bugs[] = {
         "When the allocated memory is not large enough, a segmentation fault may occur. This is usually detected "
@@ -106,12 +153,15 @@ int gmx_spatial(int argc, char *argv[])
         "with an increased [TT]-nab[tt] value."
     };
 
-    static gmx_bool bPBC         = FALSE;
-    static int      iIGNOREOUTER = -1;   /*Positive values may help if the surface is spikey */
-    static gmx_bool bCUTDOWN     = TRUE;
-    static real     rBINWIDTH    = 0.05; /* nm */
-    static gmx_bool bCALCDIV     = TRUE;
-    static int      iNAB         = 4;
+    static gmx_bool    bPBC         = FALSE;
+    static int         iIGNOREOUTER = -1;   /*Positive values may help if the surface is spikey */
+    static gmx_bool    bCUTDOWN     = TRUE;
+    static real        rBINWIDTH    = 0.05; /* nm */
+    static gmx_bool    bCALCDIV     = TRUE;
+    static int         iNAB         = 4;
+    static const char *espread[]    = { NULL, "bin", "linear", "gauss", NULL };
+    static real        sigma        = 0.05; /* nm */
+    static int         nthreads     = -1;
 
     t_pargs         pa[] = {
         { "-pbc",      FALSE, etBOOL, {&bPBC},
@@ -125,7 +175,15 @@ int gmx_spatial(int argc, char *argv[])
         { "-bin",      FALSE, etREAL, {&rBINWIDTH},
           "Width of the bins (nm)" },
         { "-nab",      FALSE, etINT, {&iNAB},
-          "Number of additional bins to ensure proper memory allocation" }
+          "Number of additional bins to ensure proper memory allocation" },
+        { "-spread",   FALSE, etENUM, {espread},
+          "How to spread each atom over the bins" },
+        { "-sigma",    FALSE, etREAL, {&sigma},
+          "Width of the Gaussian with [TT]-spread gauss[tt] (nm)" },
+#ifdef GMX_OPENMP
+        { "-nt",       FALSE, etINT, {&nthreads},
+          "Number of threads used by [THISMODULE] (if -1, all threads will be used or what is specified by the environment variable OMP_NUM_THREADS)" },
+#endif
     };
 
     double          MINBIN[3];
@@ -134,23 +192,29 @@ int gmx_spatial(int argc, char *argv[])
     int             ePBC;
     t_trxframe      fr;
     rvec           *xtop;
-    matrix          box, box_pbc;
+    matrix          box;
     t_trxstatus    *status;
     int             flags = TRX_READ_X;
-    t_pbc           pbc;
     t_atoms        *atoms;
     int             natoms;
     char           *grpnm, *grpnmp;
     atom_id        *index, *indexp;
     int             i, nidx, nidxp;
-    int             v;
+    int            *atomnr;
+    rvec           *xat;
     int             j, k;
-    int          ***bin = NULL;
-    int             nbin[3];
-    FILE           *flp;
+    t_densgrid     *grid;
+    t_frame_batch   fb;
+    int             nbin[3], ngrid[DIM], axis[DIM], ncube[DIM], lo[DIM];
+    gmx_bool        bPeriodic[DIM];
+    real            origin[DIM], invspacing[DIM];
+    double          cubeorigin[DIM];
+    double         *cube, value;
+    gmx_int64_t     c;
+    const char     *cubefile;
     int             x, y, z, minx, miny, minz, maxx, maxy, maxz;
     int             numfr, numcu;
-    int             tot, maxval, minval;
+    double          tot, maxval, minval;
     double          norm;
     output_env_t    oenv;
     gmx_rmpbc_t     gpbc = NULL;
@@ -158,7 +222,9 @@ int gmx_spatial(int argc, char *argv[])
     t_filenm        fnm[] = {
         { efTPS,  NULL,  NULL, ffREAD }, /* this is for the topology */
         { efTRX, "-f", NULL, ffREAD },   /* and this for the trajectory */
-        { efNDX, NULL, NULL, ffOPTRD }
+        { efNDX, NULL, NULL, ffOPTRD },
+        { efCUB, "-oc", "grid", ffOPTWR },
+        { efMRC, "-om", "grid", ffOPTWR }
     };
 
 #define NFILE asize(fnm)
@@ -171,6 +237,11 @@ int gmx_spatial(int argc, char *argv[])
         return 0;
     }
 
+    if (nthreads > 0)
+    {
+        gmx_omp_set_num_threads(nthreads);
+    }
+
     read_tps_conf(ftp2fn(efTPS, NFILE, fnm), &top, &ePBC, &xtop, NULL, box, TRUE);
     sfree(xtop);
 
@@ -220,226 +291,169 @@ int gmx_spatial(int argc, char *argv[])
         MINBIN[i] -= iNAB*rBINWIDTH;
         nbin[i]    = static_cast<int>(std::ceil((MAXBIN[i]-MINBIN[i])/rBINWIDTH));
     }
-    snew(bin, nbin[XX]);
-    for (i = 0; i < nbin[XX]; ++i)
+    /* The bins are numbered as ceil((x - MINBIN)/rBINWIDTH), the grid
+     * has one extra cell for the upper edge.
+     */
+    for (i = 0; i < DIM; i++)
     {
-        snew(bin[i], nbin[YY]);
-        for (j = 0; j < nbin[YY]; ++j)
-        {
-            snew(bin[i][j], nbin[ZZ]);
-        }
+        ngrid[i]      = nbin[i] + 1;
+        axis[i]       = i;
+        bPeriodic[i]  = FALSE;
+        origin[i]     = MINBIN[i] - rBINWIDTH;
+        invspacing[i] = 1/rBINWIDTH;
     }
-    copy_mat(box, box_pbc);
+    grid = init_densgrid(DIM, ngrid, axis, bPeriodic, nenum(espread), sigma);
+    init_frame_batch(&fb, grid->nthreads, nidx);
     numfr = 0;
-    minx  = miny = minz = 999;
-    maxx  = maxy = maxz = 0;
 
     if (bPBC)
     {
         gpbc = gmx_rmpbc_init(&top.idef, ePBC, natoms);
     }
-    /* This is the main loop over frames */
+    /* This is the main loop over frames, the frames are collected in
+     * batches that are spread onto the grid in parallel.
+     */
     do
     {
-        /* Must init pbc every step because of pressure coupling */
-
-        copy_mat(box, box_pbc);
         if (bPBC)
         {
             gmx_rmpbc_trxfr(gpbc, &fr);
-            set_pbc(&pbc, ePBC, box_pbc);
         }
-
-        for (i = 0; i < nidx; i++)
+        if (add_frame_batch(&fb, fr.time, fr.box, index, fr.x))
         {
-            if (fr.x[index[i]][XX] < MINBIN[XX] || fr.x[index[i]][XX] > MAXBIN[XX] ||
-                fr.x[index[i]][YY] < MINBIN[YY] || fr.x[index[i]][YY] > MAXBIN[YY] ||
-                fr.x[index[i]][ZZ] < MINBIN[ZZ] || fr.x[index[i]][ZZ] > MAXBIN[ZZ])
-            {
-                printf("There was an item outside of the allocated memory. Increase the value given with the -nab option.\n");
-                printf("Memory was allocated for [%f,%f,%f]\tto\t[%f,%f,%f]\n", MINBIN[XX], MINBIN[YY], MINBIN[ZZ], MAXBIN[XX], MAXBIN[YY], MAXBIN[ZZ]);
-                printf("Memory was required for [%f,%f,%f]\n", fr.x[index[i]][XX], fr.x[index[i]][YY], fr.x[index[i]][ZZ]);
-                exit(1);
-            }
-            x = static_cast<int>(std::ceil((fr.x[index[i]][XX]-MINBIN[XX])/rBINWIDTH));
-            y = static_cast<int>(std::ceil((fr.x[index[i]][YY]-MINBIN[YY])/rBINWIDTH));
-            z = static_cast<int>(std::ceil((fr.x[index[i]][ZZ]-MINBIN[ZZ])/rBINWIDTH));
-            ++bin[x][y][z];
-            if (x < minx)
-            {
-                minx = x;
-            }
-            if (x > maxx)
-            {
-                maxx = x;
-            }
-            if (y < miny)
-            {
-                miny = y;
-            }
-            if (y > maxy)
-            {
-                maxy = y;
-            }
-            if (z < minz)
-            {
-                minz = z;
-            }
-            if (z > maxz)
-            {
-                maxz = z;
-            }
+            spread_spatial_frames(grid, &fb, origin, invspacing, MINBIN, MAXBIN);
         }
         numfr++;
-        /* printf("%f\t%f\t%f\n",box[XX][XX],box[YY][YY],box[ZZ][ZZ]); */
-
     }
     while (read_next_frame(oenv, status, &fr));
+    spread_spatial_frames(grid, &fb, origin, invspacing, MINBIN, MAXBIN);
+    done_frame_batch(&fb);
+    reduce_densgrid(grid);
 
     if (bPBC)
     {
         gmx_rmpbc_done(gpbc);
     }
 
-    if (!bCUTDOWN)
-    {
-        minx = miny = minz = 0;
-        maxx = nbin[XX];
-        maxy = nbin[YY];
-        maxz = nbin[ZZ];
-    }
-
-    /* OUTPUT */
-    flp = gmx_ffopen("grid.cube", "w");
-    fprintf(flp, "Spatial Distribution Function\n");
-    fprintf(flp, "test\n");
-    fprintf(flp, "%5d%12.6f%12.6f%12.6f\n", nidxp, (MINBIN[XX]+(minx+iIGNOREOUTER)*rBINWIDTH)*10./bohr, (MINBIN[YY]+(miny+iIGNOREOUTER)*rBINWIDTH)*10./bohr, (MINBIN[ZZ]+(minz+iIGNOREOUTER)*rBINWIDTH)*10./bohr);
-    fprintf(flp, "%5d%12.6f%12.6f%12.6f\n", maxx-minx+1-(2*iIGNOREOUTER), rBINWIDTH*10./bohr, 0., 0.);
-    fprintf(flp, "%5d%12.6f%12.6f%12.6f\n", maxy-miny+1-(2*iIGNOREOUTER), 0., rBINWIDTH*10./bohr, 0.);
-    fprintf(flp, "%5d%12.6f%12.6f%12.6f\n", maxz-minz+1-(2*iIGNOREOUTER), 0., 0., rBINWIDTH*10./bohr);
-    for (i = 0; i < nidxp; i++)
-    {
-        v = 2;
-        if (*(top.atoms.atomname[indexp[i]][0]) == 'C')
-        {
-            v = 6;
-        }
-        if (*(top.atoms.atomname[indexp[i]][0]) == 'N')
-        {
-            v = 7;
-        }
-        if (*(top.atoms.atomname[indexp[i]][0]) == 'O')
-        {
-            v = 8;
-        }
-        if (*(top.atoms.atomname[indexp[i]][0]) == 'H')
-        {
-            v = 1;
-        }
-        if (*(top.atoms.atomname[indexp[i]][0]) == 'S')
-        {
-            v = 16;
-        }
-        fprintf(flp, "%5d%12.6f%12.6f%12.6f%12.6f\n", v, 0., fr.x[indexp[i]][XX]*10.0/bohr, fr.x[indexp[i]][YY]*10.0/bohr, fr.x[indexp[i]][ZZ]*10.0/bohr);
-    }
-
-    tot = 0;
-    for (k = 0; k < nbin[XX]; k++)
+    /* Determine the range of bins with non-zero occupancy */
+    minx = miny = minz = 999;
+    maxx = maxy = maxz = 0;
+    for (x = 0; x < ngrid[XX]; x++)
     {
-        if (!(k < minx || k > maxx))
+        for (y = 0; y < ngrid[YY]; y++)
         {
-            continue;
-        }
-        for (j = 0; j < nbin[YY]; j++)
-        {
-            if (!(j < miny || j > maxy))
-            {
-                continue;
-            }
-            for (i = 0; i < nbin[ZZ]; i++)
+            for (z = 0; z < ngrid[ZZ]; z++)
             {
-                if (!(i < minz || i > maxz))
+                if (grid->grid[(static_cast<gmx_int64_t>(x)*ngrid[YY] + y)*ngrid[ZZ] + z] != 0)
                 {
-                    continue;
-                }
-                if (bin[k][j][i] != 0)
-                {
-                    printf("A bin was not empty when it should have been empty. Programming error.\n");
-                    printf("bin[%d][%d][%d] was = %d\n", k, j, i, bin[k][j][i]);
-                    exit(1);
+                    minx = std::min(minx, x);
+                    maxx = std::max(maxx, x);
+                    miny = std::min(miny, y);
+                    maxy = std::max(maxy, y);
+                    minz = std::min(minz, z);
+                    maxz = std::max(maxz, z);
                 }
             }
         }
     }
 
+    if (!bCUTDOWN)
+    {
+        minx = miny = minz = 0;
+        maxx = nbin[XX];
+        maxy = nbin[YY];
+        maxz = nbin[ZZ];
+    }
+
+    /* Extract the bins that are written, leaving out iIGNOREOUTER bins */
+    lo[XX]    = minx+iIGNOREOUTER;
+    lo[YY]    = miny+iIGNOREOUTER;
+    lo[ZZ]    = minz+iIGNOREOUTER;
+    ncube[XX] = maxx-minx+1-(2*iIGNOREOUTER);
+    ncube[YY] = maxy-miny+1-(2*iIGNOREOUTER);
+    ncube[ZZ] = maxz-minz+1-(2*iIGNOREOUTER);
+    numcu     = ncube[XX]*ncube[YY]*ncube[ZZ];
+    snew(cube, numcu);
+    tot    = 0;
     minval = 999;
     maxval = 0;
-    for (k = 0; k < nbin[XX]; k++)
+    c      = 0;
+    for (k = 0; k < ncube[XX]; k++)
     {
-        if (k < minx+iIGNOREOUTER || k > maxx-iIGNOREOUTER)
+        x = lo[XX] + k;
+        for (j = 0; j < ncube[YY]; j++)
         {
-            continue;
-        }
-        for (j = 0; j < nbin[YY]; j++)
-        {
-            if (j < miny+iIGNOREOUTER || j > maxy-iIGNOREOUTER)
-            {
-                continue;
-            }
-            for (i = 0; i < nbin[ZZ]; i++)
+            y = lo[YY] + j;
+            for (i = 0; i < ncube[ZZ]; i++)
             {
-                if (i < minz+iIGNOREOUTER || i > maxz-iIGNOREOUTER)
+                z = lo[ZZ] + i;
+                if (x >= 0 && x < ngrid[XX] && y >= 0 && y < ngrid[YY] &&
+                    z >= 0 && z < ngrid[ZZ])
                 {
-                    continue;
-                }
-                tot += bin[k][j][i];
-                if (bin[k][j][i] > maxval)
-                {
-                    maxval = bin[k][j][i];
-                }
-                if (bin[k][j][i] < minval)
-                {
-                    minval = bin[k][j][i];
+                    value   = grid->grid[(static_cast<gmx_int64_t>(x)*ngrid[YY] + y)*ngrid[ZZ] + z];
+                    cube[c] = value;
+                    tot    += value;
+                    maxval  = std::max(maxval, value);
+                    minval  = std::min(minval, value);
                 }
+                c++;
             }
         }
     }
+    done_densgrid(grid);
 
-    numcu = (maxx-minx+1-(2*iIGNOREOUTER))*(maxy-miny+1-(2*iIGNOREOUTER))*(maxz-minz+1-(2*iIGNOREOUTER));
     if (bCALCDIV)
     {
-        norm = static_cast<double>(numcu*numfr)/tot;
+        norm = static_cast<double>(numcu)*numfr/tot;
     }
     else
     {
         norm = 1.0;
     }
 
-    for (k = 0; k < nbin[XX]; k++)
+    /* OUTPUT */
+    snew(atomnr, nidxp);
+    snew(xat, nidxp);
+    for (i = 0; i < nidxp; i++)
     {
-        if (k < minx+iIGNOREOUTER || k > maxx-iIGNOREOUTER)
+        atomnr[i] = 2;
+        if (*(top.atoms.atomname[indexp[i]][0]) == 'C')
         {
-            continue;
+            atomnr[i] = 6;
         }
-        for (j = 0; j < nbin[YY]; j++)
+        if (*(top.atoms.atomname[indexp[i]][0]) == 'N')
         {
-            if (j < miny+iIGNOREOUTER || j > maxy-iIGNOREOUTER)
-            {
-                continue;
-            }
-            for (i = 0; i < nbin[ZZ]; i++)
-            {
-                if (i < minz+iIGNOREOUTER || i > maxz-iIGNOREOUTER)
-                {
-                    continue;
-                }
-                fprintf(flp, "%12.6f ", static_cast<double>(norm*bin[k][j][i])/numfr);
-            }
-            fprintf(flp, "\n");
+            atomnr[i] = 7;
         }
-        fprintf(flp, "\n");
+        if (*(top.atoms.atomname[indexp[i]][0]) == 'O')
+        {
+            atomnr[i] = 8;
+        }
+        if (*(top.atoms.atomname[indexp[i]][0]) == 'H')
+        {
+            atomnr[i] = 1;
+        }
+        if (*(top.atoms.atomname[indexp[i]][0]) == 'S')
+        {
+            atomnr[i] = 16;
+        }
+        copy_rvec(fr.x[indexp[i]], xat[i]);
+    }
+    for (i = 0; i < DIM; i++)
+    {
+        cubeorigin[i] = MINBIN[i]+lo[i]*rBINWIDTH;
+    }
+    cubefile = opt2bSet("-oc", NFILE, fnm) ? opt2fn("-oc", NFILE, fnm) : "grid.cube";
+    write_densgrid_cube(cubefile, "Spatial Distribution Function", "test",
+                        nidxp, atomnr, xat, cubeorigin, rBINWIDTH, ncube, cube, norm/numfr);
+    if (opt2bSet("-om", NFILE, fnm))
+    {
+        write_densgrid_mrc(opt2fn("-om", NFILE, fnm), "Spatial Distribution Function",
+                            cubeorigin, rBINWIDTH, ncube, cube, norm/numfr);
     }
-    gmx_ffclose(flp);
+    sfree(cube);
+    sfree(atomnr);
+    sfree(xat);
 
     if (bCALCDIV)
     {
@@ -448,8 +462,8 @@ int gmx_spatial(int argc, char *argv[])
     }
     else
     {
-        printf("grid.cube contains counts per frame in all %d cubes\n", numcu);
-        printf("Raw data: average %le, min %le, max %le\n", 1.0/norm, static_cast<double>(minval)/numfr, static_cast<double>(maxval)/numfr);
+        printf("%s contains counts per frame in all %d cubes\n", cubefile, numcu);
+        printf("Raw data: average %le, min %le, max %le\n", 1.0/norm, minval/numfr, maxval/numfr);
     }
 
     return 0;
@@ -60,10 +60,12 @@
 #include "gromacs/legacyheaders/copyrite.h"
 #include "gromacs/legacyheaders/names.h"
 #include "gromacs/legacyheaders/typedefs.h"
+#include "gromacs/math/utilities.h"
 #include "gromacs/math/vec.h"
 #include "gromacs/random/random.h"
 #include "gromacs/utility/arraysize.h"
 #include "gromacs/utility/cstringutil.h"
+#include "gromacs/utility/exceptions.h"
 #include "gromacs/utility/fatalerror.h"
 #include "gromacs/utility/futil.h"
 #include "gromacs/utility/gmxomp.h"
@@ -220,6 +222,7 @@ typedef struct
     real     min, max, dz;
     real     Temperature, Tolerance; //!< temperature, converged when probability changes less than Tolerance
     gmx_bool bCycl;                  //!< generate cyclic (periodic) PMF
+    int      nAnderson;              //!< nr of previous iterations used for Anderson mixing, 0: no mixing
     /*!\}*/
     /*!
      * \name Output control
@@ -818,24 +821,23 @@ double tabulated_pot(double dist, t_UmbrellaOptions *opt)
  * Don't worry, that routine does not mean we compute the PMF in limited precision.
  * After rapid convergence (using only substiantal contributions), we always switch to
  * full precision.
+ *
+ * With \p bFirst, a summary of the contribution table is printed, with \p bVerbose
+ * each update is reported.
  */
 void setup_acc_wham(double *profile, t_UmbrellaWindow * window, int nWindows,
-                    t_UmbrellaOptions *opt)
+                    t_UmbrellaOptions *opt, gmx_bool bFirst, gmx_bool bVerbose)
 {
     int           i, j, k, nGrptot = 0, nContrib = 0, nTot = 0;
     double        U, min = opt->min, dz = opt->dz, temp, ztot_half, distance, ztot, contrib1, contrib2;
+    double        wham_contrib_lim;
     gmx_bool      bAnyContrib;
-    static int    bFirst = 1;
-    static double wham_contrib_lim;
 
-    if (bFirst)
+    for (i = 0; i < nWindows; ++i)
     {
-        for (i = 0; i < nWindows; ++i)
-        {
-            nGrptot += window[i].nPull;
-        }
-        wham_contrib_lim = opt->Tolerance/nGrptot;
+        nGrptot += window[i].nPull;
     }
+    wham_contrib_lim = opt->Tolerance/nGrptot;
 
     ztot      = opt->max-opt->min;
     ztot_half = ztot/2;
@@ -911,12 +913,11 @@ void setup_acc_wham(double *profile, t_UmbrellaWindow * window, int nWindows,
                "Evaluating only %d of %d expressions.\n\n", wham_contrib_lim, nContrib, nTot);
     }
 
-    if (opt->verbose)
+    if (bVerbose)
     {
         printf("Updated rapid wham stuff. (evaluating only %d of %d contributions)\n",
                nContrib, nTot);
     }
-    bFirst = 0;
 }
 
 //! Compute the PMF (one of the two main WHAM routines)
@@ -928,15 +929,14 @@ void calc_profile(double *profile, t_UmbrellaWindow * window, int nWindows,
     ztot      = opt->max-opt->min;
     ztot_half = ztot/2;
 
+    /* Bins are distributed with an OpenMP work-sharing loop, so this also
+       works (serially) when called from within a parallel region */
 #pragma omp parallel
     {
-        int nthreads  = gmx_omp_get_max_threads();
-        int thread_id = gmx_omp_get_thread_num();
         int i;
-        int i0        = thread_id*opt->bins/nthreads;
-        int i1        = std::min(opt->bins, ((thread_id+1)*opt->bins)/nthreads);
 
-        for (i = i0; i < i1; ++i)
+#pragma omp for schedule(static)
+        for (i = 0; i < opt->bins; ++i)
         {
             int    j, k;
             double num, denom, invg, temp = 0, distance, U = 0;
@@ -994,14 +994,11 @@ double calc_z(double * profile, t_UmbrellaWindow * window, int nWindows,
 
 #pragma omp parallel
     {
-        int    nthreads  = gmx_omp_get_max_threads();
-        int    thread_id = gmx_omp_get_thread_num();
         int    i;
-        int    i0        = thread_id*nWindows/nthreads;
-        int    i1        = std::min(nWindows, ((thread_id+1)*nWindows)/nthreads);
-        double maxloc    = -1e20;
+        double maxloc = -1e20;
 
-        for (i = i0; i < i1; ++i)
+#pragma omp for schedule(static)
+        for (i = 0; i < nWindows; ++i)
         {
             double total     = 0, temp, distance, U = 0;
             int    j, k;
@@ -1072,6 +1069,339 @@ double calc_z(double * profile, t_UmbrellaWindow * window, int nWindows,
     return maxglob;
 }
 
+/*! \brief Work arrays for Anderson acceleration of the WHAM iterations
+ *
+ * One WHAM iteration (calc_profile() followed by calc_z()) is a fixed-point
+ * map z -> G(z) of the free energy offsets of all pull groups. Instead of
+ * simply continuing with G(z), Anderson mixing extrapolates from the last
+ * few iterates the z that minimizes the linearized residual G(z)-z.
+ */
+typedef struct
+{
+    int       n;             //!< nr of z values (all pull groups of all windows)
+    int       m;             //!< max nr of stored differences (mixing depth)
+    int       nhist;         //!< nr of differences currently stored
+    int       ihist;         //!< slot in dF and dG to be overwritten next
+    gmx_bool  bPrev;         //!< are fPrev and gPrev set?
+    double   *z;             //!< z that went into the current iteration
+    double   *g;             //!< z after the current iteration, G(z)
+    double   *f;             //!< residual G(z)-z of the current iteration
+    double   *fPrev, *gPrev; //!< f and g of the previous iteration
+    double  **dF, **dG;      //!< differences of successive f and g
+    double   *A, *b;         //!< normal equations (m x m) and right-hand side
+} t_whamAnderson;
+
+//! Allocate the Anderson mixing work arrays for \p nWindows windows and depth \p m
+static t_whamAnderson *init_wham_anderson(t_UmbrellaWindow *window, int nWindows, int m)
+{
+    t_whamAnderson *acc;
+    int             i;
+
+    snew(acc, 1);
+    acc->m = m;
+    acc->n = 0;
+    for (i = 0; i < nWindows; ++i)
+    {
+        acc->n += window[i].nPull;
+    }
+    snew(acc->z, acc->n);
+    snew(acc->g, acc->n);
+    snew(acc->f, acc->n);
+    snew(acc->fPrev, acc->n);
+    snew(acc->gPrev, acc->n);
+    snew(acc->dF, m);
+    snew(acc->dG, m);
+    for (i = 0; i < m; ++i)
+    {
+        snew(acc->dF[i], acc->n);
+        snew(acc->dG[i], acc->n);
+    }
+    snew(acc->A, m*m);
+    snew(acc->b, m);
+    acc->nhist = acc->ihist = 0;
+    acc->bPrev = FALSE;
+
+    return acc;
+}
+
+//! Free the Anderson mixing work arrays
+static void done_wham_anderson(t_whamAnderson *acc)
+{
+    int i;
+
+    for (i = 0; i < acc->m; ++i)
+    {
+        sfree(acc->dF[i]);
+        sfree(acc->dG[i]);
+    }
+    sfree(acc->dF);
+    sfree(acc->dG);
+    sfree(acc->z);
+    sfree(acc->g);
+    sfree(acc->f);
+    sfree(acc->fPrev);
+    sfree(acc->gPrev);
+    sfree(acc->A);
+    sfree(acc->b);
+    sfree(acc);
+}
+
+//! Forget the iteration history, e.g. when the WHAM map itself has changed
+static void reset_wham_anderson(t_whamAnderson *acc)
+{
+    acc->nhist = acc->ihist = 0;
+    acc->bPrev = FALSE;
+}
+
+//! Copy the z of all pull groups of all windows into \p z (bGet) or back into the windows
+static void copy_window_z(t_UmbrellaWindow *window, int nWindows, double *z, gmx_bool bGet)
+{
+    int i, j, n = 0;
+
+    for (i = 0; i < nWindows; ++i)
+    {
+        for (j = 0; j < window[i].nPull; ++j)
+        {
+            if (bGet)
+            {
+                z[n] = window[i].z[j];
+            }
+            else
+            {
+                window[i].z[j] = z[n];
+            }
+            n++;
+        }
+    }
+}
+
+/*! \brief Solve the n x n system A x = b by Gaussian elimination with partial pivoting
+ *
+ * A is destroyed, x is returned in b. Returns FALSE if A is (numerically) singular.
+ */
+static gmx_bool solve_small_linear_system(int n, double *A, double *b)
+{
+    int    i, j, k, ipiv;
+    double fac, tmp;
+
+    for (k = 0; k < n; ++k)
+    {
+        ipiv = k;
+        for (i = k+1; i < n; ++i)
+        {
+            if (std::abs(A[i*n+k]) > std::abs(A[ipiv*n+k]))
+            {
+                ipiv = i;
+            }
+        }
+        if (A[ipiv*n+k] == 0.0)
+        {
+            return FALSE;
+        }
+        if (ipiv != k)
+        {
+            for (j = 0; j < n; ++j)
+            {
+                std::swap(A[k*n+j], A[ipiv*n+j]);
+            }
+            std::swap(b[k], b[ipiv]);
+        }
+        for (i = k+1; i < n; ++i)
+        {
+            fac = A[i*n+k]/A[k*n+k];
+            for (j = k; j < n; ++j)
+            {
+                A[i*n+j] -= fac*A[k*n+j];
+            }
+            b[i] -= fac*b[k];
+        }
+    }
+    for (k = n-1; k >= 0; --k)
+    {
+        tmp = b[k];
+        for (j = k+1; j < n; ++j)
+        {
+            tmp -= A[k*n+j]*b[j];
+        }
+        b[k] = tmp/A[k*n+k];
+    }
+    return TRUE;
+}
+
+/*! \brief Replace the z just computed by calc_z() by the Anderson-extrapolated z
+ *
+ * acc->z must hold the z that went into the iteration. If no history is
+ * available, or the least-squares problem is ill-conditioned, the plain
+ * iterate G(z) is kept.
+ */
+static void wham_anderson_mix(t_whamAnderson *acc, t_UmbrellaWindow *window, int nWindows)
+{
+    int    i, a, c, n = acc->n, m = acc->m, nh;
+    double sum, diagmax;
+
+    copy_window_z(window, nWindows, acc->g, TRUE);
+    for (i = 0; i < n; ++i)
+    {
+        acc->f[i] = acc->g[i] - acc->z[i];
+    }
+    if (acc->bPrev)
+    {
+        for (i = 0; i < n; ++i)
+        {
+            acc->dF[acc->ihist][i] = acc->f[i] - acc->fPrev[i];
+            acc->dG[acc->ihist][i] = acc->g[i] - acc->gPrev[i];
+        }
+        acc->ihist = (acc->ihist + 1) % m;
+        acc->nhist = std::min(acc->nhist + 1, m);
+    }
+    std::memcpy(acc->fPrev, acc->f, n*sizeof(double));
+    std::memcpy(acc->gPrev, acc->g, n*sizeof(double));
+    acc->bPrev = TRUE;
+
+    nh = acc->nhist;
+    if (nh == 0)
+    {
+        return;
+    }
+
+    /* Least-squares fit of the current residual by the residual differences,
+       min |f - dF gamma|, via the (slightly regularized) normal equations */
+    diagmax = 0;
+    for (a = 0; a < nh; ++a)
+    {
+        for (c = a; c < nh; ++c)
+        {
+            sum = 0;
+            for (i = 0; i < n; ++i)
+            {
+                sum += acc->dF[a][i]*acc->dF[c][i];
+            }
+            acc->A[a*nh+c] = acc->A[c*nh+a] = sum;
+        }
+        diagmax = std::max(diagmax, acc->A[a*nh+a]);
+        sum     = 0;
+        for (i = 0; i < n; ++i)
+        {
+            sum += acc->dF[a][i]*acc->f[i];
+        }
+        acc->b[a] = sum;
+    }
+    if (diagmax == 0.0)
+    {
+        return;
+    }
+    for (a = 0; a < nh; ++a)
+    {
+        acc->A[a*nh+a] += 1e-10*diagmax;
+    }
+    if (!solve_small_linear_system(nh, acc->A, acc->b))
+    {
+        reset_wham_anderson(acc);
+        return;
+    }
+
+    /* z_new = G(z) - sum_a gamma_a dG_a */
+    for (i = 0; i < n; ++i)
+    {
+        sum = acc->g[i];
+        for (a = 0; a < nh; ++a)
+        {
+            sum -= acc->b[a]*acc->dG[a][i];
+        }
+        if (!gmx_isfinite(sum))
+        {
+            /* Keep the plain iterate G(z) */
+            reset_wham_anderson(acc);
+            return;
+        }
+        acc->z[i] = sum;
+    }
+    copy_window_z(window, nWindows, acc->z, FALSE);
+}
+
+/*! \brief Iterate the WHAM equations until the z are self-consistent
+ *
+ * First only the substantial contributions are evaluated (see setup_acc_wham()),
+ * and after convergence the exact equations are iterated to convergence.
+ * With opt->nAnderson > 0, the iterations are accelerated with Anderson mixing.
+ * Progress is printed only with \p bVerbose, since bootstraps run this in parallel.
+ *
+ * \returns the number of iterations. The final maximum change of z is returned
+ * in \p maxchange.
+ */
+static int wham_iterations(double *profile, t_UmbrellaWindow *window, int nWindows,
+                           t_UmbrellaOptions *opt, gmx_bool bVerbose, double *maxchange)
+{
+    t_whamAnderson *acc    = NULL;
+    double          change = 1e20, lastchange = 1e20;
+    gmx_bool        bExact = FALSE, bConverged = FALSE;
+    int             i      = 0;
+
+    if (opt->nAnderson > 0)
+    {
+        acc = init_wham_anderson(window, nWindows, opt->nAnderson);
+    }
+    do
+    {
+        if ( (i%opt->stepUpdateContrib) == 0)
+        {
+            setup_acc_wham(profile, window, nWindows, opt, bVerbose && i == 0,
+                           bVerbose && opt->verbose);
+            /* The rapid WHAM map has changed, unless we iterate exactly already */
+            if (acc && !bExact)
+            {
+                reset_wham_anderson(acc);
+            }
+        }
+        if (change < opt->Tolerance)
+        {
+            bExact = TRUE;
+            if (acc)
+            {
+                reset_wham_anderson(acc);
+            }
+            if (bVerbose)
+            {
+                printf("Switched to exact iteration in iteration %d\n", i);
+            }
+        }
+        if (acc)
+        {
+            copy_window_z(window, nWindows, acc->z, TRUE);
+        }
+        calc_profile(profile, window, nWindows, opt, bExact);
+        if (bVerbose && ((i%opt->stepchange) == 0 || i == 1) && i != 0)
+        {
+            printf("\t%4d) Maximum change %e\n", i, change);
+        }
+        i++;
+        change     = calc_z(profile, window, nWindows, opt, bExact);
+        bConverged = (change <= opt->Tolerance && bExact);
+        if (acc && !bConverged)
+        {
+            /* Start over from the plain iterate if the extrapolation diverges */
+            if (change > 10*lastchange)
+            {
+                reset_wham_anderson(acc);
+            }
+            else
+            {
+                wham_anderson_mix(acc, window, nWindows);
+            }
+        }
+        lastchange = change;
+    }
+    while (!bConverged);
+
+    if (acc)
+    {
+        done_wham_anderson(acc);
+    }
+    *maxchange = change;
+
+    return i;
+}
+
 //! Make PMF symmetric around 0 (useful e.g. for membranes)
 void symmetrizeProfile(double* profile, t_UmbrellaOptions *opt)
 {
@@ -1216,6 +1546,8 @@ void getRandomIntArray(int nPull, int blockLength, int* randomArray, gmx_rng_t r
  *
  * This is used when bootstapping new trajectories and thereby create new histogtrams,
  * but it is not required if we bootstrap complete histograms.
+ * The table of contributing bins is not shared with \p thisWindow, since it is
+ * recomputed for each bootstrap, and bootstraps may run in parallel.
  */
 void copy_pullgrp_to_synthwindow(t_UmbrellaWindow *synthWindow,
                                  t_UmbrellaWindow *thisWindow, int pullid)
@@ -1225,7 +1557,6 @@ void copy_pullgrp_to_synthwindow(t_UmbrellaWindow *synthWindow,
     synthWindow->pos     [0] = thisWindow->pos      [pullid];
     synthWindow->z       [0] = thisWindow->z        [pullid];
     synthWindow->k       [0] = thisWindow->k        [pullid];
-    synthWindow->bContrib[0] = thisWindow->bContrib [pullid];
     synthWindow->g       [0] = thisWindow->g        [pullid];
     synthWindow->bsWeight[0] = thisWindow->bsWeight [pullid];
 }
@@ -1335,7 +1666,7 @@ void searchCumulative(double xx[], int n, double x, int *j)
 
 //! Bootstrap new trajectories and thereby generate new (bootstrapped) histograms
 void create_synthetic_histo(t_UmbrellaWindow *synthWindow, t_UmbrellaWindow *thisWindow,
-                            int pullid, t_UmbrellaOptions *opt)
+                            int pullid, t_UmbrellaOptions *opt, gmx_rng_t rng)
 {
     int    N, i, nbins, r_index, ibin;
     double r, tausteps = 0.0, a, ap, dt, x, invsqrt2, g, y, sig = 0., z, mu = 0.;
@@ -1376,7 +1707,6 @@ void create_synthetic_histo(t_UmbrellaWindow *synthWindow, t_UmbrellaWindow *thi
     synthWindow->pos     [0] = thisWindow->pos[pullid];
     synthWindow->z       [0] = thisWindow->z[pullid];
     synthWindow->k       [0] = thisWindow->k[pullid];
-    synthWindow->bContrib[0] = thisWindow->bContrib[pullid];
     synthWindow->g       [0] = thisWindow->g       [pullid];
     synthWindow->bsWeight[0] = thisWindow->bsWeight[pullid];
 
@@ -1412,14 +1742,14 @@ void create_synthetic_histo(t_UmbrellaWindow *synthWindow, t_UmbrellaWindow *thi
     invsqrt2 = 1.0/std::sqrt(2.0);
 
     /* init random sequence */
-    x = gmx_rng_gaussian_table(opt->rng);
+    x = gmx_rng_gaussian_table(rng);
 
     if (opt->bsMethod == bsMethod_traj)
     {
         /* bootstrap points from the umbrella histograms */
         for (i = 0; i < N; i++)
         {
-            y = gmx_rng_gaussian_table(opt->rng);
+            y = gmx_rng_gaussian_table(rng);
             x = a*x+ap*y;
             /* get flat distribution in [0,1] using cumulative distribution function of Gauusian
                Note: CDF(Gaussian) = 0.5*{1+erf[x/sqrt(2)]}
@@ -1439,7 +1769,7 @@ void create_synthetic_histo(t_UmbrellaWindow *synthWindow, t_UmbrellaWindow *thi
         i = 0;
         while (i < N)
         {
-            y    = gmx_rng_gaussian_table(opt->rng);
+            y    = gmx_rng_gaussian_table(rng);
             x    = a*x+ap*y;
             z    = x*sig+mu;
             ibin = static_cast<int> (std::floor((z-opt->min)/opt->dz));
@@ -1546,7 +1876,7 @@ int func_wham_is_larger(const void *a, const void *b)
 }
 
 //! Make random weights for histograms for the Bayesian bootstrap of complete histograms)
-void setRandomBsWeights(t_UmbrellaWindow *synthwin, int nAllPull, t_UmbrellaOptions *opt)
+void setRandomBsWeights(t_UmbrellaWindow *synthwin, int nAllPull, gmx_rng_t rng)
 {
     int     i;
     double *r;
@@ -1556,7 +1886,7 @@ void setRandomBsWeights(t_UmbrellaWindow *synthwin, int nAllPull, t_UmbrellaOpti
     /* generate ordered random numbers between 0 and nAllPull  */
     for (i = 0; i < nAllPull-1; i++)
     {
-        r[i] = gmx_rng_uniform_real(opt->rng) * nAllPull;
+        r[i] = gmx_rng_uniform_real(rng) * nAllPull;
     }
     qsort((void *)r, nAllPull-1, sizeof(double), &func_wham_is_larger);
     r[nAllPull-1] = 1.0*nAllPull;
@@ -1579,17 +1909,74 @@ void setRandomBsWeights(t_UmbrellaWindow *synthwin, int nAllPull, t_UmbrellaOpti
     sfree(r);
 }
 
-//! The main bootstrapping routine
+//! Allocate \p nAllPull synthetic windows with one pull group each, used for bootstrapping
+static t_UmbrellaWindow *init_synth_windows(int nAllPull, t_UmbrellaOptions *opt)
+{
+    t_UmbrellaWindow *synthWindow;
+    int               i;
+
+    snew(synthWindow, nAllPull);
+    for (i = 0; i < nAllPull; i++)
+    {
+        synthWindow[i].nPull = 1;
+        synthWindow[i].nBin  = opt->bins;
+        snew(synthWindow[i].Histo, 1);
+        if (opt->bsMethod == bsMethod_traj || opt->bsMethod == bsMethod_trajGauss)
+        {
+            snew(synthWindow[i].Histo[0], opt->bins);
+        }
+        snew(synthWindow[i].N, 1);
+        snew(synthWindow[i].pos, 1);
+        snew(synthWindow[i].z, 1);
+        snew(synthWindow[i].k, 1);
+        snew(synthWindow[i].bContrib, 1);
+        snew(synthWindow[i].g, 1);
+        snew(synthWindow[i].bsWeight, 1);
+    }
+    return synthWindow;
+}
+
+//! Free synthetic windows made with init_synth_windows()
+static void done_synth_windows(t_UmbrellaWindow *synthWindow, int nAllPull, t_UmbrellaOptions *opt)
+{
+    int i;
+
+    for (i = 0; i < nAllPull; i++)
+    {
+        if (opt->bsMethod == bsMethod_traj || opt->bsMethod == bsMethod_trajGauss)
+        {
+            sfree(synthWindow[i].Histo[0]);
+        }
+        sfree(synthWindow[i].Histo);
+        sfree(synthWindow[i].N);
+        sfree(synthWindow[i].pos);
+        sfree(synthWindow[i].z);
+        sfree(synthWindow[i].k);
+        sfree(synthWindow[i].bContrib[0]);
+        sfree(synthWindow[i].bContrib);
+        sfree(synthWindow[i].g);
+        sfree(synthWindow[i].bsWeight);
+    }
+    sfree(synthWindow);
+}
+
+/*! \brief The main bootstrapping routine
+ *
+ * The bootstraps are independent, so they are computed in parallel if there are
+ * at least as many bootstraps as threads (otherwise the WHAM iterations of each
+ * bootstrap are parallelized). Each bootstrap draws from its own random number
+ * generator, seeded from the -bs-seed generator in the order of the bootstraps,
+ * so the results do not depend on the number of threads.
+ */
 void do_bootstrapping(const char *fnres, const char* fnprof, const char *fnhist,
                       char* ylabel, double *profile,
                       t_UmbrellaWindow * window, int nWindows, t_UmbrellaOptions *opt)
 {
-    t_UmbrellaWindow * synthWindow;
-    double            *bsProfile, *bsProfiles_av, *bsProfiles_av2, maxchange = 1e20, tmp, stddev;
-    int                i, j, *randomArray = 0, winid, pullid, ib;
+    double            *bsProfiles, *bsProfile, *bsProfiles_av, *bsProfiles_av2, tmp, stddev;
+    unsigned int      *bsSeeds;
+    int                i, j, ib;
     int                iAllPull, nAllPull, *allPull_winId, *allPull_pullId;
     FILE              *fp;
-    gmx_bool           bExact = FALSE;
 
     /* init random generator */
     if (opt->bsSeed == -1)
@@ -1601,9 +1988,14 @@ void do_bootstrapping(const char *fnres, const char* fnprof, const char *fnhist,
         opt->rng = gmx_rng_init(opt->bsSeed);
     }
 
-    snew(bsProfile,     opt->bins);
-    snew(bsProfiles_av, opt->bins);
+    snew(bsProfiles,     opt->nBootStrap*opt->bins);
+    snew(bsProfiles_av,  opt->bins);
     snew(bsProfiles_av2, opt->bins);
+    snew(bsSeeds,        opt->nBootStrap);
+    for (ib = 0; ib < opt->nBootStrap; ib++)
+    {
+        bsSeeds[ib] = gmx_rng_uniform_uint32(opt->rng);
+    }
 
     /* Create array of all pull groups. Note that different windows
        may have different nr of pull groups
@@ -1627,41 +2019,13 @@ void do_bootstrapping(const char *fnres, const char* fnprof, const char *fnhist,
         }
     }
 
-    /* setup stuff for synthetic windows */
-    snew(synthWindow, nAllPull);
-    for (i = 0; i < nAllPull; i++)
-    {
-        synthWindow[i].nPull = 1;
-        synthWindow[i].nBin  = opt->bins;
-        snew(synthWindow[i].Histo, 1);
-        if (opt->bsMethod == bsMethod_traj || opt->bsMethod == bsMethod_trajGauss)
-        {
-            snew(synthWindow[i].Histo[0], opt->bins);
-        }
-        snew(synthWindow[i].N, 1);
-        snew(synthWindow[i].pos, 1);
-        snew(synthWindow[i].z, 1);
-        snew(synthWindow[i].k, 1);
-        snew(synthWindow[i].bContrib, 1);
-        snew(synthWindow[i].g, 1);
-        snew(synthWindow[i].bsWeight, 1);
-    }
-
     switch (opt->bsMethod)
     {
         case bsMethod_hist:
-            snew(randomArray, nAllPull);
             printf("\n\nWhen computing statistical errors by bootstrapping entire histograms:\n");
             please_cite(stdout, "Hub2006");
             break;
         case bsMethod_BayesianHist:
-            /* just copy all histogams into synthWindow array */
-            for (i = 0; i < nAllPull; i++)
-            {
-                winid  = allPull_winId [i];
-                pullid = allPull_pullId[i];
-                copy_pullgrp_to_synthwindow(synthWindow+i, window+winid, pullid);
-            }
             break;
         case bsMethod_traj:
         case bsMethod_trajGauss:
@@ -1672,85 +2036,101 @@ void do_bootstrapping(const char *fnres, const char* fnprof, const char *fnhist,
     }
 
     /* do bootstrapping */
-    fp = xvgropen(fnprof, "Boot strap profiles", xlabel, ylabel, opt->oenv);
-    for (ib = 0; ib < opt->nBootStrap; ib++)
+#pragma omp parallel if (opt->nBootStrap >= gmx_omp_get_max_threads())
     {
-        printf("  *******************************************\n"
-               "  ******** Start bootstrap nr %d ************\n"
-               "  *******************************************\n", ib+1);
-
-        switch (opt->bsMethod)
+        try
         {
-            case bsMethod_hist:
-                /* bootstrap complete histograms from given histograms */
-                getRandomIntArray(nAllPull, opt->histBootStrapBlockLength, randomArray, opt->rng);
-                for (i = 0; i < nAllPull; i++)
+            /* synthetic windows and work arrays of this thread */
+            t_UmbrellaWindow *synthWindow;
+            int              *randomArray = NULL;
+            int               ib, i, winid, pullid, niter;
+            double            maxchange, *bsProfile;
+            gmx_rng_t         rng;
+
+            synthWindow = init_synth_windows(nAllPull, opt);
+            if (opt->bsMethod == bsMethod_hist)
+            {
+                snew(randomArray, nAllPull);
+            }
+
+#pragma omp for schedule(dynamic)
+            for (ib = 0; ib < opt->nBootStrap; ib++)
+            {
+                rng       = gmx_rng_init(bsSeeds[ib]);
+                bsProfile = bsProfiles + ib*opt->bins;
+
+                switch (opt->bsMethod)
                 {
-                    winid  = allPull_winId [randomArray[i]];
-                    pullid = allPull_pullId[randomArray[i]];
-                    copy_pullgrp_to_synthwindow(synthWindow+i, window+winid, pullid);
+                    case bsMethod_hist:
+                        /* bootstrap complete histograms from given histograms */
+                        getRandomIntArray(nAllPull, opt->histBootStrapBlockLength, randomArray, rng);
+                        for (i = 0; i < nAllPull; i++)
+                        {
+                            winid  = allPull_winId [randomArray[i]];
+                            pullid = allPull_pullId[randomArray[i]];
+                            copy_pullgrp_to_synthwindow(synthWindow+i, window+winid, pullid);
+                        }
+                        break;
+                    case bsMethod_BayesianHist:
+                        /* keep histos, but assign random weights ("Bayesian bootstrap") */
+                        for (i = 0; i < nAllPull; i++)
+                        {
+                            winid  = allPull_winId [i];
+                            pullid = allPull_pullId[i];
+                            copy_pullgrp_to_synthwindow(synthWindow+i, window+winid, pullid);
+                        }
+                        setRandomBsWeights(synthWindow, nAllPull, rng);
+                        break;
+                    case bsMethod_traj:
+                    case bsMethod_trajGauss:
+                        /* create new histos from given histos, that is generate new hypothetical
+                           trajectories */
+                        for (i = 0; i < nAllPull; i++)
+                        {
+                            winid  = allPull_winId[i];
+                            pullid = allPull_pullId[i];
+                            create_synthetic_histo(synthWindow+i, window+winid, pullid, opt, rng);
+                        }
+                        break;
                 }
-                break;
-            case bsMethod_BayesianHist:
-                /* keep histos, but assign random weights ("Bayesian bootstrap") */
-                setRandomBsWeights(synthWindow, nAllPull, opt);
-                break;
-            case bsMethod_traj:
-            case bsMethod_trajGauss:
-                /* create new histos from given histos, that is generate new hypothetical
-                   trajectories */
-                for (i = 0; i < nAllPull; i++)
+                gmx_rng_destroy(rng);
+
+                /* write histos in case of verbose output */
+                if (opt->bs_verbose)
                 {
-                    winid  = allPull_winId[i];
-                    pullid = allPull_pullId[i];
-                    create_synthetic_histo(synthWindow+i, window+winid, pullid, opt);
+#pragma omp critical
+                    print_histograms(fnhist, synthWindow, nAllPull, ib, opt);
                 }
-                break;
-        }
 
-        /* write histos in case of verbose output */
-        if (opt->bs_verbose)
-        {
-            print_histograms(fnhist, synthWindow, nAllPull, ib, opt);
-        }
+                /* do wham */
+                std::memcpy(bsProfile, profile, opt->bins*sizeof(double)); /* use profile as guess */
+                niter = wham_iterations(bsProfile, synthWindow, nAllPull, opt, FALSE, &maxchange);
+                printf("\tBootstrap %d converged in %d iterations. Final maximum change %g\n",
+                       ib+1, niter, maxchange);
 
-        /* do wham */
-        i         = 0;
-        bExact    = FALSE;
-        maxchange = 1e20;
-        std::memcpy(bsProfile, profile, opt->bins*sizeof(double)); /* use profile as guess */
-        do
-        {
-            if ( (i%opt->stepUpdateContrib) == 0)
-            {
-                setup_acc_wham(bsProfile, synthWindow, nAllPull, opt);
-            }
-            if (maxchange < opt->Tolerance)
-            {
-                bExact = TRUE;
-            }
-            if (((i%opt->stepchange) == 0 || i == 1) && i != 0)
-            {
-                printf("\t%4d) Maximum change %e\n", i, maxchange);
-            }
-            calc_profile(bsProfile, synthWindow, nAllPull, opt, bExact);
-            i++;
-        }
-        while ( (maxchange = calc_z(bsProfile, synthWindow, nAllPull, opt, bExact)) > opt->Tolerance || !bExact);
-        printf("\tConverged in %d iterations. Final maximum change %g\n", i, maxchange);
+                if (opt->bLog)
+                {
+                    prof_normalization_and_unit(bsProfile, opt);
+                }
 
-        if (opt->bLog)
-        {
-            prof_normalization_and_unit(bsProfile, opt);
-        }
+                /* symmetrize profile around z=0 */
+                if (opt->bSym)
+                {
+                    symmetrizeProfile(bsProfile, opt);
+                }
+            }
 
-        /* symmetrize profile around z=0 */
-        if (opt->bSym)
-        {
-            symmetrizeProfile(bsProfile, opt);
+            sfree(randomArray);
+            done_synth_windows(synthWindow, nAllPull, opt);
         }
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+    }
 
-        /* save stuff to get average and stddev */
+    /* write the profiles and save stuff to get average and stddev */
+    fp = xvgropen(fnprof, "Boot strap profiles", xlabel, ylabel, opt->oenv);
+    for (ib = 0; ib < opt->nBootStrap; ib++)
+    {
+        bsProfile = bsProfiles + ib*opt->bins;
         for (i = 0; i < opt->bins; i++)
         {
             tmp                = bsProfile[i];
@@ -1778,6 +2158,14 @@ void do_bootstrapping(const char *fnres, const char* fnprof, const char *fnhist,
     }
     xvgrclose(fp);
     printf("Wrote boot strap result to %s\n", fnres);
+
+    sfree(bsProfiles);
+    sfree(bsProfiles_av);
+    sfree(bsProfiles_av2);
+    sfree(bsSeeds);
+    sfree(allPull_winId);
+    sfree(allPull_pullId);
+    gmx_rng_destroy(opt->rng);
 }
 
 //! Return type of input file based on file extension (xvg, pdo, or tpr)
@@ -3286,6 +3674,7 @@ int gmx_wham(int argc, char *argv[])
         "* [TT]-tol[tt]    Stop iteration if profile (probability) changed less than tolerance",
         "* [TT]-auto[tt]   Automatic determination of boundaries",
         "* [TT]-min,-max[tt]   Boundaries of the profile",
+        "* [TT]-anderson[tt]   Nr of previous iterations used to accelerate the WHAM iterations",
         "",
         "The data points that are used to compute the profile",
         "can be restricted with options [TT]-b[tt], [TT]-e[tt], and [TT]-dt[tt]. ",
@@ -3308,6 +3697,8 @@ int gmx_wham(int argc, char *argv[])
         "^^^^^^^^^^^^^^^",
         "",
         "If available, the number of OpenMP threads used by g_wham is controlled with [TT]-nt[tt].",
+        "The WHAM iterations are parallelized over bins and windows. With bootstrapping, ",
+        "the bootstraps are computed in parallel, each thread running its own WHAM iterations.",
         "",
         "Autocorrelations",
         "^^^^^^^^^^^^^^^^",
@@ -3398,6 +3789,8 @@ int gmx_wham(int argc, char *argv[])
           "Temperature"},
         { "-tol", FALSE, etREAL, {&opt.Tolerance},
           "Tolerance"},
+        { "-anderson", FALSE, etINT, {&opt.nAnderson},
+          "Accelerate the WHAM iterations by Anderson mixing of this many previous iterations (0: plain iterations)"},
         { "-v", FALSE, etBOOL, {&opt.verbose},
           "Verbose mode"},
         { "-b", FALSE, etREAL, {&opt.tmin},
@@ -3468,7 +3861,7 @@ int gmx_wham(int argc, char *argv[])
     t_UmbrellaHeader         header;
     t_UmbrellaWindow       * window = NULL;
     double                  *profile, maxchange = 1e20;
-    gmx_bool                 bMinSet, bMaxSet, bAutoSet, bExact = FALSE;
+    gmx_bool                 bMinSet, bMaxSet, bAutoSet;
     char                   **fninTpr, **fninPull, **fninPdo;
     const char              *fnPull;
     FILE                    *histout, *profout;
@@ -3508,6 +3901,7 @@ int gmx_wham(int argc, char *argv[])
     opt.acTrestart            = 1.0;
     opt.stepchange            = 100;
     opt.stepUpdateContrib     = 100;
+    opt.nAnderson             = 5;
 
     if (!parse_common_args(&argc, argv, 0,
                            NFILE, fnm, asize(pa), pa, asize(desc), desc, 0, NULL, &opt.oenv))
@@ -3705,27 +4099,7 @@ int gmx_wham(int argc, char *argv[])
     {
         opt.stepchange = 1;
     }
-    i = 0;
-    do
-    {
-        if ( (i%opt.stepUpdateContrib) == 0)
-        {
-            setup_acc_wham(profile, window, nwins, &opt);
-        }
-        if (maxchange < opt.Tolerance)
-        {
-            bExact = TRUE;
-            /* if (opt.verbose) */
-            printf("Switched to exact iteration in iteration %d\n", i);
-        }
-        calc_profile(profile, window, nwins, &opt, bExact);
-        if (((i%opt.stepchange) == 0 || i == 1) && i != 0)
-        {
-            printf("\t%4d) Maximum change %e\n", i, maxchange);
-        }
-        i++;
-    }
-    while ( (maxchange = calc_z(profile, window, nwins, &opt, bExact)) > opt.Tolerance || !bExact);
+    i = wham_iterations(profile, window, nwins, &opt, TRUE, &maxchange);
     printf("Converged in %d iterations. Final maximum change %g\n", i, maxchange);
 
     /* calc error from Kumar's formula */
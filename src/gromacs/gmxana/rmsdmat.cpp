@@ -0,0 +1,365 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+#include "gmxpre.h"
+
+#include "rmsdmat.h"
+
+#include "config.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include <algorithm>
+
+#include "gromacs/math/do_fit.h"
+#include "gromacs/math/vec.h"
+#include "gromacs/simd/simd.h"
+#include "gromacs/utility/exceptions.h"
+#include "gromacs/utility/gmxomp.h"
+#include "gromacs/utility/smalloc.h"
+
+/* Target size in bytes of the coordinates of a block of structures,
+ * chosen such that a block of each side of a pair fits in L2 cache.
+ */
+static const int c_blockBytes = 128*1024;
+
+/* Structures converted to padded, aligned x/y/z arrays of the atoms
+ * with non-zero fit weight, scaled by the square root of the weight,
+ * such that the weighted inner product is a plain dot product.
+ */
+typedef struct {
+    int     nframes;
+    int     stride;   /* Padded number of atoms */
+    real   *x;        /* nframes*3*stride coordinates */
+    double *E;        /* Weighted sum of squared norms per frame */
+} t_qcp_frames;
+
+static int simd_width()
+{
+#ifdef GMX_SIMD_HAVE_REAL
+    return GMX_SIMD_REAL_WIDTH;
+#else
+    return 1;
+#endif
+}
+
+static void init_qcp_frames(t_qcp_frames *f, int natoms, const real *w,
+                            int nframes, rvec **x)
+{
+    int n, width;
+
+    n = 0;
+    for (int i = 0; i < natoms; i++)
+    {
+        if (w[i] != 0)
+        {
+            n++;
+        }
+    }
+    width      = simd_width();
+    f->nframes = nframes;
+    f->stride  = ((n + width - 1)/width)*width;
+    snew_aligned(f->x, static_cast<size_t>(nframes)*DIM*f->stride, width*sizeof(real));
+    snew(f->E, nframes);
+
+#pragma omp parallel for schedule(static)
+    for (int fr = 0; fr < nframes; fr++)
+    {
+        real  *xf = f->x + static_cast<size_t>(fr)*DIM*f->stride;
+        double E  = 0;
+        int    a  = 0;
+        for (int i = 0; i < natoms; i++)
+        {
+            if (w[i] != 0)
+            {
+                real sw = std::sqrt(w[i]);
+                for (int d = 0; d < DIM; d++)
+                {
+                    xf[d*f->stride + a] = sw*x[fr][i][d];
+                    E                  += xf[d*f->stride + a]*xf[d*f->stride + a];
+                }
+                a++;
+            }
+        }
+        /* The padding is zero from snew_aligned */
+        f->E[fr] = E;
+    }
+}
+
+static void done_qcp_frames(t_qcp_frames *f)
+{
+    sfree_aligned(f->x);
+    sfree(f->E);
+}
+
+/* Computes S[a][b] = sum_i xb_i[a] xa_i[b] over the padded arrays */
+static void calc_inner_product(int stride, const real *xa, const real *xb,
+                               double S[DIM][DIM])
+{
+    const real *ya = xa + stride, *za = xa + 2*stride;
+    const real *yb = xb + stride, *zb = xb + 2*stride;
+#ifdef GMX_SIMD_HAVE_REAL
+    gmx_simd_real_t sxx = gmx_simd_setzero_r(), sxy = gmx_simd_setzero_r(), sxz = gmx_simd_setzero_r();
+    gmx_simd_real_t syx = gmx_simd_setzero_r(), syy = gmx_simd_setzero_r(), syz = gmx_simd_setzero_r();
+    gmx_simd_real_t szx = gmx_simd_setzero_r(), szy = gmx_simd_setzero_r(), szz = gmx_simd_setzero_r();
+
+    for (int i = 0; i < stride; i += GMX_SIMD_REAL_WIDTH)
+    {
+        gmx_simd_real_t ax = gmx_simd_load_r(xa + i);
+        gmx_simd_real_t ay = gmx_simd_load_r(ya + i);
+        gmx_simd_real_t az = gmx_simd_load_r(za + i);
+        gmx_simd_real_t bx = gmx_simd_load_r(xb + i);
+        gmx_simd_real_t by = gmx_simd_load_r(yb + i);
+        gmx_simd_real_t bz = gmx_simd_load_r(zb + i);
+
+        sxx = gmx_simd_fmadd_r(bx, ax, sxx);
+        sxy = gmx_simd_fmadd_r(bx, ay, sxy);
+        sxz = gmx_simd_fmadd_r(bx, az, sxz);
+        syx = gmx_simd_fmadd_r(by, ax, syx);
+        syy = gmx_simd_fmadd_r(by, ay, syy);
+        syz = gmx_simd_fmadd_r(by, az, syz);
+        szx = gmx_simd_fmadd_r(bz, ax, szx);
+        szy = gmx_simd_fmadd_r(bz, ay, szy);
+        szz = gmx_simd_fmadd_r(bz, az, szz);
+    }
+    S[XX][XX] = gmx_simd_reduce_r(sxx);
+    S[XX][YY] = gmx_simd_reduce_r(sxy);
+    S[XX][ZZ] = gmx_simd_reduce_r(sxz);
+    S[YY][XX] = gmx_simd_reduce_r(syx);
+    S[YY][YY] = gmx_simd_reduce_r(syy);
+    S[YY][ZZ] = gmx_simd_reduce_r(syz);
+    S[ZZ][XX] = gmx_simd_reduce_r(szx);
+    S[ZZ][YY] = gmx_simd_reduce_r(szy);
+    S[ZZ][ZZ] = gmx_simd_reduce_r(szz);
+#else
+    real s[DIM][DIM] = { { 0 } };
+
+    for (int i = 0; i < stride; i++)
+    {
+        s[XX][XX] += xb[i]*xa[i];
+        s[XX][YY] += xb[i]*ya[i];
+        s[XX][ZZ] += xb[i]*za[i];
+        s[YY][XX] += yb[i]*xa[i];
+        s[YY][YY] += yb[i]*ya[i];
+        s[YY][ZZ] += yb[i]*za[i];
+        s[ZZ][XX] += zb[i]*xa[i];
+        s[ZZ][YY] += zb[i]*ya[i];
+        s[ZZ][ZZ] += zb[i]*za[i];
+    }
+    for (int a = 0; a < DIM; a++)
+    {
+        for (int b = 0; b < DIM; b++)
+        {
+            S[a][b] = s[a][b];
+        }
+    }
+#endif
+}
+
+/* Returns TRUE when the deviation is the RMSD with the fit weights */
+static gmx_bool rms_weights_are_fit_weights(int natoms, const real *w_fit,
+                                            int nind, const int *index,
+                                            const real *w_rms)
+{
+    real    *w;
+    gmx_bool bSame = TRUE;
+
+    snew(w, natoms);
+    for (int j = 0; j < nind; j++)
+    {
+        int i = (index != NULL ? index[j] : j);
+        w[i] = w_rms[i];
+    }
+    for (int i = 0; i < natoms && bSame; i++)
+    {
+        bSame = (w[i] == w_fit[i]);
+    }
+    sfree(w);
+
+    return bSame;
+}
+
+void calc_rmsd_mat(int natoms, real *w_fit, gmx_bool bFit,
+                   int nind, int *index, real *w_rms, gmx_bool bRho,
+                   int nframes1, rvec **x1, int nframes2, rvec **x2,
+                   gmx_bool bVerbose, real *mat)
+{
+    gmx_bool     bSymmetric, bDirect;
+    t_qcp_frames f1, f2, *fp2;
+    double       wsum;
+    int          nblock, nblock1, nblock2;
+    gmx_int64_t  npairs, ndone;
+
+    bSymmetric = (x2 == NULL);
+    if (bSymmetric)
+    {
+        nframes2 = nframes1;
+        x2       = x1;
+    }
+    npairs = (bSymmetric ?
+              static_cast<gmx_int64_t>(nframes1)*(nframes1 - 1)/2 :
+              static_cast<gmx_int64_t>(nframes1)*nframes2);
+    bDirect = (bFit && !bRho &&
+               rms_weights_are_fit_weights(natoms, w_fit, nind, index, w_rms));
+
+    fp2  = NULL;
+    wsum = 0;
+    if (bFit)
+    {
+        for (int i = 0; i < natoms; i++)
+        {
+            wsum += w_fit[i];
+        }
+        init_qcp_frames(&f1, natoms, w_fit, nframes1, x1);
+        if (bSymmetric)
+        {
+            fp2 = &f1;
+        }
+        else
+        {
+            init_qcp_frames(&f2, natoms, w_fit, nframes2, x2);
+            fp2 = &f2;
+        }
+        nblock = c_blockBytes/std::max(1, static_cast<int>(DIM*f1.stride*sizeof(real)));
+    }
+    else
+    {
+        nblock = c_blockBytes/std::max(1, static_cast<int>(nind*sizeof(rvec)));
+    }
+    nblock  = std::max(1, std::min(nblock, 64));
+    nblock1 = (nframes1 + nblock - 1)/nblock;
+    nblock2 = (nframes2 + nblock - 1)/nblock;
+
+    ndone = 0;
+#pragma omp parallel
+    {
+        try
+        {
+            rvec *xrot = NULL;
+
+            if (!bDirect)
+            {
+                snew(xrot, natoms);
+            }
+            /* Each task is a row of blocks; the frames of a block of x1
+             * stay in cache while the blocks of x2 are streamed.
+             */
+#pragma omp for schedule(dynamic)
+            for (int ib = 0; ib < nblock1; ib++)
+            {
+                int         i0 = ib*nblock, i1 = std::min(i0 + nblock, nframes1);
+                gmx_int64_t nrow;
+
+                nrow = 0;
+                for (int jb = (bSymmetric ? ib : 0); jb < nblock2; jb++)
+                {
+                    int j0 = jb*nblock, j1 = std::min(j0 + nblock, nframes2);
+
+                    for (int i = i0; i < i1; i++)
+                    {
+                        for (int j = (bSymmetric ? std::max(j0, i + 1) : j0); j < j1; j++)
+                        {
+                            real dev;
+
+                            if (bFit)
+                            {
+                                double S[DIM][DIM], E0, lambda, msd;
+                                matrix R;
+
+                                calc_inner_product(f1.stride,
+                                                   f1.x + static_cast<size_t>(i)*DIM*f1.stride,
+                                                   fp2->x + static_cast<size_t>(j)*DIM*fp2->stride,
+                                                   S);
+                                E0     = 0.5*(f1.E[i] + fp2->E[j]);
+                                lambda = calc_fit_qcp(S, E0, bDirect ? NULL : R);
+                                if (bDirect)
+                                {
+                                    msd = 2*(E0 - lambda)/wsum;
+                                    dev = (msd > 0 ? std::sqrt(msd) : 0);
+                                }
+                                else
+                                {
+                                    for (int k = 0; k < nind; k++)
+                                    {
+                                        int a = (index != NULL ? index[k] : k);
+                                        mvmul(R, x2[j][a], xrot[a]);
+                                    }
+                                    dev = calc_similar_ind(bRho, nind, index, w_rms, x1[i], xrot);
+                                }
+                            }
+                            else
+                            {
+                                dev = calc_similar_ind(bRho, nind, index, w_rms, x1[i], x2[j]);
+                            }
+                            if (bSymmetric)
+                            {
+                                mat[rmsd_mat_index(nframes1, i, j)] = dev;
+                            }
+                            else
+                            {
+                                mat[static_cast<gmx_int64_t>(i)*nframes2 + j] = dev;
+                            }
+                            nrow++;
+                        }
+                    }
+                }
+#pragma omp critical
+                {
+                    ndone += nrow;
+                    if (bVerbose)
+                    {
+                        fprintf(stderr, "\r# RMSD calculations left: " "%" GMX_PRId64 "   ",
+                                npairs - ndone);
+                    }
+                }
+            }
+            sfree(xrot);
+        }
+        GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+    }
+    if (bVerbose)
+    {
+        fprintf(stderr, "\n");
+    }
+
+    if (bFit)
+    {
+        done_qcp_frames(&f1);
+        if (!bSymmetric)
+        {
+            done_qcp_frames(&f2);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+
+#ifndef _rmsdmat_h
+#define _rmsdmat_h
+
+#include "gromacs/math/vectypes.h"
+#include "gromacs/utility/basedefinitions.h"
+#include "gromacs/utility/real.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Returns the index of element (i,j), i < j, of the upper triangle of an
+ * n x n matrix stored packed row by row, without the diagonal.
+ */
+static gmx_inline gmx_int64_t rmsd_mat_index(int n, int i, int j)
+{
+    return ((gmx_int64_t)i)*(2*n - i - 1)/2 + (j - i - 1);
+}
+
+void calc_rmsd_mat(int natoms, real *w_fit, gmx_bool bFit,
+                   int nind, int *index, real *w_rms, gmx_bool bRho,
+                   int nframes1, rvec **x1, int nframes2, rvec **x2,
+                   gmx_bool bVerbose, real *mat);
+/* Computes the RMSD (or with bRho the size-independent Rho, see
+ * calc_similar_ind) between all pairs of structures of natoms atoms.
+ * When x2==NULL, the matrix of the nframes1 structures in x1 with each
+ * other is computed and mat should hold the
+ * nframes1*(nframes1-1)/2 elements of the upper triangle, see
+ * rmsd_mat_index. Otherwise mat should hold nframes1*nframes2 elements
+ * and element (i,j) of x1[i] with x2[j] is stored at i*nframes2+j.
+ * With bFit, x2[j] is fitted to x1[i] with the weights w_fit before the
+ * deviation is computed, and all structures should be centered with
+ * these weights, see reset_x. The deviation is computed over the nind
+ * atoms in index (over all atoms when index==NULL) with the weights w_rms.
+ * The fits use the QCP method (calc_fit_qcp); when the deviation is
+ * the RMSD computed with the fit weights, it follows directly from the
+ * QCP eigenvalue without rotating any coordinates.
+ * The pairs are processed in blocks of structures that fit in cache,
+ * distributed over the OpenMP threads. With bVerbose the progress is
+ * printed to stderr.
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -348,8 +348,9 @@ int gmx_genconf(int argc, char *argv[])
 
     /* move_x(natoms*vol,x,box); */          /* put atoms in box? */
 
-    atoms->nr   *= vol;
-    atoms->nres *= vol;
+    /* add_t_atoms above already set atoms->nr and atoms->nres
+     * to the sizes of the whole system.
+     */
 
     /*depending on how you look at it, this is either a nasty hack or the way it should work*/
     if (bRenum)
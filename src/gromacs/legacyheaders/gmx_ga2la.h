@@ -198,10 +198,22 @@ static void ga2la_del(gmx_ga2la_t ga2la, int a_gl)
     {
         if (ga2la->lal[ind].ga == a_gl)
         {
-            if (ind_prev >= 0)
+            if (ind_prev < 0 && ga2la->lal[ind].next >= 0)
+            {
+                /* This is the head of a list with more entries: move the
+                 * second entry into the head, so the list stays reachable,
+                 * and free the second entry instead.
+                 */
+                ind_prev             = ind;
+                ind                  = ga2la->lal[ind].next;
+                ga2la->lal[ind_prev] = ga2la->lal[ind];
+            }
+            else if (ind_prev >= 0)
             {
                 ga2la->lal[ind_prev].next = ga2la->lal[ind].next;
-
+            }
+            if (ind_prev >= 0)
+            {
                 /* This index is a linked entry, so we free an entry.
                  * Check if we are creating the first empty space.
                  */
@@ -252,6 +264,34 @@ static void ga2la_change_la(gmx_ga2la_t ga2la, int a_gl, int a_loc)
     return;
 }
 
+/* Set the ga2la entry for global atom a_gl to local atom a_loc and cell.
+ * When an entry for a_gl is present, it is changed in place,
+ * otherwise a new entry is added.
+ */
+static void ga2la_set_or_change(gmx_ga2la_t ga2la, int a_gl, int a_loc, int cell)
+{
+    int ind;
+
+    if (!ga2la->bAll)
+    {
+        ind = a_gl % ga2la->mod;
+        do
+        {
+            if (ga2la->lal[ind].ga == a_gl)
+            {
+                ga2la->lal[ind].la   = a_loc;
+                ga2la->lal[ind].cell = cell;
+
+                return;
+            }
+            ind = ga2la->lal[ind].next;
+        }
+        while (ind >= 0);
+    }
+
+    ga2la_set(ga2la, a_gl, a_loc, cell);
+}
+
 /* Returns if the global atom a_gl available locally.
  * Sets the local atom and cell,
  * cell can be larger than the number of zones,
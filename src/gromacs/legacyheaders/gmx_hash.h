@@ -202,10 +202,22 @@ static void gmx_hash_del(gmx_hash_t hash, int key)
     {
         if (hash->hash[ind].key == key)
         {
-            if (ind_prev >= 0)
+            if (ind_prev < 0 && hash->hash[ind].next >= 0)
+            {
+                /* This is the head of a list with more entries: move the
+                 * second entry into the head, so the list stays reachable,
+                 * and free the second entry instead.
+                 */
+                ind_prev             = ind;
+                ind                  = hash->hash[ind].next;
+                hash->hash[ind_prev] = hash->hash[ind];
+            }
+            else if (ind_prev >= 0)
             {
                 hash->hash[ind_prev].next = hash->hash[ind].next;
-
+            }
+            if (ind_prev >= 0)
+            {
                 /* This index is a linked entry, so we free an entry.
                  * Check if we are creating the first empty space.
                  */
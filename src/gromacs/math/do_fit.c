@@ -258,6 +258,207 @@ void calc_fit_R(int ndim, int natoms, real *w_rls, rvec *xp, rvec *x, matrix R)
     sfree(om);
 }
 
+/* Returns the determinant of the 3x3 minor of the 4x4 matrix a
+ * without row r and column c.
+ */
+static double minor4(double a[4][4], int r, int c)
+{
+    double m[DIM][DIM];
+    int    i, j, mi, mj;
+
+    mi = 0;
+    for (i = 0; i < 4; i++)
+    {
+        if (i == r)
+        {
+            continue;
+        }
+        mj = 0;
+        for (j = 0; j < 4; j++)
+        {
+            if (j != c)
+            {
+                m[mi][mj++] = a[i][j];
+            }
+        }
+        mi++;
+    }
+
+    return (m[XX][XX]*(m[YY][YY]*m[ZZ][ZZ] - m[YY][ZZ]*m[ZZ][YY])
+            - m[XX][YY]*(m[YY][XX]*m[ZZ][ZZ] - m[YY][ZZ]*m[ZZ][XX])
+            + m[XX][ZZ]*(m[YY][XX]*m[ZZ][YY] - m[YY][YY]*m[ZZ][XX]));
+}
+
+double calc_fit_qcp(double S[DIM][DIM], double E0, matrix R)
+{
+    double K[4][4], K2[4][4], A[4][4];
+    double c0, c1, c2, trK3, lambda, lambda_old, f, df;
+    double q[4], qnorm2, qc[4], qcnorm2;
+    int    i, j, k, c, iter;
+
+    /* The symmetric, traceless key matrix of Horn, J. Opt. Soc. Am. A 4,
+     * 629 (1987), whose largest eigenvector is the optimal rotation
+     * quaternion.
+     */
+    K[0][0] =  S[XX][XX] + S[YY][YY] + S[ZZ][ZZ];
+    K[1][1] =  S[XX][XX] - S[YY][YY] - S[ZZ][ZZ];
+    K[2][2] = -S[XX][XX] + S[YY][YY] - S[ZZ][ZZ];
+    K[3][3] = -S[XX][XX] - S[YY][YY] + S[ZZ][ZZ];
+    K[0][1] = K[1][0] = S[YY][ZZ] - S[ZZ][YY];
+    K[0][2] = K[2][0] = S[ZZ][XX] - S[XX][ZZ];
+    K[0][3] = K[3][0] = S[XX][YY] - S[YY][XX];
+    K[1][2] = K[2][1] = S[XX][YY] + S[YY][XX];
+    K[1][3] = K[3][1] = S[ZZ][XX] + S[XX][ZZ];
+    K[2][3] = K[3][2] = S[YY][ZZ] + S[ZZ][YY];
+
+    /* The characteristic polynomial is lambda^4 + c2 lambda^2 + c1 lambda + c0
+     * with c2 = -tr(K^2)/2, c1 = -tr(K^3)/3 and c0 = det(K).
+     */
+    c2   = 0;
+    trK3 = 0;
+    for (i = 0; i < 4; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            K2[i][j] = 0;
+            for (k = 0; k < 4; k++)
+            {
+                K2[i][j] += K[i][k]*K[k][j];
+            }
+        }
+        c2 -= 0.5*K2[i][i];
+    }
+    for (i = 0; i < 4; i++)
+    {
+        for (k = 0; k < 4; k++)
+        {
+            trK3 += K2[i][k]*K[k][i];
+        }
+    }
+    c1 = -trK3/3;
+    c0 = 0;
+    for (j = 0; j < 4; j++)
+    {
+        c0 += ((j % 2 == 0) ? 1 : -1)*K[0][j]*minor4(K, 0, j);
+    }
+
+    /* E0 is an upper bound of the largest eigenvalue, so Newton-Raphson
+     * iteration starting from E0 converges to it monotonically.
+     */
+    lambda = E0;
+    for (iter = 0; iter < 50; iter++)
+    {
+        lambda_old = lambda;
+        f          = (((lambda*lambda + c2)*lambda) + c1)*lambda + c0;
+        df         = (4*lambda*lambda + 2*c2)*lambda + c1;
+        if (df == 0)
+        {
+            break;
+        }
+        lambda    -= f/df;
+        if (fabs(lambda - lambda_old) <= 1e-11*fabs(lambda))
+        {
+            break;
+        }
+    }
+
+    if (R != NULL)
+    {
+        /* Any non-zero column of the adjugate of K - lambda I is
+         * proportional to the eigenvector of lambda; use the largest one.
+         */
+        for (i = 0; i < 4; i++)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                A[i][j] = K[i][j] - (i == j ? lambda : 0);
+            }
+        }
+        qnorm2 = 0;
+        for (c = 0; c < 4; c++)
+        {
+            qcnorm2 = 0;
+            for (i = 0; i < 4; i++)
+            {
+                qc[i]    = (((i + c) % 2 == 0) ? 1 : -1)*minor4(A, c, i);
+                qcnorm2 += qc[i]*qc[i];
+            }
+            if (qcnorm2 > qnorm2)
+            {
+                qnorm2 = qcnorm2;
+                for (i = 0; i < 4; i++)
+                {
+                    q[i] = qc[i];
+                }
+            }
+        }
+        if (qnorm2 == 0)
+        {
+            /* Degenerate eigenvalue, e.g. for identical linear structures:
+             * any rotation around the degenerate axis is optimal.
+             */
+            clear_mat(R);
+            R[XX][XX] = R[YY][YY] = R[ZZ][ZZ] = 1;
+        }
+        else
+        {
+            for (i = 0; i < 4; i++)
+            {
+                q[i] /= sqrt(qnorm2);
+            }
+            R[XX][XX] = q[0]*q[0] + q[1]*q[1] - q[2]*q[2] - q[3]*q[3];
+            R[XX][YY] = 2*(q[1]*q[2] - q[0]*q[3]);
+            R[XX][ZZ] = 2*(q[1]*q[3] + q[0]*q[2]);
+            R[YY][XX] = 2*(q[1]*q[2] + q[0]*q[3]);
+            R[YY][YY] = q[0]*q[0] - q[1]*q[1] + q[2]*q[2] - q[3]*q[3];
+            R[YY][ZZ] = 2*(q[2]*q[3] - q[0]*q[1]);
+            R[ZZ][XX] = 2*(q[1]*q[3] - q[0]*q[2]);
+            R[ZZ][YY] = 2*(q[2]*q[3] + q[0]*q[1]);
+            R[ZZ][ZZ] = q[0]*q[0] - q[1]*q[1] - q[2]*q[2] + q[3]*q[3];
+        }
+    }
+
+    return lambda;
+}
+
+real calc_fit_rmsd(int natoms, real *w_rls, rvec *xp, rvec *x)
+{
+    double S[DIM][DIM], E0, wsum, lambda, msd;
+    int    i, a, b;
+
+    for (a = 0; a < DIM; a++)
+    {
+        for (b = 0; b < DIM; b++)
+        {
+            S[a][b] = 0;
+        }
+    }
+    E0   = 0;
+    wsum = 0;
+    for (i = 0; i < natoms; i++)
+    {
+        if (w_rls[i] != 0)
+        {
+            for (a = 0; a < DIM; a++)
+            {
+                for (b = 0; b < DIM; b++)
+                {
+                    S[a][b] += w_rls[i]*x[i][a]*xp[i][b];
+                }
+            }
+            E0   += 0.5*w_rls[i]*(norm2(x[i]) + norm2(xp[i]));
+            wsum += w_rls[i];
+        }
+    }
+    lambda = calc_fit_qcp(S, E0, NULL);
+    /* Rounding can make the deviation slightly negative for
+     * (nearly) identical structures.
+     */
+    msd    = 2*(E0 - lambda)/wsum;
+
+    return (msd > 0 ? sqrt(msd) : 0);
+}
+
 void do_fit_ndim(int ndim, int natoms, real *w_rls, rvec *xp, rvec *x)
 {
     int    i, j, m, r, c;
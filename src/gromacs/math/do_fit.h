@@ -75,6 +75,25 @@ void calc_fit_R(int ndim, int natoms, real *w_rls, rvec *xp, rvec *x,
  * x_rotated[i] = sum R[i][j]*x[j]
  */
 
+double calc_fit_qcp(double S[DIM][DIM], double E0, matrix R);
+/* Solves the least squares superposition problem with the quaternion
+ * characteristic polynomial (QCP) method of Theobald, Acta Cryst. A 61,
+ * 478 (2005).  S[a][b] = sum_i w_i x_i[a] xp_i[b] is the weighted inner
+ * product matrix and E0 = sum_i w_i (|x_i|^2 + |xp_i|^2)/2.
+ * Returns the largest eigenvalue lambda of the quaternion key matrix;
+ * the weighted sum of squared deviations after the fit is 2*(E0 - lambda).
+ * When R!=NULL, the rotation matrix of x onto xp is returned in R with
+ * the same convention as calc_fit_R.
+ * This is much cheaper than calc_fit_R and is intended for codes
+ * that compute many fits, such as RMSD matrices.
+ */
+
+real calc_fit_rmsd(int natoms, real *w_rls, rvec *xp, rvec *x);
+/* Returns the weighted RMSD between xp and x after a least squares fit
+ * of x to xp, without modifying x. Uses calc_fit_qcp, both xp and x
+ * should be centered round the origin.
+ */
+
 void do_fit_ndim(int ndim, int natoms, real *w_rls, rvec *xp, rvec *x);
 /* Do a least squares fit of x to xp. Atoms which have zero mass
  * (w_rls[i]) are not taken into account in fitting.
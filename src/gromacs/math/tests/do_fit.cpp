@@ -0,0 +1,157 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests the QCP least squares fit against the Jacobi based fit.
+ *
+ * \ingroup module_math
+ */
+#include "gmxpre.h"
+
+#include "gromacs/math/do_fit.h"
+
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include "gromacs/math/vec.h"
+
+#include "testutils/testasserts.h"
+
+namespace
+{
+
+class QcpFitTest : public ::testing::Test
+{
+    public:
+        static const int c_natoms = 7;
+
+        QcpFitTest()
+        {
+            /* A structure without symmetry, with unequal weights */
+            const real x[c_natoms][DIM] = {
+                { 0.1, 0.2, 0.3 }, { 0.4, -0.1, 0.2 }, { -0.3, 0.5, 0.1 },
+                { 0.2, -0.4, -0.2 }, { -0.5, -0.1, 0.4 }, { 0.3, 0.3, -0.6 },
+                { -0.2, -0.4, 0.1 }
+            };
+
+            for (int i = 0; i < c_natoms; i++)
+            {
+                copy_rvec(x[i], xp_[i]);
+                w_[i] = 1 + 0.5*i;
+            }
+            reset_x(c_natoms, NULL, c_natoms, NULL, xp_, w_);
+        }
+
+        //! Sets x_ to a rotated and perturbed copy of xp_.
+        void makeRotatedCopy(real perturbation)
+        {
+            /* Rotation by 1 rad around (1,2,2)/3 */
+            const real c = std::cos(1.0), s = std::sin(1.0);
+            const rvec u = { 1.0/3, 2.0/3, 2.0/3 };
+            matrix     rot;
+
+            for (int a = 0; a < DIM; a++)
+            {
+                for (int b = 0; b < DIM; b++)
+                {
+                    rot[a][b] = (a == b ? c : 0) + (1 - c)*u[a]*u[b];
+                }
+            }
+            rot[XX][YY] -= s*u[ZZ];
+            rot[XX][ZZ] += s*u[YY];
+            rot[YY][XX] += s*u[ZZ];
+            rot[YY][ZZ] -= s*u[XX];
+            rot[ZZ][XX] -= s*u[YY];
+            rot[ZZ][YY] += s*u[XX];
+            for (int i = 0; i < c_natoms; i++)
+            {
+                mvmul(rot, xp_[i], x_[i]);
+                x_[i][i % DIM] += ((i % 2 == 0) ? perturbation : -perturbation);
+            }
+            reset_x(c_natoms, NULL, c_natoms, NULL, x_, w_);
+        }
+
+        rvec xp_[c_natoms];
+        rvec x_[c_natoms];
+        real w_[c_natoms];
+};
+
+TEST_F(QcpFitTest, RecoversExactRotation)
+{
+    makeRotatedCopy(0);
+    EXPECT_REAL_EQ_TOL(0, calc_fit_rmsd(c_natoms, w_, xp_, x_),
+                       gmx::test::absoluteTolerance(1e-3));
+}
+
+TEST_F(QcpFitTest, MatchesJacobiFit)
+{
+    makeRotatedCopy(0.05);
+
+    double S[DIM][DIM], E0 = 0;
+    for (int a = 0; a < DIM; a++)
+    {
+        for (int b = 0; b < DIM; b++)
+        {
+            S[a][b] = 0;
+            for (int i = 0; i < c_natoms; i++)
+            {
+                S[a][b] += w_[i]*x_[i][a]*xp_[i][b];
+            }
+        }
+    }
+    for (int i = 0; i < c_natoms; i++)
+    {
+        E0 += 0.5*w_[i]*(norm2(x_[i]) + norm2(xp_[i]));
+    }
+    matrix Rqcp, Rjacobi;
+    calc_fit_qcp(S, E0, Rqcp);
+    calc_fit_R(DIM, c_natoms, w_, xp_, x_, Rjacobi);
+    for (int a = 0; a < DIM; a++)
+    {
+        for (int b = 0; b < DIM; b++)
+        {
+            EXPECT_REAL_EQ_TOL(Rjacobi[a][b], Rqcp[a][b],
+                               gmx::test::absoluteTolerance(1e-5));
+        }
+    }
+
+    real rmsd = calc_fit_rmsd(c_natoms, w_, xp_, x_);
+    do_fit(c_natoms, w_, xp_, x_);
+    EXPECT_REAL_EQ_TOL(rmsdev(c_natoms, w_, xp_, x_), rmsd,
+                       gmx::test::relativeToleranceAsFloatingPoint(rmsd, 1e-4));
+}
+
+} // namespace
@@ -742,6 +742,7 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
     gmx_bool            bStateChanged, bNS, bFillGrid, bCalcCGCM;
     gmx_bool            bDoLongRange, bDoForces, bSepLRF, bUseGPU, bUseOrEmulGPU;
     gmx_bool            bDiffKernels = FALSE;
+    gmx_bool            bMoveXOverlap, bMoveFOverlap;
     rvec                vzero, box_diag;
     float               cycles_pme, cycles_force, cycles_wait_gpu;
     nonbonded_verlet_t *nbv;
@@ -778,6 +779,12 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
     bUseGPU       = fr->nbv->bUseGPU;
     bUseOrEmulGPU = bUseGPU || (nbv->grp[0].kernel_type == nbnxnk8x8x8_PlainC);
 
+    /* With the non-bonded kernels on the CPU we overlap the halo
+     * communication with the local non-bonded work.
+     */
+    bMoveXOverlap = (DOMAINDECOMP(cr) && !bNS && !bUseOrEmulGPU);
+    bMoveFOverlap = (DOMAINDECOMP(cr) && bDoForces && !bUseOrEmulGPU);
+
     if (bStateChanged)
     {
         update_forcerec(fr, box);
@@ -1024,7 +1031,17 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
         else
         {
             wallcycle_start(wcycle, ewcMOVEX);
-            dd_move_x(cr->dd, box, x);
+            if (bMoveXOverlap)
+            {
+                /* The communication is completed after the local
+                 * non-bonded kernel, which only needs home atoms.
+                 */
+                dd_move_x_start(cr->dd, box, x);
+            }
+            else
+            {
+                dd_move_x(cr->dd, box, x);
+            }
 
             /* When we don't need the total dipole we sum it in global_stat */
             if (bStateChanged && NEED_MUTOT(*inputrec))
@@ -1033,12 +1050,15 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
             }
             wallcycle_stop(wcycle, ewcMOVEX);
 
-            wallcycle_start(wcycle, ewcNB_XF_BUF_OPS);
-            wallcycle_sub_start(wcycle, ewcsNB_X_BUF_OPS);
-            nbnxn_atomdata_copy_x_to_nbat_x(nbv->nbs, eatNonlocal, FALSE, x,
-                                            nbv->grp[eintNonlocal].nbat);
-            wallcycle_sub_stop(wcycle, ewcsNB_X_BUF_OPS);
-            cycles_force += wallcycle_stop(wcycle, ewcNB_XF_BUF_OPS);
+            if (!bMoveXOverlap)
+            {
+                wallcycle_start(wcycle, ewcNB_XF_BUF_OPS);
+                wallcycle_sub_start(wcycle, ewcsNB_X_BUF_OPS);
+                nbnxn_atomdata_copy_x_to_nbat_x(nbv->nbs, eatNonlocal, FALSE, x,
+                                                nbv->grp[eintNonlocal].nbat);
+                wallcycle_sub_stop(wcycle, ewcsNB_X_BUF_OPS);
+                cycles_force += wallcycle_stop(wcycle, ewcNB_XF_BUF_OPS);
+            }
         }
 
         if (bUseGPU && !bDiffKernels)
@@ -1178,6 +1198,26 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
                      nrnb, wcycle);
     }
 
+    if (bMoveXOverlap)
+    {
+        /* Complete the halo coordinate communication which was in flight
+         * during the local non-bonded kernel. We stop the force counter,
+         * so waiting for the communication does not affect load balancing.
+         */
+        cycles_force += wallcycle_stop(wcycle, ewcFORCE);
+        wallcycle_start_nocount(wcycle, ewcMOVEX);
+        dd_move_x_finish(cr->dd, box, x);
+        wallcycle_stop(wcycle, ewcMOVEX);
+
+        wallcycle_start_nocount(wcycle, ewcNB_XF_BUF_OPS);
+        wallcycle_sub_start(wcycle, ewcsNB_X_BUF_OPS);
+        nbnxn_atomdata_copy_x_to_nbat_x(nbv->nbs, eatNonlocal, FALSE, x,
+                                        nbv->grp[eintNonlocal].nbat);
+        wallcycle_sub_stop(wcycle, ewcsNB_X_BUF_OPS);
+        cycles_force += wallcycle_stop(wcycle, ewcNB_XF_BUF_OPS);
+        wallcycle_start_nocount(wcycle, ewcFORCE);
+    }
+
     if (fr->efep != efepNO)
     {
         /* Calculate the local and non-local free energy interactions here.
@@ -1272,6 +1312,16 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
 
     cycles_force += wallcycle_stop(wcycle, ewcFORCE);
 
+    if (bMoveFOverlap)
+    {
+        /* All forces on halo atoms have been computed, start sending them.
+         * Work below this point only adds forces to home atoms.
+         */
+        wallcycle_start(wcycle, ewcMOVEF);
+        dd_move_f_start(cr->dd, f);
+        wallcycle_stop(wcycle, ewcMOVEF);
+    }
+
     if (ed)
     {
         do_flood(cr, inputrec, x, f, ed, box, step, bNS);
@@ -1329,8 +1379,16 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
         }
 
         /* Communicate the forces */
-        wallcycle_start(wcycle, ewcMOVEF);
-        dd_move_f(cr->dd, f, fr->fshift);
+        if (bMoveFOverlap)
+        {
+            wallcycle_start_nocount(wcycle, ewcMOVEF);
+            dd_move_f_finish(cr->dd, f, fr->fshift);
+        }
+        else
+        {
+            wallcycle_start(wcycle, ewcMOVEF);
+            dd_move_f(cr->dd, f, fr->fshift);
+        }
         if (bSepLRF)
         {
             /* We should not update the shift forces here,
@@ -2583,6 +2641,7 @@ void finish_run(FILE *fplog, t_commrec *cr,
             elapsed_time_over_all_ranks,
             elapsed_time_over_all_threads,
             elapsed_time_over_all_threads_over_all_ranks;
+    wallcycle_trace_write(wcycle);
     wallcycle_sum(cr, wcycle);
 
     if (cr->nnodes > 1)
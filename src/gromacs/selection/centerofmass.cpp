@@ -45,11 +45,36 @@
 
 #include <errno.h>
 
+#include <algorithm>
+
 #include "gromacs/math/vec.h"
 #include "gromacs/pbcutil/pbc.h"
 #include "gromacs/topology/block.h"
 #include "gromacs/topology/topology.h"
 #include "gromacs/utility/fatalerror.h"
+#include "gromacs/utility/gmxomp.h"
+
+/*! \brief
+ * Minimum number of blocks per thread in the blocked calculations.
+ *
+ * The work per block is very small (typically a residue or a molecule), so
+ * threads are only used if each of them gets a reasonable amount of work.
+ */
+#define GMX_CALC_MIN_BLOCKS_PER_THREAD 256
+
+/*! \brief
+ * Returns the number of OpenMP threads to use for a blocked calculation.
+ *
+ * \param[in] nblocks  Number of blocks to process.
+ * \returns   Number of threads (always at least one).
+ */
+static int
+calc_block_thread_count(int nblocks)
+{
+    int nthreads = std::min(gmx_omp_get_max_threads(),
+                            nblocks / GMX_CALC_MIN_BLOCKS_PER_THREAD);
+    return std::max(nthreads, 1);
+}
 
 int
 gmx_calc_cog(t_topology * /* top */, rvec x[], int nrefat, atom_id index[], rvec xout)
@@ -366,19 +391,25 @@ gmx_calc_comg_pbc(t_topology *top, rvec x[], t_pbc *pbc,
 }
 
 
+/*!
+ * The blocks are independent, so for a large number of blocks (e.g., all
+ * residues of a solvent), the blocks are distributed over OpenMP threads.
+ * The result does not depend on the number of threads.
+ */
 int
 gmx_calc_cog_block(t_topology * /* top */, rvec x[], t_block *block, atom_id index[],
                    rvec xout[])
 {
-    int                 b, i, ai;
-    rvec                xb;
+    const int nthreads = calc_block_thread_count(block->nr);
 
-    for (b = 0; b < block->nr; ++b)
+#pragma omp parallel for num_threads(nthreads) schedule(static)
+    for (int b = 0; b < block->nr; ++b)
     {
+        rvec xb;
         clear_rvec(xb);
-        for (i = block->index[b]; i < block->index[b+1]; ++i)
+        for (int i = block->index[b]; i < block->index[b+1]; ++i)
         {
-            ai = index[i];
+            const int ai = index[i];
             rvec_inc(xb, x[ai]);
         }
         svmul(1.0/(block->index[b+1] - block->index[b]), xb, xout[b]);
@@ -401,24 +432,25 @@ int
 gmx_calc_com_block(t_topology *top, rvec x[], t_block *block, atom_id index[],
                    rvec xout[])
 {
-    int                 b, i, ai, d;
-    rvec                xb;
-    real                mass, mtot;
-
     if (!top)
     {
         gmx_incons("no masses available while mass weighting was requested");
         return EINVAL;
     }
-    for (b = 0; b < block->nr; ++b)
+    const t_atom *atom     = top->atoms.atom;
+    const int     nthreads = calc_block_thread_count(block->nr);
+
+#pragma omp parallel for num_threads(nthreads) schedule(static)
+    for (int b = 0; b < block->nr; ++b)
     {
+        rvec xb;
+        real mtot = 0;
         clear_rvec(xb);
-        mtot = 0;
-        for (i = block->index[b]; i < block->index[b+1]; ++i)
+        for (int i = block->index[b]; i < block->index[b+1]; ++i)
         {
-            ai   = index[i];
-            mass = top->atoms.atom[ai].m;
-            for (d = 0; d < DIM; ++d)
+            const int  ai   = index[i];
+            const real mass = atom[ai].m;
+            for (int d = 0; d < DIM; ++d)
             {
                 xb[d] += mass * x[ai][d];
             }
@@ -441,24 +473,25 @@ int
 gmx_calc_cog_f_block(t_topology *top, rvec f[], t_block *block, atom_id index[],
                      rvec fout[])
 {
-    int                 b, i, ai, d;
-    rvec                fb;
-    real                mass, mtot;
-
     if (!top)
     {
         gmx_incons("no masses available while mass weighting was needed");
         return EINVAL;
     }
-    for (b = 0; b < block->nr; ++b)
+    const t_atom *atom     = top->atoms.atom;
+    const int     nthreads = calc_block_thread_count(block->nr);
+
+#pragma omp parallel for num_threads(nthreads) schedule(static)
+    for (int b = 0; b < block->nr; ++b)
     {
+        rvec fb;
+        real mtot = 0;
         clear_rvec(fb);
-        mtot = 0;
-        for (i = block->index[b]; i < block->index[b+1]; ++i)
+        for (int i = block->index[b]; i < block->index[b+1]; ++i)
         {
-            ai   = index[i];
-            mass = top->atoms.atom[ai].m;
-            for (d = 0; d < DIM; ++d)
+            const int  ai   = index[i];
+            const real mass = atom[ai].m;
+            for (int d = 0; d < DIM; ++d)
             {
                 fb[d] += f[ai][d] / mass;
             }
@@ -473,6 +506,9 @@ int
 gmx_calc_com_f_block(t_topology * /* top */, rvec f[], t_block *block, atom_id index[],
                      rvec fout[])
 {
+    const int nthreads = calc_block_thread_count(block->nr);
+
+#pragma omp parallel for num_threads(nthreads) schedule(static)
     for (int b = 0; b < block->nr; ++b)
     {
         rvec fb;
@@ -64,6 +64,8 @@
  * gmx_calc_comg_block() take an index group and a partitioning of that index
  * group (as a \c t_block structure), and calculate the centers for
  * each group defined by the \c t_block structure separately.
+ * If there are many blocks, these functions distribute the blocks over
+ * OpenMP threads.
  *
  * Finally, there is a function gmx_calc_comg_blocka() that takes both the
  * index group and the partitioning as a single \c t_blocka structure.
@@ -438,6 +438,9 @@ SelectionEvaluator::evaluate(SelectionCollection *coll,
     gmx_ana_selcollection_t *sc = &coll->impl_->sc_;
     gmx_sel_evaluate_t       data;
 
+    /* All temporary values are released at the end of each frame, so the
+     * pool can be reset to a clean state in constant time. */
+    _gmx_sel_mempool_reset(sc->mempool);
     _gmx_sel_evaluate_init(&data, sc->mempool, &sc->gall, sc->top, fr, pbc);
     init_frame_eval(sc->root);
     SelectionTreeElementPointer sel = sc->root;
@@ -36,6 +36,14 @@
  * \brief
  * Implements functions in mempool.h.
  *
+ * The pool works in two modes.  Before _gmx_sel_mempool_reserve() has been
+ * called, each allocation is passed to malloc(), and the pool only keeps
+ * track of the maximum amount of memory (and number of blocks) that is in use
+ * simultaneously.  The selection compiler uses this mode while it evaluates
+ * the selections for the first time.  After the reservation, all allocations
+ * are served from a single preallocated buffer in stack (LIFO) order, without
+ * any calls to the system allocator.
+ *
  * \author Teemu Murtola <teemu.murtola@gmail.com>
  * \ingroup module_selection
  */
@@ -85,6 +93,11 @@ struct gmx_sel_mempool_t
     gmx_sel_mempool_block_t    *blockstack;
     //! Number of elements allocated for the \a blockstack array.
     int                         blockstack_nalloc;
+    /*! \brief
+     * Maximum number of blocks that have been allocated from the pool
+     * simultaneously.
+     */
+    int                         maxblocks;
     /*! \brief
      * Maximum number of bytes that have been reserved from the pool
      * simultaneously.
@@ -105,6 +118,7 @@ _gmx_sel_mempool_create()
     mp->nblocks           = 0;
     mp->blockstack        = NULL;
     mp->blockstack_nalloc = 0;
+    mp->maxblocks         = 0;
     mp->maxsize           = 0;
     return mp;
 }
@@ -135,7 +149,7 @@ _gmx_sel_mempool_alloc(gmx_sel_mempool_t *mp, size_t size)
     size_walign = ((size + ALIGN_STEP - 1) / ALIGN_STEP) * ALIGN_STEP;
     if (mp->buffer)
     {
-        if (mp->freesize < size)
+        if (mp->freesize < size_walign)
         {
             GMX_THROW(gmx::InternalError("Out of memory pool memory"));
         }
@@ -166,6 +180,10 @@ _gmx_sel_mempool_alloc(gmx_sel_mempool_t *mp, size_t size)
     mp->blockstack[mp->nblocks].ptr  = ptr;
     mp->blockstack[mp->nblocks].size = size_walign;
     mp->nblocks++;
+    if (mp->nblocks > mp->maxblocks)
+    {
+        mp->maxblocks = mp->nblocks;
+    }
 
     return ptr;
 }
@@ -212,6 +230,34 @@ _gmx_sel_mempool_reserve(gmx_sel_mempool_t *mp, size_t size)
     }
     mp->freesize = size;
     mp->freeptr  = mp->buffer;
+    /* Also reserve the block stack such that allocations during evaluation
+     * never need to go to the system allocator. */
+    if (mp->maxblocks > mp->blockstack_nalloc)
+    {
+        mp->blockstack_nalloc = mp->maxblocks;
+        srenew(mp->blockstack, mp->blockstack_nalloc);
+    }
+}
+
+void
+_gmx_sel_mempool_reset(gmx_sel_mempool_t *mp)
+{
+    if (mp->buffer)
+    {
+        mp->freesize += mp->currsize;
+        mp->freeptr   = mp->buffer;
+    }
+    else
+    {
+        int  i;
+
+        for (i = 0; i < mp->nblocks; ++i)
+        {
+            sfree(mp->blockstack[i].ptr);
+        }
+    }
+    mp->currsize = 0;
+    mp->nblocks  = 0;
 }
 
 void
@@ -35,8 +35,15 @@
 /*! \internal \file
  * \brief Declarations for memory pooling functions.
  *
+ * The memory pool provides fast stack-like (LIFO) allocation for temporary
+ * values needed during selection evaluation.  Each selection collection owns
+ * its own pool (gmx_ana_selcollection_t::mempool), and the pool contains no
+ * global state, so different selection collections can be evaluated
+ * concurrently from different threads without any locking.
+ * A single pool must not be accessed from several threads at the same time.
+ *
  * \todo
- * Document these functions.
+ * Document these functions more thoroughly.
  *
  * This is an implementation header: there should be no need to use it outside
  * this directory.
@@ -70,6 +77,17 @@ _gmx_sel_mempool_free(gmx_sel_mempool_t *mp, void *ptr);
 /** Set the size of a memory pool. */
 void
 _gmx_sel_mempool_reserve(gmx_sel_mempool_t *mp, size_t size);
+/*! \brief
+ * Releases all memory allocated from a memory pool.
+ *
+ * \param[in,out] mp  Memory pool to reset.
+ *
+ * After the pool has been reserved with _gmx_sel_mempool_reserve(), this is
+ * a constant-time operation.  Any pointers previously returned by
+ * _gmx_sel_mempool_alloc() become invalid.
+ */
+void
+_gmx_sel_mempool_reset(gmx_sel_mempool_t *mp);
 
 /** Convenience function for allocating an index group from a memory pool. */
 void
@@ -0,0 +1,190 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+#include "gmxpre.h"
+
+#include "perfcounters.h"
+
+#include "config.h"
+
+#include <cstring>
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "gromacs/utility/smalloc.h"
+
+const char *perfcounter_names[epcNR] = {
+    "Cycles", "Instructions", "Cache misses", "Branch misses"
+};
+
+typedef struct gmx_perfcounters
+{
+    int fd[epcNR];
+} gmx_perfcounters_t_t;
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+
+static const int perfcounter_config[epcNR] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/* Opens a hardware counter for the calling thread on any cpu */
+static int open_counter(int config, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.size           = sizeof(attr);
+    attr.config         = config;
+    attr.disabled       = (group_fd == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP |
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+gmx_perfcounters_t perfcounters_init(FILE *fplog)
+{
+    gmx_perfcounters_t pc;
+    int                i;
+
+    snew(pc, 1);
+    for (i = 0; i < epcNR; i++)
+    {
+        /* The first counter is the group leader, so all counters
+         * are scheduled together and can be read with one call.
+         */
+        pc->fd[i] = open_counter(perfcounter_config[i], i == 0 ? -1 : pc->fd[0]);
+        if (pc->fd[i] == -1)
+        {
+            if (fplog)
+            {
+                fprintf(fplog, "\nNOTE: Could not open hardware counter '%s', will not count hardware events.\n"
+                        "      Check the value of /proc/sys/kernel/perf_event_paranoid.\n\n",
+                        perfcounter_names[i]);
+            }
+            while (i > 0)
+            {
+                i--;
+                close(pc->fd[i]);
+            }
+            sfree(pc);
+            return NULL;
+        }
+    }
+    ioctl(pc->fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(pc->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    return pc;
+}
+
+void perfcounters_read(gmx_perfcounters_t pc, gmx_int64_t values[epcNR])
+{
+    /* Layout for PERF_FORMAT_GROUP with the enabled and running times */
+    gmx_uint64_t buf[3 + epcNR];
+    double       scale;
+    int          i;
+
+    if (read(pc->fd[0], buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)) ||
+        buf[2] == 0)
+    {
+        for (i = 0; i < epcNR; i++)
+        {
+            values[i] = 0;
+        }
+        return;
+    }
+
+    /* When more counters are requested than the hardware has,
+     * the kernel multiplexes them and we extrapolate.
+     */
+    scale = static_cast<double>(buf[1])/buf[2];
+    for (i = 0; i < epcNR; i++)
+    {
+        values[i] = static_cast<gmx_int64_t>(buf[3 + i]*scale);
+    }
+}
+
+void perfcounters_destroy(gmx_perfcounters_t pc)
+{
+    int i;
+
+    if (pc == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < epcNR; i++)
+    {
+        close(pc->fd[i]);
+    }
+    sfree(pc);
+}
+
+#else
+
+gmx_perfcounters_t perfcounters_init(FILE *fplog)
+{
+    if (fplog)
+    {
+        fprintf(fplog, "\nNOTE: Hardware counters are only supported on Linux, will not count hardware events.\n\n");
+    }
+
+    return NULL;
+}
+
+void perfcounters_read(gmx_perfcounters_t gmx_unused pc, gmx_int64_t values[epcNR])
+{
+    int i;
+
+    for (i = 0; i < epcNR; i++)
+    {
+        values[i] = 0;
+    }
+}
+
+void perfcounters_destroy(gmx_perfcounters_t gmx_unused pc)
+{
+}
+
+#endif
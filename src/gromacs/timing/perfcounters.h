@@ -0,0 +1,91 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \libinternal \file
+ * \brief
+ * Optional hardware performance counters for the cycle accounting.
+ *
+ * Uses the Linux perf_event_open interface to count events of the calling
+ * thread. When the interface is not available, or the kernel does not allow
+ * counting, perfcounters_init() returns NULL and the caller should continue
+ * without hardware counters.
+ *
+ * \inlibraryapi
+ */
+#ifndef GMX_TIMING_PERFCOUNTERS_H
+#define GMX_TIMING_PERFCOUNTERS_H
+
+#include <stdio.h>
+
+#include "gromacs/utility/basedefinitions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief The hardware events that are counted */
+enum {
+    epcCYCLES, epcINSTRUCTIONS, epcCACHE_MISSES, epcBRANCH_MISSES, epcNR
+};
+
+//! Names of the events, for printing
+extern const char *perfcounter_names[epcNR];
+
+//! Opaque handle to a group of hardware counters
+typedef struct gmx_perfcounters *gmx_perfcounters_t;
+
+/*! \brief
+ * Starts counting epcNR hardware events for the calling thread.
+ *
+ * Returns NULL, after printing a note to \p fplog when it is not NULL,
+ * when the counters can not be opened.
+ */
+gmx_perfcounters_t perfcounters_init(FILE *fplog);
+
+/*! \brief
+ * Reads the current values of all counters into \p values.
+ *
+ * Must be called from the thread that called perfcounters_init().
+ * The values are scaled when the kernel had to multiplex the counters.
+ */
+void perfcounters_read(gmx_perfcounters_t pc, gmx_int64_t values[epcNR]);
+
+//! Closes the counters and frees \p pc
+void perfcounters_destroy(gmx_perfcounters_t pc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
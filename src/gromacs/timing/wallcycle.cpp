@@ -46,7 +46,9 @@
 #include "gromacs/legacyheaders/types/commrec.h"
 #include "gromacs/timing/cyclecounter.h"
 #include "gromacs/timing/gpu_timing.h"
+#include "gromacs/timing/perfcounters.h"
 #include "gromacs/utility/cstringutil.h"
+#include "gromacs/utility/futil.h"
 #include "gromacs/utility/gmxassert.h"
 #include "gromacs/utility/gmxmpi.h"
 #include "gromacs/utility/smalloc.h"
@@ -70,6 +72,28 @@ typedef struct
     gmx_cycles_t last;
 } wallcc_t;
 
+/* A single timed region, recorded when the counter is stopped */
+typedef struct
+{
+    gmx_cycles_t start;
+    gmx_cycles_t stop;
+    gmx_int64_t  step;
+    int          counter; /* ewc, or ewcNR + ewcs for sub-counters */
+} wallcycle_event_t;
+
+/* Ring buffer with the most recent timed regions of this rank.
+ * The counters are only used by the master thread of each rank,
+ * so there is only a single writer and no locking is needed.
+ */
+typedef struct
+{
+    wallcycle_event_t *event;
+    int                nalloc;
+    gmx_int64_t        nrecorded;
+    gmx_int64_t        step;      /* MD step, set with wallcycle_set_step */
+    int                rank;
+} wallcycle_trace_t;
+
 typedef struct gmx_wallcycle
 {
     wallcc_t        *wcc;
@@ -96,6 +120,13 @@ typedef struct gmx_wallcycle
     wallcc_t         *wcsc;
 #endif
     double           *cycles_sum;
+    wallcycle_trace_t *trace;
+    /* Hardware counters, only set when requested */
+    gmx_bool           bPerf;
+    gmx_perfcounters_t perf;
+    gmx_int64_t       *perf_start; /* (ewcNR + ewcsNR)*epcNR values */
+    gmx_int64_t       *perf_c;     /* (ewcNR + ewcsNR)*epcNR values */
+    double            *perf_sum;
 } gmx_wallcycle_t_t;
 
 /* Each name should not exceed 19 printing characters
@@ -134,10 +165,14 @@ gmx_bool wallcycle_have_counter(void)
     return gmx_cycles_have_counter();
 }
 
+/* The default number of events kept per rank with GMX_CYCLE_TRACE */
+static const int c_traceEventsDefault = 100000;
+
 gmx_wallcycle_t wallcycle_init(FILE *fplog, int resetstep, t_commrec gmx_unused *cr,
                                int nthreads_pp, int nthreads_pme)
 {
     gmx_wallcycle_t wc;
+    const char     *env;
 
 
     if (!wallcycle_have_counter())
@@ -183,6 +218,39 @@ gmx_wallcycle_t wallcycle_init(FILE *fplog, int resetstep, t_commrec gmx_unused
     snew(wc->wcsc, ewcsNR);
 #endif
 
+    wc->trace = NULL;
+    if ((env = getenv("GMX_CYCLE_TRACE")) != NULL)
+    {
+        snew(wc->trace, 1);
+        wc->trace->nalloc = strtol(env, NULL, 10);
+        if (wc->trace->nalloc <= 0)
+        {
+            wc->trace->nalloc = c_traceEventsDefault;
+        }
+        snew(wc->trace->event, wc->trace->nalloc);
+        wc->trace->rank = cr->nodeid;
+        if (fplog)
+        {
+            fprintf(fplog, "\nWill record a trace of the last %d timed regions per rank\n\n",
+                    wc->trace->nalloc);
+        }
+    }
+
+    /* Hardware counters can only be read by the thread that opened them,
+     * which is fine since the counters are only used by the master thread.
+     */
+    wc->bPerf = (getenv("GMX_PERF_COUNTERS") != NULL);
+    if (wc->bPerf)
+    {
+        wc->perf = perfcounters_init(fplog);
+        snew(wc->perf_start, (ewcNR + ewcsNR)*epcNR);
+        snew(wc->perf_c, (ewcNR + ewcsNR)*epcNR);
+        if (wc->perf != NULL && fplog)
+        {
+            fprintf(fplog, "\nWill count hardware events for all cycle counters\n\n");
+        }
+    }
+
 #ifdef DEBUG_WCYCLE
     wc->count_depth = 0;
 #endif
@@ -211,9 +279,51 @@ void wallcycle_destroy(gmx_wallcycle_t wc)
         sfree(wc->wcsc);
     }
 #endif
+    if (wc->trace != NULL)
+    {
+        sfree(wc->trace->event);
+        sfree(wc->trace);
+    }
+    perfcounters_destroy(wc->perf);
+    sfree(wc->perf_start);
+    sfree(wc->perf_c);
+    sfree(wc->perf_sum);
     sfree(wc);
 }
 
+/* Reads the hardware counters at the start of counter index c */
+static void wallcycle_perf_start(gmx_wallcycle_t wc, int c)
+{
+    perfcounters_read(wc->perf, wc->perf_start + c*epcNR);
+}
+
+/* Adds the hardware events since the start of counter index c */
+static void wallcycle_perf_stop(gmx_wallcycle_t wc, int c)
+{
+    gmx_int64_t values[epcNR];
+    int         i;
+
+    perfcounters_read(wc->perf, values);
+    for (i = 0; i < epcNR; i++)
+    {
+        wc->perf_c[c*epcNR + i] += values[i] - wc->perf_start[c*epcNR + i];
+    }
+}
+
+/* Stores a timed region in the trace ring buffer, overwriting the oldest */
+static void wallcycle_trace_add(wallcycle_trace_t *trace, int counter,
+                                gmx_cycles_t start, gmx_cycles_t stop)
+{
+    wallcycle_event_t *event;
+
+    event          = &trace->event[trace->nrecorded % trace->nalloc];
+    event->start   = start;
+    event->stop    = stop;
+    event->step    = trace->step;
+    event->counter = counter;
+    trace->nrecorded++;
+}
+
 static void wallcycle_all_start(gmx_wallcycle_t wc, int ewc, gmx_cycles_t cycle)
 {
     wc->ewc_prev   = ewc;
@@ -281,6 +391,10 @@ void wallcycle_start(gmx_wallcycle_t wc, int ewc)
 
     cycle              = gmx_cycles_read();
     wc->wcc[ewc].start = cycle;
+    if (wc->perf != NULL)
+    {
+        wallcycle_perf_start(wc, ewc);
+    }
     if (wc->wcc_all != NULL)
     {
         wc->wc_depth++;
@@ -346,6 +460,14 @@ double wallcycle_stop(gmx_wallcycle_t wc, int ewc)
     }
     wc->wcc[ewc].c          += last;
     wc->wcc[ewc].n++;
+    if (wc->trace != NULL)
+    {
+        wallcycle_trace_add(wc->trace, ewc, wc->wcc[ewc].start, cycle);
+    }
+    if (wc->perf != NULL)
+    {
+        wallcycle_perf_stop(wc, ewc);
+    }
     if (wc->wcc_all)
     {
         wc->wc_depth--;
@@ -399,6 +521,13 @@ void wallcycle_reset_all(gmx_wallcycle_t wc)
         wc->wcsc[i].c = 0;
     }
 #endif
+    if (wc->bPerf)
+    {
+        for (i = 0; i < (ewcNR + ewcsNR)*epcNR; i++)
+        {
+            wc->perf_c[i] = 0;
+        }
+    }
 }
 
 static gmx_bool is_pme_counter(int ewc)
@@ -572,6 +701,46 @@ void wallcycle_sum(t_commrec *cr, gmx_wallcycle_t wc)
             wc->cycles_sum[i] = cycles[i];
         }
     }
+
+    if (wc->bPerf)
+    {
+        /* Ranks that could not open the counters contribute zeros */
+        nsum = (ewcNR + ewcsNR)*epcNR;
+        snew(wc->perf_sum, nsum);
+        for (i = 0; i < nsum; i++)
+        {
+            wc->perf_sum[i] = static_cast<double>(wc->perf_c[i]);
+        }
+#ifdef GMX_MPI
+        if (cr->nnodes > 1)
+        {
+            double *perf_buf;
+
+            snew(perf_buf, nsum);
+            MPI_Allreduce(wc->perf_sum, perf_buf, nsum, MPI_DOUBLE, MPI_SUM,
+                          cr->mpi_comm_mysim);
+            sfree(wc->perf_sum);
+            wc->perf_sum = perf_buf;
+        }
+#endif
+    }
+}
+
+/* Prints the hardware events of one counter, summed over ranks */
+static void print_perf(FILE *fplog, const char *name, const double *perf)
+{
+    double instr;
+
+    if (perf[epcCYCLES] <= 0)
+    {
+        return;
+    }
+    instr = perf[epcINSTRUCTIONS];
+    fprintf(fplog, " %-19.19s %11.3f %11.3f %6.2f %11.3f %11.3f\n",
+            name, perf[epcCYCLES]*1e-9, instr*1e-9,
+            instr/perf[epcCYCLES],
+            instr > 0 ? 1000*perf[epcCACHE_MISSES]/instr : 0.0,
+            instr > 0 ? 1000*perf[epcBRANCH_MISSES]/instr : 0.0);
 }
 
 static void print_cycles(FILE *fplog, double c2t, const char *name,
@@ -845,6 +1014,28 @@ void wallcycle_print(FILE *fplog, int nnodes, int npme, double realtime,
     fprintf(fplog, "%s\n", hline);
 #endif
 
+    if (wc->perf_sum != NULL)
+    {
+        /* The hardware counters are read by the master thread of each rank
+         * and are inclusive of nested counters.
+         */
+        fprintf(fplog, "\n Hardware events of the master thread, summed over ranks\n%s\n", hline);
+        fprintf(fplog, " Computing:          G-Cycles    G-Instr.    IPC  Cache miss/ Branch miss/\n");
+        fprintf(fplog, "                                                   k-Instr.    k-Instr.\n");
+        fprintf(fplog, "%s\n", hline);
+        for (i = 0; i < ewcNR; i++)
+        {
+            print_perf(fplog, wcn[i], wc->perf_sum + i*epcNR);
+        }
+#ifdef GMX_CYCLE_SUBCOUNTERS
+        for (i = 0; i < ewcsNR; i++)
+        {
+            print_perf(fplog, wcsn[i], wc->perf_sum + (ewcNR + i)*epcNR);
+        }
+#endif
+        fprintf(fplog, "%s\n", hline);
+    }
+
     /* print GPU timing summary */
     if (gpu_t)
     {
@@ -1008,6 +1199,73 @@ extern void wcycle_set_reset_counters(gmx_wallcycle_t wc, gmx_int64_t reset_coun
     wc->reset_counters = reset_counters;
 }
 
+void wallcycle_set_step(gmx_wallcycle_t wc, gmx_int64_t step)
+{
+    if (wc == NULL || wc->trace == NULL)
+    {
+        return;
+    }
+
+    wc->trace->step = step;
+}
+
+void wallcycle_trace_write(gmx_wallcycle_t wc)
+{
+    wallcycle_trace_t *trace;
+    char               fn[STRLEN], sbuf[STEPSTRSIZE];
+    FILE              *fp;
+    double             c2us;
+    gmx_int64_t        i, first;
+    gmx_cycles_t       t0;
+    const char        *name;
+
+    if (wc == NULL || wc->trace == NULL || wc->trace->nrecorded == 0)
+    {
+        return;
+    }
+    trace = wc->trace;
+
+    /* Convert cycles to microseconds, as used by the trace event format */
+    c2us = gmx_cycles_calibrate(0.1);
+    c2us = (c2us > 0 ? c2us : 1e-9)*1e6;
+
+    first = (trace->nrecorded > trace->nalloc ? trace->nrecorded - trace->nalloc : 0);
+    t0    = trace->event[first % trace->nalloc].start;
+
+    /* Writes a JSON trace that can be loaded in chrome://tracing and similar
+     * viewers. Regions are written as complete events, nesting is implied
+     * by the start and stop times.
+     */
+    snprintf(fn, STRLEN, "wallcycle_trace_rank%d.json", trace->rank);
+    fp = gmx_ffopen(fn, "w");
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (i = first; i < trace->nrecorded; i++)
+    {
+        const wallcycle_event_t *event = &trace->event[i % trace->nalloc];
+
+        if (event->counter < ewcNR)
+        {
+            name = wcn[event->counter];
+        }
+        else
+        {
+#ifdef GMX_CYCLE_SUBCOUNTERS
+            name = wcsn[event->counter - ewcNR];
+#else
+            name = "";
+#endif
+        }
+        fprintf(fp, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,"
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"step\":%s}}%s\n",
+                name, trace->rank,
+                (event->start - t0)*c2us, (event->stop - event->start)*c2us,
+                gmx_step_str(event->step, sbuf),
+                i + 1 < trace->nrecorded ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+    gmx_ffclose(fp);
+}
+
 #ifdef GMX_CYCLE_SUBCOUNTERS
 
 void wallcycle_sub_start(gmx_wallcycle_t wc, int ewcs)
@@ -1015,6 +1273,10 @@ void wallcycle_sub_start(gmx_wallcycle_t wc, int ewcs)
     if (wc != NULL)
     {
         wc->wcsc[ewcs].start = gmx_cycles_read();
+        if (wc->perf != NULL)
+        {
+            wallcycle_perf_start(wc, ewcNR + ewcs);
+        }
     }
 }
 
@@ -1033,8 +1295,20 @@ void wallcycle_sub_stop(gmx_wallcycle_t wc, int ewcs)
 {
     if (wc != NULL)
     {
-        wc->wcsc[ewcs].c += gmx_cycles_read() - wc->wcsc[ewcs].start;
+        gmx_cycles_t cycle;
+
+        cycle             = gmx_cycles_read();
+        wc->wcsc[ewcs].c += cycle - wc->wcsc[ewcs].start;
         wc->wcsc[ewcs].n++;
+        if (wc->trace != NULL)
+        {
+            wallcycle_trace_add(wc->trace, ewcNR + ewcs,
+                                wc->wcsc[ewcs].start, cycle);
+        }
+        if (wc->perf != NULL)
+        {
+            wallcycle_perf_stop(wc, ewcNR + ewcs);
+        }
     }
 }
 
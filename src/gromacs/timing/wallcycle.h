@@ -89,6 +89,9 @@ gmx_wallcycle_t wallcycle_init(FILE *fplog, int resetstep, t_commrec *cr,
  * Returns NULL when cycle counting is not supported.
  */
 
+void wallcycle_destroy(gmx_wallcycle_t wc);
+/* Frees the wall cycle structure */
+
 void wallcycle_start(gmx_wallcycle_t wc, int ewc);
 /* Starts the cycle counter (and increases the call count) */
 
@@ -117,6 +120,16 @@ gmx_int64_t wcycle_get_reset_counters(gmx_wallcycle_t wc);
 void wcycle_set_reset_counters(gmx_wallcycle_t wc, gmx_int64_t reset_counters);
 /* Set reset_counters */
 
+void wallcycle_set_step(gmx_wallcycle_t wc, gmx_int64_t step);
+/* Set the MD step that the regions recorded with GMX_CYCLE_TRACE are
+ * tagged with
+ */
+
+void wallcycle_trace_write(gmx_wallcycle_t wc);
+/* Write the timed regions recorded with GMX_CYCLE_TRACE set to
+ * wallcycle_trace_rank<rank>.json in the Chrome trace event format
+ */
+
 void wallcycle_sub_start(gmx_wallcycle_t wc, int ewcs);
 /* Set the start sub cycle count for ewcs */
 
@@ -770,6 +770,7 @@ double gmx::do_md(FILE *fplog, t_commrec *cr, int nfile, const t_filenm fnm[],
                  ((multisim_nsteps >= 0) && (step_rel >= multisim_nsteps )));
     while (!bLastStep || (bRerunMD && bNotLastFrame))
     {
+        wallcycle_set_step(wcycle, step);
 
         /* Determine if this is a neighbor search step */
         bNStList = (ir->nstlist > 0  && step % ir->nstlist == 0);
@@ -794,6 +795,7 @@ double gmx::do_md(FILE *fplog, t_commrec *cr, int nfile, const t_filenm fnm[],
             {
                 step     = rerun_fr.step;
                 step_rel = step - ir->init_step;
+                wallcycle_set_step(wcycle, step);
             }
             if (rerun_fr.bTime)
             {
@@ -0,0 +1,1296 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2015, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Implements gmx-microbench, timings of individual mdrun components.
+ *
+ * The components are run on a generated box of SPC-like water and, for
+ * the listed forces and LINCS, on generated united-atom chains, so the
+ * timings do not depend on any input files and are reproducible
+ * between builds and machines.
+ */
+#include "gmxpre.h"
+
+#include "config.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "gromacs/commandline/cmdlinemodulemanager.h"
+#include "gromacs/commandline/pargs.h"
+#include "gromacs/ewald/pme.h"
+#include "gromacs/fileio/filenm.h"
+#include "gromacs/fileio/gmxfio.h"
+#include "gromacs/legacyheaders/calcgrid.h"
+#include "gromacs/legacyheaders/force.h"
+#include "gromacs/legacyheaders/gmx_ga2la.h"
+#include "gromacs/legacyheaders/gmx_hash.h"
+#include "gromacs/legacyheaders/gmx_omp_nthreads.h"
+#include "gromacs/legacyheaders/names.h"
+#include "gromacs/legacyheaders/network.h"
+#include "gromacs/legacyheaders/nrnb.h"
+#include "gromacs/legacyheaders/typedefs.h"
+#include "gromacs/legacyheaders/types/commrec.h"
+#include "gromacs/legacyheaders/types/force_flags.h"
+#include "gromacs/legacyheaders/update.h"
+#include "gromacs/listed-forces/listed-forces.h"
+#include "gromacs/listed-forces/manage-threading.h"
+#include "gromacs/math/calculate-ewald-splitting-coefficient.h"
+#include "gromacs/math/units.h"
+#include "gromacs/math/utilities.h"
+#include "gromacs/math/vec.h"
+#include "gromacs/mdlib/constr.h"
+#include "gromacs/mdlib/forcerec.h"
+#include "gromacs/mdlib/nb_verlet.h"
+#include "gromacs/mdlib/nbnxn_atomdata.h"
+#include "gromacs/mdlib/nbnxn_grid.h"
+#include "gromacs/mdlib/nbnxn_search.h"
+#include "gromacs/mdlib/nbnxn_simd.h"
+#include "gromacs/mdlib/nbnxn_kernels/nbnxn_kernel_ref.h"
+#include "gromacs/mdlib/nbnxn_kernels/simd_2xnn/nbnxn_kernel_simd_2xnn.h"
+#include "gromacs/mdlib/nbnxn_kernels/simd_4xn/nbnxn_kernel_simd_4xn.h"
+#include "gromacs/pbcutil/ishift.h"
+#include "gromacs/pbcutil/pbc.h"
+#include "gromacs/random/random.h"
+#include "gromacs/timing/wallcycle.h"
+#include "gromacs/timing/walltime_accounting.h"
+#include "gromacs/utility/arraysize.h"
+#include "gromacs/utility/fatalerror.h"
+#include "gromacs/utility/futil.h"
+#include "gromacs/utility/smalloc.h"
+
+/* Volume per water molecule at 300 K in nm^3 */
+static const real c_waterVolume = 0.0299;
+/* SPC geometry and masses */
+static const real c_waterOH    = 0.1;
+static const real c_waterAngle = 109.47;
+static const real c_massO      = 15.9994;
+static const real c_massH      = 1.008;
+/* United-atom CH2 chains: bond length, bond angle and mass */
+static const int  c_chainLength = 12;
+static const real c_chainBond   = 0.153;
+static const real c_chainAngle  = 111.0;
+static const real c_massCH2     = 14.027;
+/* Time step in ps for the update and constraint benchmarks */
+static const real c_timeStep    = 0.002;
+
+/* A generated water system */
+typedef struct
+{
+    int        natoms;
+    matrix     box;
+    rvec      *x;
+    rvec      *f;
+    real      *q;
+    int       *type;
+    int       *atinfo;
+    t_blocka   excls;
+    int        ntype;
+    real      *nbfp;
+} bench_system_t;
+
+/* A generated system of united-atom chains with listed interactions */
+typedef struct
+{
+    int        natoms;
+    int        nchain;
+    matrix     box;
+    rvec      *x;
+    rvec      *f;
+    real      *invmass;
+    t_idef     idef;   /* Bonds, angles, dihedrals and, for LINCS, constraints */
+} bench_chains_t;
+
+/* The outcome of one benchmark */
+typedef struct
+{
+    char    name[STRLEN];
+    int     natoms;
+    double  time;   /* Seconds per call */
+    double  flops;  /* Floating point operations per call, 0 when unknown */
+} bench_result_t;
+
+/* The outcomes of all benchmarks, in the order they were run */
+typedef struct
+{
+    int             nres;
+    int             nalloc;
+    bench_result_t *res;
+} bench_results_t;
+
+/* Generates nmol SPC water molecules on a perturbed lattice in a cubic box */
+static void make_water_box(int nmol, gmx_rng_t rng, bench_system_t *sys)
+{
+    const real dOH   = c_waterOH;
+    const real angle = c_waterAngle*DEG2RAD;
+    int        nside, m, i, d;
+    real       len, spacing;
+    rvec       u, v, w;
+
+    len     = std::pow(nmol*c_waterVolume, static_cast<real>(1.0/3.0));
+    nside   = static_cast<int>(std::ceil(std::pow(static_cast<double>(nmol), 1.0/3.0)));
+    spacing = len/nside;
+
+    sys->natoms = 3*nmol;
+    clear_mat(sys->box);
+    for (d = 0; d < DIM; d++)
+    {
+        sys->box[d][d] = len;
+    }
+    snew(sys->x, sys->natoms);
+    snew(sys->f, sys->natoms);
+    snew(sys->q, sys->natoms);
+    snew(sys->type, sys->natoms);
+    snew(sys->atinfo, sys->natoms);
+
+    for (m = 0; m < nmol; m++)
+    {
+        rvec *xm = sys->x + 3*m;
+
+        xm[0][XX] = (m % nside + 0.5)*spacing;
+        xm[0][YY] = ((m/nside) % nside + 0.5)*spacing;
+        xm[0][ZZ] = (m/(nside*nside) + 0.5)*spacing;
+        for (d = 0; d < DIM; d++)
+        {
+            xm[0][d] += 0.2*spacing*(gmx_rng_uniform_real(rng) - 0.5);
+            u[d]      = gmx_rng_uniform_real(rng) - 0.5;
+            w[d]      = gmx_rng_uniform_real(rng) - 0.5;
+        }
+        /* Two random orthonormal vectors give the molecule orientation */
+        unitv(u, u);
+        cprod(u, w, v);
+        unitv(v, v);
+        for (d = 0; d < DIM; d++)
+        {
+            xm[1][d] = xm[0][d] + dOH*u[d];
+            xm[2][d] = xm[0][d] + dOH*(std::cos(angle)*u[d] + std::sin(angle)*v[d]);
+        }
+        put_atoms_in_box(epbcXYZ, sys->box, 3, xm);
+
+        sys->q[3*m]        = -0.82;
+        sys->q[3*m + 1]    = 0.41;
+        sys->q[3*m + 2]    = 0.41;
+        sys->type[3*m]     = 0;
+        sys->type[3*m + 1] = 1;
+        sys->type[3*m + 2] = 1;
+        for (i = 0; i < 3; i++)
+        {
+            SET_CGINFO_HAS_Q(sys->atinfo[3*m + i]);
+        }
+        SET_CGINFO_HAS_VDW(sys->atinfo[3*m]);
+    }
+
+    /* All atoms in a molecule exclude each other, including themselves */
+    sys->excls.nr           = sys->natoms;
+    sys->excls.nalloc_index = sys->natoms + 1;
+    sys->excls.nra          = 3*sys->natoms;
+    sys->excls.nalloc_a     = sys->excls.nra;
+    snew(sys->excls.index, sys->excls.nalloc_index);
+    snew(sys->excls.a, sys->excls.nalloc_a);
+    for (i = 0; i < sys->natoms; i++)
+    {
+        sys->excls.index[i] = 3*i;
+        for (d = 0; d < 3; d++)
+        {
+            sys->excls.a[3*i + d] = (i/3)*3 + d;
+        }
+    }
+    sys->excls.index[sys->natoms] = sys->excls.nra;
+
+    /* Only oxygen has LJ, the parameters are stored as 6*C6 and 12*C12 */
+    sys->ntype = 2;
+    snew(sys->nbfp, 2*sys->ntype*sys->ntype);
+    sys->nbfp[0] = 6.0*0.0026173;
+    sys->nbfp[1] = 12.0*2.6341e-6;
+}
+
+/* Parameter types in the chain topology, matching the entries in iparams */
+enum {
+    echainBOND, echainANGLE, echainDIHEDRAL, echainCONSTR, echainNR
+};
+
+/* Appends an interaction of type type with the atoms in a to il */
+static void add_interaction(t_ilist *il, int type, int nral, const int *a)
+{
+    int i;
+
+    il->iatoms[il->nr++] = type;
+    for (i = 0; i < nral; i++)
+    {
+        il->iatoms[il->nr++] = a[i];
+    }
+}
+
+/* Generates nchain united-atom chains with random dihedrals in a box.
+ * The chains are whole, so no periodic boundary treatment is needed,
+ * as with a single rank in mdrun. All bonds are both in the F_BONDS
+ * list for the listed forces and in the F_CONSTR list for LINCS.
+ */
+static void make_chains(int nchain, const matrix box, gmx_rng_t rng,
+                        bench_chains_t *ch)
+{
+    const real      cos_a = std::cos(M_PI - c_chainAngle*DEG2RAD);
+    const real      sin_a = std::sin(M_PI - c_chainAngle*DEG2RAD);
+    const int       ftype[echainNR] = { F_BONDS, F_ANGLES, F_PDIHS, F_CONSTR };
+    const int       nral[echainNR]  = { 2, 3, 4, 2 };
+    t_idef         *idef;
+    int             c, i, d, t, a0;
+    int             a[4];
+    rvec            u, w;
+    real            wu;
+
+    ch->nchain = nchain;
+    ch->natoms = nchain*c_chainLength;
+    copy_mat(box, ch->box);
+    snew(ch->x, ch->natoms);
+    snew(ch->f, ch->natoms);
+    snew(ch->invmass, ch->natoms);
+
+    idef         = &ch->idef;
+    idef->ntypes = echainNR;
+    idef->ilsort = ilsortNO_FE;
+    snew(idef->functype, idef->ntypes);
+    snew(idef->iparams, idef->ntypes);
+    for (t = 0; t < echainNR; t++)
+    {
+        t_ilist *il = &idef->il[ftype[t]];
+
+        idef->functype[t] = ftype[t];
+        snew(il->iatoms, nchain*(c_chainLength - nral[t] + 1)*(1 + nral[t]));
+    }
+    /* Typical united-atom alkane parameters, the same for the A and B state */
+    idef->iparams[echainBOND].harmonic.rA    = c_chainBond;
+    idef->iparams[echainBOND].harmonic.krA   = 334720;
+    idef->iparams[echainBOND].harmonic.rB    = c_chainBond;
+    idef->iparams[echainBOND].harmonic.krB   = 334720;
+    idef->iparams[echainANGLE].harmonic.rA   = c_chainAngle;
+    idef->iparams[echainANGLE].harmonic.krA  = 460;
+    idef->iparams[echainANGLE].harmonic.rB   = c_chainAngle;
+    idef->iparams[echainANGLE].harmonic.krB  = 460;
+    idef->iparams[echainDIHEDRAL].pdihs.phiA = 0;
+    idef->iparams[echainDIHEDRAL].pdihs.cpA  = 5.92;
+    idef->iparams[echainDIHEDRAL].pdihs.phiB = 0;
+    idef->iparams[echainDIHEDRAL].pdihs.cpB  = 5.92;
+    idef->iparams[echainDIHEDRAL].pdihs.mult = 3;
+    idef->iparams[echainCONSTR].constr.dA    = c_chainBond;
+    idef->iparams[echainCONSTR].constr.dB    = c_chainBond;
+
+    for (c = 0; c < nchain; c++)
+    {
+        a0 = c*c_chainLength;
+        for (d = 0; d < DIM; d++)
+        {
+            ch->x[a0][d] = gmx_rng_uniform_real(rng)*box[d][d];
+            u[d]         = gmx_rng_uniform_real(rng) - 0.5;
+        }
+        unitv(u, u);
+        for (i = 1; i < c_chainLength; i++)
+        {
+            /* Step along u, then tilt u by the supplement of the bond
+             * angle towards a random perpendicular direction w, which
+             * gives a random dihedral.
+             */
+            svmul(c_chainBond, u, w);
+            rvec_add(ch->x[a0 + i - 1], w, ch->x[a0 + i]);
+            for (d = 0; d < DIM; d++)
+            {
+                w[d] = gmx_rng_uniform_real(rng) - 0.5;
+            }
+            wu = iprod(w, u);
+            for (d = 0; d < DIM; d++)
+            {
+                w[d] -= wu*u[d];
+            }
+            unitv(w, w);
+            for (d = 0; d < DIM; d++)
+            {
+                u[d] = cos_a*u[d] + sin_a*w[d];
+            }
+        }
+        for (i = 0; i < c_chainLength; i++)
+        {
+            ch->invmass[a0 + i] = 1/c_massCH2;
+        }
+        for (t = 0; t < echainNR; t++)
+        {
+            for (i = 0; i + nral[t] <= c_chainLength; i++)
+            {
+                for (d = 0; d < nral[t]; d++)
+                {
+                    a[d] = a0 + i + d;
+                }
+                add_interaction(&idef->il[ftype[t]], t, nral[t], a);
+            }
+        }
+    }
+    for (t = 0; t < echainNR; t++)
+    {
+        idef->il[ftype[t]].nr_nonperturbed = idef->il[ftype[t]].nr;
+    }
+}
+
+/* Returns the flop count for the nrnb counters that were incremented */
+static double nrnb_flops(const t_nrnb *nrnb)
+{
+    double flops;
+    int    i;
+
+    flops = 0;
+    for (i = 0; i < eNRNB; i++)
+    {
+        flops += nrnb->n[i]*cost_nrnb(i);
+    }
+
+    return flops;
+}
+
+static void add_result(bench_results_t *results,
+                       const char *name, int natoms, double time, double flops)
+{
+    bench_result_t *res;
+
+    if (results->nres == results->nalloc)
+    {
+        results->nalloc = 2*results->nalloc + 16;
+        srenew(results->res, results->nalloc);
+    }
+    res = &results->res[results->nres++];
+    snprintf(res->name, STRLEN, "%s", name);
+    res->natoms = natoms;
+    res->time   = time;
+    res->flops  = flops;
+}
+
+/* Sets up the interaction constants for PME electrostatics with
+ * potential-shifted LJ, as used in a typical mdrun setup.
+ */
+static interaction_const_t *init_bench_ic(real rc, real rlist)
+{
+    interaction_const_t *ic;
+
+    snew(ic, 1);
+    ic->cutoff_scheme         = ecutsVERLET;
+    ic->rlist                 = rlist;
+    ic->rlistlong             = rlist;
+    ic->vdwtype               = evdwCUT;
+    ic->vdw_modifier          = eintmodPOTSHIFT;
+    ic->rvdw                  = rc;
+    ic->dispersion_shift.cpot = -std::pow(rc, static_cast<real>(-6.0));
+    ic->repulsion_shift.cpot  = -std::pow(rc, static_cast<real>(-12.0));
+    ic->sh_invrc6             = -ic->dispersion_shift.cpot;
+    ic->eeltype               = eelPME;
+    ic->coulomb_modifier      = eintmodPOTSHIFT;
+    ic->rcoulomb              = rc;
+    ic->epsilon_r             = 1;
+    ic->epsfac                = ONE_4PI_EPS0;
+    ic->ewaldcoeff_q          = calc_ewaldcoeff_q(rc, 1e-5);
+    ic->sh_ewald              = gmx_erfc(ic->ewaldcoeff_q*rc);
+    ic->epsilon_rf            = 1;
+    init_interaction_const_tables(NULL, ic, 0);
+
+    return ic;
+}
+
+/* Returns the cluster layout of kernel_type, so the SIMD 4xN and 2xNN
+ * kernels, which share the name of the SIMD instruction set, get
+ * distinct result names.
+ */
+static const char *nbnxn_kernel_layout_name(int kernel_type)
+{
+    switch (kernel_type)
+    {
+        case nbnxnk4x4_PlainC:      return "4x4";
+        case nbnxnk4xN_SIMD_4xN:    return "4xN";
+        case nbnxnk4xN_SIMD_2xNN:   return "2xNN";
+        default: gmx_incons("Unsupported nbnxn kernel type in gmx-microbench");
+    }
+
+    return NULL;
+}
+
+/* Times the pair search and the non-bonded kernels of type kernel_type */
+static void bench_nbnxn(const bench_system_t *sys, const interaction_const_t *ic,
+                        int kernel_type, int ewald_excl, int nrep,
+                        bench_results_t *results)
+{
+    nbnxn_search_t        nbs;
+    nbnxn_pairlist_set_t  nbl_list;
+    nbnxn_atomdata_t     *nbat;
+    t_mdatoms             md;
+    t_nrnb                nrnb;
+    rvec                  shift_vec[SHIFTS];
+    matrix                box;
+    rvec                  box_diag, vzero;
+    real                  fshift[SHIFTS*DIM], Vc[1], Vvdw[1];
+    gmx_bool              bSimple;
+    int                   nthreads, r, e, enr_ljc, enr_lj;
+    double                t0 = 0;
+    char                  name[STRLEN];
+
+    nthreads = gmx_omp_nthreads_get(emntNonbonded);
+    bSimple  = nbnxn_kernel_pairlist_simple(kernel_type);
+
+    nbnxn_init_search(&nbs, NULL, NULL, FALSE, nthreads);
+    nbnxn_init_pairlist_set(&nbl_list, bSimple, !bSimple, NULL, NULL);
+    snew(nbat, 1);
+    nbnxn_atomdata_init(NULL, nbat, kernel_type, enbnxninitcombruleDETECT,
+                        sys->ntype, sys->nbfp, 1, bSimple ? nthreads : 1,
+                        NULL, NULL);
+
+    copy_mat(sys->box, box);
+    calc_shifts(box, shift_vec);
+    nbnxn_atomdata_copy_shiftvec(FALSE, shift_vec, nbat);
+
+    std::memset(&md, 0, sizeof(md));
+    md.nr      = sys->natoms;
+    md.homenr  = sys->natoms;
+    md.typeA   = sys->type;
+    md.chargeA = sys->q;
+
+    clear_rvec(vzero);
+    for (e = 0; e < DIM; e++)
+    {
+        box_diag[e] = box[e][e];
+    }
+
+    /* Pair search: gridding and pair list construction, as done at each
+     * search step in do_force.
+     */
+    init_nrnb(&nrnb);
+    for (r = -1; r < nrep; r++)
+    {
+        if (r == 0)
+        {
+            t0 = gmx_gettime();
+            init_nrnb(&nrnb);
+        }
+        nbnxn_put_on_grid(nbs, epbcXYZ, box,
+                          0, vzero, box_diag, 0, sys->natoms, -1,
+                          sys->atinfo, sys->x, 0, NULL, kernel_type, nbat);
+        nbnxn_atomdata_set(nbat, eatAll, nbs, &md, sys->atinfo);
+        nbnxn_make_pairlist(nbs, nbat, &sys->excls, ic->rlist, 0,
+                            &nbl_list, eintLocal, kernel_type, &nrnb);
+    }
+    snprintf(name, STRLEN, "search %s %s%s",
+             lookup_nbnxn_kernel_name(kernel_type),
+             nbnxn_kernel_layout_name(kernel_type),
+             ewald_excl == ewaldexclAnalytical ? " analytical" : " tabulated");
+    add_result(results, name, sys->natoms, (gmx_gettime() - t0)/nrep,
+               nrnb_flops(&nrnb)/nrep);
+
+    nbnxn_atomdata_copy_x_to_nbat_x(nbs, eatLocal, FALSE, sys->x, nbat);
+
+    enr_ljc = (ewald_excl == ewaldexclAnalytical ? eNR_NBNXN_LJ_EWALD : eNR_NBNXN_LJ_TAB);
+    enr_lj  = eNR_NBNXN_LJ;
+
+    /* The force-only and the force plus energy kernel flavours */
+    for (e = 0; e < 2; e++)
+    {
+        int flags = GMX_FORCE_FORCES | (e == 1 ? GMX_FORCE_ENERGY : 0);
+
+        for (r = -1; r < nrep; r++)
+        {
+            if (r == 0)
+            {
+                t0 = gmx_gettime();
+            }
+            switch (kernel_type)
+            {
+                case nbnxnk4x4_PlainC:
+                    nbnxn_kernel_ref(&nbl_list, nbat, ic, shift_vec, flags,
+                                     enbvClearFYes, fshift, Vc, Vvdw);
+                    break;
+#ifdef GMX_NBNXN_SIMD_4XN
+                case nbnxnk4xN_SIMD_4xN:
+                    nbnxn_kernel_simd_4xn(&nbl_list, nbat, ic, ewald_excl,
+                                          shift_vec, flags, enbvClearFYes,
+                                          fshift, Vc, Vvdw);
+                    break;
+#endif
+#ifdef GMX_NBNXN_SIMD_2XNN
+                case nbnxnk4xN_SIMD_2xNN:
+                    nbnxn_kernel_simd_2xnn(&nbl_list, nbat, ic, ewald_excl,
+                                           shift_vec, flags, enbvClearFYes,
+                                           fshift, Vc, Vvdw);
+                    break;
+#endif
+                default:
+                    gmx_incons("Unsupported kernel type in the benchmark");
+            }
+        }
+
+        /* Count the flops as mdrun does in do_nb_verlet */
+        init_nrnb(&nrnb);
+        inc_nrnb(&nrnb, enr_ljc + e, nbl_list.natpair_ljq);
+        inc_nrnb(&nrnb, enr_lj + e, nbl_list.natpair_lj);
+        inc_nrnb(&nrnb, enr_ljc + e - eNR_NBNXN_LJ_RF + eNR_NBNXN_RF, nbl_list.natpair_q);
+
+        snprintf(name, STRLEN, "nonbonded %s %s%s %s",
+                 lookup_nbnxn_kernel_name(kernel_type),
+                 nbnxn_kernel_layout_name(kernel_type),
+                 ewald_excl == ewaldexclAnalytical ? " analytical" : " tabulated",
+                 e == 1 ? "F+E" : "F");
+        add_result(results, name, sys->natoms, (gmx_gettime() - t0)/nrep,
+                   nrnb_flops(&nrnb));
+    }
+}
+
+/* Times the PME mesh part and its spread/gather, FFT and solve stages */
+static void bench_pme(const bench_system_t *sys, const interaction_const_t *ic,
+                      real spacing, int nrep, bench_results_t *results)
+{
+    struct gmx_pme_t *pme;
+    t_inputrec       *ir;
+    t_commrec        *cr;
+    t_nrnb            nrnb;
+    gmx_wallcycle_t   wcycle;
+    matrix            box, vir_q, vir_lj;
+    real              energy_q, energy_lj, dvdl_q, dvdl_lj;
+    int               nthreads, r, i, n;
+    double            t0 = 0, time, c_mesh, c;
+    char              name[STRLEN];
+    const int         ewc_stage[]  = { ewcPME_SPREADGATHER, ewcPME_FFT, ewcPME_SOLVE };
+    const char       *stage_name[] = { "spread+gather", "3D-FFT", "solve" };
+
+    nthreads = gmx_omp_nthreads_get(emntPME);
+    copy_mat(sys->box, box);
+
+    snew(ir, 1);
+    ir->ePBC        = epbcXYZ;
+    ir->efep        = efepNO;
+    ir->coulombtype = eelPME;
+    ir->vdwtype     = evdwCUT;
+    ir->pme_order   = 4;
+    ir->epsilon_r   = 1;
+    calc_grid(NULL, box, spacing, &ir->nkx, &ir->nky, &ir->nkz);
+
+    cr = init_commrec();
+    if (gmx_pme_init(&pme, cr, 1, 1, ir, sys->natoms, FALSE, FALSE, FALSE,
+                     nthreads) != 0)
+    {
+        gmx_fatal(FARGS, "Could not initialize PME");
+    }
+    wcycle = wallcycle_init(NULL, 0, cr, nthreads, nthreads);
+
+    init_nrnb(&nrnb);
+    for (r = -1; r < nrep; r++)
+    {
+        if (r == 0)
+        {
+            t0 = gmx_gettime();
+            wallcycle_reset_all(wcycle);
+            init_nrnb(&nrnb);
+        }
+        wallcycle_start(wcycle, ewcPMEMESH);
+        gmx_pme_do(pme, 0, sys->natoms, sys->x, sys->f, sys->q, NULL,
+                   NULL, NULL, NULL, NULL, box, cr, 0, 0, &nrnb, wcycle,
+                   vir_q, ic->ewaldcoeff_q, vir_lj, 0,
+                   &energy_q, &energy_lj, 0, 0, &dvdl_q, &dvdl_lj,
+                   GMX_PME_DO_ALL_F | GMX_PME_DO_COULOMB);
+        wallcycle_stop(wcycle, ewcPMEMESH);
+    }
+    time = (gmx_gettime() - t0)/nrep;
+    snprintf(name, STRLEN, "PME mesh %dx%dx%d", ir->nkx, ir->nky, ir->nkz);
+    add_result(results, name, sys->natoms, time, nrnb_flops(&nrnb)/nrep);
+
+    /* Split the measured time over the stages with the cycle counts */
+    if (wcycle != NULL)
+    {
+        wallcycle_get(wcycle, ewcPMEMESH, &n, &c_mesh);
+        for (i = 0; i < static_cast<int>(asize(ewc_stage)); i++)
+        {
+            wallcycle_get(wcycle, ewc_stage[i], &n, &c);
+            snprintf(name, STRLEN, "  PME %s", stage_name[i]);
+            add_result(results, name, sys->natoms,
+                       c_mesh > 0 ? time*c/c_mesh : 0, 0);
+        }
+    }
+
+    wallcycle_destroy(wcycle);
+    gmx_pme_destroy(NULL, &pme);
+    sfree(ir);
+    sfree(cr);
+}
+
+/* Sets xp to x displaced by uniform random amounts of at most dmax,
+ * mimicking the unconstrained coordinates after an update.
+ */
+static void displace_coords(int natoms, const rvec *x, real dmax,
+                            gmx_rng_t rng, rvec *xp)
+{
+    int i, d;
+
+    for (i = 0; i < natoms; i++)
+    {
+        for (d = 0; d < DIM; d++)
+        {
+            xp[i][d] = x[i][d] + dmax*(2*gmx_rng_uniform_real(rng) - 1);
+        }
+    }
+}
+
+/* Times the listed forces of the chain system, without and with energies
+ * and virial, as on normal and energy steps in mdrun. Without energies
+ * the angles and dihedrals use the SIMD kernels when available.
+ */
+static void bench_listed(bench_chains_t *ch, int nrep,
+                         bench_results_t *results)
+{
+    t_forcerec     *fr;
+    gmx_enerdata_t  enerd;
+    t_mdatoms       md;
+    t_fcdata        fcd;
+    t_nrnb          nrnb;
+    real            lambda[efptNR];
+    int             e, r;
+    double          t0 = 0;
+    char            name[STRLEN];
+
+    fr                   = mk_forcerec();
+    fr->bMolPBC          = FALSE;
+    fr->efep             = efepNO;
+    fr->use_simd_kernels = (getenv("GMX_DISABLE_SIMD_KERNELS") == NULL);
+    fr->natoms_force     = ch->natoms;
+    snew(fr->fshift, SHIFTS);
+    init_bonded_threading(NULL, 1, &fr->bonded_threading);
+    setup_bonded_threading(fr, &ch->idef);
+
+    std::memset(&enerd, 0, sizeof(enerd));
+    init_enerdata(1, 0, &enerd);
+    std::memset(&md, 0, sizeof(md));
+    md.nr     = ch->natoms;
+    md.homenr = ch->natoms;
+    std::memset(&fcd, 0, sizeof(fcd));
+    std::memset(lambda, 0, sizeof(lambda));
+
+    for (e = 0; e < 2; e++)
+    {
+        int flags = GMX_FORCE_FORCES | (e == 1 ? GMX_FORCE_ENERGY | GMX_FORCE_VIRIAL : 0);
+
+        init_nrnb(&nrnb);
+        for (r = -1; r < nrep; r++)
+        {
+            if (r == 0)
+            {
+                t0 = gmx_gettime();
+                init_nrnb(&nrnb);
+            }
+            calc_listed(NULL, NULL, &ch->idef, ch->x, NULL, ch->f, fr,
+                        NULL, NULL, NULL, &enerd, &nrnb, lambda, &md, &fcd,
+                        NULL, flags);
+        }
+        snprintf(name, STRLEN, "listed bonds+angles+dihedrals %s",
+                 e == 1 ? "F+E" : "F");
+        add_result(results, name, ch->natoms, (gmx_gettime() - t0)/nrep,
+                   nrnb_flops(&nrnb)/nrep);
+    }
+
+    destroy_enerdata(&enerd);
+    sfree(fr->fshift);
+}
+
+/* Times the coordinate and velocity update with integrator eI for the
+ * water system, without coupling, as done by update_coords in mdrun.
+ */
+static void bench_update(const bench_system_t *sys, int eI, int seed, int nrep,
+                         bench_results_t *results)
+{
+    t_inputrec     *ir;
+    gmx_update_t    upd;
+    gmx_ekindata_t  ekind;
+    t_state         state;
+    t_mdatoms       md;
+    t_commrec      *cr;
+    t_nrnb          nrnb;
+    matrix          M;
+    int             i, r;
+    double          t0 = 0;
+    char            name[STRLEN];
+
+    snew(ir, 1);
+    ir->eI         = eI;
+    ir->delta_t    = c_timeStep;
+    ir->etc        = etcNO;
+    ir->epc        = epcNO;
+    ir->ld_seed    = seed;
+    ir->opts.ngtc  = 1;
+    ir->opts.ngacc = 1;
+    ir->opts.ngfrz = 1;
+    snew(ir->opts.tau_t, 1);
+    snew(ir->opts.ref_t, 1);
+    snew(ir->opts.acc, 1);
+    snew(ir->opts.nFreeze, 1);
+    ir->opts.tau_t[0] = 1;
+    ir->opts.ref_t[0] = 300;
+    upd               = init_update(ir);
+
+    std::memset(&ekind, 0, sizeof(ekind));
+    ekind.ngtc  = 1;
+    ekind.ngacc = 1;
+    snew(ekind.tcstat, ekind.ngtc);
+    snew(ekind.grpstat, ekind.ngacc);
+    ekind.tcstat[0].lambda = 1;
+
+    /* update_coords only writes the new coordinates to its own buffer */
+    std::memset(&state, 0, sizeof(state));
+    state.natoms = sys->natoms;
+    state.nalloc = sys->natoms;
+    state.x      = sys->x;
+    snew(state.v, state.nalloc);
+    copy_mat(sys->box, state.box);
+
+    std::memset(&md, 0, sizeof(md));
+    md.nr     = sys->natoms;
+    md.homenr = sys->natoms;
+    snew(md.invmass, md.nr);
+    snew(md.ptype, md.nr);
+    for (i = 0; i < md.nr; i++)
+    {
+        md.invmass[i] = 1/(i % 3 == 0 ? c_massO : c_massH);
+    }
+
+    cr = init_commrec();
+    clear_mat(M);
+
+    for (r = -1; r < nrep; r++)
+    {
+        if (r == 0)
+        {
+            t0 = gmx_gettime();
+        }
+        update_coords(NULL, r, ir, &md, &state, FALSE, sys->f, FALSE, NULL,
+                      NULL, NULL, &ekind, M, upd, FALSE, etrtPOSITION,
+                      cr, &nrnb, NULL, NULL);
+    }
+
+    /* Count the flops as mdrun does in update_constraints */
+    init_nrnb(&nrnb);
+    inc_nrnb(&nrnb, eNR_UPDATE, sys->natoms);
+    snprintf(name, STRLEN, "update %s", EI(eI));
+    add_result(results, name, sys->natoms, (gmx_gettime() - t0)/nrep,
+               nrnb_flops(&nrnb));
+
+    sfree(md.ptype);
+    sfree(md.invmass);
+    sfree(state.v);
+    sfree(ekind.grpstat);
+    sfree(ekind.tcstat);
+    sfree(ir->opts.nFreeze);
+    sfree(ir->opts.acc);
+    sfree(ir->opts.ref_t);
+    sfree(ir->opts.tau_t);
+    sfree(ir);
+    sfree(cr);
+}
+
+/* Times SETTLE on the water system with velocity correction and virial,
+ * divided over the threads as in constrain. The cost does not depend on
+ * the size of the deviations, so after the first call the constrained
+ * coordinates are simply constrained again.
+ */
+static void bench_settle(const bench_system_t *sys, gmx_rng_t rng, int nrep,
+                         bench_results_t *results)
+{
+    gmx_settledata_t settled;
+    t_iatom         *iatoms;
+    t_pbc            pbc;
+    t_nrnb           nrnb;
+    matrix           box;
+    rvec            *xprime, *v;
+    tensor          *vir;
+    int             *error;
+    int              nsettle, nth, th, i, r;
+    real             dHH;
+    double           t0 = 0;
+
+    nth     = gmx_omp_nthreads_get(emntSETTLE);
+    nsettle = sys->natoms/3;
+    dHH     = 2*c_waterOH*std::sin(0.5*c_waterAngle*DEG2RAD);
+    settled = settle_init(c_massO, c_massH, 1/c_massO, 1/c_massH, c_waterOH, dHH);
+
+    snew(iatoms, nsettle*(1 + NRAL(F_SETTLE)));
+    for (i = 0; i < nsettle; i++)
+    {
+        iatoms[i*(1 + NRAL(F_SETTLE))] = 0;
+        for (r = 0; r < NRAL(F_SETTLE); r++)
+        {
+            iatoms[i*(1 + NRAL(F_SETTLE)) + 1 + r] = 3*i + r;
+        }
+    }
+
+    /* The molecules are not whole, as with domain decomposition */
+    copy_mat(sys->box, box);
+    set_pbc(&pbc, epbcXYZ, box);
+
+    snew(xprime, sys->natoms);
+    snew(v, sys->natoms);
+    displace_coords(sys->natoms, sys->x, 0.005, rng, xprime);
+    snew(vir, nth);
+    snew(error, nth);
+
+    for (r = -1; r < nrep; r++)
+    {
+        if (r == 0)
+        {
+            t0 = gmx_gettime();
+        }
+#pragma omp parallel for num_threads(nth) schedule(static)
+        for (th = 0; th < nth; th++)
+        {
+            int start_th, end_th;
+
+            start_th  = (nsettle* th   )/nth;
+            end_th    = (nsettle*(th+1))/nth;
+            error[th] = -1;
+            csettle(settled, end_th - start_th,
+                    iatoms + start_th*(1 + NRAL(F_SETTLE)), &pbc,
+                    sys->x[0], xprime[0], 1/c_timeStep, v[0], sys->natoms,
+                    vir[th], &error[th]);
+        }
+        for (th = 0; th < nth; th++)
+        {
+            if (error[th] >= 0)
+            {
+                gmx_fatal(FARGS, "SETTLE failed for water molecule %d of the generated system",
+                          error[th]);
+            }
+        }
+    }
+
+    /* Count the flops as mdrun does in constrain */
+    init_nrnb(&nrnb);
+    inc_nrnb(&nrnb, eNR_SETTLE, nsettle);
+    inc_nrnb(&nrnb, eNR_CONSTR_V, nsettle*3);
+    inc_nrnb(&nrnb, eNR_CONSTR_VIR, nsettle*3);
+    add_result(results, "SETTLE", sys->natoms, (gmx_gettime() - t0)/nrep,
+               nrnb_flops(&nrnb));
+
+    sfree(error);
+    sfree(vir);
+    sfree(v);
+    sfree(xprime);
+    sfree(iatoms);
+    sfree(settled);
+}
+
+/* Times LINCS with the mdrun default expansion order and number of
+ * iterations on the chain system, with velocity correction and virial.
+ */
+static void bench_lincs(bench_chains_t *ch, gmx_rng_t rng, int nrep,
+                        bench_results_t *results)
+{
+    gmx_mtop_t       mtop;
+    gmx_moltype_t    moltype;
+    gmx_molblock_t   molblock;
+    t_blocka         at2con;
+    gmx_lincsdata_t  lincsd;
+    t_inputrec      *ir;
+    t_mdatoms        md;
+    t_commrec       *cr;
+    t_nrnb           nrnb;
+    rvec            *xprime, *v;
+    tensor           vir;
+    int              nflexcon, warncount, r;
+    double           t0 = 0;
+    char             name[STRLEN];
+
+    snew(ir, 1);
+    ir->eI             = eiMD;
+    ir->efep           = efepNO;
+    ir->delta_t        = c_timeStep;
+    ir->nLincsIter     = 1;
+    ir->nProjOrder     = 4;
+    ir->LincsWarnAngle = 30;
+
+    /* init_lincs only needs the constraints of one chain, which are
+     * the first entries of the global list.
+     */
+    std::memset(&moltype, 0, sizeof(moltype));
+    moltype.atoms.nr              = c_chainLength;
+    moltype.ilist[F_CONSTR].nr     = (c_chainLength - 1)*(1 + NRAL(F_CONSTR));
+    moltype.ilist[F_CONSTR].iatoms = ch->idef.il[F_CONSTR].iatoms;
+    std::memset(&molblock, 0, sizeof(molblock));
+    molblock.type       = 0;
+    molblock.nmol       = ch->nchain;
+    molblock.natoms_mol = c_chainLength;
+    std::memset(&mtop, 0, sizeof(mtop));
+    mtop.nmoltype  = 1;
+    mtop.moltype   = &moltype;
+    mtop.nmolblock = 1;
+    mtop.molblock  = &molblock;
+    mtop.natoms    = ch->natoms;
+
+    at2con = make_at2con(0, c_chainLength, moltype.ilist, ch->idef.iparams,
+                         TRUE, &nflexcon);
+    lincsd = init_lincs(NULL, &mtop, nflexcon, &at2con, FALSE,
+                        ir->nLincsIter, ir->nProjOrder);
+
+    std::memset(&md, 0, sizeof(md));
+    md.nr      = ch->natoms;
+    md.homenr  = ch->natoms;
+    md.invmass = ch->invmass;
+
+    cr = init_commrec();
+    set_lincs(&ch->idef, &md, TRUE, cr, lincsd);
+
+    snew(xprime, ch->natoms);
+    snew(v, ch->natoms);
+    displace_coords(ch->natoms, ch->x, 0.005, rng, xprime);
+    warncount = 0;
+
+    init_nrnb(&nrnb);
+    for (r = -1; r < nrep; r++)
+    {
+        if (r == 0)
+        {
+            t0 = gmx_gettime();
+            init_nrnb(&nrnb);
+        }
+        clear_mat(vir);
+        constrain_lincs(NULL, FALSE, FALSE, ir, r, lincsd, &md, cr,
+                        ch->x, xprime, NULL, ch->box, NULL, 0, NULL,
+                        1/c_timeStep, v, TRUE, vir, econqCoord, &nrnb,
+                        -1, &warncount);
+    }
+    snprintf(name, STRLEN, "LINCS order %d iter %d",
+             ir->nProjOrder, ir->nLincsIter);
+    add_result(results, name, ch->natoms, (gmx_gettime() - t0)/nrep,
+               nrnb_flops(&nrnb)/nrep);
+
+    done_blocka(&at2con);
+    sfree(v);
+    sfree(xprime);
+    sfree(ir);
+    sfree(cr);
+}
+
+/* Times setting up and looking up the global to local atom indices used by
+ * domain decomposition, for systems of 10^4 to 10^7 atoms. A sixteenth of
+ * the atoms is local, so ga2la uses its hash table, as it does with many
+ * domains. The local atoms have either consecutive global indices, as for
+ * a domain of molecules with contiguous atoms, or random ones. Twice as
+ * many global indices as there are local atoms are looked up, so half of
+ * the lookups miss.
+ */
+static void bench_ga2la(gmx_rng_t rng, int nrep, bench_results_t *results)
+{
+    const int   c_numSizes = 4;
+    const char *order_name[] = { "consecutive", "random" };
+    gmx_ga2la_t ga2la;
+    gmx_hash_t  hash;
+    int         natoms, nloc, s, o, i, r, a_loc, cell;
+    int        *gl;
+    double      t0;
+    long        nfound;
+    char        name[STRLEN];
+
+    natoms = 10000;
+    for (s = 0; s < c_numSizes; s++)
+    {
+        nloc = natoms/16;
+
+        snew(gl, natoms);
+        for (o = 0; o < 2; o++)
+        {
+            for (i = 0; i < natoms; i++)
+            {
+                gl[i] = i;
+            }
+            if (o == 1)
+            {
+                /* A random permutation gives a random local to global mapping */
+                for (i = natoms - 1; i > 0; i--)
+                {
+                    int j, tmp;
+
+                    j     = static_cast<int>(gmx_rng_uniform_real(rng)*(i + 1)) % (i + 1);
+                    tmp   = gl[i];
+                    gl[i] = gl[j];
+                    gl[j] = tmp;
+                }
+            }
+
+            ga2la = ga2la_init(natoms, nloc);
+            hash  = gmx_hash_init(nloc);
+
+            /* Setting all entries, as done at each domain decomposition step */
+            t0 = gmx_gettime();
+            for (r = 0; r < nrep; r++)
+            {
+                ga2la_clear(ga2la);
+                for (i = 0; i < nloc; i++)
+                {
+                    ga2la_set(ga2la, gl[i], i, 0);
+                }
+            }
+            snprintf(name, STRLEN, "ga2la set %d %s", natoms, order_name[o]);
+            add_result(results, name, nloc, (gmx_gettime() - t0)/nrep, 0);
+
+            t0 = gmx_gettime();
+            for (r = 0; r < nrep; r++)
+            {
+                gmx_hash_clear_and_optimize(hash);
+                for (i = 0; i < nloc; i++)
+                {
+                    gmx_hash_set(hash, gl[i], i);
+                }
+            }
+            snprintf(name, STRLEN, "gmx_hash set %d %s", natoms, order_name[o]);
+            add_result(results, name, nloc, (gmx_gettime() - t0)/nrep, 0);
+
+            nfound = 0;
+            t0     = gmx_gettime();
+            for (r = 0; r < nrep; r++)
+            {
+                for (i = 0; i < 2*nloc; i++)
+                {
+                    nfound += ga2la_get(ga2la, gl[i], &a_loc, &cell);
+                }
+            }
+            snprintf(name, STRLEN, "ga2la lookup %d %s", natoms, order_name[o]);
+            add_result(results, name, 2*nloc, (gmx_gettime() - t0)/nrep, 0);
+
+            t0 = gmx_gettime();
+            for (r = 0; r < nrep; r++)
+            {
+                for (i = 0; i < 2*nloc; i++)
+                {
+                    nfound += (gmx_hash_get_minone(hash, gl[i]) >= 0);
+                }
+            }
+            snprintf(name, STRLEN, "gmx_hash lookup %d %s", natoms, order_name[o]);
+            add_result(results, name, 2*nloc, (gmx_gettime() - t0)/nrep, 0);
+
+            if (nfound != 2*static_cast<long>(nrep)*nloc)
+            {
+                gmx_incons("Inconsistent number of local atoms found in the lookup benchmark");
+            }
+
+            /* There are no destroy functions for these tables */
+            sfree(ga2la->laa);
+            sfree(ga2la->lal);
+            sfree(ga2la);
+            sfree(hash->hash);
+            sfree(hash);
+        }
+        sfree(gl);
+
+        natoms *= 10;
+    }
+}
+
+static void print_results(FILE *fp, const bench_results_t *results)
+{
+    const bench_result_t *res = results->res;
+    int                   i;
+
+    fprintf(fp, "\n%-44s %8s %14s %10s %9s\n",
+            "Benchmark", "Atoms", "ms/call", "ns/atom", "GFLOP/s");
+    for (i = 0; i < results->nres; i++)
+    {
+        fprintf(fp, "%-44s %8d %14.4f %10.3f",
+                res[i].name, res[i].natoms, res[i].time*1e3,
+                res[i].time*1e9/res[i].natoms);
+        if (res[i].flops > 0 && res[i].time > 0)
+        {
+            fprintf(fp, " %9.2f", res[i].flops*1e-9/res[i].time);
+        }
+        fprintf(fp, "\n");
+    }
+    fprintf(fp, "\n");
+}
+
+/* Writes the results as tab-separated values for scripted comparisons */
+static void write_results(const char *fn, const bench_results_t *results,
+                          int nthreads)
+{
+    const bench_result_t *res = results->res;
+    FILE                 *fp;
+    int                   i;
+
+    fp = gmx_ffopen(fn, "w");
+    fprintf(fp, "# benchmark\tnatoms\tnthreads\tsimd\tns_per_atom\tgflops\n");
+    for (i = 0; i < results->nres; i++)
+    {
+        fprintf(fp, "%s\t%d\t%d\t%s\t%.4f\t%.3f\n",
+                res[i].name, res[i].natoms, nthreads, GMX_SIMD_STRING,
+                res[i].time*1e9/res[i].natoms,
+                res[i].time > 0 ? res[i].flops*1e-9/res[i].time : 0.0);
+    }
+    gmx_ffclose(fp);
+}
+
+int gmx_microbench(int argc, char *argv[])
+{
+    const char     *desc[] = {
+        "[THISMODULE] times individual components of mdrun on a generated",
+        "box of SPC water, to compare builds, SIMD levels and hardware",
+        "without running full simulations. The listed forces and LINCS",
+        "use united-atom chains of 12 atoms with the same number of atoms",
+        "as the water box.[PAR]",
+        "The benchmarks are the non-bonded pair search and the",
+        "force-only and force plus energy non-bonded kernels for all",
+        "kernel types supported by the build, the PME mesh part with",
+        "a breakdown of its stages, the listed forces, the leap-frog and",
+        "stochastic dynamics updates, SETTLE and LINCS, and the global",
+        "to local atom lookups used with domain decomposition for systems",
+        "of 10^4 to 10^7 atoms. Each component is called once",
+        "to warm up and then [TT]-nrep[tt] times.[PAR]",
+        "The timings are reported per call and per atom, with the",
+        "floating point throughput when mdrun counts flops for the component.",
+        "With [TT]-o[tt] the results are also written as tab-separated",
+        "values."
+    };
+    static int      nmol     = 8000;
+    static int      nrep     = 20;
+    static int      nthreads = 1;
+    static int      seed     = 1993;
+    static real     rc       = 1.0;
+    static real     spacing  = 0.12;
+    static const char *bench[] = { NULL, "all", "nbnxn", "pme", "listed", "update", "constr", "ga2la", NULL };
+    t_pargs         pa[]     = {
+        { "-nmol", FALSE, etINT, {&nmol}, "Number of water molecules" },
+        { "-nrep", FALSE, etINT, {&nrep}, "Number of timed calls for each component" },
+        { "-nt", FALSE, etINT, {&nthreads}, "Number of OpenMP threads" },
+        { "-seed", FALSE, etINT, {&seed}, "Random seed for the water configuration" },
+        { "-rc", FALSE, etREAL, {&rc}, "Cut-off distance (nm)" },
+        { "-spacing", FALSE, etREAL, {&spacing}, "PME grid spacing (nm)" },
+        { "-bench", FALSE, etENUM, {bench}, "Components to benchmark" }
+    };
+    t_filenm        fnm[] = {
+        { efDAT, "-o", "microbench", ffOPTWR }
+    };
+#define NFILE asize(fnm)
+    output_env_t    oenv;
+    gmx_rng_t       rng;
+    bench_system_t  sys;
+    bench_chains_t  chains;
+    interaction_const_t *ic;
+    bench_results_t results;
+    int             m;
+    gmx_bool        bAll, bListed, bConstr;
+
+    if (!parse_common_args(&argc, argv, 0, NFILE, fnm, asize(pa), pa,
+                           asize(desc), desc, 0, NULL, &oenv))
+    {
+        return 0;
+    }
+    if (nmol < 1 || nrep < 1 || nthreads < 1)
+    {
+        gmx_fatal(FARGS, "-nmol, -nrep and -nt should be positive");
+    }
+
+    for (m = 0; m < emntNR; m++)
+    {
+        gmx_omp_nthreads_set(m, nthreads);
+    }
+
+    rng = gmx_rng_init(seed);
+    std::memset(&sys, 0, sizeof(sys));
+    make_water_box(nmol, rng, &sys);
+    if (2*(rc + 0.1) > sys.box[XX][XX])
+    {
+        gmx_fatal(FARGS, "The cut-off of %g nm is too long for a box of %g nm, increase -nmol",
+                  rc, sys.box[XX][XX]);
+    }
+    fprintf(stderr, "Generated %d water molecules in a box of %.3f nm, SIMD: %s\n",
+            nmol, sys.box[XX][XX], GMX_SIMD_STRING);
+
+    /* Use a pair list buffer of 0.1 nm, a common value with nstlist=10 */
+    ic   = init_bench_ic(rc, rc + 0.1);
+    bAll    = (bench[0][0] == 'a');
+    bListed = (bAll || std::strcmp(bench[0], "listed") == 0);
+    bConstr = (bAll || std::strcmp(bench[0], "constr") == 0);
+    std::memset(&results, 0, sizeof(results));
+
+    std::memset(&chains, 0, sizeof(chains));
+    if (bListed || bConstr)
+    {
+        make_chains(sys.natoms/c_chainLength, sys.box, rng, &chains);
+    }
+
+    if (bAll || std::strcmp(bench[0], "nbnxn") == 0)
+    {
+        bench_nbnxn(&sys, ic, nbnxnk4x4_PlainC, ewaldexclTable, nrep, &results);
+#ifdef GMX_NBNXN_SIMD_4XN
+        bench_nbnxn(&sys, ic, nbnxnk4xN_SIMD_4xN, ewaldexclTable, nrep, &results);
+        bench_nbnxn(&sys, ic, nbnxnk4xN_SIMD_4xN, ewaldexclAnalytical, nrep, &results);
+#endif
+#ifdef GMX_NBNXN_SIMD_2XNN
+        bench_nbnxn(&sys, ic, nbnxnk4xN_SIMD_2xNN, ewaldexclTable, nrep, &results);
+        bench_nbnxn(&sys, ic, nbnxnk4xN_SIMD_2xNN, ewaldexclAnalytical, nrep, &results);
+#endif
+    }
+    if (bAll || std::strcmp(bench[0], "pme") == 0)
+    {
+        bench_pme(&sys, ic, spacing, nrep, &results);
+    }
+    if (bListed)
+    {
+        bench_listed(&chains, nrep, &results);
+    }
+    if (bAll || std::strcmp(bench[0], "update") == 0)
+    {
+        bench_update(&sys, eiMD, seed, nrep, &results);
+        bench_update(&sys, eiSD1, seed, nrep, &results);
+    }
+    if (bConstr)
+    {
+        bench_settle(&sys, rng, nrep, &results);
+        bench_lincs(&chains, rng, nrep, &results);
+    }
+    if (bAll || std::strcmp(bench[0], "ga2la") == 0)
+    {
+        bench_ga2la(rng, nrep, &results);
+    }
+
+    print_results(stdout, &results);
+    if (opt2bSet("-o", NFILE, fnm))
+    {
+        write_results(opt2fn("-o", NFILE, fnm), &results, nthreads);
+    }
+
+    gmx_rng_destroy(rng);
+    sfree(results.res);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    return gmx::CommandLineModuleManager::runAsMainCMain(argc, argv, &gmx_microbench);
+}
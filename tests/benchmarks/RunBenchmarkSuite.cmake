@@ -0,0 +1,212 @@
+#
+# This file is part of the GROMACS molecular simulation package.
+#
+# Copyright (c) 2015, by the GROMACS development team, led by
+# Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+# and including many others, as listed in the AUTHORS file in the
+# top-level source directory and at http://www.gromacs.org.
+#
+# GROMACS is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public License
+# as published by the Free Software Foundation; either version 2.1
+# of the License, or (at your option) any later version.
+#
+# GROMACS is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with GROMACS; if not, see
+# http://www.gnu.org/licenses, or write to the Free Software Foundation,
+# Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+#
+# If you want to redistribute modifications to GROMACS, please
+# consider that scientific software is very special. Version
+# control is crucial - bugs must be traceable. We will be happy to
+# consider code for inclusion in the official distribution, but
+# derived work must not be called official GROMACS. Details are found
+# in the README & COPYING files - if they are missing, get the
+# official version at http://www.gromacs.org.
+#
+# To help us fund GROMACS development, we humbly ask that you cite
+# the research papers on the package. Check out http://www.gromacs.org.
+
+# Runs the mdrun performance regression suite.
+#
+# Invoked by the benchmark-suite target as
+#   cmake -D GMX_EXECUTABLE=<gmx> -D SOURCE_DIR=<dir> -D WORK_DIR=<dir>
+#         -D GMXLIB=<share/top> -D NSTEPS=<n> -D CONFIGURATIONS=<RxT;...>
+#         [-D THREAD_MPI=ON] [-D SYSTEMS=<name;...>] [-D REFERENCE=<tsv>]
+#         -P RunBenchmarkSuite.cmake
+#
+# For each system, the input is generated with gmx tools and run with mdrun
+# for each ranks x threads configuration.  The performance and the
+# cycle accounting from each md.log are collected into
+# ${WORK_DIR}/benchmarks.tsv, one metric per line.  If REFERENCE points to
+# a file written by an earlier run, the ns/day of each run is compared with
+# it and runs slower by more than TOLERANCE percent are reported.
+
+foreach(_var GMX_EXECUTABLE SOURCE_DIR WORK_DIR GMXLIB NSTEPS CONFIGURATIONS)
+    if(NOT DEFINED ${_var})
+        message(FATAL_ERROR "${_var} must be defined")
+    endif()
+endforeach()
+if(NOT DEFINED SYSTEMS OR SYSTEMS STREQUAL "")
+    set(SYSTEMS water tip4p methanol membrane lj-fluid fep)
+endif()
+if(NOT DEFINED TOLERANCE)
+    set(TOLERANCE 5)
+endif()
+string(REPLACE "," ";" CONFIGURATIONS "${CONFIGURATIONS}")
+string(REPLACE "," ";" SYSTEMS "${SYSTEMS}")
+
+set(ENV{GMXLIB} "${GMXLIB}")
+set(MDRUN_TESTS_DIR "${SOURCE_DIR}/../../src/programs/mdrun/tests")
+
+# Runs a gmx command in the working directory of the current system and
+# stops the suite with the output of the command if it fails.
+function(run_gmx _dir)
+    execute_process(COMMAND ${GMX_EXECUTABLE} ${ARGN}
+        WORKING_DIRECTORY ${_dir}
+        RESULT_VARIABLE _result
+        OUTPUT_VARIABLE _output
+        ERROR_VARIABLE  _output)
+    if(NOT _result EQUAL 0)
+        message(FATAL_ERROR "gmx ${ARGN} failed in ${_dir}:\n${_output}")
+    endif()
+endfunction()
+
+# Generates the coordinates and topology of a system in ${_dir} and
+# writes a run input file topol.tpr there.
+function(prepare_system _name _dir)
+    file(REMOVE_RECURSE ${_dir})
+    file(MAKE_DIRECTORY ${_dir})
+    set(_mdp ${SOURCE_DIR}/pme.mdp)
+    if(_name STREQUAL "water")
+        configure_file(${SOURCE_DIR}/water.top ${_dir}/topol.top COPYONLY)
+        run_gmx(${_dir} solvate -cs spc216.gro -box 6 6 6 -p topol.top -o conf.gro)
+    elseif(_name STREQUAL "tip4p")
+        configure_file(${SOURCE_DIR}/tip4p.top ${_dir}/topol.top COPYONLY)
+        run_gmx(${_dir} solvate -cs tip4p.gro -box 5 5 5 -p topol.top -o conf.gro)
+    elseif(_name STREQUAL "methanol")
+        configure_file(${SOURCE_DIR}/methanol.top ${_dir}/topol.top COPYONLY)
+        run_gmx(${_dir} genconf -f ${GMXLIB}/gromos43a1.ff/methanol216.gro
+                -nbox 2 2 2 -o conf.gro)
+    elseif(_name STREQUAL "membrane")
+        configure_file(${MDRUN_TESTS_DIR}/OctaneSandwich.top ${_dir}/topol.top COPYONLY)
+        configure_file(${MDRUN_TESTS_DIR}/OctaneSandwich.gro ${_dir}/conf.gro COPYONLY)
+    elseif(_name STREQUAL "lj-fluid")
+        configure_file(${SOURCE_DIR}/lj.top ${_dir}/topol.top COPYONLY)
+        run_gmx(${_dir} genconf -f ${SOURCE_DIR}/lj.gro -nbox 20 20 20 -o conf.gro)
+        set(_mdp ${SOURCE_DIR}/lj.mdp)
+    elseif(_name STREQUAL "fep")
+        configure_file(${SOURCE_DIR}/fep.top ${_dir}/topol.top COPYONLY)
+        run_gmx(${_dir} solvate -cp ${SOURCE_DIR}/fep.gro -cs spc216.gro
+                -box 4 4 4 -p topol.top -o conf.gro)
+        set(_mdp ${SOURCE_DIR}/fep.mdp)
+    else()
+        message(FATAL_ERROR "Unknown benchmark system '${_name}'")
+    endif()
+    run_gmx(${_dir} grompp -f ${_mdp} -c conf.gro -p topol.top -o topol.tpr)
+endfunction()
+
+# Appends the performance and the cycle accounting of an md.log to the
+# output table.
+function(parse_log _log _prefix _out)
+    file(STRINGS ${_log} _lines)
+    set(_inTable FALSE)
+    foreach(_line IN LISTS _lines)
+        if(_line MATCHES "R E A L   C Y C L E")
+            set(_inTable TRUE)
+        elseif(_inTable AND _line MATCHES "^ Total ")
+            set(_inTable FALSE)
+        elseif(_inTable AND _line MATCHES " ([0-9.]+) +([0-9.]+) +([0-9.]+)$")
+            # The counter name is printed left-aligned in 19 characters,
+            # followed by the rank, thread and call counts that can be
+            # empty, and the wall time, G-cycles and percentage.
+            set(_cycles  ${CMAKE_MATCH_2})
+            set(_percent ${CMAKE_MATCH_3})
+            string(SUBSTRING "${_line}" 1 19 _name)
+            string(STRIP "${_name}" _name)
+            string(REGEX REPLACE "[^A-Za-z0-9]+" "-" _name "${_name}")
+            string(REGEX REPLACE "-$" "" _name "${_name}")
+            string(TOLOWER "${_name}" _name)
+            file(APPEND ${_out} "${_prefix}\tcycles-${_name}\t${_cycles}\tGcycles\n")
+            file(APPEND ${_out} "${_prefix}\tpercent-${_name}\t${_percent}\t%\n")
+        elseif(_line MATCHES "^Performance: +([0-9.]+) +([0-9.]+)")
+            file(APPEND ${_out} "${_prefix}\tperformance\t${CMAKE_MATCH_1}\tns/day\n")
+        endif()
+    endforeach()
+endfunction()
+
+set(_out ${WORK_DIR}/benchmarks.tsv)
+file(MAKE_DIRECTORY ${WORK_DIR})
+file(WRITE ${_out} "system\tntmpi\tntomp\tmetric\tvalue\tunit\n")
+
+foreach(_system IN LISTS SYSTEMS)
+    set(_dir ${WORK_DIR}/${_system})
+    message(STATUS "Preparing ${_system}")
+    prepare_system(${_system} ${_dir})
+    foreach(_config IN LISTS CONFIGURATIONS)
+        if(NOT _config MATCHES "^([0-9]+)x([0-9]+)$")
+            message(FATAL_ERROR "Configuration '${_config}' is not of the form <ranks>x<threads>")
+        endif()
+        set(_ntmpi ${CMAKE_MATCH_1})
+        set(_ntomp ${CMAKE_MATCH_2})
+        set(_args -nsteps ${NSTEPS} -resethway -noconfout -notunepme -nb cpu
+                  -ntomp ${_ntomp})
+        if(THREAD_MPI)
+            list(APPEND _args -ntmpi ${_ntmpi})
+        elseif(NOT _ntmpi EQUAL 1)
+            message(STATUS "Skipping ${_system} ${_config}: thread-MPI is not available")
+            continue()
+        endif()
+        message(STATUS "Running ${_system} with ${_ntmpi} ranks x ${_ntomp} threads")
+        set(_deffnm ${_system}-${_config})
+        run_gmx(${_dir} mdrun -s topol.tpr -deffnm ${_deffnm} ${_args})
+        parse_log(${_dir}/${_deffnm}.log "${_system}\t${_ntmpi}\t${_ntomp}" ${_out})
+    endforeach()
+endforeach()
+message(STATUS "Benchmark results written to ${_out}")
+
+if(REFERENCE)
+    if(NOT EXISTS ${REFERENCE})
+        message(FATAL_ERROR "Reference results '${REFERENCE}' do not exist")
+    endif()
+    file(STRINGS ${REFERENCE} _refLines REGEX "\tperformance\t")
+    file(STRINGS ${_out} _newLines REGEX "\tperformance\t")
+    set(_regressions 0)
+    foreach(_line IN LISTS _newLines)
+        string(REPLACE "\t" ";" _fields "${_line}")
+        list(GET _fields 0 1 2 _key)
+        string(REPLACE ";" "\t" _key "${_key}")
+        list(GET _fields 4 _new)
+        foreach(_ref IN LISTS _refLines)
+            if(_ref MATCHES "^${_key}\tperformance\t([0-9.]+)")
+                set(_old ${CMAKE_MATCH_1})
+                # CMake has only integer arithmetic; compare in units of
+                # 0.001 ns/day.
+                string(REGEX REPLACE "^([0-9]+)\\.?([0-9]*)$" "\\1;\\2" _oldParts "${_old}")
+                string(REGEX REPLACE "^([0-9]+)\\.?([0-9]*)$" "\\1;\\2" _newParts "${_new}")
+                foreach(_v old new)
+                    list(GET _${_v}Parts 0 _int)
+                    list(GET _${_v}Parts 1 _frac)
+                    string(SUBSTRING "${_frac}000" 0 3 _frac)
+                    math(EXPR _${_v}Milli "${_int} * 1000 + 1${_frac} - 1000")
+                endforeach()
+                math(EXPR _limit "${_oldMilli} * (100 - ${TOLERANCE}) / 100")
+                string(REPLACE "\t" " " _label "${_key}")
+                if(_newMilli LESS _limit)
+                    message(WARNING "Performance regression for ${_label}: ${_new} ns/day, reference ${_old} ns/day")
+                    math(EXPR _regressions "${_regressions} + 1")
+                else()
+                    message(STATUS "${_label}: ${_new} ns/day, reference ${_old} ns/day")
+                endif()
+            endif()
+        endforeach()
+    endforeach()
+    if(_regressions GREATER 0)
+        message(FATAL_ERROR "${_regressions} run(s) were more than ${TOLERANCE}% slower than the reference")
+    endif()
+endif()